@@ -0,0 +1,129 @@
+#pragma once
+
+#include <ciso646>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+
+/**
+ * Monotonic arena
+ *
+ * Memory is handed out by bumping a pointer inside large blocks obtained
+ * from the heap; individual allocations are never freed. A call to reset()
+ * rewinds the arena so that the same blocks are reused for the next unit
+ * of work (e.g. the next image). If a unit of work spilled over several
+ * blocks, reset() replaces them by a single block large enough to hold
+ * all of them, so in steady state the arena performs no heap allocation
+ * at all.
+ *
+ * An arena is meant to be owned by a single worker; it is not thread-safe.
+ */
+
+class arena
+{
+public:
+
+    explicit arena(const size_t block_size = 1 << 20)
+        : block_size_(block_size), used_(0), peak_(0), mallocs_(0)
+    {
+    }
+
+    ~arena()
+    {
+        release();
+    }
+
+    /**
+     * Allocate 'bytes' bytes aligned to 'align' (a power of two).
+     */
+
+    void* allocate(const size_t bytes, const size_t align = 16)
+    {
+        if (not blocks_.empty())
+        {
+            block& b = blocks_.back();
+            const size_t base = reinterpret_cast<size_t>(b.data),
+                         at = ((base + b.used + align - 1) & ~(align - 1)) - base;
+            if (at + bytes <= b.size)
+            {
+                b.used = at + bytes;
+                used_ += bytes;
+                return b.data + at;
+            }
+        }
+
+        // The current block is exhausted, start a new one.
+        const size_t size = bytes + align > block_size_ ? bytes + align
+                                                        : block_size_;
+        block b;
+        b.data = static_cast<char*>( std::malloc(size) );
+        if (not b.data)
+            throw std::bad_alloc();
+        b.size = size;
+        b.used = 0;
+        blocks_.push_back(b);
+        ++mallocs_;
+
+        return allocate(bytes, align);
+    }
+
+    /**
+     * Rewind the arena, keeping its memory for reuse.
+     */
+
+    void reset()
+    {
+        if (used_ > peak_)
+            peak_ = used_;
+        used_ = 0;
+
+        if (blocks_.size() > 1)
+        {
+            // Coalesce: the next unit of work is likely to need as much.
+            size_t total = 0;
+            for (size_t i = 0; i < blocks_.size(); ++i)
+                total += blocks_[i].size;
+            release();
+            if (total > block_size_)
+                block_size_ = total;
+        }
+
+        else if (not blocks_.empty())
+            blocks_.front().used = 0;
+    }
+
+    /**
+     * Return every block to the heap.
+     */
+
+    void release()
+    {
+        for (size_t i = 0; i < blocks_.size(); ++i)
+            std::free(blocks_[i].data);
+        blocks_.clear();
+    }
+
+    size_t used() const { return used_; }                 // bytes in use
+    size_t peak() const { return peak_; }                 // high-water mark
+    size_t heap_allocations() const { return mallocs_; }  // blocks obtained
+
+private:
+
+    struct block
+    {
+        char*  data;
+        size_t size,
+               used;
+    };
+
+    arena(const arena&);                // non-copyable
+    arena& operator=(const arena&);
+
+    std::vector<block> blocks_;
+    size_t block_size_,
+           used_,
+           peak_,
+           mallocs_;
+};
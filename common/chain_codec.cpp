@@ -0,0 +1,438 @@
+#include <algorithm>
+#include <ciso646>
+
+#include "chain_codec.hpp"
+
+
+namespace
+{
+
+    // Frequencies are in units of 1/4096
+    const unsigned scale_bits = 12,
+                   scale = 1u << scale_bits;
+
+    // Lower bound of the normalised coder states, which stay in
+    // [lower, 2^32) and are renormalised 16 bits at a time
+    const boost::uint32_t lower = 1u << 16;
+
+    const unsigned states = 2;
+
+    // Distribution every context starts from: that of all the differences
+    // of the MPEG-7 contours, as cumulative frequencies
+    const boost::int16_t prior[8] = { 0, 2005, 3205, 3248, 3256, 3264, 3272, 3672 };
+
+    // Cumulative frequencies the model moves towards after difference d:
+    // a frequency of 4068 for d, of 4 for every other one
+    const boost::int16_t target[8][8] = {
+        {    0, 4068, 4072, 4076, 4080, 4084, 4088, 4092 },
+        {    0,    4, 4072, 4076, 4080, 4084, 4088, 4092 },
+        {    0,    4,    8, 4076, 4080, 4084, 4088, 4092 },
+        {    0,    4,    8,   12, 4080, 4084, 4088, 4092 },
+        {    0,    4,    8,   12,   16, 4084, 4088, 4092 },
+        {    0,    4,    8,   12,   16,   20, 4088, 4092 },
+        {    0,    4,    8,   12,   16,   20,   24, 4092 },
+        {    0,    4,    8,   12,   16,   20,   24,   28 }
+    };
+
+    /**
+     * Adaptive model of the differences of consecutive codes.
+     *
+     * In each of 64 contexts, made of the two differences before, the
+     * model keeps the cumulative frequencies of the 8 differences. After
+     * each difference, those of its context move a sixteenth of the way
+     * towards target[d]; targets are strictly increasing, so that no
+     * frequency ever drops to zero.
+     *
+     * The update is applied one difference late, so that finding a
+     * difference never waits for the update of the one just found. Both
+     * the search and the update work on the eight 16-bit lanes of a row
+     * at once, in loops the compiler vectorises.
+     */
+
+    struct model
+    {
+        boost::int16_t cdf[65][16];     // lanes 8 to 15 hold the total;
+                                        // row 64 takes the first update
+        unsigned       context,
+                       pending_context,
+                       pending;         // difference not learnt yet
+
+        model() : context(0), pending_context(64), pending(0)
+        {
+            for (int c = 0; c < 65; ++c)
+            {
+                std::copy(prior, prior + 8, cdf[c]);
+                std::fill(cdf[c] + 8, cdf[c] + 16, boost::int16_t(scale));
+            }
+        }
+
+        /**
+         * Difference whose interval holds 'slot'.
+         */
+
+        unsigned find(const unsigned slot) const
+        {
+            const boost::int16_t* const f = cdf[context];
+            const boost::int16_t s = static_cast<boost::int16_t>(slot);
+
+            boost::int16_t n = 0;
+            for (int k = 0; k < 8; ++k)
+                n += s >= f[k];
+            return n - 1;
+        }
+
+        unsigned start(const unsigned d) const
+        {
+            return cdf[context][d];
+        }
+
+        unsigned frequency(const unsigned d) const
+        {
+            return cdf[context][d+1] - cdf[context][d];
+        }
+
+        /**
+         * Learn the previous difference, and move on to the context 'd'
+         * makes.
+         */
+
+        void update(const unsigned d)
+        {
+            boost::int16_t* const f = cdf[pending_context];
+            const boost::int16_t* const t = target[pending];
+
+            for (int k = 0; k < 8; ++k)
+                f[k] += static_cast<boost::int16_t>(t[k] - f[k]) >> 4;
+
+            pending_context = context;
+            pending = d;
+            context = ((context << 3) | d) & 63;
+        }
+    };
+
+    /**
+     * Decode the next difference from state 's', reading a renormalisation
+     * word from 'at' if needed. Returns false if the words run out.
+     */
+
+    inline bool decode(boost::uint32_t& s, const unsigned char*& at,
+                       const unsigned char* const end, model& m, unsigned& d)
+    {
+        const unsigned slot = s & (scale - 1);
+
+        d = m.find(slot);
+        s = m.frequency(d) * (s >> scale_bits) + slot - m.start(d);
+
+        // One word at most, since frequencies are at least 1
+        if (s < lower)
+        {
+            if (at == end)
+                return false;
+            s = (s << 16) | at[0] | boost::uint32_t(at[1]) << 8;
+            at += 2;
+        }
+
+        m.update(d);
+        return true;
+    }
+
+    const char base64_digits[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // Value of every ASCII character as a base64 digit, or -1
+    const signed char base64_values[128] = {
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+        52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+        -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+        15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+        -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+        41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1
+    };
+
+    inline int base64_value(const char c)
+    {
+        return static_cast<unsigned char>(c) < 128
+               ? base64_values[static_cast<unsigned char>(c)] : -1;
+    }
+
+    // First bytes of a sidecar file
+    const unsigned char sidecar_magic[8] = { 'c', 't', 'x', 'c', 'h', 'a', 'i', 'n' };
+
+    void put_number(unsigned long long v, std::vector<unsigned char>& out)
+    {
+        for (; v >= 0x80; v >>= 7)
+            out.push_back( static_cast<unsigned char>(v | 0x80) );
+        out.push_back( static_cast<unsigned char>(v) );
+    }
+
+    bool get_number(const unsigned char*& at, const unsigned char* end,
+                    unsigned long long& v)
+    {
+        v = 0;
+        for (int shift = 0; at != end and shift < 64; shift += 7)
+        {
+            const unsigned char b = *at++;
+            v |= static_cast<unsigned long long>(b & 0x7f) << shift;
+            if (b < 0x80)
+                return true;
+        }
+        return false;
+    }
+
+}
+
+
+void chain_packer::pack(const unsigned char* codes, const size_t n,
+                        std::vector<unsigned char>& out)
+{
+    // Run the model of each half forwards, keeping the interval of every
+    // difference
+    start_.resize(n);
+    frequency_.resize(n);
+
+    const size_t half = (n + 1) / 2;
+
+    for (unsigned h = 0; h < states; ++h)
+    {
+        model m;
+        unsigned previous = 0;
+
+        for (size_t i = h * half; i < std::min(n, (h + 1) * half); ++i)
+        {
+            const unsigned d = (codes[i] - previous) & 7;
+            previous = codes[i] & 7;
+
+            start_[i] = static_cast<boost::uint16_t>( m.start(d) );
+            frequency_[i] = static_cast<boost::uint16_t>( m.frequency(d) );
+            m.update(d);
+        }
+    }
+
+    // rANS codes backwards, so that the decoder reads forwards: the words
+    // are pushed as on a stack, high byte first, and reversed at the end.
+    // The decoder takes the halves in turns, a code of the first, then one
+    // of the second.
+    out.clear();
+
+    boost::uint32_t x[states];
+    std::fill(x, x + states, lower);
+
+    for (size_t k = 2 * half; k-- > 0; )
+    {
+        const size_t i = (k % 2) * half + k / 2;
+        if (i >= n)
+            continue;
+
+        boost::uint32_t& s = x[k % 2];
+        const boost::uint32_t f = frequency_[i];
+
+        if ( s >= ((lower >> scale_bits) << 16) * f )
+        {
+            out.push_back( static_cast<unsigned char>(s >> 8) );
+            out.push_back( static_cast<unsigned char>(s) );
+            s >>= 16;
+        }
+
+        s = ((s / f) << scale_bits) + s % f + start_[i];
+    }
+
+    // Final states, the first of them first, each little-endian
+    for (unsigned i = states; i-- > 0; )
+        for (int b = 3; b >= 0; --b)
+            out.push_back( static_cast<unsigned char>(x[i] >> (8 * b)) );
+
+    std::reverse(out.begin(), out.end());
+}
+
+
+bool unpack_chain(const unsigned char* data, const size_t size,
+                  const size_t n, unsigned char* codes)
+{
+    if (size < 4 * states or size % 2 != 0)
+        return false;
+
+    const unsigned char* at = data;
+    const unsigned char* const end = data + size;
+
+    boost::uint32_t x[states];
+    for (unsigned i = 0; i < states; ++i, at += 4)
+        x[i] = boost::uint32_t(at[0])         | boost::uint32_t(at[1]) << 8
+             | boost::uint32_t(at[2]) << 16   | boost::uint32_t(at[3]) << 24;
+
+    // The two halves of the chain, each with its own state and model, so
+    // that their codes decode side by side
+    const size_t half = (n + 1) / 2;
+
+    model m0, m1;
+    unsigned previous0 = 0,
+             previous1 = 0,
+             d0, d1;
+    size_t i = 0;
+
+    for (; i < n - half; ++i)
+    {
+        if ( not decode(x[0], at, end, m0, d0) or not decode(x[1], at, end, m1, d1) )
+            return false;
+
+        codes[i]        = static_cast<unsigned char>( previous0 = (previous0 + d0) & 7 );
+        codes[half + i] = static_cast<unsigned char>( previous1 = (previous1 + d1) & 7 );
+    }
+
+    // The first half is one code longer if n is odd
+    if (i < half)
+    {
+        if ( not decode(x[0], at, end, m0, d0) )
+            return false;
+        codes[i] = static_cast<unsigned char>( (previous0 + d0) & 7 );
+    }
+
+    if (at != end)
+        return false;
+
+    for (unsigned k = 0; k < states; ++k)
+        if (x[k] != lower)
+            return false;
+
+    return true;
+}
+
+
+void encode_base64(const unsigned char* data, const size_t size, std::string& out)
+{
+    size_t i = 0;
+
+    for (; i + 3 <= size; i += 3)
+    {
+        const unsigned v = unsigned(data[i]) << 16 | unsigned(data[i+1]) << 8 | data[i+2];
+        out += base64_digits[v >> 18];
+        out += base64_digits[(v >> 12) & 63];
+        out += base64_digits[(v >> 6) & 63];
+        out += base64_digits[v & 63];
+    }
+
+    if (i < size)
+    {
+        const unsigned v = unsigned(data[i]) << 16
+                         | (i + 1 < size ? unsigned(data[i+1]) << 8 : 0);
+        out += base64_digits[v >> 18];
+        out += base64_digits[(v >> 12) & 63];
+        out += i + 1 < size ? base64_digits[(v >> 6) & 63] : '=';
+        out += '=';
+    }
+}
+
+
+bool decode_base64(const char* begin, const char* end, std::vector<unsigned char>& out)
+{
+    out.clear();
+
+    if ( (end - begin) % 4 != 0 )
+        return false;
+
+    // Up to two '=' of padding, at the very end
+    const char* last = end;
+    for (int i = 0; i < 2 and last != begin and last[-1] == '='; ++i)
+        --last;
+
+    const size_t digits = last - begin;
+    out.resize(digits / 4 * 3 + (digits % 4 == 0 ? 0 : digits % 4 - 1));
+
+    unsigned char* o = out.data();
+    const char* c = begin;
+
+    // Whole groups of four digits; a negative value taints the whole group
+    for (; last - c >= 4; c += 4, o += 3)
+    {
+        const int a = base64_value(c[0]), b = base64_value(c[1]),
+                  e = base64_value(c[2]), f = base64_value(c[3]);
+        if ( (a | b | e | f) < 0 )
+            return false;
+
+        const int v = a << 18 | b << 12 | e << 6 | f;
+
+        o[0] = static_cast<unsigned char>(v >> 16);
+        o[1] = static_cast<unsigned char>(v >> 8);
+        o[2] = static_cast<unsigned char>(v);
+    }
+
+    // Two or three digits before the padding
+    if (c != last)
+    {
+        if (last - c < 2)
+            return false;
+
+        const int a = base64_value(c[0]), b = base64_value(c[1]),
+                  e = last - c > 2 ? base64_value(c[2]) : 0;
+        if ( (a | b | e) < 0 )
+            return false;
+
+        const int v = a << 18 | b << 12 | e << 6;
+
+        o[0] = static_cast<unsigned char>(v >> 16);
+        if (last - c > 2)
+            o[1] = static_cast<unsigned char>(v >> 8);
+    }
+
+    return true;
+}
+
+
+void begin_sidecar(std::vector<unsigned char>& out)
+{
+    out.assign(sidecar_magic, sidecar_magic + 8);
+}
+
+
+void append_sidecar(const long long id, const size_t n,
+                    const std::vector<unsigned char>& bytes,
+                    std::vector<unsigned char>& out)
+{
+    put_number(id, out);
+    put_number(n, out);
+    put_number(bytes.size(), out);
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+
+sidecar_reader::sidecar_reader(const unsigned char* data, const size_t size)
+    : at_(data), end_(data + size), failed_(false)
+{
+    if ( size < 8 or not std::equal(sidecar_magic, sidecar_magic + 8, data) )
+        failed_ = true;
+    else
+        at_ += 8;
+}
+
+
+bool sidecar_reader::next(long long& id, size_t& n,
+                          const unsigned char*& bytes, size_t& size)
+{
+    if (failed_ or at_ == end_)
+        return false;
+
+    unsigned long long v[3];
+
+    for (int k = 0; k < 3; ++k)
+        if ( not get_number(at_, end_, v[k]) )
+        {
+            failed_ = true;
+            return false;
+        }
+
+    if ( v[0] == 0 or v[0] > 0x7fffffffffffffffull or v[1] > 0x7fffffff
+         or v[2] > static_cast<unsigned long long>(end_ - at_) )
+    {
+        failed_ = true;
+        return false;
+    }
+
+    id = static_cast<long long>(v[0]);
+    n = static_cast<size_t>(v[1]);
+    bytes = at_;
+    size = static_cast<size_t>(v[2]);
+
+    at_ += size;
+    return true;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+
+/**
+ * Entropy coded chain codes
+ *
+ * The compact form of the 'packed' path level (see datasets/contour.xsd).
+ * Consecutive Freeman codes of a boundary mostly go straight on or turn by
+ * 45 degrees, so each code is replaced by its difference to the previous
+ * one, modulo 8, and the differences are coded with an adaptive model
+ * whose context is the two differences before. The coder is a range
+ * asymmetric numeral system (rANS) with 12-bit frequencies and 16-bit
+ * renormalisation, which decodes a code with one multiplication and no
+ * division. The two halves of a chain are coded with a state and a model
+ * each, so that a decoder interleaves two independent dependency chains.
+ * Every contour starts from the same model, so that contours decode
+ * independently; on MPEG-7 contours the codes take about 1.3 bits each,
+ * against 16 as text.
+ *
+ * The bytes end with a check: the decoder must find both states back at
+ * their initial value, exactly when the bytes run out.
+ */
+
+/**
+ * Encoder, keeping its working storage across calls.
+ */
+
+class chain_packer
+{
+public:
+
+    /**
+     * Replace 'out' with the packed form of the 'n' chain 'codes'.
+     */
+
+    void pack(const unsigned char* codes, const size_t n,
+              std::vector<unsigned char>& out);
+
+private:
+
+    std::vector<boost::uint16_t> start_,        // interval of each code
+                                 frequency_;
+};
+
+/**
+ * Decode the 'n' chain codes packed in [data, data + size). Returns false
+ * if the bytes are not exactly the packed form of 'n' codes.
+ */
+
+bool unpack_chain(const unsigned char* data, const size_t size,
+                  const size_t n, unsigned char* codes);
+
+/**
+ * Append the base64 form of [data, data + size) to 'out'.
+ */
+
+void encode_base64(const unsigned char* data, const size_t size, std::string& out);
+
+/**
+ * Replace 'out' with the bytes of the base64 text [begin, end). Returns
+ * false if the text is not base64.
+ */
+
+bool decode_base64(const char* begin, const char* end, std::vector<unsigned char>& out);
+
+/**
+ * Sidecar files
+ *
+ * With mpeg7contour --sidecar, the packed level of a CTX document keeps
+ * its codes in a binary file next to it, <name>.chains, as the bytes
+ * pack() made, without base64 or XML around them; the <path> only tells
+ * where the path starts. The file is the 8 bytes "ctxchain", then a record
+ * per packed path, in document order: the id of its contour, the number
+ * of its codes and that of their packed bytes, as LEB128 numbers, then
+ * the bytes.
+ */
+
+/**
+ * Replace 'out' with the start of a sidecar file.
+ */
+
+void begin_sidecar(std::vector<unsigned char>& out);
+
+/**
+ * Append to 'out' the record of contour 'id', whose 'n' codes are packed
+ * in 'bytes'.
+ */
+
+void append_sidecar(const long long id, const size_t n,
+                    const std::vector<unsigned char>& bytes,
+                    std::vector<unsigned char>& out);
+
+/**
+ * Reader of the records of a sidecar file.
+ */
+
+class sidecar_reader
+{
+public:
+
+    /**
+     * Reader of the sidecar in [data, data + size), which must outlive it.
+     */
+
+    sidecar_reader(const unsigned char* data, const size_t size);
+
+    /**
+     * Read the next record: contour 'id' and its 'n' codes, packed in
+     * [bytes, bytes + size), for unpack_chain(). Returns false at the end
+     * of the file, or if it is malformed.
+     */
+
+    bool next(long long& id, size_t& n, const unsigned char*& bytes, size_t& size);
+
+    /**
+     * Whether every record has been read, and whether the file is
+     * malformed (or not a sidecar at all).
+     */
+
+    bool done() const { return not failed_ and at_ == end_; }
+
+    bool failed() const { return failed_; }
+
+private:
+
+    const unsigned char* at_;
+    const unsigned char* end_;
+    bool failed_;
+};
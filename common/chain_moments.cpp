@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <ciso646>
+#include <cmath>
+
+#include "chain_moments.hpp"
+
+
+namespace
+{
+
+    // Steps of the 8-connected Freeman chain code (see contour.xsd)
+    const int step_x[8] = { 1, 1, 0, -1, -1, -1,  0,  1 },
+              step_y[8] = { 0, 1, 1,  1,  0, -1, -1, -1 };
+
+    /**
+     * Add the terms of the edge from (x1, y1) to (x, y).
+     */
+
+    inline void add_edge(const boost::int64_t x1, const boost::int64_t y1,
+                         const boost::int64_t x, const boost::int64_t y,
+                         chain_sums& s)
+    {
+        const boost::int64_t d = x1 * y - x * y1;
+
+        if (d == 0)
+            return;
+
+        const boost::int64_t xs = x1 + x,
+                             ys = y1 + y,
+                             x12 = x1 * x1, x2 = x * x,
+                             y12 = y1 * y1, y2 = y * y;
+
+        s.s00 += int128(d);
+        s.s10 += int128::product(d, xs);
+        s.s01 += int128::product(d, ys);
+        s.s20 += int128::product(d, x1 * xs + x2);
+        s.s11 += int128::product(d, x1 * (ys + y1) + x * (ys + y));
+        s.s02 += int128::product(d, y1 * ys + y2);
+        s.s30 += int128::product(d, xs * (x12 + x2));
+        s.s21 += int128::product(d, x12 * (3 * y1 + y) + 2 * x * x1 * ys + x2 * (y1 + 3 * y));
+        s.s12 += int128::product(d, y12 * (3 * x1 + x) + 2 * y * y1 * xs + y2 * (x1 + 3 * x));
+        s.s03 += int128::product(d, ys * (y12 + y2));
+    }
+
+    inline bool within(const boost::int64_t v)
+    {
+        return v >= -chain_coordinate_limit and v <= chain_coordinate_limit;
+    }
+
+    /**
+     * Sums of the closed polygon of the 'n' vertices 'v', taking (ox, oy)
+     * as the origin, in the order of chain_sums.
+     */
+
+    void sum_polygon(const cv::Point2d* v, const size_t n, const double ox,
+                     const double oy, double s[10])
+    {
+        std::fill(s, s + 10, 0.0);
+
+        double x1 = v[n - 1].x - ox,
+               y1 = v[n - 1].y - oy;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            const double x = v[i].x - ox,
+                         y = v[i].y - oy,
+                         d = x1 * y - x * y1,
+                         xs = x1 + x,
+                         ys = y1 + y,
+                         x12 = x1 * x1, x2 = x * x,
+                         y12 = y1 * y1, y2 = y * y;
+
+            s[0] += d;
+            s[1] += d * xs;
+            s[2] += d * ys;
+            s[3] += d * (x1 * xs + x2);
+            s[4] += d * (x1 * (ys + y1) + x * (ys + y));
+            s[5] += d * (y1 * ys + y2);
+            s[6] += d * xs * (x12 + x2);
+            s[7] += d * (x12 * (3 * y1 + y) + 2 * x * x1 * ys + x2 * (y1 + 3 * y));
+            s[8] += d * (y12 * (3 * x1 + x) + 2 * y * y1 * xs + y2 * (x1 + 3 * x));
+            s[9] += d * ys * (y12 + y2);
+
+            x1 = x;
+            y1 = y;
+        }
+    }
+
+    // Divisors of the sums, in the order of chain_sums
+    const double divisor[10] = { 2, 6, 6, 12, 24, 12, 20, 60, 60, 20 };
+
+    /**
+     * Central and normalised central moments of 'm', from the moments 'c'
+     * about an origin within about a pixel of the centroid, in the order
+     * of chain_sums.
+     */
+
+    void central_moments(const double c[10], cv::Moments& m)
+    {
+        const double c00 = c[0], c10 = c[1], c01 = c[2],
+                     c20 = c[3], c11 = c[4], c02 = c[5],
+                     c30 = c[6], c21 = c[7], c12 = c[8], c03 = c[9];
+
+        // Centroid relative to the origin
+        const double cx = c10 / c00,
+                     cy = c01 / c00;
+
+        m.mu20 = c20 - c10 * cx;
+        m.mu11 = c11 - c10 * cy;
+        m.mu02 = c02 - c01 * cy;
+
+        m.mu30 = c30 - cx * (3 * m.mu20 + cx * c10);
+        m.mu21 = c21 - cx * (2 * m.mu11 + cx * c01) - cy * m.mu20;
+        m.mu12 = c12 - cy * (2 * m.mu11 + cy * c10) - cx * m.mu02;
+        m.mu03 = c03 - cy * (3 * m.mu02 + cy * c01);
+
+        const double i00 = 1 / m.m00,
+                     s2 = i00 * i00,
+                     s3 = s2 * std::sqrt(i00);
+
+        m.nu20 = m.mu20 * s2;
+        m.nu11 = m.mu11 * s2;
+        m.nu02 = m.mu02 * s2;
+        m.nu30 = m.mu30 * s3;
+        m.nu21 = m.mu21 * s3;
+        m.nu12 = m.mu12 * s3;
+        m.nu03 = m.mu03 * s3;
+    }
+
+}
+
+
+bool sum_chain(const int x, const int y, const unsigned char* codes,
+               const size_t n, const int ox, const int oy, chain_sums& s)
+{
+    s = chain_sums();
+
+    const boost::int64_t x0 = boost::int64_t(x) - ox,
+                         y0 = boost::int64_t(y) - oy;
+
+    boost::int64_t px = x0,
+                   py = y0;
+
+    if ( not within(px) or not within(py) )
+        return false;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const boost::int64_t qx = px + step_x[codes[i] & 7],
+                             qy = py + step_y[codes[i] & 7];
+
+        if ( not within(qx) or not within(qy) )
+            return false;
+
+        add_edge(px, py, qx, qy, s);
+        px = qx;
+        py = qy;
+    }
+
+    // Close the polygon
+    add_edge(px, py, x0, y0, s);
+
+    return true;
+}
+
+
+bool chain_moments(const int x, const int y, const unsigned char* codes,
+                   const size_t n, cv::Moments& m)
+{
+    m = cv::Moments();
+
+    chain_sums s;
+    if ( not sum_chain(x, y, codes, n, 0, 0, s) )
+        return false;
+
+    if ( s.s00.zero() )
+        return true;
+
+    // Positive whatever the orientation
+    const double sign = s.s00.negative() ? -1 : 1;
+
+    m.m00 = sign * s.s00.to_double() / 2;
+    m.m10 = sign * s.s10.to_double() / 6;
+    m.m01 = sign * s.s01.to_double() / 6;
+    m.m20 = sign * s.s20.to_double() / 12;
+    m.m11 = sign * s.s11.to_double() / 24;
+    m.m02 = sign * s.s02.to_double() / 12;
+    m.m30 = sign * s.s30.to_double() / 20;
+    m.m21 = sign * s.s21.to_double() / 60;
+    m.m12 = sign * s.s12.to_double() / 60;
+    m.m03 = sign * s.s03.to_double() / 20;
+
+    // Sums again about the pixel nearest to the centroid, where the
+    // central moments do not lose their digits to cancellation
+    const int ox = static_cast<int>( std::floor(m.m10 / m.m00 + 0.5) ),
+              oy = static_cast<int>( std::floor(m.m01 / m.m00 + 0.5) );
+
+    chain_sums c;
+    if ( not sum_chain(x, y, codes, n, ox, oy, c) )
+        return false;
+
+    const double central[10] = {
+        m.m00,
+        sign * c.s10.to_double() / 6,
+        sign * c.s01.to_double() / 6,
+        sign * c.s20.to_double() / 12,
+        sign * c.s11.to_double() / 24,
+        sign * c.s02.to_double() / 12,
+        sign * c.s30.to_double() / 20,
+        sign * c.s21.to_double() / 60,
+        sign * c.s12.to_double() / 60,
+        sign * c.s03.to_double() / 20 };
+
+    central_moments(central, m);
+
+    return true;
+}
+
+
+void polygon_moments(const cv::Point2d* v, const size_t n, cv::Moments& m)
+{
+    m = cv::Moments();
+
+    if (n < 3)
+        return;
+
+    double s[10];
+    sum_polygon(v, n, 0, 0, s);
+
+    if (s[0] == 0)
+        return;
+
+    // Positive whatever the orientation
+    const double sign = s[0] < 0 ? -1 : 1;
+
+    double* const spatial[10] = { &m.m00, &m.m10, &m.m01, &m.m20, &m.m11,
+                                  &m.m02, &m.m30, &m.m21, &m.m12, &m.m03 };
+    for (int k = 0; k < 10; ++k)
+        *spatial[k] = sign * s[k] / divisor[k];
+
+    // Sums again about the pixel nearest to the centroid
+    sum_polygon( v, n, std::floor(m.m10 / m.m00 + 0.5), std::floor(m.m01 / m.m00 + 0.5), s );
+
+    for (int k = 0; k < 10; ++k)
+        s[k] = sign * s[k] / divisor[k];
+
+    central_moments(s, m);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "int128.hpp"
+
+
+/**
+ * Exact moments of chain coded contours
+ *
+ * The moments written in CTX files are those cv::moments gives for the
+ * points of a contour: the moments of the closed polygon through the
+ * centres of its boundary pixels, by Green's theorem. Each one is an
+ * integer sum over the edges, (x', y') to (x, y), divided by a constant:
+ *
+ *      m00 = S[ d ] / 2,                       d = x' y - x y'
+ *      m10 = S[ d (x' + x) ] / 6
+ *      m20 = S[ d (x'^2 + x' x + x^2) ] / 12
+ *      m11 = S[ d (x' (2y' + y) + x (y' + 2y)) ] / 24
+ *      m30 = S[ d (x' + x) (x'^2 + x^2) ] / 20
+ *      m21 = S[ d (x'^2 (3y' + y) + 2 x x' (y' + y) + x^2 (y' + 3y)) ] / 60
+ *
+ * and symmetrically for m01, m02, m12 and m03. With integer vertices the
+ * sums are computed exactly, in 128-bit integers, straight from the start
+ * point and Freeman codes of a CTX path, without the image. Like OpenCV,
+ * the moments are taken positive whatever the orientation of the contour,
+ * and are all zero for contours enclosing no area.
+ */
+
+struct chain_sums
+{
+    int128 s00, s10, s01, s20, s11, s02, s30, s21, s12, s03;
+};
+
+/**
+ * Largest coordinate, in absolute value, for which the sums cannot
+ * overflow.
+ */
+
+const int chain_coordinate_limit = 1 << 19;
+
+/**
+ * Sums of the closed polygon starting at (x, y) and following the 'n'
+ * chain 'codes', taking (ox, oy) as the origin. Returns false if a vertex
+ * is beyond chain_coordinate_limit.
+ */
+
+bool sum_chain(const int x, const int y, const unsigned char* codes,
+               const size_t n, const int ox, const int oy, chain_sums& s);
+
+/**
+ * Spatial, central and normalised central moments of the contour starting
+ * at (x, y) and following the 'n' chain 'codes'. Spatial moments are
+ * rounded once from their exact value; central moments are computed from
+ * exact sums about the pixel nearest to the centroid, so that they keep
+ * all their digits. Returns false as sum_chain() does.
+ */
+
+bool chain_moments(const int x, const int y, const unsigned char* codes,
+                   const size_t n, cv::Moments& m);
+
+/**
+ * Moments of the closed polygon of the 'n' vertices 'v', by the same sums
+ * in floating point, central moments again about the pixel nearest to the
+ * centroid: those of a contour path mapped by an affine transform (see
+ * silhouette.hpp), before it is digitized again.
+ */
+
+void polygon_moments(const cv::Point2d* v, const size_t n, cv::Moments& m);
@@ -0,0 +1,300 @@
+#include <cerrno>
+#include <ciso646>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "commit.hpp"
+#include "trace.hpp"
+
+
+namespace
+{
+
+    /**
+     * Tag of this process in staging names: its id, and the time it
+     * started, for ids reused on other hosts sharing a directory.
+     */
+
+    std::string make_staging_tag()
+    {
+#if defined(_WIN32)
+        const unsigned long id = GetCurrentProcessId();
+#else
+        const unsigned long id = static_cast<unsigned long>( getpid() );
+#endif
+        const unsigned long start = static_cast<unsigned long>(
+            std::chrono::system_clock::now().time_since_epoch().count() );
+
+        char tag[32];
+        sprintf(tag, ".%lx-%08lx", id, start & 0xfffffffful);
+        return tag;
+    }
+
+    const std::string staging_tag = make_staging_tag();
+
+    /**
+     * Whether the process of id 'id' is running, on this host.
+     */
+
+    bool running(const unsigned long id)
+    {
+#if defined(_WIN32)
+        const HANDLE h = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(id));
+        if (not h)
+            return GetLastError() == ERROR_ACCESS_DENIED;
+
+        const bool alive = WaitForSingleObject(h, 0) == WAIT_TIMEOUT;
+        CloseHandle(h);
+        return alive;
+#else
+        const pid_t pid = static_cast<pid_t>(id);
+        if (pid <= 0 or static_cast<unsigned long>(pid) != id)
+            return false;
+
+        return kill(pid, 0) == 0 or errno == EPERM;
+#endif
+    }
+
+    /**
+     * Whether the staging file s may still be written by a live run: one
+     * whose tag names a running process. Files of a run that has died, and
+     * those without a tag, are left over.
+     */
+
+    bool live_staging(const boost::filesystem::path& s)
+    {
+        // <final name>.<id>-<start>.part
+        const std::string tag = s.stem().extension().string();
+
+        unsigned long id, start;
+        char rest;
+        if ( sscanf(tag.c_str(), ".%lx-%lx%c", &id, &start, &rest) != 2 )
+            return false;
+
+        return running(id);
+    }
+
+#if !defined(_WIN32)
+
+    /**
+     * Make the contents of the file open as fd durable; its metadata only
+     * as far as needed to read them back.
+     */
+
+    bool sync_data(const int fd)
+    {
+        int r;
+        do
+        {
+#if defined(__linux__)
+            r = fdatasync(fd);
+#else
+            r = fsync(fd);
+#endif
+        }
+        while (r != 0 and errno == EINTR);
+
+        return r == 0;
+    }
+
+#endif
+
+    /**
+     * Make the renames into 'dir' durable. Returns false if they could not
+     * be synced.
+     */
+
+    bool sync_directory(const boost::filesystem::path& dir)
+    {
+#if !defined(_WIN32)
+        const int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        const bool ok = fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+#else
+        (void)dir;
+        return true;
+#endif
+    }
+
+}
+
+
+boost::filesystem::path staging_path(const boost::filesystem::path& p)
+{
+    boost::filesystem::path s = p;
+    s += staging_tag + ".part";
+    return s;
+}
+
+
+bool write_staged(const boost::filesystem::path& s, const std::vector<unsigned char>& bytes,
+                  const bool durable)
+{
+#if defined(_WIN32)
+    const HANDLE h = CreateFileW(s.c_str(), GENERIC_WRITE, 0, 0, CREATE_ALWAYS,
+                                 FILE_ATTRIBUTE_NORMAL, 0);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    bool ok = true;
+    for (size_t done = 0; ok and done < bytes.size(); )
+    {
+        const size_t left = bytes.size() - done;
+        const DWORD chunk = static_cast<DWORD>( left < (1u << 30) ? left : (1u << 30) );
+
+        DWORD written = 0;
+        ok = WriteFile(h, &bytes[done], chunk, &written, 0) and written > 0;
+        done += written;
+    }
+
+    if (ok and durable)
+        ok = FlushFileBuffers(h) != 0;
+
+    if ( not CloseHandle(h) )
+        ok = false;
+
+    return ok;
+#else
+    const int fd = ::open(s.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+        return false;
+
+    bool ok = true;
+    for (size_t done = 0; ok and done < bytes.size(); )
+    {
+        const ssize_t r = ::write(fd, &bytes[done], bytes.size() - done);
+        if (r > 0)
+            done += static_cast<size_t>(r);
+        else if (r < 0 and errno == EINTR)
+            continue;
+        else
+            ok = false;
+    }
+
+    if (ok and durable)
+        ok = sync_data(fd);
+
+    if (::close(fd) != 0)
+        ok = false;
+
+    return ok;
+#endif
+}
+
+
+size_t remove_staged(const boost::filesystem::path& dir)
+{
+    using namespace boost::filesystem;
+
+    size_t removed = 0;
+
+    boost::system::error_code ec;
+    if ( not is_directory(dir, ec) )
+        return 0;
+
+    for ( auto it = directory_iterator(dir); it != directory_iterator(); ++it )
+    {
+        if ( it->path().extension() == ".part" and is_regular_file(*it)
+             and not live_staging(it->path()) )
+        {
+            if ( remove(it->path(), ec) )
+                ++removed;
+        }
+    }
+
+    return removed;
+}
+
+
+output_batch::output_batch(const bool durable)
+    : durable_(durable)
+{
+}
+
+
+void output_batch::add(const boost::filesystem::path& p, const bool written,
+                       const bool shared)
+{
+    outputs_.push_back(p);
+    state_.push_back(written ? 1 : 0);
+    shared_.push_back(shared ? 1 : 0);
+}
+
+
+int output_batch::commit()
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    int status = EXIT_SUCCESS;
+
+    // 1. Names
+    set<path> dirs;
+    {
+        trace_scope scope("rename");
+
+        for (size_t i = 0; i < outputs_.size(); ++i)
+        {
+            boost::system::error_code ec;
+            const path s = staging_path(outputs_[i]);
+
+            if (state_[i])
+            {
+                rename(s, outputs_[i], ec);
+                if (not ec)
+                    dirs.insert( outputs_[i].parent_path() );
+                else if ( shared_[i] and exists(outputs_[i]) )
+                    remove(s, ec);      // another writer got there first
+                else
+                    state_[i] = 0;
+            }
+
+            if (not state_[i])
+            {
+                remove(s, ec);
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+
+    // 2. Directory entries. The renames are done by now, but outputs whose
+    // names may not survive a crash are not reported as committed
+    if (durable_)
+    {
+        trace_scope scope("sync");
+        for (auto it = dirs.begin(); it != dirs.end(); ++it)
+        {
+            if ( sync_directory(*it) )
+                continue;
+
+            for (size_t i = 0; i < outputs_.size(); ++i)
+                if (state_[i] and outputs_[i].parent_path() == *it)
+                    state_[i] = 0;
+            status = EXIT_FAILURE;
+        }
+    }
+
+    return status;
+}
+
+
+void output_batch::clear()
+{
+    outputs_.clear();
+    state_.clear();
+    shared_.clear();
+}
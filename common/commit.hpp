@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vector>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+
+/**
+ * Crash-safe commit of output files
+ *
+ * Outputs are never written under their final name. They are first
+ * written under a staging name (the final name followed by a tag of the
+ * process and ".part", so that concurrent runs writing the same output
+ * never share one), and made durable by their writer, through the
+ * descriptor it holds (fdatasync() on Linux, fsync() on other POSIX
+ * systems, FlushFileBuffers() on Windows), before it closes them. A whole
+ * batch of them is then committed at once:
+ *
+ *      1. every staged file is renamed to its final name;
+ *      2. the renames are made durable, with one fsync() per directory
+ *         involved (POSIX only; NTFS journals the renames itself).
+ *
+ * Only the staged files are synced, never the rest of the file system.
+ *
+ * A final name thus only ever refers to a complete file, even after a
+ * crash or a power loss, and the tools can keep on skipping the outputs
+ * that exist. What an interrupted run leaves behind are staging files;
+ * remove_staged() disposes of them before a new run.
+ */
+
+/**
+ * Staging name of the output file p.
+ */
+
+boost::filesystem::path staging_path(const boost::filesystem::path& p);
+
+/**
+ * Write 'bytes' to the staging file s, and with 'durable' make them
+ * durable before closing it. Returns false on failure.
+ */
+
+bool write_staged(const boost::filesystem::path& s, const std::vector<unsigned char>& bytes,
+                  const bool durable);
+
+/**
+ * Remove the staging files left in directory 'dir' by an interrupted run
+ * (not recursively). Returns the number of files removed. The staging
+ * files of runs still going, whose tag names a process running on this
+ * host, are left alone, so that concurrent runs can share a tree. Runs
+ * on other hosts cannot be told apart from dead ones.
+ */
+
+size_t remove_staged(const boost::filesystem::path& dir);
+
+
+class output_batch
+{
+public:
+
+    /**
+     * With durable == false the batch is still committed by renaming,
+     * which protects against the tool being killed, but the directories
+     * are not synced to the storage device (nor should the staged files
+     * have been).
+     */
+
+    explicit output_batch(const bool durable = true);
+
+    /**
+     * Add the output whose final name is p; 'written' tells whether its
+     * staging file was written successfully (and, for a durable batch,
+     * synced: see write_staged()). Failed outputs are not
+     * committed, and their staging files are removed.
+     *
+     * A shared output, such as a cache entry, may be written by others at
+     * the same time, with the same contents: if it cannot be renamed but
+     * its final name exists by then, it counts as committed.
+     */
+
+    void add(const boost::filesystem::path& p, const bool written,
+             const bool shared = false);
+
+    /**
+     * Commit the batch. Returns EXIT_FAILURE if any output failed. If a
+     * directory cannot be synced after the renames, its outputs count as
+     * failed, though they keep their final names.
+     */
+
+    int commit();
+
+    /**
+     * Whether the i-th output added has been committed.
+     */
+
+    bool committed(const size_t i) const { return state_[i] != 0; }
+
+    size_t size() const { return outputs_.size(); }
+
+    /**
+     * Start a new batch.
+     */
+
+    void clear();
+
+private:
+
+    bool durable_;
+    std::vector<boost::filesystem::path> outputs_;
+    std::vector<char> state_,
+                      shared_;
+};
@@ -0,0 +1,738 @@
+#include <algorithm>
+#include <ciso646>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "chain_codec.hpp"
+#include "ctx.hpp"
+
+
+namespace
+{
+
+    inline bool is_space(const char c)
+    {
+        return c == ' ' or c == '\t' or c == '\n' or c == '\r';
+    }
+
+    inline bool is_name_end(const char c)
+    {
+        return is_space(c) or c == '/' or c == '>' or c == '=';
+    }
+
+    /**
+     * Skip to just past the first occurrence of 'token' in [at, end);
+     * returns end if there is none.
+     */
+
+    const char* skip_past(const char* at, const char* end, const char* token)
+    {
+        const size_t n = std::strlen(token);
+        const char* found = std::search(at, end, token, token + n);
+        return found == end ? end : found + n;
+    }
+
+    /**
+     * Parse a non-negative integer at 'at', moving it past the digits.
+     */
+
+    inline bool parse_natural(const char*& at, const char* end, long long& value)
+    {
+        const char* first = at;
+
+        value = 0;
+        for (; at != end and *at >= '0' and *at <= '9'; ++at)
+            value = value * 10 + (*at - '0');
+
+        return at != first;
+    }
+
+    inline void skip_spaces(const char*& at, const char* end)
+    {
+        while (at != end and is_space(*at))
+            ++at;
+    }
+
+    /**
+     * Parse a list of non-negative integers into 'values'.
+     */
+
+    bool parse_naturals(const char* at, const char* end,
+                        std::vector<long long>& values)
+    {
+        values.clear();
+
+        for (;;)
+        {
+            skip_spaces(at, end);
+            if (at == end)
+                return true;
+
+            long long value;
+            if ( not parse_natural(at, end, value) )
+                return false;
+            values.push_back(value);
+        }
+    }
+
+    /**
+     * Parse "x y" followed by chain codes into c; 'runs' tells whether the
+     * codes come as (code, length) pairs.
+     */
+
+    bool parse_path(const char* at, const char* end, const bool runs,
+                    ctx_contour& c)
+    {
+        long long x, y;
+
+        skip_spaces(at, end);
+        if ( not parse_natural(at, end, x) )
+            return false;
+        skip_spaces(at, end);
+        if ( not parse_natural(at, end, y) )
+            return false;
+
+        c.x = static_cast<int>(x);
+        c.y = static_cast<int>(y);
+        c.chain.clear();
+
+        for (;;)
+        {
+            skip_spaces(at, end);
+            if (at == end)
+                return true;
+
+            long long code, length = 1;
+            if ( not parse_natural(at, end, code) or code > 7 )
+                return false;
+
+            if (runs)
+            {
+                skip_spaces(at, end);
+                if ( not parse_natural(at, end, length) or length == 0 )
+                    return false;
+            }
+
+            c.chain.insert( c.chain.end(), static_cast<size_t>(length),
+                            static_cast<unsigned char>(code) );
+        }
+    }
+
+    /**
+     * Parse "x y" followed by the base64 form of 'n' packed chain codes
+     * (see chain_codec.hpp) into c.
+     */
+
+    bool parse_packed(const char* at, const char* end, const size_t n,
+                      ctx_contour& c)
+    {
+        long long x, y;
+
+        skip_spaces(at, end);
+        if ( not parse_natural(at, end, x) )
+            return false;
+        skip_spaces(at, end);
+        if ( not parse_natural(at, end, y) )
+            return false;
+        skip_spaces(at, end);
+
+        c.x = static_cast<int>(x);
+        c.y = static_cast<int>(y);
+
+        if ( not decode_base64(at, end, c.bytes) )
+            return false;
+
+        c.chain.resize(n);
+        return unpack_chain(c.bytes.data(), c.bytes.size(), n, c.chain.data());
+    }
+
+}
+
+
+ctx_reader::ctx_reader(const char* data, const size_t size)
+    : begin_(data), at_(data), end_(data + size), depth_(0),
+      pending_end_(false), close_(false)
+{
+}
+
+
+ctx_reader::event ctx_reader::next()
+{
+    if ( not error_.empty() )
+        return failed;
+
+    if (close_)
+    {
+        --depth_;
+        close_ = false;
+    }
+
+    if (pending_end_)
+    {
+        pending_end_ = false;
+        close_ = true;
+        return end;
+    }
+
+    for (;;)
+    {
+        // Skip character data
+        at_ = std::find(at_, end_, '<');
+
+        if (at_ == end_)
+        {
+            if (depth_ > 0)
+                return fail("unexpected end of document");
+            return done;
+        }
+
+        const char* p = at_ + 1;
+
+        if (p != end_ and *p == '?')            // declaration, processing
+        {
+            at_ = skip_past(p, end_, "?>");
+            continue;
+        }
+
+        if (end_ - p >= 3 and std::memcmp(p, "!--", 3) == 0)    // comment
+        {
+            at_ = skip_past(p, end_, "-->");
+            continue;
+        }
+
+        if (p != end_ and *p == '!')            // document type
+        {
+            at_ = skip_past(p, end_, ">");
+            continue;
+        }
+
+        const bool closing = p != end_ and *p == '/';
+        if (closing)
+            ++p;
+
+        const char* n = p;
+        while (p != end_ and not is_name_end(*p))
+            ++p;
+
+        if (p == n)
+            return fail("element name expected");
+
+        name_.assign(n, p);
+
+        if (closing)
+        {
+            skip_spaces(p, end_);
+            if (p == end_ or *p != '>')
+                return fail("'>' expected");
+            if (depth_ == 0)
+                return fail("end tag without start tag");
+
+            at_ = p + 1;
+            close_ = true;
+            return end;
+        }
+
+        // Attributes
+        attributes_.clear();
+
+        for (;;)
+        {
+            skip_spaces(p, end_);
+
+            if (p == end_)
+                return fail("unterminated start tag");
+
+            if (*p == '>')
+            {
+                ++p;
+                break;
+            }
+
+            if (*p == '/')
+            {
+                if (++p == end_ or *p != '>')
+                    return fail("'>' expected");
+                ++p;
+                pending_end_ = true;
+                break;
+            }
+
+            const char* a = p;
+            while (p != end_ and not is_name_end(*p))
+                ++p;
+            if (p == a)
+                return fail("attribute name expected");
+            const span attribute_name(a, p);
+
+            skip_spaces(p, end_);
+            if (p == end_ or *p != '=')
+                return fail("'=' expected");
+            ++p;
+            skip_spaces(p, end_);
+
+            if (p == end_ or (*p != '"' and *p != '\''))
+                return fail("quoted attribute value expected");
+
+            const char quote = *p++;
+            const char* v = p;
+            p = std::find(p, end_, quote);
+            if (p == end_)
+                return fail("unterminated attribute value");
+
+            attributes_.push_back( std::make_pair(attribute_name, span(v, p)) );
+            ++p;
+        }
+
+        at_ = p;
+        ++depth_;
+        return start;
+    }
+}
+
+
+bool ctx_reader::attribute(const char* name, const char*& begin, const char*& end) const
+{
+    const size_t n = std::strlen(name);
+
+    for (size_t i = 0; i < attributes_.size(); ++i)
+    {
+        const span& s = attributes_[i].first;
+
+        if ( size_t(s.second - s.first) == n and std::memcmp(s.first, name, n) == 0 )
+        {
+            begin = attributes_[i].second.first;
+            end = attributes_[i].second.second;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+bool ctx_reader::attribute(const char* name, std::string& value) const
+{
+    const char* b;
+    const char* e;
+
+    if ( not attribute(name, b, e) )
+        return false;
+
+    value.assign(b, e);
+    return true;
+}
+
+
+bool ctx_reader::attribute(const char* name, double& value) const
+{
+    const char* b;
+    const char* e;
+
+    if ( not attribute(name, b, e) or b == e or e - b > 63 )
+        return false;
+
+    // strtod needs a terminated string
+    char text[64];
+    std::memcpy(text, b, e - b);
+    text[e - b] = '\0';
+
+    char* rest;
+    value = std::strtod(text, &rest);
+    return *rest == '\0';
+}
+
+
+bool ctx_reader::attribute(const char* name, long long& value) const
+{
+    const char* b;
+    const char* e;
+
+    if ( not attribute(name, b, e) )
+        return false;
+
+    const bool negative = b != e and *b == '-';
+    if (negative)
+        ++b;
+
+    if ( not parse_natural(b, e, value) or b != e )
+        return false;
+
+    if (negative)
+        value = -value;
+    return true;
+}
+
+
+size_t ctx_reader::line() const
+{
+    return 1 + std::count(begin_, at_, '\n');
+}
+
+
+ctx_reader::event ctx_reader::fail(const char* message)
+{
+    if ( error_.empty() )
+    {
+        std::ostringstream s;
+        s << "line " << line() << ": " << message;
+        error_ = s.str();
+    }
+
+    return failed;
+}
+
+
+bool read_canvas(ctx_reader& reader, long long& width, long long& height)
+{
+    for (;;)
+    {
+        const ctx_reader::event e = reader.next();
+
+        if (e == ctx_reader::done or e == ctx_reader::failed)
+            return false;
+
+        if (e != ctx_reader::start)
+            continue;
+
+        if (reader.depth() == 1)
+        {
+            if (reader.name() != "ctx")
+            {
+                reader.fail("not a CTX document");
+                return false;
+            }
+            continue;
+        }
+
+        if (reader.name() != "canvas")
+        {
+            reader.fail("canvas expected");
+            return false;
+        }
+
+        if ( not reader.attribute("width", width)
+             or not reader.attribute("height", height) )
+        {
+            reader.fail("canvas without width or height");
+            return false;
+        }
+
+        return true;
+    }
+}
+
+
+bool read_index(ctx_reader& reader, packed_rtree& index)
+{
+    index.clear();
+
+    for (;;)
+    {
+        const ctx_reader::event e = reader.next();
+
+        if (e == ctx_reader::done or e == ctx_reader::failed)
+            return false;
+
+        if (e != ctx_reader::start)
+            continue;
+
+        if (reader.name() == "silhouette")
+            return false;
+
+        if (reader.name() == "index")
+            break;
+    }
+
+    long long fanout;
+    const char* first;
+    const char* last;
+    std::vector<long long> order, numbers;
+
+    if ( not reader.attribute("fanout", fanout)
+         or fanout != static_cast<long long>(packed_rtree::fanout) )
+    {
+        reader.fail("unsupported index fanout");
+        return false;
+    }
+
+    if ( not reader.attribute("order", first, last) or not parse_naturals(first, last, order)
+         or not reader.attribute("nodes", first, last) or not parse_naturals(first, last, numbers)
+         or numbers.size() % 4 != 0 )
+    {
+        reader.fail("malformed index");
+        return false;
+    }
+
+    // Contour ids to entries
+    std::vector<size_t> entries(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        if (order[i] == 0)
+        {
+            reader.fail("malformed index");
+            return false;
+        }
+        entries[i] = static_cast<size_t>(order[i] - 1);
+    }
+
+    std::vector<bbox> nodes(numbers.size() / 4);
+    for (size_t i = 0; i < nodes.size(); ++i)
+        nodes[i] = bbox( static_cast<int>(numbers[4*i]), static_cast<int>(numbers[4*i+1]),
+                         static_cast<int>(numbers[4*i+2]), static_cast<int>(numbers[4*i+3]) );
+
+    if ( not index.assign(nodes, entries) )
+    {
+        reader.fail("index is not a packed R-tree");
+        return false;
+    }
+
+    return true;
+}
+
+
+bool read_contour(ctx_reader& reader, ctx_contour& c)
+{
+    return read_contour(reader, c, 0);
+}
+
+
+bool read_contour(ctx_reader& reader, ctx_contour& c, sidecar_reader* sidecar)
+{
+    static const char* const spatial[10] = {
+        "m00", "m10", "m01", "m20", "m11", "m02", "m30", "m21", "m12", "m03" };
+
+    // Find the next contour
+    for (;;)
+    {
+        const ctx_reader::event e = reader.next();
+
+        if (e == ctx_reader::done or e == ctx_reader::failed)
+            return false;
+
+        if (e == ctx_reader::start and reader.name() == "contour")
+            break;
+    }
+
+    const int depth = reader.depth();
+
+    // Where the full path comes from: the full chain wins over the packed
+    // codes, which win over the runs of the simple level
+    enum { no_path, from_runs, from_packed, from_chain } source = no_path;
+
+    c.id = 0;
+    c.parent = 0;
+    c.has_spatial = false;
+    c.has_bounds = false;
+    c.has_chain = false;
+    c.chain.clear();
+
+    if ( not reader.attribute("id", c.id) or c.id <= 0 )
+    {
+        reader.fail("contour without id");
+        return false;
+    }
+
+    if ( reader.attribute("parent", c.parent) and c.parent <= 0 )
+    {
+        reader.fail("bad parent");
+        return false;
+    }
+
+    for (;;)
+    {
+        const ctx_reader::event e = reader.next();
+
+        if (e == ctx_reader::failed)
+            return false;
+
+        if (e == ctx_reader::done)
+        {
+            reader.fail("unterminated contour");
+            return false;
+        }
+
+        if (e == ctx_reader::end)
+        {
+            if (reader.depth() == depth)
+                return true;
+            continue;
+        }
+
+        if (reader.name() == "spatial-moments")
+        {
+            c.has_spatial = true;
+            for (int k = 0; k < 10; ++k)
+                if ( not reader.attribute(spatial[k], c.spatial[k]) )
+                    c.has_spatial = false;
+        }
+
+        else if (reader.name() == "bounds")
+        {
+            long long x, y, width, height;
+
+            if ( not reader.attribute("x", x) or not reader.attribute("y", y)
+                 or not reader.attribute("width", width)
+                 or not reader.attribute("height", height) )
+            {
+                reader.fail("malformed bounds");
+                return false;
+            }
+
+            c.bounds = bbox( static_cast<int>(x), static_cast<int>(y),
+                             static_cast<int>(width), static_cast<int>(height) );
+            c.has_bounds = true;
+        }
+
+        else if (reader.name() == "path")
+        {
+            const char* first;
+            const char* last;
+
+            if ( reader.attribute("chain", first, last) )
+            {
+                if ( not parse_path(first, last, false, c) )
+                {
+                    reader.fail("malformed chain");
+                    return false;
+                }
+
+                long long vertices;
+                if ( not reader.attribute("vertices", vertices)
+                     or vertices != static_cast<long long>(c.chain.size()) + 1 )
+                {
+                    reader.fail("vertices do not match the chain");
+                    return false;
+                }
+
+                source = from_chain;
+                c.has_chain = true;
+            }
+
+            else if ( source < from_packed and reader.attribute("packed", first, last) )
+            {
+                long long vertices;
+                if ( not reader.attribute("vertices", vertices) or vertices <= 0 )
+                {
+                    reader.fail("packed path without vertices");
+                    return false;
+                }
+
+                if ( not parse_packed(first, last, static_cast<size_t>(vertices - 1), c) )
+                {
+                    reader.fail("malformed packed path");
+                    return false;
+                }
+
+                source = from_packed;
+                c.has_chain = true;
+            }
+
+            // Packed codes in the sidecar file, if the caller reads it:
+            // their record is read even if the path is known already, to
+            // keep in step
+            else if ( sidecar and reader.attribute("sidecar", first, last) )
+            {
+                long long vertices, id;
+                size_t n, size;
+                const unsigned char* bytes;
+
+                if ( not reader.attribute("vertices", vertices) or vertices <= 0 )
+                {
+                    reader.fail("packed path without vertices");
+                    return false;
+                }
+
+                if ( not sidecar->next(id, n, bytes, size) )
+                {
+                    reader.fail( sidecar->failed() ? "malformed sidecar file"
+                                                   : "sidecar file out of step with the document" );
+                    return false;
+                }
+
+                if ( id != c.id or static_cast<long long>(n) != vertices - 1 )
+                {
+                    reader.fail("sidecar file out of step with the document");
+                    return false;
+                }
+
+                if (source < from_packed)
+                {
+                    if ( not parse_path(first, last, false, c) or not c.chain.empty() )
+                    {
+                        reader.fail("malformed packed path");
+                        return false;
+                    }
+
+                    c.chain.resize(n);
+                    if ( not unpack_chain(bytes, size, n, c.chain.data()) )
+                    {
+                        reader.fail("malformed packed path");
+                        return false;
+                    }
+
+                    source = from_packed;
+                    c.has_chain = true;
+                }
+            }
+
+            else if ( source < from_runs and reader.attribute("runs", first, last) )
+            {
+                if ( not parse_path(first, last, true, c) )
+                {
+                    reader.fail("malformed runs");
+                    return false;
+                }
+
+                source = from_runs;
+                c.has_chain = true;
+            }
+        }
+    }
+}
+
+
+bool encloses(const ctx_contour& c, const int x, const int y)
+{
+    // Steps of the 8-connected Freeman chain code (see contour.xsd)
+    static const int step_x[8] = { 1, 1, 0, -1, -1, -1,  0,  1 },
+                     step_y[8] = { 0, 1, 1,  1,  0, -1, -1, -1 };
+
+    if ( c.has_bounds and not c.bounds.contains(x, y) )
+        return false;
+
+    // Count the edges crossing the ray from (x, y) to the right. Steps
+    // move y by at most 1, so an edge meets the line of the ray at its
+    // end at height y; vertices on the line count as lying on its side of
+    // smaller y, so that each is counted once.
+    int px = c.x,
+        py = c.y;
+    bool inside = false;
+
+    for (size_t i = 0; i <= c.chain.size(); ++i)
+    {
+        if (px == x and py == y)
+            return true;
+
+        // The last edge closes the path
+        int qx = c.x,
+            qy = c.y;
+        if ( i < c.chain.size() )
+        {
+            qx = px + step_x[c.chain[i] & 7];
+            qy = py + step_y[c.chain[i] & 7];
+        }
+
+        if ( (py > y) != (qy > y) )
+        {
+            const int cx = py == y ? px : qx;
+            if (cx > x)
+                inside = not inside;
+        }
+
+        px = qx;
+        py = qy;
+    }
+
+    return inside;
+}
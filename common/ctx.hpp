@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rtree.hpp"
+
+class sidecar_reader;
+
+
+/**
+ * Streaming reader of CTX documents
+ *
+ * Walks a CTX document (see datasets/contour.xsd) held in memory, element
+ * by element, without building a tree: the reader only keeps the name and
+ * the attributes of the current element, as spans of the document, so
+ * that a corpus of contour files can be read at the speed of the disk.
+ *
+ * Only what CTX documents use of XML is understood: elements, attributes,
+ * and the XML declaration, comments and character data, which are
+ * skipped. Attribute values are returned as they are written; CTX values
+ * have no character references.
+ */
+
+class ctx_reader
+{
+public:
+
+    enum event { start, end, done, failed };
+
+    /**
+     * Reader of the document in [data, data + size), which must outlive
+     * it.
+     */
+
+    ctx_reader(const char* data, const size_t size);
+
+    /**
+     * Move on to the next start or end tag. An empty element tag
+     * (<a ... />) gives a start event followed by an end event. Returns
+     * done at the end of the document, or failed on a syntax error.
+     */
+
+    event next();
+
+    /**
+     * Name of the element of the current tag.
+     */
+
+    const std::string& name() const { return name_; }
+
+    /**
+     * Depth of the current element; the root element is at depth 1.
+     */
+
+    int depth() const { return depth_; }
+
+    /**
+     * The value of attribute 'name' of the current start tag, as the span
+     * [begin, end). Returns false if the element has no such attribute.
+     */
+
+    bool attribute(const char* name, const char*& begin, const char*& end) const;
+
+    /**
+     * The value of attribute 'name' of the current start tag.
+     */
+
+    bool attribute(const char* name, std::string& value) const;
+
+    /**
+     * The value of attribute 'name' of the current start tag, as a number.
+     * Returns false if there is no such attribute or it is not a number.
+     */
+
+    bool attribute(const char* name, double& value) const;
+
+    bool attribute(const char* name, long long& value) const;
+
+    /**
+     * Number of attributes of the current start tag, and attribute i of
+     * them, in the order they are written, as the spans of its name and
+     * value.
+     */
+
+    size_t attributes() const { return attributes_.size(); }
+
+    void attribute(const size_t i, const char*& name_begin, const char*& name_end,
+                   const char*& value_begin, const char*& value_end) const
+    {
+        name_begin = attributes_[i].first.first;
+        name_end = attributes_[i].first.second;
+        value_begin = attributes_[i].second.first;
+        value_end = attributes_[i].second.second;
+    }
+
+    /**
+     * Line number of the current position, and message of the syntax error
+     * that made next() fail (empty if none).
+     */
+
+    size_t line() const;
+
+    const std::string& error() const { return error_; }
+
+    /**
+     * Record that the document is malformed, for a reason found by the
+     * caller, and return failed. Only the first error is kept.
+     */
+
+    event fail(const char* message);
+
+private:
+
+    typedef std::pair<const char*, const char*> span;
+
+    const char* begin_;
+    const char* at_;
+    const char* end_;
+
+    std::string name_;
+    std::vector< std::pair<span, span> > attributes_;   // name, value
+    int depth_;
+    bool pending_end_;          // an empty element tag was just read
+
+    bool close_;                // the previous event was an end tag
+
+    std::string error_;
+};
+
+
+/**
+ * One contour of a CTX document, as read by read_contour().
+ */
+
+struct ctx_contour
+{
+    long long id,
+              parent;                   // 0 for outer contours
+    double spatial[10];                 // stored m00, m10, m01, m20, m11,
+                                        // m02, m30, m21, m12, m03
+    bool has_spatial;                   // whether they were present
+    bbox bounds;                        // bounding box of the path
+    bool has_bounds;                    // whether it was present
+    int x, y;                           // start of the full path
+    std::vector<unsigned char> chain;   // Freeman codes of the full path
+    bool has_chain;                     // whether there is a full path
+                                        // (given as chain, packed or runs)
+    std::vector<unsigned char> bytes;   // packed codes, decoded from base64
+
+    ctx_contour()
+        : id(0), parent(0), has_spatial(false), has_bounds(false), x(0), y(0),
+          has_chain(false)
+    {
+    }
+};
+
+/**
+ * Read the canvas of the document, moving 'reader' past it. Returns false
+ * if the document does not start with one.
+ */
+
+bool read_canvas(ctx_reader& reader, long long& width, long long& height);
+
+/**
+ * Read the index of the contours, which follows the canvas, into 'index':
+ * entry i of the index is the contour of id i + 1, and its box the
+ * bounds of that contour. Returns false if the document has no index, the
+ * reader having then moved into the silhouette, where read_contour()
+ * goes on; reader.error() tells whether the index was malformed.
+ */
+
+bool read_index(ctx_reader& reader, packed_rtree& index);
+
+/**
+ * Read the next contour of the document into 'c' (whose buffers are
+ * reused). Returns false at the end of the document; then reader.error()
+ * tells whether the document was malformed.
+ *
+ * The full path is taken from the <path> holding a 'chain', or, failing
+ * that, from the one holding the 'packed' codes (or whose codes are in the
+ * sidecar file), decoded, or from the one holding the 'runs' of the simple
+ * level, expanded.
+ */
+
+bool read_contour(ctx_reader& reader, ctx_contour& c);
+
+/**
+ * Same, for a document whose packed level is kept in a sidecar file (see
+ * chain_codec.hpp), read by 'sidecar' along with the document. Once the
+ * document is read, sidecar->done() tells whether the sidecar file held
+ * exactly its paths. Without a sidecar reader, such paths are passed
+ * over.
+ */
+
+bool read_contour(ctx_reader& reader, ctx_contour& c, sidecar_reader* sidecar);
+
+/**
+ * Whether the pixel (x, y) lies inside the full path of 'c', or on it.
+ * The path is taken as the polygon through the centres of its pixels, as
+ * for the moments.
+ */
+
+bool encloses(const ctx_contour& c, const int x, const int y);
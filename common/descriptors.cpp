@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <ciso646>
+#define _USE_MATH_DEFINES 1
+#include <cmath>
+#include <vector>
+
+#include "chain_moments.hpp"
+#include "descriptors.hpp"
+
+
+namespace
+{
+
+    // Steps of the 8-connected Freeman chain code (see contour.xsd)
+    const int step_x[8] = { 1, 1, 0, -1, -1, -1,  0,  1 },
+              step_y[8] = { 0, 1, 1,  1,  0, -1, -1, -1 };
+
+    // Samples of the path, and harmonics kept, of the Fourier descriptor
+    const size_t fourier_samples = 128,
+                 fourier_harmonics = 32;
+
+    inline double distance(const double dx, const double dy)
+    {
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+    bool describe_hu(const cv::Moments& m, float* values)
+    {
+        double hu[7];
+        cv::HuMoments(m, hu);
+
+        // Below 1e-30 the invariants are rounding noise
+        for (int k = 0; k < 7; ++k)
+        {
+            const double a = std::max(std::fabs(hu[k]), 1e-30);
+            values[k] = static_cast<float>( hu[k] < 0 ? std::log10(a) : -std::log10(a) );
+        }
+
+        return true;
+    }
+
+    bool describe_fourier(const ctx_contour& c, const cv::Moments& m, float* values)
+    {
+        using namespace std;
+
+        const size_t n = c.chain.size();
+
+        // End of the path, which closes back on its start point
+        int ex = c.x,
+            ey = c.y;
+        for (size_t i = 0; i < n; ++i)
+        {
+            ex += step_x[c.chain[i] & 7];
+            ey += step_y[c.chain[i] & 7];
+        }
+
+        double length = distance(c.x - ex, c.y - ey);
+        for (size_t i = 0; i < n; ++i)
+            length += c.chain[i] & 1 ? M_SQRT2 : 1;
+
+        if (length == 0)
+            return false;
+
+        const double cx = m.m10 / m.m00,
+                     cy = m.m01 / m.m00;
+
+        // Distance to the centroid every length/samples pixels along the
+        // closed path
+        double r[fourier_samples];
+        const double step = length / fourier_samples;
+        size_t k = 0;
+        double at = 0;
+        int x = c.x,
+            y = c.y;
+
+        for (size_t i = 0; i <= n and k < fourier_samples; ++i)
+        {
+            const int dx = i < n ? step_x[c.chain[i] & 7] : c.x - ex,
+                      dy = i < n ? step_y[c.chain[i] & 7] : c.y - ey;
+            const double edge = distance(dx, dy);
+
+            for (; k < fourier_samples and k * step <= at + edge; ++k)
+            {
+                const double t = edge > 0 ? (k * step - at) / edge : 0;
+                r[k] = distance(x + t * dx - cx, y + t * dy - cy);
+            }
+
+            x += dx;
+            y += dy;
+            at += edge;
+        }
+
+        // Rounding may leave the last samples just past the end of the path
+        for (; k < fourier_samples; ++k)
+            r[k] = distance(c.x - cx, c.y - cy);
+
+        // The zeroth harmonic, which the others are taken relative to
+        double sum = 0;
+        for (size_t s = 0; s < fourier_samples; ++s)
+            sum += r[s];
+
+        if (sum == 0)
+            return false;
+
+        for (size_t h = 1; h <= fourier_harmonics; ++h)
+        {
+            double re = 0,
+                   im = 0;
+
+            for (size_t s = 0; s < fourier_samples; ++s)
+            {
+                const double a = 2 * M_PI * double(h * s % fourier_samples) / fourier_samples;
+                re += r[s] * cos(a);
+                im -= r[s] * sin(a);
+            }
+
+            values[h - 1] = static_cast<float>( distance(re, im) / sum );
+        }
+
+        return true;
+    }
+
+}
+
+
+bool parse_descriptor(const std::string& name, descriptor_kind& kind)
+{
+    if (name == "hu")
+        kind = hu_descriptor;
+    else if (name == "fourier")
+        kind = fourier_descriptor;
+    else
+        return false;
+
+    return true;
+}
+
+
+const char* descriptor_name(const descriptor_kind kind)
+{
+    return kind == hu_descriptor ? "hu" : "fourier";
+}
+
+
+size_t descriptor_size(const descriptor_kind kind)
+{
+    return kind == hu_descriptor ? 7 : fourier_harmonics;
+}
+
+
+bool describe(const ctx_contour& c, const descriptor_kind kind, float* values)
+{
+    cv::Moments m;
+
+    if ( not chain_moments(c.x, c.y, c.chain.empty() ? 0 : &c.chain[0],
+                           c.chain.size(), m)
+         or m.m00 == 0 )
+        return false;
+
+    if (kind == hu_descriptor)
+        return describe_hu(m, values);
+
+    return describe_fourier(c, m, values);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "ctx.hpp"
+
+
+/**
+ * Shape descriptors of CTX contours
+ *
+ * Fixed-size vectors of floats computed from the full path of a contour,
+ * invariant to translation, rotation and scale, so that shapes compare
+ * by a distance between vectors:
+ *
+ *      hu         the 7 Hu invariants of the exact moments of the path
+ *                 (see chain_moments.hpp), each as -sign(h) log10 |h|,
+ *                 which brings them to comparable ranges;
+ *      fourier    the magnitudes of the first 32 harmonics of the
+ *                 distance to the centroid, sampled at 128 points evenly
+ *                 spaced along the path, over that of the zeroth; the
+ *                 start point and orientation drop out with the phases.
+ */
+
+enum descriptor_kind { hu_descriptor, fourier_descriptor };
+
+/**
+ * Parse a descriptor name. Returns false if there is no such descriptor.
+ */
+
+bool parse_descriptor(const std::string& name, descriptor_kind& kind);
+
+const char* descriptor_name(const descriptor_kind kind);
+
+/**
+ * Number of values of a descriptor.
+ */
+
+size_t descriptor_size(const descriptor_kind kind);
+
+/**
+ * Compute the descriptor of the full path of 'c' into 'values'. Returns
+ * false if the path encloses no area or is out of the range of the exact
+ * moments.
+ */
+
+bool describe(const ctx_contour& c, const descriptor_kind kind, float* values);
@@ -0,0 +1,157 @@
+#include <ciso646>
+#include <cstdio>
+#include <cstring>
+
+#include "frame_cache.hpp"
+#include "hash.hpp"
+#include "io_stage.hpp"
+#include "mapped_file.hpp"
+#include "sources.hpp"
+
+
+namespace
+{
+
+    const char magic[8] = { 'M', 'P', 'E', 'G', '7', 'R', 'F', '1' };
+    const boost::uint32_t byte_order = 0x01020304;
+
+    // Pixels start on a cache line
+    const boost::uint64_t pixels_offset = 64;
+
+}
+
+
+frame_cache::frame_cache(const boost::filesystem::path& dir)
+    : dir_(dir), hits_(0), stores_(0)
+{
+    using namespace boost::filesystem;
+
+    if (not enabled())
+        return;
+
+    // Create the 256 buckets once, rather than checking for them on every
+    // store
+    for (unsigned b = 0; b < 256; ++b)
+    {
+        char name[3];
+        sprintf(name, "%02x", b);
+
+        boost::system::error_code ec;
+        create_directories(dir_ / name, ec);
+    }
+}
+
+
+std::string frame_cache::key(const boost::filesystem::path& p) const
+{
+    const std::string stamp = source_stamp(p);
+    if ( stamp.empty() )
+        return stamp;
+
+    // Bump the format tag whenever the tools decode differently
+    hash128 h;
+    h.update( "frame-1 anydepth " + stamp );
+    return h.hex();
+}
+
+
+std::vector<boost::filesystem::path>
+frame_cache::misses(const std::vector<boost::filesystem::path>& files)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    if (not enabled())
+        return files;
+
+    vector<path> rest;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const string k = key(files[i]);
+
+        boost::system::error_code ec;
+        if ( not k.empty() and exists(entry(k), ec) )
+            found_[ files[i].string() ] = k;
+        else
+            rest.push_back(files[i]);
+    }
+
+    return rest;
+}
+
+
+bool frame_cache::find(const boost::filesystem::path& p, mapped_file& file,
+                       cv::Mat& img)
+{
+    const std::map<std::string, std::string>::const_iterator k = found_.find( p.string() );
+    if ( k == found_.end() or not file.open( entry(k->second) ) )
+        return false;
+
+    const unsigned char* data = file.data();
+    const size_t size = file.size();
+
+    if (size < sizeof(frame_header) or memcmp(data, magic, sizeof magic) != 0)
+        return false;
+
+    frame_header h;
+    memcpy(&h, data, sizeof h);
+
+    const int type = static_cast<int>(h.type);
+    if ( h.order != byte_order or h.type != boost::uint32_t( CV_MAT_TYPE(type) )
+         or h.rows == 0 or h.cols == 0 or h.rows > (1u << 30) or h.cols > (1u << 30) )
+        return false;
+
+    // An entry cut short (or of another layout) is a miss
+    const boost::uint64_t bytes = boost::uint64_t(h.rows) * h.cols * CV_ELEM_SIZE(type);
+    if ( h.pixels < sizeof(frame_header) or h.end != size or h.pixels + bytes != h.end )
+        return false;
+
+    img = cv::Mat( static_cast<int>(h.rows), static_cast<int>(h.cols), type,
+                   const_cast<unsigned char*>(data + h.pixels) );
+    ++hits_;
+    return true;
+}
+
+
+void frame_cache::store(const boost::filesystem::path& p, const cv::Mat& img,
+                        std::vector<uchar>& bytes, io_stage& io)
+{
+    if ( not enabled() or img.empty() )
+        return;
+
+    const std::string k = key(p);
+    if ( k.empty() )
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if ( not stored_.insert(k).second )
+            return;
+    }
+
+    const size_t row = img.cols * img.elemSize();
+
+    frame_header h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, magic, sizeof h.magic);
+    h.order = byte_order;
+    h.rows = static_cast<boost::uint32_t>(img.rows);
+    h.cols = static_cast<boost::uint32_t>(img.cols);
+    h.type = static_cast<boost::uint32_t>( img.type() );
+    h.pixels = pixels_offset;
+    h.end = pixels_offset + boost::uint64_t(row) * img.rows;
+
+    bytes.assign( static_cast<size_t>(h.end), 0 );
+    memcpy(&bytes[0], &h, sizeof h);
+    for (int r = 0; r < img.rows; ++r)
+        memcpy(&bytes[pixels_offset + r * row], img.ptr(r), row);
+
+    io.store(entry(k), bytes);
+    ++stores_;
+}
+
+
+boost::filesystem::path frame_cache::entry(const std::string& key) const
+{
+    return dir_ / key.substr(0, 2) / (key + ".raw");
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+#include <boost/cstdint.hpp>
+
+#include <opencv2/core/core.hpp>
+
+class io_stage;
+class mapped_file;
+
+
+/**
+ * Cache of decoded source images
+ *
+ * mpeg7A and mpeg7D decode the same base images, mpeg7contour decodes
+ * them again, and every repeated run does it all over. The frame cache
+ * keeps each decoded image uncompressed under the hash of the path, size
+ * and modification time of its source:
+ *
+ *      <cache dir>/<2 hex digits>/<32 hex digits>.raw
+ *
+ * so that the next run of any of the tools maps the file and uses its
+ * pixels in place, which costs no decode, and no read once the file is in
+ * the page cache; the sources of the entries found are not even read
+ * ahead. A source that changes gets another entry, leaving the old one
+ * behind: the directory can be emptied at any time. Archive members are
+ * keyed by the size and time of their archive. Entries are committed like
+ * any other output, under staging names of their own, so the cache can be
+ * shared by concurrent runs; an entry that cannot be written is decoded
+ * again next time, and does not fail the run.
+ *
+ * An entry is a frame_header followed, from offset 'pixels', by the rows
+ * of the image one after the other, in the byte order of the machine that
+ * wrote it; one of another order is taken for a miss.
+ */
+
+struct frame_header
+{
+    char magic[8];                  // "MPEG7RF1"
+    boost::uint32_t order,          // 0x01020304 as written
+                    rows,
+                    cols,
+                    type;           // OpenCV type of the pixels
+    boost::uint64_t pixels,         // offset of the pixels, from the start
+                                    // of the file
+                    end;            // size of the file
+};
+
+class frame_cache
+{
+public:
+
+    /**
+     * Cache in 'dir'. An empty 'dir' disables the cache.
+     */
+
+    explicit frame_cache(const boost::filesystem::path& dir);
+
+    bool enabled() const { return not dir_.empty(); }
+
+    /**
+     * Sort out the files of 'files' whose decoded image is in the cache,
+     * which find() will map, and return the others, in order: those the
+     * I/O stage still has to read. Entries made later, by this run or a
+     * concurrent one, are not looked up.
+     */
+
+    std::vector<boost::filesystem::path> misses(const std::vector<boost::filesystem::path>& files);
+
+    /**
+     * Map the entry of source p into 'file' and make 'img' a read-only
+     * view of its pixels, valid while 'file' stays mapped. Returns false
+     * if misses() did not find p, or its entry is not valid.
+     */
+
+    bool find(const boost::filesystem::path& p, mapped_file& file, cv::Mat& img);
+
+    /**
+     * Queue a copy of 'img', the image decoded from source p, to be
+     * written to its entry, unless this run has already queued it. 'bytes'
+     * is the buffer handed over to the I/O stage.
+     */
+
+    void store(const boost::filesystem::path& p, const cv::Mat& img,
+               std::vector<uchar>& bytes, io_stage& io);
+
+    size_t hits() const { return hits_; }
+
+    size_t stores() const { return stores_; }
+
+private:
+
+    boost::filesystem::path dir_;
+    std::map<std::string, std::string> found_;  // entries of the sources
+                                                // in the cache, by path
+    std::atomic<size_t> hits_,
+                        stores_;
+
+    std::mutex m_;
+    std::set<std::string> stored_;              // keys queued by this run
+
+    std::string key(const boost::filesystem::path& p) const;
+
+    boost::filesystem::path entry(const std::string& key) const;
+};
@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <ciso646>
+#include <cmath>
+#include <cstring>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "grid.hpp"
+
+
+namespace
+{
+
+    /**
+     * A pixel of N bytes, moved around as a whole.
+     */
+
+    template <int N>
+    struct pixel
+    {
+        unsigned char b[N];
+    };
+
+    // Side, in pixels, of the square blocks the rotation kernel works on:
+    // a 32 x 32 block of 8-byte pixels takes 8 KiB, source and destination
+    // together fitting in any L1 cache.
+    const int block = 32;
+
+    /**
+     * Quarter turn, counter-clockwise (ccw) or clockwise, block by block so
+     * that both the rows read and the rows written stay in the cache.
+     */
+
+    template <typename T>
+    void quarter_kernel(const cv::Mat& src, cv::Mat& dst, const bool ccw)
+    {
+        const int w = src.cols,
+                  h = src.rows;
+
+        const unsigned char* const s0 = src.data;
+        const size_t ss = src.step;
+
+        for (int rb = 0; rb < w; rb += block)
+        {
+            const int re = std::min(rb + block, w);
+
+            for (int cb = 0; cb < h; cb += block)
+            {
+                const int ce = std::min(cb + block, h);
+
+                for (int r = rb; r < re; ++r)
+                {
+                    T* d = dst.ptr<T>(r);
+
+                    // dst(r, c) = src(c, w - 1 - r) or src(h - 1 - c, r)
+                    if (ccw)
+                    {
+                        const unsigned char* s = s0 + (w - 1 - r) * sizeof(T);
+                        for (int c = cb; c < ce; ++c)
+                            d[c] = *reinterpret_cast<const T*>(s + c * ss);
+                    }
+                    else
+                    {
+                        const unsigned char* s = s0 + r * sizeof(T);
+                        for (int c = cb; c < ce; ++c)
+                            d[c] = *reinterpret_cast<const T*>(s + (h - 1 - c) * ss);
+                    }
+                }
+            }
+        }
+    }
+
+    template <typename T>
+    void replicate_kernel(const cv::Mat& src, cv::Mat& dst, const int k,
+                          const int y)
+    {
+        const size_t row = dst.cols * sizeof(T);
+
+        for (int r = 0; r < dst.rows; ++r)
+        {
+            // Rows replicating the same source row are copies of the first
+            if (r > 0 and (y + r) / k == (y + r - 1) / k)
+            {
+                std::memcpy(dst.ptr(r), dst.ptr(r - 1), row);
+                continue;
+            }
+
+            const T* s = src.ptr<T>( (y + r) / k );
+            T* d = dst.ptr<T>(r);
+
+            for (int c = 0; c < src.cols; ++c)
+                for (int i = 0; i < k; ++i)
+                    *d++ = s[c];
+        }
+    }
+
+    /**
+     * Run K<pixel<N>> for the pixel size N of src. Returns false for
+     * pixel sizes there is no kernel for.
+     */
+
+    template <template <typename> class K>
+    bool dispatch(const cv::Mat& src, cv::Mat& dst, const int a, const int b)
+    {
+        switch (src.elemSize())
+        {
+        case 1: K< pixel<1> >::run(src, dst, a, b); return true;
+        case 2: K< pixel<2> >::run(src, dst, a, b); return true;
+        case 3: K< pixel<3> >::run(src, dst, a, b); return true;
+        case 4: K< pixel<4> >::run(src, dst, a, b); return true;
+        case 6: K< pixel<6> >::run(src, dst, a, b); return true;
+        case 8: K< pixel<8> >::run(src, dst, a, b); return true;
+        default: return false;
+        }
+    }
+
+    template <typename T>
+    struct quarter
+    {
+        static void run(const cv::Mat& src, cv::Mat& dst, const int ccw,
+                        const int)
+        {
+            quarter_kernel<T>(src, dst, ccw != 0);
+        }
+    };
+
+    template <typename T>
+    struct widen
+    {
+        static void run(const cv::Mat& src, cv::Mat& dst, const int k,
+                        const int y)
+        {
+            replicate_kernel<T>(src, dst, k, y);
+        }
+    };
+
+}
+
+
+bool is_quarter_turn(const double angle, int& turns)
+{
+    const double q = angle / 90.0,
+                 n = std::floor(q + 0.5);
+
+    if (std::fabs(q - n) > 1e-12)
+        return false;
+
+    turns = static_cast<int>( std::fmod(std::fmod(n, 4.0) + 4.0, 4.0) );
+    return true;
+}
+
+
+bool is_integer_scale(const double scale, int& factor)
+{
+    const double n = std::floor(scale + 0.5);
+
+    if (n < 1 or std::fabs(scale - n) > 1e-12)
+        return false;
+
+    factor = static_cast<int>(n);
+    return true;
+}
+
+
+void rotate_quarter(const cv::Mat& src, cv::Mat& dst, const int turns)
+{
+    const int t = ((turns % 4) + 4) % 4;
+
+    if (t == 0)
+        src.copyTo(dst);
+
+    else if (t == 2)
+        cv::flip(src, dst, -1);
+
+    else
+    {
+        CV_Assert(src.data != dst.data);
+        dst.create(src.cols, src.rows, src.type());
+
+        if ( not dispatch<quarter>(src, dst, t == 1, 0) )
+        {
+            // Wider pixels: transpose and flip
+            cv::transpose(src, dst);
+            cv::flip(dst, dst, t == 1 ? 0 : 1);
+        }
+    }
+}
+
+
+void replicate(const cv::Mat& src, cv::Mat& dst, const int factor)
+{
+    CV_Assert(factor >= 1 and src.data != dst.data);
+
+    dst.create(src.rows * factor, src.cols * factor, src.type());
+    replicate_rows(src, factor, 0, dst);
+}
+
+
+void replicate_rows(const cv::Mat& src, const int factor, const int y,
+                    cv::Mat& strip)
+{
+    CV_Assert(factor >= 1 and strip.cols == src.cols * factor
+              and y + strip.rows <= src.rows * factor);
+
+    if ( dispatch<widen>(src, strip, factor, y) )
+        return;
+
+    for (int r = 0; r < strip.rows; ++r)
+    {
+        cv::Mat d = strip.row(r);
+        cv::resize(src.row( (y + r) / factor ), d, d.size(), 0, 0, CV_INTER_NN);
+    }
+}
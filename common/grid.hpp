@@ -0,0 +1,57 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+
+/**
+ * Exact transforms on the pixel grid
+ *
+ * Rotations by multiples of 90 degrees and scalings by integer factors
+ * map pixels onto pixels; done by moving pixels around, rather than by
+ * interpolating, they are lossless and much cheaper than warpAffine or
+ * resize. The kernels work on blocks that fit in the L1 cache, and handle
+ * any matrix of 1 to 4 channels of 8 or 16 bits.
+ */
+
+/**
+ * If 'angle' (in degrees, counter-clockwise) is a multiple of 90 degrees,
+ * set 'turns' to the matching number of quarter turns, in [0, 4), and
+ * return true.
+ */
+
+bool is_quarter_turn(const double angle, int& turns);
+
+/**
+ * If 'scale' is an integer factor of at least 1, set 'factor' to it and
+ * return true.
+ */
+
+bool is_integer_scale(const double scale, int& factor);
+
+/**
+ * Rotate 'src' counter-clockwise by 'turns' quarter turns:
+ *
+ *      turns = 1:  dst(r, c) = src(c, w - 1 - r)
+ *      turns = 2:  dst(r, c) = src(h - 1 - r, w - 1 - c)
+ *      turns = 3:  dst(r, c) = src(h - 1 - c, r)
+ *
+ * where w and h are the width and height of src.
+ */
+
+void rotate_quarter(const cv::Mat& src, cv::Mat& dst, const int turns);
+
+/**
+ * Scale 'src' up by the integer 'factor', replicating every pixel into a
+ * factor x factor block.
+ */
+
+void replicate(const cv::Mat& src, cv::Mat& dst, const int factor);
+
+/**
+ * Rows 'y' to 'y' + strip.rows - 1 of the replication of 'src' by
+ * 'factor', into 'strip'; for images too large to be held whole (see
+ * strips.hpp).
+ */
+
+void replicate_rows(const cv::Mat& src, const int factor, const int y,
+                    cv::Mat& strip);
@@ -0,0 +1,134 @@
+#include <ciso646>
+#include <cstring>
+
+#include "hash.hpp"
+
+
+namespace
+{
+
+    const boost::uint64_t c1 = 0x87c37b91114253d5ULL,
+                          c2 = 0x4cf5ad432745937fULL;
+
+    inline boost::uint64_t rotl(const boost::uint64_t x, const int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline boost::uint64_t load64(const unsigned char* p)
+    {
+        // Little-endian, whatever the platform
+        boost::uint64_t v = 0;
+        for (int i = 7; i >= 0; --i)
+            v = (v << 8) | p[i];
+        return v;
+    }
+
+    inline boost::uint64_t fmix(boost::uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+}
+
+
+hash128::hash128(const boost::uint64_t seed)
+    : h1_(seed), h2_(seed), tail_size_(0), length_(0)
+{
+}
+
+
+void hash128::block(const unsigned char* p)
+{
+    boost::uint64_t k1 = load64(p),
+                    k2 = load64(p + 8);
+
+    k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1_ ^= k1;
+    h1_ = rotl(h1_, 27); h1_ += h2_; h1_ = h1_ * 5 + 0x52dce729;
+
+    k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2_ ^= k2;
+    h2_ = rotl(h2_, 31); h2_ += h1_; h2_ = h2_ * 5 + 0x38495ab5;
+}
+
+
+void hash128::update(const void* data, const size_t size)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    size_t n = size;
+
+    length_ += size;
+
+    // Complete the pending partial block first
+    if (tail_size_ > 0)
+    {
+        const size_t k = n < 16 - tail_size_ ? n : 16 - tail_size_;
+        std::memcpy(tail_ + tail_size_, p, k);
+        tail_size_ += k;
+        p += k;
+        n -= k;
+
+        if (tail_size_ < 16)
+            return;
+
+        block(tail_);
+        tail_size_ = 0;
+    }
+
+    for (; n >= 16; p += 16, n -= 16)
+        block(p);
+
+    std::memcpy(tail_, p, n);
+    tail_size_ = n;
+}
+
+
+std::string hash128::hex() const
+{
+    boost::uint64_t h1 = h1_,
+                    h2 = h2_,
+                    k1 = 0,
+                    k2 = 0;
+
+    for (size_t i = tail_size_; i > 8; --i)
+        k2 = (k2 << 8) | tail_[i - 1];
+    for (size_t i = tail_size_ < 8 ? tail_size_ : 8; i > 0; --i)
+        k1 = (k1 << 8) | tail_[i - 1];
+
+    if (tail_size_ > 8)
+    {
+        k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    if (tail_size_ > 0)
+    {
+        k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= length_;
+    h2 ^= length_;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    static const char digits[] = "0123456789abcdef";
+    std::string s(32, '0');
+    for (int i = 0; i < 16; ++i)
+    {
+        s[15 - i] = digits[h1 & 15];
+        s[31 - i] = digits[h2 & 15];
+        h1 >>= 4;
+        h2 >>= 4;
+    }
+
+    return s;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+
+/**
+ * Incremental 128-bit content hash (MurmurHash3 x64-128)
+ *
+ * Not cryptographic, but with 128 bits the chance of two distinct inputs
+ * of a dataset colliding is negligible, which is what content-addressed
+ * caches need. The result does not depend on how the input is split
+ * between update() calls.
+ */
+
+class hash128
+{
+public:
+
+    explicit hash128(const boost::uint64_t seed = 0);
+
+    void update(const void* data, const size_t size);
+
+    void update(const std::string& s) { update(s.data(), s.size()); }
+
+    /**
+     * Hash of everything given so far, as 32 hexadecimal digits.
+     */
+
+    std::string hex() const;
+
+private:
+
+    boost::uint64_t h1_, h2_;
+    unsigned char   tail_[16];
+    size_t          tail_size_,
+                    length_;
+
+    void block(const unsigned char* p);
+};
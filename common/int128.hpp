@@ -0,0 +1,98 @@
+#pragma once
+
+#include <ciso646>
+
+#include <boost/cstdint.hpp>
+
+
+/**
+ * Signed 128-bit integer
+ *
+ * Just what exact moment sums need: sums of products of two 64-bit
+ * integers, and conversion to double. Two's complement, in two 64-bit
+ * halves, since there is no portable 128-bit type.
+ */
+
+class int128
+{
+public:
+
+    int128() : hi_(0), lo_(0) {}
+
+    int128(const boost::int64_t v)
+        : hi_(v < 0 ? -1 : 0), lo_( static_cast<boost::uint64_t>(v) )
+    {
+    }
+
+    /**
+     * Exact product of a and b.
+     */
+
+    static int128 product(const boost::int64_t a, const boost::int64_t b)
+    {
+        const boost::uint64_t ua = a < 0 ? 0 - static_cast<boost::uint64_t>(a) : a,
+                              ub = b < 0 ? 0 - static_cast<boost::uint64_t>(b) : b;
+
+        // Schoolbook multiplication in 32-bit digits
+        const boost::uint64_t a0 = ua & 0xffffffffu, a1 = ua >> 32,
+                              b0 = ub & 0xffffffffu, b1 = ub >> 32;
+
+        const boost::uint64_t p00 = a0 * b0,
+                              p01 = a0 * b1,
+                              p10 = a1 * b0,
+                              p11 = a1 * b1;
+
+        const boost::uint64_t mid = (p00 >> 32) + (p01 & 0xffffffffu) + (p10 & 0xffffffffu);
+
+        int128 r;
+        r.lo_ = (mid << 32) | (p00 & 0xffffffffu);
+        r.hi_ = static_cast<boost::int64_t>( p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32) );
+
+        return (a < 0) != (b < 0) ? -r : r;
+    }
+
+    int128& operator+=(const int128& x)
+    {
+        const boost::uint64_t lo = lo_ + x.lo_;
+        hi_ = static_cast<boost::int64_t>( static_cast<boost::uint64_t>(hi_)
+                                           + static_cast<boost::uint64_t>(x.hi_)
+                                           + (lo < lo_ ? 1 : 0) );
+        lo_ = lo;
+        return *this;
+    }
+
+    int128 operator-() const
+    {
+        int128 r;
+        r.lo_ = 0 - lo_;
+        r.hi_ = static_cast<boost::int64_t>( ~static_cast<boost::uint64_t>(hi_)
+                                             + (lo_ == 0 ? 1 : 0) );
+        return r;
+    }
+
+    bool operator==(const int128& x) const { return hi_ == x.hi_ and lo_ == x.lo_; }
+
+    bool operator!=(const int128& x) const { return not (*this == x); }
+
+    bool negative() const { return hi_ < 0; }
+
+    bool zero() const { return hi_ == 0 and lo_ == 0; }
+
+    /**
+     * Nearest double (exact up to 2^53).
+     */
+
+    double to_double() const
+    {
+        if ( negative() )
+            return -(-*this).to_double();
+
+        return static_cast<double>(hi_) * 18446744073709551616.0
+             + static_cast<double>(lo_);
+    }
+
+private:
+
+    boost::int64_t  hi_;
+    boost::uint64_t lo_;
+};
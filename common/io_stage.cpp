@@ -0,0 +1,965 @@
+#include <ciso646>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <boost/filesystem/fstream.hpp>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "uring.hpp"
+#endif
+
+#include "commit.hpp"
+#include "io_stage.hpp"
+#include "parallel.hpp"
+#include "sources.hpp"
+#include "trace.hpp"
+
+
+bool read_file(const boost::filesystem::path& p, std::vector<unsigned char>& bytes)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    boost::filesystem::ifstream in(p, ios_base::binary);
+
+    if (not in.is_open())
+        return false;
+
+    boost::system::error_code ec;
+    const boost::uintmax_t size = file_size(p, ec);
+
+    if (ec)
+        return false;
+
+    bytes.resize( static_cast<size_t>(size) );
+
+    if ( not bytes.empty() )
+        in.read( reinterpret_cast<char*>(&bytes[0]), bytes.size() );
+
+    return not in.fail();
+}
+
+
+bool write_file(const boost::filesystem::path& p, const std::vector<unsigned char>& bytes)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    boost::filesystem::ofstream out(p, ios_base::binary | ios_base::trunc);
+
+    if (not out.is_open())
+        return false;
+
+    if ( not bytes.empty() )
+        out.write( reinterpret_cast<const char*>(&bytes[0]), bytes.size() );
+
+    out.close();
+
+    return not out.fail();
+}
+
+
+namespace
+{
+
+    /**
+     * A read or a write of one whole file. Writes go to the staging file
+     * 'p' of the output 'final'.
+     */
+
+    struct io_job
+    {
+        boost::filesystem::path p,
+                                final;
+        std::vector<unsigned char> bytes;
+        bool ok,
+             shared;            // cache entry, see io_stage::store()
+    };
+
+
+    /**
+     * A way of performing batches of reads or writes. Committing the
+     * written files is left to the stage. A backend is used by a single
+     * thread.
+     */
+
+    class io_backend
+    {
+    public:
+
+        virtual ~io_backend() {}
+
+        virtual void read(std::vector<io_job*>& batch) = 0;
+        virtual void write(std::vector<io_job*>& batch) = 0;
+    };
+
+
+    /**
+     * Portable blocking I/O, one file after the other.
+     */
+
+    class blocking_backend : public io_backend
+    {
+    public:
+
+        explicit blocking_backend(const bool durable)
+            : durable_(durable)
+        {
+        }
+
+        void read(std::vector<io_job*>& batch)
+        {
+            for (size_t i = 0; i < batch.size(); ++i)
+                batch[i]->ok = read_file(batch[i]->p, batch[i]->bytes);
+        }
+
+        void write(std::vector<io_job*>& batch)
+        {
+            for (size_t i = 0; i < batch.size(); ++i)
+                batch[i]->ok = write_staged(batch[i]->p, batch[i]->bytes, durable_);
+        }
+
+    private:
+
+        bool durable_;
+    };
+
+
+#if defined(__linux__)
+
+    /**
+     * io_uring: the files of a batch are opened, then all their transfers
+     * are submitted at once and reaped as they complete; short transfers
+     * are resubmitted for the remainder. Durable writes are followed by an
+     * fdatasync of the file, submitted through the ring as well. Should the
+     * ring fail, the batch and all later ones fall back to blocking I/O.
+     */
+
+    class uring_backend : public io_backend
+    {
+    public:
+
+        static const unsigned depth = 64;
+
+        explicit uring_backend(const bool durable)
+            : durable_(durable), broken_(false)
+        {
+            ring_.open(depth);
+        }
+
+        void read(std::vector<io_job*>& batch)
+        {
+            if (broken_)
+            {
+                blocking_backend(durable_).read(batch);
+                return;
+            }
+
+            start(batch, false);
+            run(false);
+        }
+
+        void write(std::vector<io_job*>& batch)
+        {
+            if (broken_)
+            {
+                blocking_backend(durable_).write(batch);
+                return;
+            }
+
+            start(batch, true);
+            run(true);
+        }
+
+    private:
+
+        struct transfer
+        {
+            io_job* job;
+            int     fd;
+            size_t  done;
+            bool    syncing,        // written whole, being synced
+                    queued;         // in the hands of the kernel
+            struct iovec iov;
+        };
+
+        void start(std::vector<io_job*>& batch, const bool writing)
+        {
+            ops_.resize(batch.size());
+            pending_.clear();
+
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                transfer& t = ops_[i];
+                t.job = batch[i];
+                t.done = 0;
+                t.syncing = t.queued = false;
+                t.job->ok = false;
+
+                const std::string name = t.job->p.string();
+                t.fd = writing ? ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)
+                               : ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+                if (t.fd < 0)
+                    continue;
+
+                if (not writing)
+                {
+                    struct stat st;
+                    if (fstat(t.fd, &st) != 0)
+                    {
+                        ::close(t.fd);
+                        t.fd = -1;
+                        continue;
+                    }
+                    t.job->bytes.resize( static_cast<size_t>(st.st_size) );
+                }
+
+                if ( not t.job->bytes.empty() )
+                    pending_.push_back(&t);
+                else if (writing and durable_)
+                {
+                    t.syncing = true;
+                    pending_.push_back(&t);
+                }
+                else
+                    t.job->ok = true;
+            }
+        }
+
+        void run(const bool writing)
+        {
+            unsigned in_flight = 0;
+
+            while ( in_flight > 0 or not pending_.empty() )
+            {
+                // Queue as many transfers as the ring takes
+                while ( not pending_.empty() )
+                {
+                    transfer* t = pending_.back();
+                    bool queued;
+                    if (t->syncing)
+                        queued = ring_.prep_fdatasync(t->fd, t);
+                    else
+                    {
+                        t->iov.iov_base = &t->job->bytes[0] + t->done;
+                        t->iov.iov_len = t->job->bytes.size() - t->done;
+
+                        queued = writing
+                            ? ring_.prep_writev(t->fd, &t->iov, 1, t->done, t)
+                            : ring_.prep_readv(t->fd, &t->iov, 1, t->done, t);
+                    }
+                    if (not queued)
+                        break;
+
+                    pending_.pop_back();
+                    t->queued = true;
+                    ++in_flight;
+                }
+
+                if ( not ring_.submit(1) )
+                {
+                    // The ring is unusable: fall back to blocking I/O
+                    abandon(writing, in_flight);
+                    return;
+                }
+
+                int result;
+                void* data;
+                while ( ring_.next_completion(result, data) )
+                {
+                    transfer* t = static_cast<transfer*>(data);
+                    t->queued = false;
+                    --in_flight;
+
+                    if (result == -EINTR or result == -EAGAIN)
+                        pending_.push_back(t);
+
+                    else if (result < 0)
+                        t->job->ok = false;
+
+                    else if (t->syncing)
+                        t->job->ok = true;
+
+                    else if (result == 0)   // the file shrank under us
+                    {
+                        if (not writing)
+                            t->job->bytes.resize(t->done);
+                        t->job->ok = not writing;
+                    }
+
+                    else
+                    {
+                        t->done += static_cast<size_t>(result);
+                        if ( t->done < t->job->bytes.size() )
+                            pending_.push_back(t);
+                        else if (writing and durable_)
+                        {
+                            t->syncing = true;
+                            pending_.push_back(t);
+                        }
+                        else
+                            t->job->ok = true;
+                    }
+                }
+            }
+
+            finish();
+        }
+
+        void abandon(const bool writing, unsigned in_flight)
+        {
+            // Nothing may be closed or reused while the kernel can still
+            // transfer into or from the buffers, or through the descriptors:
+            // take back what it has not consumed, and wait for the rest
+            int result;
+            void* data;
+            while ( ring_.discard(data) )
+            {
+                static_cast<transfer*>(data)->queued = false;
+                --in_flight;
+            }
+
+            while (in_flight > 0)
+            {
+                if ( ring_.next_completion(result, data) )
+                {
+                    static_cast<transfer*>(data)->queued = false;
+                    --in_flight;
+                }
+                else if ( not ring_.submit(1) )     // waits for a completion
+                    break;
+            }
+
+            // Transfers that could not be waited for fail, and their buffers
+            // and descriptors are kept as they are for good
+            for (size_t i = 0; i < ops_.size(); ++i)
+            {
+                transfer& t = ops_[i];
+                if (not t.queued)
+                    continue;
+
+                orphans_.push_back( std::vector<unsigned char>() );
+                orphans_.back().swap(t.job->bytes);
+                t.job->ok = false;
+                t.fd = -1;
+            }
+
+            finish();
+            broken_ = true;
+
+            blocking_backend fallback(durable_);
+            std::vector<io_job*> batch;
+            for (size_t i = 0; i < ops_.size(); ++i)
+                if (not ops_[i].job->ok and not ops_[i].queued)
+                    batch.push_back(ops_[i].job);
+
+            if (writing)
+                fallback.write(batch);
+            else
+                fallback.read(batch);
+        }
+
+        void finish()
+        {
+            for (size_t i = 0; i < ops_.size(); ++i)
+            {
+                if (ops_[i].fd >= 0)
+                    ::close(ops_[i].fd);
+                ops_[i].fd = -1;
+            }
+            pending_.clear();
+        }
+
+        bool durable_,
+             broken_;
+        std::vector< std::vector<unsigned char> > orphans_;
+        uring ring_;                    // closed before the orphans go
+        std::vector<transfer> ops_;
+        std::vector<transfer*> pending_;
+    };
+
+#endif  // __linux__
+
+
+    bool uring_supported()
+    {
+#if defined(__linux__)
+        uring probe;
+        return probe.open(8);
+#else
+        return false;
+#endif
+    }
+
+}
+
+
+struct io_stage::impl
+{
+    std::string name;
+    bool async,
+         durable;
+    size_t read_batch,
+           write_batch;
+
+    std::mutex m;
+    std::condition_variable read_cv,    // readers waiting for work
+                            ready_cv,   // fetch() waiting for data
+                            write_cv,   // writers waiting for work
+                            done_cv;    // write()/drain() waiting for writers
+
+    // Input side: one slot per prefetched file
+    std::vector<boost::filesystem::path> files;
+    std::unordered_map<std::string, size_t> index;
+    std::vector< std::unique_ptr<io_job> > slots;
+    std::vector<char> state;            // 0: queued, 1: reading, 2: ready, 3: taken,
+                                        // 4: queued, archive member
+    size_t next_read,
+           consumed,
+           lookahead;
+
+    // Archive members, unpacked in order by a thread of their own
+    std::vector<size_t> packed;         // their slots, in ascending order
+    size_t next_packed;                 // first slot of 'packed' maybe queued
+    bool unpacking;
+
+    // Archive member reads on the spot, kept open for the next one
+    std::mutex cursor_m;
+    std::unique_ptr<archive_stream> cursor;
+
+    // Output side
+    std::deque<io_job*> queue;
+    std::vector< std::unique_ptr<io_job> > jobs;
+    std::vector<io_job*> free_jobs;
+    size_t queued_bytes,
+           max_queued_bytes,
+           in_flight;
+    bool failed;
+
+    // Buffers returned by the workers, to be reused
+    std::vector< std::vector<unsigned char> > spare;
+    size_t max_spare;
+
+    bool stopping;
+    std::vector<std::thread> threads;
+
+    std::unique_ptr<io_backend> make_backend()
+    {
+#if defined(__linux__)
+        if (name == "uring")
+            return std::unique_ptr<io_backend>(new uring_backend(durable));
+#endif
+        return std::unique_ptr<io_backend>(new blocking_backend(durable));
+    }
+
+    void recycle(std::vector<unsigned char>& bytes)
+    {
+        if (spare.size() < max_spare)
+        {
+            spare.push_back( std::vector<unsigned char>() );
+            spare.back().swap(bytes);
+            spare.back().clear();
+        }
+        else
+            std::vector<unsigned char>().swap(bytes);
+    }
+
+    void reader(const unsigned i)
+    {
+        name_trace_thread("reader", i);
+
+        std::unique_ptr<io_backend> backend = make_backend();
+        std::vector<io_job*> work;
+        std::vector<size_t> ids;
+
+        for (;;)
+        {
+            std::unique_lock<std::mutex> lock(m);
+            read_cv.wait(lock, [&]
+            {
+                return stopping or ( next_read < files.size() and
+                                     next_read < consumed + lookahead );
+            });
+
+            if (stopping)
+                return;
+
+            const size_t limit = std::min(files.size(), consumed + lookahead);
+
+            work.clear();
+            ids.clear();
+            while (next_read < limit and work.size() < read_batch)
+            {
+                const size_t i = next_read++;
+                if (state[i] != 0)      // left to the unpacker
+                    continue;
+
+                io_job* job = slots[i].get();
+                if ( not spare.empty() )
+                {
+                    job->bytes.swap(spare.back());
+                    spare.pop_back();
+                }
+                state[i] = 1;
+                work.push_back(job);
+                ids.push_back(i);
+            }
+
+            lock.unlock();
+            {
+                trace_scope scope("read");
+                backend->read(work);
+            }
+            lock.lock();
+
+            for (size_t k = 0; k < ids.size(); ++k)
+                state[ids[k]] = 2;
+            ready_cv.notify_all();
+        }
+    }
+
+    /**
+     * Lowest slot of an archive member still queued, or files.size().
+     */
+
+    size_t first_packed()
+    {
+        while (next_packed < packed.size() and state[packed[next_packed]] != 4)
+            ++next_packed;
+
+        return next_packed < packed.size() ? packed[next_packed] : files.size();
+    }
+
+    void unpacker()
+    {
+        using namespace boost::filesystem;
+
+        name_trace_thread("unpacker", 0);
+
+        for (;;)
+        {
+            std::unique_lock<std::mutex> lock(m);
+            read_cv.wait(lock, [&]
+            {
+                return stopping or first_packed() < files.size();
+            });
+
+            if (stopping)
+                return;
+
+            // Stream the archive of the lowest member still queued, and
+            // serve every queued member met on the way
+            const path a = archive_of( files[first_packed()] );
+
+            lock.unlock();
+            archive_stream in(a);
+            path member;
+
+            while ( in.is_open() and in.next(member) )
+            {
+                lock.lock();
+
+                if (stopping)
+                    return;
+
+                const auto it = index.find(member.string());
+                if (it == index.end() or state[it->second] != 4)
+                {
+                    lock.unlock();
+                    continue;
+                }
+
+                // Keep within the lookahead window, unless an earlier
+                // member, which the workers may be waiting for, is still
+                // queued: members are not always listed in archive order.
+                const size_t i = it->second;
+                read_cv.wait(lock, [&]
+                {
+                    return stopping or i < consumed + lookahead
+                           or first_packed() < i;
+                });
+
+                if (stopping)
+                    return;
+
+                io_job* job = slots[i].get();
+                if ( not spare.empty() )
+                {
+                    job->bytes.swap(spare.back());
+                    spare.pop_back();
+                }
+                state[i] = 1;
+
+                lock.unlock();
+                {
+                    trace_scope scope("unpack");
+                    job->ok = in.read(job->bytes);
+                }
+                lock.lock();
+
+                state[i] = 2;
+                ready_cv.notify_all();
+                lock.unlock();
+            }
+
+            // Members that were not found
+            lock.lock();
+            for (size_t k = next_packed; k < packed.size(); ++k)
+            {
+                const size_t i = packed[k];
+                if (state[i] == 4 and archive_of(files[i]) == a)
+                {
+                    slots[i]->ok = false;
+                    state[i] = 2;
+                }
+            }
+            ready_cv.notify_all();
+        }
+    }
+
+    /**
+     * Read source p on the spot.
+     */
+
+    bool read_source(const boost::filesystem::path& p, std::vector<unsigned char>& bytes)
+    {
+        trace_scope scope("read");
+
+        const boost::filesystem::path a = archive_of(p);
+
+        if (a.empty())
+            return read_file(p, bytes);
+
+        std::lock_guard<std::mutex> lock(cursor_m);
+
+        if (not cursor or cursor->archive() != a)
+            cursor.reset(new archive_stream(a));
+
+        return cursor->read(p, bytes);
+    }
+
+    void writer(const unsigned i)
+    {
+        name_trace_thread("writer", i);
+
+        std::unique_ptr<io_backend> backend = make_backend();
+        std::vector<io_job*> work;
+        output_batch outputs(durable);
+
+        for (;;)
+        {
+            std::unique_lock<std::mutex> lock(m);
+            write_cv.wait(lock, [&]
+            {
+                return stopping or not queue.empty();
+            });
+
+            if ( queue.empty() )    // stopping, and nothing left to write
+                return;
+
+            work.clear();
+            while ( not queue.empty() and work.size() < write_batch )
+            {
+                work.push_back(queue.front());
+                queue.pop_front();
+            }
+            in_flight += work.size();
+
+            lock.unlock();
+
+            {
+                trace_scope scope("write");
+                backend->write(work);
+            }
+
+            // Commit the whole batch at once
+            outputs.clear();
+            for (size_t k = 0; k < work.size(); ++k)
+                outputs.add(work[k]->final, work[k]->ok, work[k]->shared);
+            outputs.commit();
+
+            for (size_t k = 0; k < work.size(); ++k)
+            {
+                io_job* job = work[k];
+                job->ok = outputs.committed(k);
+
+                if (not job->ok)
+                {
+                    std::lock_guard<std::mutex> guard(console_mutex());
+                    std::clog << job->final << (job->shared ? " could not be cached\n"
+                                                            : " could not be written\n");
+                }
+            }
+
+            lock.lock();
+
+            for (size_t k = 0; k < work.size(); ++k)
+            {
+                io_job* job = work[k];
+                if (not job->ok and not job->shared)
+                    failed = true;
+                queued_bytes -= job->bytes.size();
+                recycle(job->bytes);
+                free_jobs.push_back(job);
+            }
+            in_flight -= work.size();
+
+            done_cv.notify_all();
+        }
+    }
+};
+
+
+io_stage::io_stage(const std::string& backend, const unsigned threads,
+                   const size_t lookahead, const bool durable)
+    : d_(new impl)
+{
+    using namespace std;
+
+    d_->name = backend;
+    if (d_->name == "auto")
+        d_->name = uring_supported() ? "uring" : "threads";
+    else if (d_->name == "uring" and not uring_supported())
+    {
+        clog << "io_uring is not available, using the threads backend\n";
+        d_->name = "threads";
+    }
+
+    d_->async = d_->name != "sync";
+    d_->durable = durable;
+    d_->next_read = d_->consumed = d_->next_packed = 0;
+    d_->unpacking = false;
+    d_->lookahead = max<size_t>(lookahead, 1);
+    d_->queued_bytes = d_->in_flight = 0;
+    d_->max_queued_bytes = 256 << 20;
+    d_->failed = d_->stopping = false;
+
+    if (not d_->async)
+        return;
+
+    // A ring takes whole batches of reads; blocking threads read one file
+    // at a time. Writes are always batched, to be committed together.
+    const unsigned n = d_->name == "uring" ? 1 : max(threads, 1u);
+    d_->read_batch = d_->name == "uring" ? 32 : 1;
+    d_->write_batch = 32;
+    d_->max_spare = d_->lookahead + n * (d_->read_batch + d_->write_batch);
+
+    for (unsigned i = 0; i < n; ++i)
+    {
+        d_->threads.push_back( thread(&impl::reader, d_.get(), i) );
+        d_->threads.push_back( thread(&impl::writer, d_.get(), i) );
+    }
+}
+
+
+io_stage::~io_stage()
+{
+    if (d_->async)
+    {
+        {
+            std::lock_guard<std::mutex> lock(d_->m);
+            d_->stopping = true;
+        }
+
+        d_->read_cv.notify_all();
+        d_->write_cv.notify_all();
+
+        for (size_t i = 0; i < d_->threads.size(); ++i)
+            d_->threads[i].join();
+    }
+}
+
+
+const char* io_stage::backend() const
+{
+    return d_->name.c_str();
+}
+
+
+void io_stage::prefetch(const std::vector<boost::filesystem::path>& files)
+{
+    if (not d_->async)
+        return;
+
+    std::lock_guard<std::mutex> lock(d_->m);
+
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const bool member = not archive_of(files[i]).empty();
+
+        if (member)
+            d_->packed.push_back( d_->files.size() );
+
+        d_->index[files[i].string()] = d_->files.size();
+        d_->files.push_back(files[i]);
+        d_->slots.push_back( std::unique_ptr<io_job>(new io_job) );
+        d_->slots.back()->p = files[i];
+        d_->slots.back()->ok = false;
+        d_->state.push_back(member ? 4 : 0);
+    }
+
+    if ( not d_->packed.empty() and not d_->unpacking )
+    {
+        d_->threads.push_back( std::thread(&impl::unpacker, d_.get()) );
+        d_->unpacking = true;
+    }
+
+    d_->read_cv.notify_all();
+}
+
+
+bool io_stage::fetch(const boost::filesystem::path& p, std::vector<unsigned char>& bytes)
+{
+    if (not d_->async)
+        return d_->read_source(p, bytes);
+
+    std::unique_lock<std::mutex> lock(d_->m);
+
+    const auto it = d_->index.find(p.string());
+    if (it == d_->index.end() or d_->state[it->second] == 3)
+    {
+        // Not prefetched (or fetched already): read it on the spot
+        lock.unlock();
+        return d_->read_source(p, bytes);
+    }
+
+    const size_t i = it->second;
+    if (d_->state[i] != 2)
+    {
+        // The worker stalls on the I/O stage
+        trace_scope scope("fetch wait");
+        d_->ready_cv.wait(lock, [&] { return d_->state[i] == 2; });
+    }
+
+    io_job* job = d_->slots[i].get();
+    const bool ok = job->ok;
+    bytes.swap(job->bytes);
+
+    d_->recycle(job->bytes);
+    d_->slots[i].reset();
+    d_->state[i] = 3;
+    ++d_->consumed;
+
+    d_->read_cv.notify_all();
+
+    return ok;
+}
+
+
+void io_stage::write(const boost::filesystem::path& p, std::vector<unsigned char>& bytes)
+{
+    queue(p, bytes, false);
+}
+
+
+void io_stage::store(const boost::filesystem::path& p, std::vector<unsigned char>& bytes)
+{
+    queue(p, bytes, true);
+}
+
+
+void io_stage::queue(const boost::filesystem::path& p, std::vector<unsigned char>& bytes,
+                     const bool shared)
+{
+    using namespace std;
+
+    if (not d_->async)
+    {
+        output_batch outputs(d_->durable);
+        {
+            trace_scope scope("write");
+            outputs.add( p, write_staged(staging_path(p), bytes, d_->durable), shared );
+        }
+
+        if (outputs.commit() != EXIT_SUCCESS)
+        {
+            {
+                lock_guard<mutex> guard(console_mutex());
+                clog << p << (shared ? " could not be cached\n" : " could not be written\n");
+            }
+
+            if (not shared)
+            {
+                lock_guard<mutex> lock(d_->m);
+                d_->failed = true;
+            }
+        }
+
+        bytes.clear();
+        return;
+    }
+
+    unique_lock<mutex> lock(d_->m);
+
+    // Back-pressure: do not let unwritten data pile up without bound
+    const auto room = [&]
+    {
+        return d_->queued_bytes < d_->max_queued_bytes or d_->queue.empty();
+    };
+
+    if ( not room() )
+    {
+        trace_scope scope("write wait");
+        d_->done_cv.wait(lock, room);
+    }
+
+    io_job* job;
+    if ( d_->free_jobs.empty() )
+    {
+        d_->jobs.push_back( unique_ptr<io_job>(new io_job) );
+        job = d_->jobs.back().get();
+    }
+    else
+    {
+        job = d_->free_jobs.back();
+        d_->free_jobs.pop_back();
+    }
+
+    job->p = staging_path(p);
+    job->final = p;
+    job->ok = false;
+    job->shared = shared;
+    job->bytes.swap(bytes);
+
+    if ( not d_->spare.empty() )
+    {
+        bytes.swap(d_->spare.back());
+        d_->spare.pop_back();
+    }
+    bytes.clear();
+
+    d_->queued_bytes += job->bytes.size();
+    d_->queue.push_back(job);
+
+    d_->write_cv.notify_one();
+}
+
+
+int io_stage::drain()
+{
+    trace_scope scope("drain");
+
+    std::unique_lock<std::mutex> lock(d_->m);
+
+    if (d_->async)
+        d_->done_cv.wait(lock, [&]
+        {
+            return d_->queue.empty() and d_->in_flight == 0;
+        });
+
+    const bool failed = d_->failed;
+    d_->failed = false;
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+
+/**
+ * Blocking whole-file read and write.
+ */
+
+bool read_file(const boost::filesystem::path& p, std::vector<unsigned char>& bytes);
+
+bool write_file(const boost::filesystem::path& p, const std::vector<unsigned char>& bytes);
+
+
+/**
+ * Asynchronous I/O stage
+ *
+ * Moves file system access off the compute workers. Source files are read
+ * ahead, in the order they will be processed, into memory buffers that
+ * the workers decode in place; encoded outputs are handed over as memory
+ * buffers and written in batches behind the workers' back, each batch
+ * being committed at once (see commit.hpp), so that an output exists
+ * under its final name only once it is complete. Buffers are exchanged
+ * by swapping vectors, so their capacity circulates between the workers
+ * and the stage instead of being reallocated for every file.
+ *
+ * Archive members (see sources.hpp) are unpacked by a thread of their
+ * own, streaming each archive once, in order, within the same lookahead
+ * window.
+ *
+ * Backends:
+ *
+ *      uring    Linux io_uring; one reader and one writer thread, each
+ *               driving its own ring with batches of vectored requests.
+ *      threads  Portable blocking I/O on a pool of reader and writer
+ *               threads.
+ *      sync     Blocking I/O on the calling thread (the legacy behaviour).
+ *      auto     uring if the kernel supports it, threads otherwise.
+ */
+
+class io_stage
+{
+public:
+
+    /**
+     * With durable == false outputs are committed by renaming only, and
+     * never synced to the storage device.
+     */
+
+    io_stage(const std::string& backend, const unsigned threads,
+             const size_t lookahead, const bool durable = true);
+
+    /**
+     * Waits for pending writes (see drain()) before stopping the stage.
+     */
+
+    ~io_stage();
+
+    /**
+     * Name of the backend actually in use.
+     */
+
+    const char* backend() const;
+
+    /**
+     * Start reading 'files', in order, no more than 'lookahead' files
+     * ahead of the fetch() calls.
+     */
+
+    void prefetch(const std::vector<boost::filesystem::path>& files);
+
+    /**
+     * Get the contents of 'p' into 'bytes', waiting for it if it is still
+     * being read. Files that were not prefetched are read on the spot.
+     * Returns false if the file could not be read.
+     */
+
+    bool fetch(const boost::filesystem::path& p, std::vector<unsigned char>& bytes);
+
+    /**
+     * Queue 'bytes' to be written to the output file 'p' (through its
+     * staging file). The contents of 'bytes' are taken over and replaced
+     * by an empty buffer with recycled capacity.
+     *
+     * Blocks only while the stage is holding too much unwritten data.
+     */
+
+    void write(const boost::filesystem::path& p, std::vector<unsigned char>& bytes);
+
+    /**
+     * Like write(), for an entry of a cache that concurrent runs share:
+     * another writer of the same entry may win the commit, and an entry
+     * that cannot be written is reported, but does not fail the run.
+     */
+
+    void store(const boost::filesystem::path& p, std::vector<unsigned char>& bytes);
+
+    /**
+     * Wait until every queued write has been committed. Returns
+     * EXIT_FAILURE if any output failed since the last call.
+     */
+
+    int drain();
+
+private:
+
+    io_stage(const io_stage&);          // non-copyable
+    io_stage& operator=(const io_stage&);
+
+    struct impl;
+    std::unique_ptr<impl> d_;
+
+    void queue(const boost::filesystem::path& p, std::vector<unsigned char>& bytes,
+               const bool shared);
+};
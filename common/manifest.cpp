@@ -0,0 +1,297 @@
+#include <ciso646>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "commit.hpp"
+#include "manifest.hpp"
+#include "shard.hpp"
+
+
+namespace
+{
+
+    const char* const result_names[] = { "done", "skipped", "failed" };
+
+    /**
+     * Contents of a manifest file.
+     */
+
+    struct manifest_data
+    {
+        std::string tool;
+        unsigned index,
+                 count;
+        bool ok;
+        double seconds;
+        std::vector< std::pair<std::string, int> > entries;
+    };
+
+    int read_manifest(const boost::filesystem::path& p, manifest_data& m)
+    {
+        using namespace std;
+
+        ifstream in( p.string().c_str() );
+        string line;
+
+        if ( not getline(in, line) or line != "mpeg7-manifest 1" )
+        {
+            clog << p << " is not a manifest\n";
+            return EXIT_FAILURE;
+        }
+
+        m.tool.clear();
+        m.index = 0;
+        m.count = 0;
+        m.ok = false;
+        m.seconds = 0;
+        m.entries.clear();
+
+        while ( getline(in, line) )
+        {
+            const size_t sp = line.find(' ');
+            const string key = line.substr(0, sp),
+                         value = sp == string::npos ? "" : line.substr(sp + 1);
+
+            int r = -1;
+            for (int k = 0; k < 3; ++k)
+                if (key == result_names[k])
+                    r = k;
+
+            if (r >= 0)
+                m.entries.push_back( make_pair(value, r) );
+            else if (key == "tool")
+                m.tool = value;
+            else if (key == "shard")
+            {
+                char rest;
+                if ( sscanf(value.c_str(), "%u/%u%c", &m.index, &m.count, &rest) != 2 )
+                    m.count = 0;
+            }
+            else if (key == "status")
+                m.ok = value == "ok";
+            else if (key == "seconds")
+                m.seconds = atof( value.c_str() );
+        }
+
+        if ( m.tool.empty() or m.count == 0 or m.index >= m.count )
+        {
+            clog << p << " is not a valid manifest\n";
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    int write_manifest(const boost::filesystem::path& p, manifest_data& m,
+                       const bool durable)
+    {
+        using namespace std;
+
+        sort( m.entries.begin(), m.entries.end() );
+
+        const boost::filesystem::path part_p = staging_path(p);
+        bool written;
+        {
+            ostringstream out;
+
+            out << "mpeg7-manifest 1\n"
+                   "tool " << m.tool << "\n"
+                   "shard " << m.index << '/' << m.count << "\n"
+                   "status " << (m.ok ? "ok" : "failed") << "\n"
+                   "seconds " << fixed << setprecision(3) << m.seconds << '\n';
+
+            for (size_t i = 0; i < m.entries.size(); ++i)
+                out << result_names[ m.entries[i].second ] << ' '
+                    << m.entries[i].first << '\n';
+
+            const string text = out.str();
+            written = write_staged( part_p, vector<unsigned char>(text.begin(), text.end()),
+                                    durable );
+        }
+
+        output_batch batch(durable);
+        batch.add(p, written);
+
+        if (batch.commit() != EXIT_SUCCESS)
+        {
+            clog << p << " could not be written\n";
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+}
+
+
+manifest::manifest(const std::string& tool, const unsigned index,
+                   const unsigned count, const boost::filesystem::path& root)
+    : tool_(tool), index_(index), count_(count), root_(root)
+{
+}
+
+
+void manifest::record(const boost::filesystem::path& f, const result r)
+{
+    const std::string key = relative_key(f, root_);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back( std::make_pair(key, r) );
+}
+
+
+int manifest::save(const boost::filesystem::path& p, const int run_status,
+                   const bool durable) const
+{
+    manifest_data m;
+    m.tool = tool_;
+    m.index = index_;
+    m.count = count_;
+    m.ok = run_status == EXIT_SUCCESS;
+    m.seconds = clock_.seconds();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < entries_.size(); ++i)
+            m.entries.push_back( std::make_pair( entries_[i].first,
+                                                 static_cast<int>(entries_[i].second) ) );
+    }
+
+    return write_manifest(p, m, durable);
+}
+
+
+int merge_manifests(const std::vector<boost::filesystem::path>& inputs,
+                    const boost::filesystem::path& out, const bool durable)
+{
+    using namespace std;
+
+    int status = EXIT_SUCCESS;
+
+    manifest_data merged;
+    merged.index = 0;
+    merged.count = 1;
+    merged.ok = true;
+    merged.seconds = 0;
+
+    vector<char> seen;
+    map<string, size_t> owner;
+    double busy = 0;
+
+    cout << "shard      sources       done    skipped     failed    seconds  status\n";
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        manifest_data m;
+        if (read_manifest(inputs[i], m) != EXIT_SUCCESS)
+        {
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        if (merged.tool.empty())
+        {
+            // Every shard must be given: a count beyond the manifests given
+            // is missing shards, whatever it is, and is not allocated for
+            if (m.count > inputs.size())
+            {
+                clog << inputs[i] << " is shard " << m.index << " of " << m.count
+                     << ", but only " << inputs.size() << " manifests are given\n";
+                status = EXIT_FAILURE;
+                continue;
+            }
+
+            merged.tool = m.tool;
+            seen.assign(m.count, 0);
+        }
+
+        if (m.tool != merged.tool or m.count != seen.size())
+        {
+            clog << inputs[i] << " belongs to another run (" << m.tool << ", "
+                 << m.count << " shards)\n";
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        if (seen[m.index])
+        {
+            clog << inputs[i] << ": shard " << m.index << '/' << m.count
+                 << " given twice\n";
+            status = EXIT_FAILURE;
+            continue;
+        }
+        seen[m.index] = 1;
+
+        size_t counts[3] = { 0, 0, 0 };
+        for (size_t k = 0; k < m.entries.size(); ++k)
+        {
+            ++counts[ m.entries[k].second ];
+
+            if ( not owner.insert( make_pair(m.entries[k].first, m.index) ).second )
+            {
+                clog << m.entries[k].first << " is listed by shards "
+                     << owner[ m.entries[k].first ] << " and " << m.index << '\n';
+                status = EXIT_FAILURE;
+            }
+            else
+                merged.entries.push_back(m.entries[k]);
+        }
+
+        merged.ok = merged.ok and m.ok and counts[manifest::failed] == 0;
+        merged.seconds = max(merged.seconds, m.seconds);
+        busy += m.seconds;
+
+        ostringstream shard;
+        shard << m.index << '/' << m.count;
+        cout << left << setw(8) << shard.str() << right
+             << setw(10) << m.entries.size()
+             << setw(11) << counts[manifest::done]
+             << setw(11) << counts[manifest::skipped]
+             << setw(11) << counts[manifest::failed]
+             << setw(11) << fixed << setprecision(1) << m.seconds
+             << "  " << (m.ok ? "ok" : "failed") << '\n';
+    }
+
+    for (size_t s = 0; s < seen.size(); ++s)
+        if (not seen[s])
+        {
+            clog << "shard " << s << '/' << seen.size() << " is missing\n";
+            status = EXIT_FAILURE;
+        }
+
+    if (status != EXIT_SUCCESS)
+        merged.ok = false;
+
+    size_t counts[3] = { 0, 0, 0 };
+    for (size_t k = 0; k < merged.entries.size(); ++k)
+        ++counts[ merged.entries[k].second ];
+
+    cout << left << setw(8) << "total" << right
+         << setw(10) << merged.entries.size()
+         << setw(11) << counts[manifest::done]
+         << setw(11) << counts[manifest::skipped]
+         << setw(11) << counts[manifest::failed]
+         << setw(11) << fixed << setprecision(1) << merged.seconds
+         << "  " << (merged.ok ? "ok" : "failed") << '\n';
+
+    // The slowest shard bounds the run; compare it to an even split
+    if (not seen.empty() and merged.seconds > 0)
+        cout << "balance " << setprecision(2)
+             << busy / seen.size() / merged.seconds << '\n';
+
+    if (merged.tool.empty())
+        return EXIT_FAILURE;
+
+    if (not merged.ok)
+        status = EXIT_FAILURE;
+
+    if ( not out.empty() and write_manifest(out, merged, durable) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    return status;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+#include "stopwatch.hpp"
+
+
+/**
+ * Run manifests
+ *
+ * A manifest lists what one run (or one shard of a run) did with each of
+ * its source files. It is a text file:
+ *
+ *      mpeg7-manifest 1
+ *      tool mpeg7contour
+ *      shard 2/8
+ *      status ok
+ *      seconds 12.531
+ *      done apple/apple-1.gif
+ *      skipped apple/apple-2.gif
+ *      failed bat/bat-1.gif
+ *      ...
+ *
+ * Sources are given relative to the source root (see shard.hpp), sorted.
+ * 'status' is "failed" if anything went wrong that cannot be tied to a
+ * source, such as an output that could not be committed.
+ *
+ * The manifests of the N shards of a run are merged into a single one
+ * (shard 0/1) by merge_manifests(), which also checks that no shard is
+ * missing; a manifest claiming more shards than there are manifests to
+ * merge is rejected as it is read.
+ */
+
+class manifest
+{
+public:
+
+    enum result { done, skipped, failed };
+
+    /**
+     * Manifest of shard 'index' of 'count' of a run of 'tool' over the
+     * sources under 'root'. Time is measured from construction on.
+     */
+
+    manifest(const std::string& tool, const unsigned index, const unsigned count,
+             const boost::filesystem::path& root);
+
+    /**
+     * Record what became of source f. May be called from any thread.
+     */
+
+    void record(const boost::filesystem::path& f, const result r);
+
+    /**
+     * Commit the manifest to p, with status "ok" if run_status is
+     * EXIT_SUCCESS. Returns EXIT_FAILURE if it could not be written.
+     */
+
+    int save(const boost::filesystem::path& p, const int run_status,
+             const bool durable) const;
+
+private:
+
+    std::string tool_;
+    unsigned index_,
+             count_;
+    boost::filesystem::path root_;
+    stopwatch clock_;
+
+    mutable std::mutex mutex_;
+    std::vector< std::pair<std::string, result> > entries_;
+};
+
+/**
+ * Merge the manifests of the shards of a run into 'out' (unless empty),
+ * and print per-shard and total statistics. Returns EXIT_FAILURE if the
+ * manifests do not belong to the same run, if a shard is missing or
+ * given twice, or if any shard failed.
+ */
+
+int merge_manifests(const std::vector<boost::filesystem::path>& inputs,
+                    const boost::filesystem::path& out, const bool durable);
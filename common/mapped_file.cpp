@@ -0,0 +1,111 @@
+#include <ciso646>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.hpp"
+
+
+mapped_file::mapped_file()
+    : data_(0), size_(0), open_(false)
+{
+}
+
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+
+bool mapped_file::open(const boost::filesystem::path& p)
+{
+    close();
+
+    // The view outlives the handles it was made from
+#if defined(_WIN32)
+    const HANDLE file = CreateFileW(p.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if ( not GetFileSizeEx(file, &size)
+         or ( sizeof(size_t) < sizeof(LONGLONG) and size.HighPart != 0 ) )
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    if (size.QuadPart > 0)
+    {
+        const HANDLE mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+        if (mapping != 0)
+        {
+            data_ = static_cast<const unsigned char*>( MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) );
+            CloseHandle(mapping);
+        }
+
+        if (data_ == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+    }
+
+    CloseHandle(file);
+    size_ = static_cast<size_t>(size.QuadPart);
+#else
+    const int fd = ::open(p.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    if (st.st_size > 0)
+    {
+        void* const m = mmap(0, static_cast<size_t>(st.st_size), PROT_READ,
+                             MAP_SHARED, fd, 0);
+        if (m == MAP_FAILED)
+        {
+            ::close(fd);
+            return false;
+        }
+        data_ = static_cast<const unsigned char*>(m);
+    }
+
+    ::close(fd);
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+
+    open_ = true;
+    return true;
+}
+
+
+void mapped_file::close()
+{
+    if (data_ != 0)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(data_);
+#else
+        munmap( const_cast<unsigned char*>(data_), size_ );
+#endif
+    }
+
+    data_ = 0;
+    size_ = 0;
+    open_ = false;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+
+/**
+ * Read-only memory map of a whole file
+ *
+ * The pages of the file are read in by the system as they are touched
+ * and shared by every process mapping it, so that a large file made to be
+ * used in place (an index, a cache) costs no parse and no copy to open.
+ * The file must not be truncated while it is mapped.
+ */
+
+class mapped_file
+{
+public:
+
+    mapped_file();
+    ~mapped_file();
+
+    /**
+     * Map the file 'p', unmapping the previous one. Returns false if it
+     * cannot be opened or mapped. An empty file maps to no data.
+     */
+
+    bool open(const boost::filesystem::path& p);
+
+    void close();
+
+    bool is_open() const { return open_; }
+
+    const unsigned char* data() const { return data_; }
+
+    size_t size() const { return size_; }
+
+private:
+
+    mapped_file(const mapped_file&);            // non-copyable
+    mapped_file& operator=(const mapped_file&);
+
+    const unsigned char* data_;
+    size_t size_;
+    bool open_;
+};
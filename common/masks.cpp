@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <ciso646>
+#include <cmath>
+
+#include "masks.hpp"
+
+
+namespace
+{
+
+    /**
+     * Narrow the span [lo, hi) of row y to the pixels whose centres lie in
+     * the half-plane a x + b y >= c.
+     */
+
+    void clip_row(const double a, const double b, const double c, const int y,
+                  const int cols, int& lo, int& hi)
+    {
+        const double r = c - b * y;     // a x >= r
+
+        if (a == 0)
+        {
+            if (r > 0)
+                hi = lo;
+            return;
+        }
+
+        // Clamped before conversion: the bound may be far off the image
+        const double t = std::max( -1.0, std::min(double(cols) + 1, r / a) );
+
+        if (a > 0)
+            lo = std::max( lo, static_cast<int>( std::ceil(t) ) );
+        else
+            hi = std::min( hi, static_cast<int>( std::floor(t) ) + 1 );
+    }
+
+    /**
+     * Mark in 'flags' the pixels of row 'row' (cols pixels of 'channels'
+     * values) that differ from the pixel 'bg'.
+     */
+
+    template <class T>
+    void mark_row(const T* row, const int cols, const int channels, const T* bg,
+                  unsigned char* flags)
+    {
+        if (channels == 1)
+        {
+            const T b = bg[0];
+            for (int x = 0; x < cols; ++x)
+                flags[x] = row[x] != b;
+        }
+
+        else
+        {
+            std::fill(flags, flags + cols, 0);
+            for (int k = 0; k < channels; ++k)
+            {
+                const T b = bg[k];
+                for (int x = 0; x < cols; ++x)
+                    flags[x] |= row[x * channels + k] != b;
+            }
+        }
+    }
+
+    template <class T>
+    void mark_rows(const cv::Mat& img, const cv::Scalar& background,
+                   std::vector<unsigned char>& flags)
+    {
+        const int channels = img.channels();
+
+        T bg[4];
+        for (int k = 0; k < 4; ++k)
+            bg[k] = cv::saturate_cast<T>(background[k]);
+
+        flags.resize( static_cast<size_t>(img.rows) * img.cols );
+        for (int y = 0; y < img.rows; ++y)
+            mark_row( img.ptr<T>(y), img.cols, channels, bg,
+                      &flags[ static_cast<size_t>(y) * img.cols ] );
+    }
+
+    template <class T>
+    void fill_rows(cv::Mat& img, const span_mask& m, const cv::Scalar& value)
+    {
+        const int channels = img.channels();
+
+        T v[4];
+        for (int k = 0; k < 4; ++k)
+            v[k] = cv::saturate_cast<T>(value[k]);
+
+        for (int y = 0; y < m.rows(); ++y)
+        {
+            if (m.end[y] <= m.begin[y])
+                continue;
+
+            T* const row = img.ptr<T>(y);
+
+            if (channels == 1)
+                std::fill(row + m.begin[y], row + m.end[y], v[0]);
+            else
+                for (int x = m.begin[y]; x < m.end[y]; ++x)
+                    for (int k = 0; k < channels; ++k)
+                        row[x * channels + k] = v[k];
+        }
+    }
+
+}
+
+
+void foreground_map::assign(const cv::Mat& img)
+{
+    using namespace std;
+
+    rows_ = img.rows;
+    cols_ = img.cols;
+    total_ = 0;
+    bounds_ = cv::Rect();
+    background_ = cv::Scalar();
+    counts_.assign( static_cast<size_t>(rows_) * (cols_ + 1), 0 );
+
+    if ( img.empty() )
+        return;
+
+    for (int k = 0; k < min(img.channels(), 4); ++k)
+        background_[k] = img.depth() == CV_16U ? img.ptr<ushort>(0)[k]
+                                               : img.ptr<uchar>(0)[k];
+
+    // The comparison first, over whole rows, then the running counts
+    if (img.depth() == CV_16U)
+        mark_rows<ushort>(img, background_, flags_);
+    else
+        mark_rows<uchar>(img, background_, flags_);
+
+    int x0 = cols_, y0 = rows_, x1 = -1, y1 = -1;
+
+    for (int y = 0; y < rows_; ++y)
+    {
+        const unsigned char* const f = &flags_[ static_cast<size_t>(y) * cols_ ];
+        int* const c = &counts_[ static_cast<size_t>(y) * (cols_ + 1) ];
+
+        for (int x = 0; x < cols_; ++x)
+            c[x + 1] = c[x] + f[x];
+
+        if (c[cols_] == 0)
+            continue;
+
+        total_ += c[cols_];
+        y0 = min(y0, y);
+        y1 = y;
+        x0 = min( x0, static_cast<int>( find(f, f + cols_, 1) - f ) );
+        for (int x = cols_ - 1; x > x1; --x)
+            if (f[x])
+            {
+                x1 = x;
+                break;
+            }
+    }
+
+    if (total_ > 0)
+        bounds_ = cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+}
+
+
+size_t foreground_map::covered(const span_mask& m) const
+{
+    size_t n = 0;
+
+    const int rows = std::min(rows_, m.rows());
+    for (int y = 0; y < rows; ++y)
+    {
+        const int b = std::max(m.begin[y], 0),
+                  e = std::min(m.end[y], cols_);
+        if (b < e)
+            n += count(y, e) - count(y, b);
+    }
+
+    return n;
+}
+
+
+void rectangle_spans(const int rows, const int cols, const cv::Rect& r,
+                     span_mask& m)
+{
+    using namespace std;
+
+    const int b = max(r.x, 0),
+              e = min(r.x + r.width, cols);
+
+    m.begin.assign(rows, 0);
+    m.end.assign(rows, 0);
+
+    for (int y = max(r.y, 0); y < min(r.y + r.height, rows); ++y)
+    {
+        m.begin[y] = b;
+        m.end[y] = e;
+    }
+}
+
+
+void half_plane_spans(const int rows, const int cols, const double a,
+                      const double b, const double c, span_mask& m)
+{
+    m.begin.resize(rows);
+    m.end.resize(rows);
+
+    for (int y = 0; y < rows; ++y)
+    {
+        int lo = 0, hi = cols;
+        clip_row(a, b, c, y, cols, lo, hi);
+        m.begin[y] = lo;
+        m.end[y] = hi;
+    }
+}
+
+
+void polygon_spans(const int rows, const int cols,
+                   const std::vector<cv::Point2d>& vertices, span_mask& m)
+{
+    using namespace std;
+
+    const size_t n = vertices.size();
+
+    // Orientation of the polygon, from its signed area
+    double area = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const cv::Point2d& p = vertices[i];
+        const cv::Point2d& q = vertices[(i + 1) % n];
+        area += p.x * q.y - q.x * p.y;
+    }
+
+    m.begin.assign(rows, 0);
+    m.end.assign(rows, 0);
+
+    if (n < 3 or area == 0)
+        return;
+
+    const double s = area > 0 ? 1 : -1;
+
+    // The inside of every edge is the half-plane to its left (or right)
+    for (int y = 0; y < rows; ++y)
+    {
+        int lo = 0, hi = cols;
+
+        for (size_t i = 0; i < n and lo < hi; ++i)
+        {
+            const cv::Point2d& p = vertices[i];
+            const cv::Point2d& q = vertices[(i + 1) % n];
+            const double dx = q.x - p.x,
+                         dy = q.y - p.y;
+
+            clip_row(-dy * s, dx * s, (dx * p.y - dy * p.x) * s, y, cols, lo, hi);
+        }
+
+        m.begin[y] = lo;
+        m.end[y] = hi;
+    }
+}
+
+
+void fill_spans(cv::Mat& img, const span_mask& m, const cv::Scalar& value)
+{
+    switch ( img.depth() )
+    {
+    case CV_8U:
+        fill_rows<uchar>(img, m, value);
+        break;
+
+    case CV_16U:
+        fill_rows<ushort>(img, m, value);
+        break;
+
+    default:
+        for (int y = 0; y < std::min(img.rows, m.rows()); ++y)
+            if (m.begin[y] < m.end[y])
+                img.row(y).colRange(m.begin[y], m.end[y]).setTo(value);
+        break;
+    }
+}
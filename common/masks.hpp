@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+
+/**
+ * Span masks
+ *
+ * A mask is kept as one span of columns per row, [begin, end), which is
+ * all a convex region needs: rectangles, half-planes and convex polygons
+ * are made directly as spans, without rasterizing anything, and both
+ * measuring and applying a mask run along contiguous pixels of each row.
+ *
+ * The pixels of the image that belong to the shape are counted once, into
+ * a foreground_map of per-row running counts, after which the number of
+ * shape pixels under any mask takes one subtraction per row. That is what
+ * lets the generators search for the mask size that hides a given share
+ * of the shape without touching the image again.
+ */
+
+struct span_mask
+{
+    std::vector<int> begin,     // first column covered, per row
+                     end;       // one past the last one (end <= begin: none)
+
+    int rows() const { return static_cast<int>( begin.size() ); }
+};
+
+/**
+ * Running counts of the shape pixels of an image, a row of cols + 1 per
+ * image row: count(y, x) is the number of shape pixels of row y before
+ * column x.
+ */
+
+class foreground_map
+{
+public:
+
+    foreground_map() : rows_(0), cols_(0), total_(0) {}
+
+    /**
+     * Count the pixels of 'img' (8 or 16 bit, up to 4 channels) that
+     * differ from the background, the value of its top-left pixel.
+     */
+
+    void assign(const cv::Mat& img);
+
+    int rows() const { return rows_; }
+
+    int cols() const { return cols_; }
+
+    int count(const int y, const int x) const
+    {
+        return counts_[ static_cast<size_t>(y) * (cols_ + 1) + x ];
+    }
+
+    /**
+     * Shape pixels of the whole image.
+     */
+
+    size_t total() const { return total_; }
+
+    /**
+     * Shape pixels under mask 'm'.
+     */
+
+    size_t covered(const span_mask& m) const;
+
+    /**
+     * Bounds of the shape pixels (empty if there are none).
+     */
+
+    cv::Rect bounds() const { return bounds_; }
+
+    cv::Scalar background() const { return background_; }
+
+private:
+
+    int rows_,
+        cols_;
+    std::vector<int> counts_;
+    std::vector<unsigned char> flags_;  // shape pixels of the image
+    size_t total_;
+    cv::Rect bounds_;
+    cv::Scalar background_;
+};
+
+/**
+ * Spans of the pixels of a rows x cols image inside 'r'.
+ */
+
+void rectangle_spans(const int rows, const int cols, const cv::Rect& r,
+                     span_mask& m);
+
+/**
+ * Spans of the pixels of a rows x cols image whose centres (x, y) lie in
+ * the half-plane a x + b y >= c.
+ */
+
+void half_plane_spans(const int rows, const int cols, const double a,
+                      const double b, const double c, span_mask& m);
+
+/**
+ * Spans of the pixels of a rows x cols image whose centres lie inside the
+ * convex polygon 'vertices', given in either order.
+ */
+
+void polygon_spans(const int rows, const int cols,
+                   const std::vector<cv::Point2d>& vertices, span_mask& m);
+
+/**
+ * Set the pixels of 'img' under mask 'm' to 'value'.
+ */
+
+void fill_spans(cv::Mat& img, const span_mask& m, const cv::Scalar& value);
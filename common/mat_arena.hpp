@@ -0,0 +1,56 @@
+#pragma once
+
+#include <ciso646>
+#include <cstddef>
+
+#include <opencv2/core/core.hpp>
+
+#include "arena.hpp"
+
+
+/**
+ * Matrix allocator backed by an arena
+ *
+ * Assign its address to 'cv::Mat::allocator' of an empty matrix and every
+ * subsequent create() on that matrix (including those made by OpenCV
+ * functions writing into it as an output array) takes its storage from the
+ * arena. Deallocation is a no-op; the memory is reclaimed all at once by
+ * arena::reset(), hence every matrix using the allocator must be released
+ * before the arena is reset.
+ */
+
+class mat_arena_allocator : public cv::MatAllocator
+{
+public:
+
+    explicit mat_arena_allocator(arena& heap)
+        : heap_(heap)
+    {
+    }
+
+    void allocate(int dims, const int* sizes, int type, int*& refcount,
+                  uchar*& datastart, uchar*& data, size_t* step)
+    {
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; --i)
+        {
+            step[i] = total;
+            total *= sizes[i];
+        }
+
+        datastart = data = static_cast<uchar*>( heap_.allocate(total, 16) );
+        refcount = static_cast<int*>( heap_.allocate(sizeof(int), sizeof(int)) );
+        *refcount = 1;
+    }
+
+    void deallocate(int* /*refcount*/, uchar* /*datastart*/, uchar* /*data*/)
+    {
+    }
+
+private:
+
+    mat_arena_allocator(const mat_arena_allocator&);    // non-copyable
+    mat_arena_allocator& operator=(const mat_arena_allocator&);
+
+    arena& heap_;
+};
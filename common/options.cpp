@@ -0,0 +1,145 @@
+#include <cerrno>
+#include <ciso646>
+#include <cstdlib>
+
+#include "options.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+
+namespace
+{
+
+    /**
+     * Parse 'value' as a whole number from 'low' to 'high' into n. Signs,
+     * blanks and trailing characters are rejected.
+     */
+
+    bool parse_count(const std::string& value, const unsigned long low,
+                     const unsigned long high, unsigned long& n)
+    {
+        if ( value.empty() or value[0] < '0' or value[0] > '9' )
+            return false;
+
+        char* end = 0;
+        errno = 0;
+        n = strtoul(value.c_str(), &end, 10);
+
+        return errno == 0 and *end == '\0' and n >= low and n <= high;
+    }
+
+}
+
+
+const char* const run_options_usage =
+    "  --jobs | -j <n>    Process <n> images concurrently, up to 4096 (0:\n"
+    "                     one per hardware thread; default: 1).\n"
+    "  --io <backend>     I/O backend: auto (default), uring (Linux only),\n"
+    "                     threads or sync (blocking, inline).\n"
+    "  --io-threads <n>   Readers and writers of the threads backend, 1 to\n"
+    "                     256 (default: 2 each).\n"
+    "  --lookahead <n>    Source files read ahead of the workers, 1 to\n"
+    "                     65536 (default: 64).\n"
+    "  --no-sync          Commit outputs without syncing them to the\n"
+    "                     storage device (faster, but a power loss may\n"
+    "                     leave empty files behind).\n"
+    "  --shard <i>/<n>    Process shard <i> of <n> (up to 65536) of the\n"
+    "                     sources only, so that <n> processes can share\n"
+    "                     a run.\n"
+    "  --manifest <file>  Write what became of each source to <file>.\n"
+    "  --trace <file>     Write the timeline of every thread to <file> at\n"
+    "                     exit, as Chrome trace JSON (chrome://tracing,\n"
+    "                     ui.perfetto.dev).\n"
+    "  --frame-cache <dir>\n"
+    "                     Keep the images mpeg7A, mpeg7D and mpeg7contour\n"
+    "                     decode in <dir>, and map them from there\n"
+    "                     instead of decoding their sources again.\n";
+
+
+bool parse_run_option(const int argc, const char* argv[], int& arg,
+                      run_options& opts, bool& bad)
+{
+    using namespace std;
+
+    const string opt = argv[arg];
+
+    if (opt == "--no-sync")
+    {
+        opts.durable = false;
+        return true;
+    }
+
+    if (arg + 1 >= argc)
+        return false;
+
+    const string value = argv[arg + 1];
+
+    unsigned long n;
+
+    if (opt == "-j" or opt == "--jobs")
+    {
+        if ( not parse_count(value, 0, 4096, n) )
+            bad = true;
+        else
+            opts.jobs = n == 0 ? default_jobs() : static_cast<unsigned>(n);
+    }
+
+    else if (opt == "--io")
+    {
+        if (value != "auto" and value != "uring" and value != "threads"
+            and value != "sync")
+            bad = true;
+        opts.io = value;
+    }
+
+    else if (opt == "--io-threads")
+    {
+        if ( not parse_count(value, 1, 256, n) )
+            bad = true;
+        else
+            opts.io_threads = static_cast<unsigned>(n);
+    }
+
+    else if (opt == "--lookahead")
+    {
+        if ( not parse_count(value, 1, 65536, n) )
+            bad = true;
+        else
+            opts.lookahead = static_cast<size_t>(n);
+    }
+
+    else if (opt == "--shard")
+    {
+        const size_t slash = value.find('/');
+        unsigned long i, count;
+
+        if ( slash == string::npos
+             or not parse_count(value.substr(0, slash), 0, 65535, i)
+             or not parse_count(value.substr(slash + 1), 1, 65536, count)
+             or i >= count )
+            bad = true;
+        else
+        {
+            opts.shard = static_cast<unsigned>(i);
+            opts.shards = static_cast<unsigned>(count);
+        }
+    }
+
+    else if (opt == "--manifest")
+        opts.manifest = value;
+
+    else if (opt == "--frame-cache")
+        opts.frames = value;
+
+    else if (opt == "--trace")
+    {
+        opts.trace = value;
+        start_trace(value);
+    }
+
+    else
+        return false;
+
+    arg += 1;
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+/**
+ * Options shared by every tool
+ */
+
+struct run_options
+{
+    unsigned    jobs;           // images processed concurrently
+    std::string io;             // I/O backend: auto, uring, threads or sync
+    unsigned    io_threads;     // readers/writers of the threads backend
+    size_t      lookahead;      // source files read ahead of the workers
+    bool        durable;        // sync committed outputs to the device
+    unsigned    shard,          // share of the sources processed: shard
+                shards;         // 'shard' of 'shards' (see shard.hpp)
+    std::string manifest;       // where to write the run manifest, if set
+    std::string trace;          // where to write the timeline (trace.hpp),
+                                // if set
+    std::string frames;         // decoded image cache directory
+                                // (frame_cache.hpp), if set
+
+    run_options()
+        : jobs(1), io("auto"), io_threads(2), lookahead(64), durable(true),
+          shard(0), shards(1)
+    {
+    }
+};
+
+/**
+ * If argv[arg] is one of the shared options, store it (and its value) in
+ * 'opts', advance 'arg' past its value and return true; otherwise return
+ * false leaving everything untouched. Sets 'bad' on a malformed value.
+ * --trace starts recording right away.
+ */
+
+bool parse_run_option(const int argc, const char* argv[], int& arg,
+                      run_options& opts, bool& bad);
+
+/**
+ * Usage text describing the shared options.
+ */
+
+extern const char* const run_options_usage;
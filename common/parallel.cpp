@@ -0,0 +1,86 @@
+#include <ciso646>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <thread>
+
+#include "parallel.hpp"
+#include "trace.hpp"
+
+
+std::mutex& console_mutex()
+{
+    static std::mutex m;
+    return m;
+}
+
+
+unsigned default_jobs()
+{
+    const unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+
+int parallel_for(const size_t count, const unsigned jobs,
+                 const std::function<int (size_t, unsigned)>& task)
+{
+    using namespace std;
+
+    atomic<size_t> next(0);
+    atomic<bool> failed(false);
+    exception_ptr error;
+    mutex error_mutex;
+
+    auto worker = [&](const unsigned w)
+    {
+        name_trace_thread("worker", w);
+
+        for (size_t i = next++; i < count; i = next++)
+        {
+            try
+            {
+                if ( task(i, w) != EXIT_SUCCESS )
+                    failed = true;
+            }
+
+            catch (...)
+            {
+                lock_guard<mutex> lock(error_mutex);
+                if (not error)
+                    error = current_exception();
+                failed = true;
+                next = count;           // stop handing out work
+            }
+        }
+    };
+
+    if (jobs <= 1)
+        worker(0);
+
+    else
+    {
+        vector<thread> pool;
+        for (unsigned w = 0; w < jobs; ++w)
+            pool.push_back( thread(worker, w) );
+        for (size_t w = 0; w < pool.size(); ++w)
+            pool[w].join();
+    }
+
+    if (error)
+        rethrow_exception(error);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+int parallel_for_each(const std::vector<boost::filesystem::path>& files,
+                      const unsigned jobs,
+                      const std::function<int (const boost::filesystem::path&,
+                                               unsigned)>& task)
+{
+    return parallel_for( files.size(), jobs, [&](const size_t i, const unsigned w)
+    {
+        return task(files[i], w);
+    } );
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+
+/**
+ * Worker pool helpers
+ */
+
+/**
+ * Lock to be held while writing to the console from a worker thread, so
+ * that the messages of concurrent workers do not interleave.
+ */
+
+std::mutex& console_mutex();
+
+/**
+ * Number of workers to use when none is requested: the amount of hardware
+ * threads, or 1 if it cannot be determined.
+ */
+
+unsigned default_jobs();
+
+/**
+ * Run 'task' once for every index in [0, count) on 'jobs' worker threads.
+ *
+ * Indices are handed out in order. The second argument of 'task' is the
+ * index of the worker running it, in [0, jobs), so that tasks can address
+ * per-worker state without locking. With jobs <= 1 everything runs on the
+ * calling thread.
+ *
+ * Returns EXIT_FAILURE if any task did; the first exception thrown by a
+ * task is rethrown on the calling thread once all workers have stopped.
+ */
+
+int parallel_for(const size_t count, const unsigned jobs,
+                 const std::function<int (size_t, unsigned)>& task);
+
+/**
+ * Run 'task' once for every file in 'files' on 'jobs' worker threads, as
+ * parallel_for() does.
+ */
+
+int parallel_for_each(const std::vector<boost::filesystem::path>& files,
+                      const unsigned jobs,
+                      const std::function<int (const boost::filesystem::path&,
+                                               unsigned)>& task);
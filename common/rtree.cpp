@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <ciso646>
+#include <cmath>
+
+#include "rtree.hpp"
+
+
+namespace
+{
+
+    /**
+     * Orders entries by the x (or y) of the centres of their boxes, kept
+     * doubled to stay in integers.
+     */
+
+    struct by_centre
+    {
+        const std::vector<bbox>& boxes;
+        const bool along_y;
+
+        by_centre(const std::vector<bbox>& boxes, const bool along_y)
+            : boxes(boxes), along_y(along_y)
+        {
+        }
+
+        long long centre(const size_t i) const
+        {
+            const bbox& b = boxes[i];
+            return along_y ? 2LL * b.y + b.height : 2LL * b.x + b.width;
+        }
+
+        bool operator()(const size_t a, const size_t b) const
+        {
+            return centre(a) < centre(b);
+        }
+    };
+
+    /**
+     * Smallest box holding both a and b.
+     */
+
+    bbox merge(const bbox& a, const bbox& b)
+    {
+        const int x = std::min(a.x, b.x),
+                  y = std::min(a.y, b.y);
+
+        return bbox( x, y, std::max(a.x + a.width, b.x + b.width) - x,
+                     std::max(a.y + a.height, b.y + b.height) - y );
+    }
+
+}
+
+
+const size_t packed_rtree::fanout;
+
+
+void packed_rtree::clear()
+{
+    boxes_.clear();
+    nodes_.clear();
+    order_.clear();
+    levels_.clear();
+}
+
+
+void packed_rtree::build()
+{
+    const size_t n = boxes_.size();
+
+    order_.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        order_[i] = i;
+
+    // Vertical slices of about sqrt(n / fanout) leaf nodes each, sorted
+    // by x, then every slice by y
+    const size_t leaves = (n + fanout - 1) / fanout,
+                 slices = static_cast<size_t>( std::ceil(std::sqrt(double(leaves))) ),
+                 slice = std::max<size_t>(slices, 1) * fanout;
+
+    std::sort( order_.begin(), order_.end(), by_centre(boxes_, false) );
+
+    for (size_t s = 0; s < n; s += slice)
+        std::sort( order_.begin() + s, order_.begin() + std::min(n, s + slice),
+                   by_centre(boxes_, true) );
+
+    nodes_.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        nodes_[i] = boxes_[order_[i]];
+
+    link();
+}
+
+
+bool packed_rtree::assign(const std::vector<bbox>& nodes,
+                          const std::vector<size_t>& order)
+{
+    const size_t n = order.size();
+
+    clear();
+
+    if (nodes.size() < n)
+        return false;
+
+    // Every entry exactly once
+    boxes_.resize(n);
+    std::vector<bool> seen(n, false);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (order[i] >= n or seen[order[i]])
+        {
+            clear();
+            return false;
+        }
+
+        seen[order[i]] = true;
+        boxes_[order[i]] = nodes[i];
+    }
+
+    // The levels above the leaves must be those the leaves make
+    order_ = order;
+    nodes_.assign(nodes.begin(), nodes.begin() + n);
+    link();
+
+    if (nodes_ != nodes)
+    {
+        clear();
+        return false;
+    }
+
+    return true;
+}
+
+
+void packed_rtree::link()
+{
+    levels_.assign(1, 0);
+
+    size_t first = 0,
+           count = nodes_.size();
+
+    while (count > 1)
+    {
+        for (size_t k = 0; k < count; k += fanout)
+        {
+            bbox b = nodes_[first + k];
+            for (size_t c = k + 1; c < std::min(count, k + fanout); ++c)
+                b = merge(b, nodes_[first + c]);
+            nodes_.push_back(b);
+        }
+
+        first += count;
+        count = nodes_.size() - first;
+        levels_.push_back(first);
+    }
+
+    levels_.push_back( nodes_.size() );
+}
+
+
+void packed_rtree::search(const bbox& region, std::vector<size_t>& found) const
+{
+    found.clear();
+
+    if ( nodes_.empty() )
+        return;
+
+    visit(levels_.size() - 2, 0, region, found);
+    std::sort( found.begin(), found.end() );
+}
+
+
+void packed_rtree::visit(const size_t level, const size_t k, const bbox& region,
+                         std::vector<size_t>& found) const
+{
+    if ( not nodes_[levels_[level] + k].intersects(region) )
+        return;
+
+    if (level == 0)
+    {
+        found.push_back(order_[k]);
+        return;
+    }
+
+    const size_t count = levels_[level] - levels_[level - 1];
+
+    for (size_t c = k * fanout; c < std::min(count, k * fanout + fanout); ++c)
+        visit(level - 1, c, region, found);
+}
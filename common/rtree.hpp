@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * Packed R-tree of bounding boxes
+ *
+ * A static R-tree built bottom-up by Sort-Tile-Recursive: the boxes are
+ * sorted into vertical slices by the x of their centres, each slice by
+ * the y, and every 'fanout' consecutive boxes become one node; the nodes
+ * are grouped the same way, level by level, up to a single root. Since
+ * every node but the last of a level is full, the tree needs no pointers:
+ * the children of node k are nodes k * fanout to k * fanout + fanout - 1
+ * of the level below. The whole tree is then two arrays, the boxes of
+ * every level, leaves first, and the entry each leaf stands for, which is
+ * also how CTX documents store it (see datasets/contour.xsd).
+ */
+
+/**
+ * Axis-aligned box of whole pixels: x to x + width - 1, y to y + height
+ * - 1, as cv::boundingRect gives it.
+ */
+
+struct bbox
+{
+    int x, y, width, height;
+
+    bbox() : x(0), y(0), width(0), height(0) {}
+
+    bbox(const int x, const int y, const int width, const int height)
+        : x(x), y(y), width(width), height(height)
+    {
+    }
+
+    bool intersects(const bbox& b) const
+    {
+        return x < b.x + b.width and b.x < x + width
+               and y < b.y + b.height and b.y < y + height;
+    }
+
+    bool contains(const int px, const int py) const
+    {
+        return px >= x and px < x + width and py >= y and py < y + height;
+    }
+
+    bool operator==(const bbox& b) const
+    {
+        return x == b.x and y == b.y and width == b.width and height == b.height;
+    }
+};
+
+class packed_rtree
+{
+public:
+
+    static const size_t fanout = 8;
+
+    /**
+     * Start a new tree; the storage of the previous one is kept.
+     */
+
+    void clear();
+
+    /**
+     * Add the box of the next entry, numbered from 0.
+     */
+
+    void add(const bbox& b) { boxes_.push_back(b); }
+
+    /**
+     * Build the tree over the entries added since clear().
+     */
+
+    void build();
+
+    /**
+     * Take the tree stored as 'nodes' and 'order' (see nodes() and
+     * order()). Returns false, leaving the tree empty, if they are not a
+     * packed R-tree of this fanout.
+     */
+
+    bool assign(const std::vector<bbox>& nodes, const std::vector<size_t>& order);
+
+    size_t size() const { return boxes_.size(); }
+
+    /**
+     * Box of entry i.
+     */
+
+    const bbox& box(const size_t i) const { return boxes_[i]; }
+
+    /**
+     * Boxes of every node, the leaves first and the root last, and the
+     * entry of each leaf.
+     */
+
+    const std::vector<bbox>& nodes() const { return nodes_; }
+
+    const std::vector<size_t>& order() const { return order_; }
+
+    /**
+     * Replace 'found' with the entries whose box meets 'region', in
+     * increasing order.
+     */
+
+    void search(const bbox& region, std::vector<size_t>& found) const;
+
+    /**
+     * Replace 'found' with the entries whose box contains the pixel
+     * (x, y), in increasing order.
+     */
+
+    void search(const int x, const int y, std::vector<size_t>& found) const
+    {
+        search(bbox(x, y, 1, 1), found);
+    }
+
+private:
+
+    /**
+     * Compute the levels above the leaves.
+     */
+
+    void link();
+
+    void visit(const size_t level, const size_t k, const bbox& region,
+               std::vector<size_t>& found) const;
+
+    std::vector<bbox>   boxes_;     // box of each entry
+    std::vector<bbox>   nodes_;     // every level, leaves first
+    std::vector<size_t> order_,     // entry of each leaf
+                        levels_;    // first node of each level, and the end
+};
@@ -0,0 +1,71 @@
+#include <ciso646>
+#include <algorithm>
+#include <cstdint>
+
+#include "shard.hpp"
+
+
+std::string relative_key(const boost::filesystem::path& f,
+                         const boost::filesystem::path& root)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    // Compare element-wise, ignoring the "." elements that "./src" or
+    // "src/" carry
+    vector<path> fe, re;
+    for (auto it = f.begin(); it != f.end(); ++it)
+        if (*it != ".")
+            fe.push_back(*it);
+    for (auto it = root.begin(); it != root.end(); ++it)
+        if (*it != ".")
+            re.push_back(*it);
+
+    if ( re.size() > fe.size() or not equal(re.begin(), re.end(), fe.begin()) )
+        return f.generic_string();
+
+    if (re.size() == fe.size())
+        return f.filename().generic_string();
+
+    path r;
+    for (size_t i = re.size(); i < fe.size(); ++i)
+        r /= fe[i];
+
+    return r.generic_string();
+}
+
+
+unsigned shard_of(const std::string& key, const unsigned count)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.size(); ++i)
+    {
+        h ^= static_cast<unsigned char>(key[i]);
+        h *= 1099511628211ULL;
+    }
+
+    // The low bits of an FNV hash only depend on the low bits of the key;
+    // mix the high bits down before reducing
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return count > 1 ? static_cast<unsigned>(h % count) : 0;
+}
+
+
+void select_shard(std::vector<boost::filesystem::path>& files,
+                  const boost::filesystem::path& root,
+                  const unsigned index, const unsigned count)
+{
+    if (count <= 1)
+        return;
+
+    size_t n = 0;
+    for (size_t i = 0; i < files.size(); ++i)
+        if (shard_of(relative_key(files[i], root), count) == index)
+            files[n++] = files[i];
+
+    files.resize(n);
+}
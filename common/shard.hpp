@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+
+/**
+ * Splitting a run across processes
+ *
+ * Every process of a sharded run walks the whole source tree, and keeps
+ * the files whose relative path hashes to its own shard. The hash (64-bit
+ * FNV-1a of the path relative to the source root, with '/' separators,
+ * followed by a final bit mix) depends on nothing but the path, so
+ * processes on different machines agree on the split without talking to
+ * each other.
+ */
+
+/**
+ * Path of f relative to 'root', in generic form ('/' separators). If f is
+ * root itself, its file name.
+ */
+
+std::string relative_key(const boost::filesystem::path& f,
+                         const boost::filesystem::path& root);
+
+/**
+ * Shard of 'key' among 'count' shards.
+ */
+
+unsigned shard_of(const std::string& key, const unsigned count);
+
+/**
+ * Keep the files of 'files' (found under 'root') that belong to shard
+ * 'index' of 'count'. Order is preserved.
+ */
+
+void select_shard(std::vector<boost::filesystem::path>& files,
+                  const boost::filesystem::path& root,
+                  const unsigned index, const unsigned count);
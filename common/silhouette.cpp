@@ -0,0 +1,480 @@
+#include <algorithm>
+#include <ciso646>
+#include <cmath>
+#include <iomanip>
+
+#include "chain_moments.hpp"
+#include "silhouette.hpp"
+
+
+namespace
+{
+
+    // Steps of the 8-connected Freeman chain code (see contour.xsd)
+    const int step_x[8] = { 1, 1, 0, -1, -1, -1,  0,  1 },
+              step_y[8] = { 0, 1, 1,  1,  0, -1, -1, -1 };
+
+    // Code of the step (dx, dy), at 3 (dy + 1) + dx + 1
+    const unsigned char step_code[9] = { 5, 6, 7, 4, 0, 0, 3, 2, 1 };
+
+    inline void set(cv::Mat& dst, const double x, const double y)
+    {
+        const double px = std::floor(x + 0.5),
+                     py = std::floor(y + 0.5);
+
+        if (px >= 0 and px < dst.cols and py >= 0 and py < dst.rows)
+            dst.ptr<uchar>( int(py) )[ int(px) ] = 255;
+    }
+
+    /**
+     * Set the pixels nearest to the points of the edge from a to b, one
+     * per unit step along its longer axis.
+     */
+
+    void draw_edge(const cv::Point2d& a, const cv::Point2d& b, cv::Mat& dst)
+    {
+        const double dx = b.x - a.x,
+                     dy = b.y - a.y;
+        const int n = static_cast<int>( std::ceil( std::max( std::fabs(dx), std::fabs(dy) ) ) );
+
+        set(dst, a.x, a.y);
+        for (int k = 1; k <= n; ++k)
+            set(dst, a.x + dx * k / n, a.y + dy * k / n);
+    }
+
+    /**
+     * Add the crossings of the edge from a to b with the rows of pixel
+     * centres in [0, rows): a row y crosses it if it lies in
+     * [min(a.y, b.y), max(a.y, b.y)), so that a path crosses each row an
+     * even number of times.
+     */
+
+    void cross_edge(const cv::Point2d& a, const cv::Point2d& b, const int rows,
+                    std::vector< std::pair<int, double> >& crossings)
+    {
+        using namespace std;
+
+        if (a.y == b.y)
+            return;
+
+        const double y0 = min(a.y, b.y),
+                     y1 = max(a.y, b.y),
+                     slope = (b.x - a.x) / (b.y - a.y);
+
+        const int first = max( static_cast<int>( ceil(y0) ), 0 ),
+                  last = min( static_cast<int>( ceil(y1) ) - 1, rows - 1 );
+
+        for (int y = first; y <= last; ++y)
+            crossings.push_back( make_pair( y, a.x + (y - a.y) * slope ) );
+    }
+
+    /**
+     * The vertices of the path of 'c', mapped by 'm'.
+     */
+
+    void map_path(const ctx_contour& c, const double* const m,
+                  std::vector<cv::Point2d>& polygon)
+    {
+        polygon.resize( c.chain.size() + 1 );
+
+        int x = c.x,
+            y = c.y;
+
+        for (size_t k = 0; ; ++k)
+        {
+            polygon[k] = cv::Point2d( m[0] * x + m[1] * y + m[2],
+                                      m[3] * x + m[4] * y + m[5] );
+            if (k == c.chain.size())
+                break;
+
+            x += step_x[ c.chain[k] & 7 ];
+            y += step_y[ c.chain[k] & 7 ];
+        }
+    }
+
+    /**
+     * Pixel nearest to (x, y), within a canvas of 'size'.
+     */
+
+    inline cv::Point nearest(const double x, const double y, const cv::Size& size)
+    {
+        using namespace std;
+
+        return cv::Point( min( max( static_cast<int>( floor(x + 0.5) ), 0 ), size.width - 1 ),
+                          min( max( static_cast<int>( floor(y + 0.5) ), 0 ), size.height - 1 ) );
+    }
+
+    /**
+     * Digitize the closed 'polygon' into 'points': the pixels nearest to
+     * points of its edges, one per unit step along their longer axis, so
+     * that consecutive pixels are 8-neighbours, each pixel once in a row.
+     */
+
+    void digitize_path(const std::vector<cv::Point2d>& polygon, const cv::Size& size,
+                       std::vector<cv::Point>& points)
+    {
+        using namespace std;
+
+        points.clear();
+        points.push_back( nearest(polygon[0].x, polygon[0].y, size) );
+
+        for (size_t k = 0; k < polygon.size(); ++k)
+        {
+            const cv::Point2d& a = polygon[k];
+            const cv::Point2d& b = polygon[ k + 1 < polygon.size() ? k + 1 : 0 ];
+
+            const double dx = b.x - a.x,
+                         dy = b.y - a.y;
+            const int n = static_cast<int>( ceil( max( fabs(dx), fabs(dy) ) ) );
+
+            for (int j = 1; j <= n; ++j)
+            {
+                const cv::Point p = nearest(a.x + dx * j / n, a.y + dy * j / n, size);
+                if (p != points.back())
+                    points.push_back(p);
+            }
+        }
+
+        // The path closes on its first pixel
+        while (points.size() > 1 and points.back() == points.front())
+            points.pop_back();
+    }
+
+    /**
+     * Moments of the contour of 's' of largest area.
+     */
+
+    bool largest_moments(const silhouette& s, cv::Moments& largest)
+    {
+        bool found = false;
+        cv::Moments m;
+
+        for (size_t i = 0; i < s.contours.size(); ++i)
+        {
+            const ctx_contour& c = s.contours[i];
+
+            if ( not chain_moments( c.x, c.y, c.chain.empty() ? 0 : &c.chain[0],
+                                    c.chain.size(), m ) )
+                continue;
+
+            if (not found or m.m00 > largest.m00)
+                largest = m, found = true;
+        }
+
+        return found;
+    }
+
+}
+
+
+bool read_silhouette(const char* text, const size_t size, silhouette& s,
+                     std::string& error)
+{
+    ctx_reader reader(text, size);
+
+    if ( not read_canvas(reader, s.width, s.height) )
+    {
+        error = reader.error().empty() ? "no canvas" : reader.error();
+        return false;
+    }
+
+    // Read into the contours of the previous silhouette, keeping their
+    // buffers
+    size_t n = 0;
+    for (;; ++n)
+    {
+        if (n == s.contours.size())
+            s.contours.resize(n + 1);
+
+        ctx_contour& c = s.contours[n];
+        if ( not read_contour(reader, c) )
+            break;
+
+        if (not c.has_chain)
+        {
+            error = "contour " + std::to_string(c.id) + " has no full path";
+            return false;
+        }
+    }
+
+    s.contours.resize(n);
+
+    error = reader.error();
+    return error.empty();
+}
+
+
+void make_silhouette(const std::vector< std::vector<cv::Point> >& contours,
+                     const std::vector<cv::Vec4i>& hierarchy,
+                     const long long width, const long long height,
+                     silhouette& s)
+{
+    s.width = width;
+    s.height = height;
+    s.contours.resize( contours.size() );
+
+    for (size_t i = 0; i < contours.size(); ++i)
+    {
+        const std::vector<cv::Point>& points = contours[i];
+        ctx_contour& c = s.contours[i];
+
+        c.id = i + 1;
+        c.parent = hierarchy[i][3] + 1;
+        c.has_spatial = c.has_bounds = false;
+        c.has_chain = true;
+        c.x = points.empty() ? 0 : points[0].x;
+        c.y = points.empty() ? 0 : points[0].y;
+
+        c.chain.clear();
+        for (size_t k = 1; k < points.size(); ++k)
+        {
+            const int dx = points[k].x - points[k - 1].x,
+                      dy = points[k].y - points[k - 1].y;
+            c.chain.push_back( step_code[ 3 * (dy + 1) + dx + 1 ] );
+        }
+    }
+}
+
+
+void draw_silhouette(const silhouette& s, const affine_map& forward,
+                     cv::Mat& dst, fill_scratch& scratch)
+{
+    using namespace std;
+
+    const double* const m = forward.m;
+
+    vector<cv::Point2d>& polygon = scratch.polygon;
+    vector< pair<int, double> >& crossings = scratch.crossings;
+
+    crossings.clear();
+
+    for (size_t i = 0; i < s.contours.size(); ++i)
+    {
+        const ctx_contour& c = s.contours[i];
+
+        map_path(c, m, polygon);
+
+        // The edges, closing the path, and where they cross the rows
+        for (size_t k = 0; k < polygon.size(); ++k)
+        {
+            const cv::Point2d& a = polygon[k];
+            const cv::Point2d& b = polygon[ k + 1 < polygon.size() ? k + 1 : 0 ];
+
+            draw_edge(a, b, dst);
+            cross_edge(a, b, dst.rows, crossings);
+        }
+    }
+
+    // The pixel centres between the first and second crossing of each row,
+    // the third and fourth...
+    sort( crossings.begin(), crossings.end() );
+
+    for (size_t k = 0; k + 1 < crossings.size(); )
+    {
+        if (crossings[k].first != crossings[k + 1].first)
+        {
+            ++k;
+            continue;
+        }
+
+        const int begin = max( static_cast<int>( ceil(crossings[k].second) ), 0 ),
+                  end = min( static_cast<int>( floor(crossings[k + 1].second) ), dst.cols - 1 );
+
+        uchar* row = dst.ptr<uchar>(crossings[k].first);
+        for (int px = begin; px <= end; ++px)
+            row[px] = 255;
+
+        k += 2;
+    }
+}
+
+
+void map_silhouette(const silhouette& s, const affine_map& forward,
+                    const cv::Size& size,
+                    std::vector< std::vector<cv::Point> >& contours,
+                    std::vector<cv::Vec4i>& hierarchy,
+                    std::vector<contour_shape>& shapes, fill_scratch& scratch)
+{
+    using namespace std;
+
+    // Contours come after the one holding them, as cv::findContours and
+    // write_contour order them
+    const int unseen = -1,
+              dropped = -2;
+
+    const long long n = static_cast<long long>( s.contours.size() );
+
+    vector<cv::Point2d>& polygon = scratch.polygon;
+    vector<int>& index = scratch.index;     // contour made of each id
+    vector<int>& last = scratch.last;       // last child of each made
+
+    index.assign(n + 1, unseen);
+    last.clear();
+
+    // Keep the inner vectors, and their capacity
+    contours.resize(n);
+    hierarchy.clear();
+    shapes.clear();
+
+    int top = -1;       // last outer contour
+    int made = 0;
+
+    for (long long i = 0; i < n; ++i)
+    {
+        const ctx_contour& c = s.contours[i];
+        const bool known = c.id > 0 and c.id <= n;
+
+        int parent = -1;
+        if (c.parent > 0 and c.parent <= n)
+            parent = index[c.parent];
+
+        if (parent == dropped)
+        {
+            if (known)
+                index[c.id] = dropped;
+            continue;
+        }
+
+        map_path(c, forward.m, polygon);
+
+        contour_shape shape;
+        polygon_moments(&polygon[0], polygon.size(), shape.moments);
+
+        // A hole of less than a pixel leaves no background pixel
+        if (c.parent != 0 and shape.moments.m00 < 1)
+        {
+            if (known)
+                index[c.id] = dropped;
+            continue;
+        }
+
+        for (size_t k = 0; k < polygon.size(); ++k)
+        {
+            const cv::Point2d d = polygon[ k + 1 < polygon.size() ? k + 1 : 0 ] - polygon[k];
+            shape.perimeter += sqrt(d.x * d.x + d.y * d.y);
+        }
+
+        digitize_path(polygon, size, contours[made]);
+        shapes.push_back(shape);
+
+        // Link it after the last contour of the same parent
+        int& previous = parent >= 0 ? last[parent] : top;
+
+        hierarchy.push_back( cv::Vec4i(-1, previous, -1, parent) );
+        if (previous >= 0)
+            hierarchy[previous][0] = made;
+        else if (parent >= 0)
+            hierarchy[parent][2] = made;
+
+        previous = made;
+        last.push_back(-1);
+
+        if (known)
+            index[c.id] = made;
+        ++made;
+    }
+
+    contours.resize(made);
+}
+
+
+divergence compare_silhouettes(const silhouette& v, const silhouette& r,
+                               fill_scratch& scratch)
+{
+    using namespace std;
+
+    const affine_map identity = {{ 1, 0, 0, 0, 1, 0 }};
+
+    const int width = static_cast<int>( max(v.width, r.width) ),
+              height = static_cast<int>( max(v.height, r.height) );
+
+    divergence d;
+    d.contours = static_cast<int>( v.contours.size() ) - static_cast<int>( r.contours.size() );
+
+    if (width <= 0 or height <= 0)
+        return d;
+
+    cv::Mat a = cv::Mat::zeros(height, width, CV_8U),
+            b = cv::Mat::zeros(height, width, CV_8U);
+
+    draw_silhouette(v, identity, a, scratch);
+    draw_silhouette(r, identity, b, scratch);
+
+    size_t in_v = 0, in_r = 0, both = 0, either = 0;
+
+    for (int y = 0; y < height; ++y)
+    {
+        const uchar* p = a.ptr<uchar>(y);
+        const uchar* q = b.ptr<uchar>(y);
+
+        for (int x = 0; x < width; ++x)
+        {
+            in_v += p[x] != 0;
+            in_r += q[x] != 0;
+            both += p[x] != 0 and q[x] != 0;
+            either += p[x] != 0 or q[x] != 0;
+        }
+    }
+
+    d.overlap = either > 0 ? double(both) / either : 1;
+    d.area = in_r > 0 ? (double(in_v) - double(in_r)) / in_r : in_v > 0 ? 1 : 0;
+
+    cv::Moments mv, mr;
+    if ( largest_moments(v, mv) and largest_moments(r, mr) )
+    {
+        const double nv[7] = { mv.nu20, mv.nu11, mv.nu02, mv.nu30, mv.nu21, mv.nu12, mv.nu03 },
+                     nr[7] = { mr.nu20, mr.nu11, mr.nu02, mr.nu30, mr.nu21, mr.nu12, mr.nu03 };
+
+        for (int k = 0; k < 7; ++k)
+            d.moments = max( d.moments, fabs(nv[k] - nr[k]) );
+    }
+
+    return d;
+}
+
+
+void divergence_report::add(const std::string& kind, const divergence& d)
+{
+    using namespace std;
+
+    lock_guard<mutex> lock(mutex_);
+
+    totals& t = kinds_[kind];
+    ++t.count;
+    t.contours += d.contours != 0;
+    t.overlap += d.overlap;
+    t.worst_overlap = min(t.worst_overlap, d.overlap);
+    t.area = max( t.area, fabs(d.area) );
+    t.moments = max(t.moments, d.moments);
+}
+
+
+void divergence_report::print(std::ostream& out) const
+{
+    using namespace std;
+
+    lock_guard<mutex> lock(mutex_);
+
+    out << "\n  Vector vs raster   shapes   overlap mean   worst   area worst   moments worst   contour counts differ\n";
+
+    for (map<string, totals>::const_iterator k = kinds_.begin(); k != kinds_.end(); ++k)
+    {
+        const totals& t = k->second;
+
+        out << "  " << left << setw(17) << k->first << right << setw(8) << t.count
+            << fixed << setprecision(4)
+            << setw(15) << t.overlap / t.count << setw(8) << t.worst_overlap
+            << setw(12) << 100 * t.area << '%'
+            << scientific << setprecision(2) << setw(16) << t.moments
+            << setw(24) << t.contours << '\n';
+    }
+
+    out.unsetf(ios::floatfield);
+}
+
+
+bool divergence_report::empty() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return kinds_.empty();
+}
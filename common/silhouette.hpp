@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "ctx.hpp"
+#include "warp.hpp"
+
+
+/**
+ * Silhouettes in the vector domain
+ *
+ * A CTX file holds the whole silhouette of its image: the full paths of
+ * the outer contours and of the holes, through the centres of boundary
+ * pixels. Drawing them back, the pixels inside an odd number of paths or
+ * on one of them, gives the binary image they were traced from, so that an
+ * affine transform of the image can be had from its contour file alone:
+ * map the vertices of the paths, then digitize the mapped paths again.
+ *
+ * map_silhouette() digitizes every mapped path on its own, straight into
+ * a chain: the pixels nearest to points of its edges, one per unit step
+ * along each edge, make an 8-connected path, kept in the hierarchy of the
+ * source. The moments and perimeter of each contour are those of the
+ * mapped polygon, from its vertices by Green's theorem, rather than those
+ * of its new chain. No image is drawn or traced.
+ *
+ * draw_silhouette() draws the mapped silhouette instead, for comparisons:
+ * a pixel is set if its centre lies inside an odd number of mapped paths,
+ * or if it is the pixel nearest to a point of one of their edges, so that
+ * thin parts, whose paths enclose no area, are kept. The identity gives
+ * back the pixels traced.
+ */
+
+/**
+ * Canvas and contours of a CTX file.
+ */
+
+struct silhouette
+{
+    long long width,
+              height;
+    std::vector<ctx_contour> contours;
+
+    silhouette() : width(0), height(0) {}
+};
+
+/**
+ * Read the silhouette of the CTX document in [text, text + size) into
+ * 's'. Returns false, with the reason in 'error', if the document is
+ * malformed or one of its contours has no full path.
+ */
+
+bool read_silhouette(const char* text, const size_t size, silhouette& s,
+                     std::string& error);
+
+/**
+ * The silhouette of 'contours' (in the order and with the hierarchy of
+ * cv::findContours), on a canvas of 'width' x 'height'.
+ */
+
+void make_silhouette(const std::vector< std::vector<cv::Point> >& contours,
+                     const std::vector<cv::Vec4i>& hierarchy,
+                     const long long width, const long long height,
+                     silhouette& s);
+
+/**
+ * Working storage of draw_silhouette() and map_silhouette(), reused across
+ * calls.
+ */
+
+struct fill_scratch
+{
+    std::vector<cv::Point2d> polygon;                   // mapped path
+    std::vector< std::pair<int, double> > crossings;    // row, x
+    std::vector<int> index,                             // contour made of
+                                                        // each id
+                     last;                              // last child of
+                                                        // each one made
+};
+
+/**
+ * Moments and perimeter of a contour, known otherwise than from its path.
+ */
+
+struct contour_shape
+{
+    cv::Moments moments;
+    double perimeter;
+
+    contour_shape() : perimeter(0) {}
+};
+
+/**
+ * Map the silhouette 's' by 'forward' onto a canvas of 'size', digitizing
+ * every path into 'contours' (clamped to the canvas), with 'hierarchy' as
+ * cv::findContours gives it, and the moments and perimeter of every
+ * mapped path into 'shapes'. Holes mapped to less than a pixel of area
+ * are dropped, with the contours they hold.
+ */
+
+void map_silhouette(const silhouette& s, const affine_map& forward,
+                    const cv::Size& size,
+                    std::vector< std::vector<cv::Point> >& contours,
+                    std::vector<cv::Vec4i>& hierarchy,
+                    std::vector<contour_shape>& shapes, fill_scratch& scratch);
+
+/**
+ * Set to 255 the pixels of the CV_8UC1 image 'dst' within the silhouette
+ * 's' mapped by 'forward' (from the coordinates of 's' to those of
+ * 'dst'), leaving the others as they are.
+ */
+
+void draw_silhouette(const silhouette& s, const affine_map& forward,
+                     cv::Mat& dst, fill_scratch& scratch);
+
+/**
+ * How far a silhouette made in the vector domain is from the one traced
+ * from a raster image.
+ */
+
+struct divergence
+{
+    double overlap,     // pixels in both over pixels in either
+           area,        // relative difference of the pixel counts
+           moments;     // largest difference of the normalised central
+                        // moments of the largest contours
+    int contours;       // difference of the contour counts
+
+    divergence() : overlap(1), area(0), moments(0), contours(0) {}
+};
+
+/**
+ * Compare silhouette 'v' with the reference 'r'.
+ */
+
+divergence compare_silhouettes(const silhouette& v, const silhouette& r,
+                               fill_scratch& scratch);
+
+/**
+ * Divergences gathered by kind of transform, from any thread.
+ */
+
+class divergence_report
+{
+public:
+
+    void add(const std::string& kind, const divergence& d);
+
+    /**
+     * One line per kind: count, mean and worst overlap, worst area and
+     * moment differences, and how many differ in their contour count.
+     */
+
+    void print(std::ostream& out) const;
+
+    bool empty() const;
+
+private:
+
+    struct totals
+    {
+        size_t count,
+               contours;
+        double overlap,
+               worst_overlap,
+               area,
+               moments;
+
+        totals()
+            : count(0), contours(0), overlap(0), worst_overlap(1), area(0),
+              moments(0)
+        {
+        }
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::string, totals> kinds_;
+};
@@ -0,0 +1,397 @@
+#include <ciso646>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+#if defined(MPEG7_HAVE_LIBARCHIVE)
+#include <archive.h>
+#include <archive_entry.h>
+#endif
+
+#include "sources.hpp"
+
+
+namespace
+{
+
+    /**
+     * Whether 'name' ends with 'suffix' (in lower case), ignoring case.
+     */
+
+    bool ends_with(const std::string& name, const char* suffix)
+    {
+        const std::string s = suffix;
+
+        if (name.size() < s.size())
+            return false;
+
+        for (size_t i = 0; i < s.size(); ++i)
+            if ( std::tolower( static_cast<unsigned char>(name[name.size() - s.size() + i]) ) != s[i] )
+                return false;
+
+        return true;
+    }
+
+    bool has_archive_name(const boost::filesystem::path& p)
+    {
+        static const char* const suffixes[] = {
+            ".zip", ".rar", ".7z", ".tar", ".tgz", ".tbz2", ".txz",
+            ".tar.gz", ".tar.bz2", ".tar.xz"
+        };
+
+        const std::string name = p.filename().string();
+
+        for (size_t i = 0; i < sizeof suffixes / sizeof *suffixes; ++i)
+            if (ends_with(name, suffixes[i]))
+                return true;
+
+        return false;
+    }
+
+    int collect_archive(const boost::filesystem::path& p,
+                        std::vector<boost::filesystem::path>& files)
+    {
+        using namespace boost::filesystem;
+        using namespace std;
+
+        archive_stream in(p);
+
+        if (not in.is_open())
+        {
+            clog << p << " could not be opened as an archive\n";
+            return EXIT_FAILURE;
+        }
+
+        path member;
+        while (in.next(member))
+            files.push_back(member);
+
+        return EXIT_SUCCESS;
+    }
+
+}
+
+
+bool archives_supported()
+{
+#if defined(MPEG7_HAVE_LIBARCHIVE)
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool is_archive(const boost::filesystem::path& p)
+{
+    return archives_supported() and has_archive_name(p);
+}
+
+
+boost::filesystem::path archive_of(const boost::filesystem::path& p)
+{
+    if (not archives_supported())
+        return boost::filesystem::path();
+
+    // A directory named like an archive is just a directory
+    for (boost::filesystem::path a = p.parent_path(); not a.empty(); a = a.parent_path())
+    {
+        boost::system::error_code ec;
+        if ( has_archive_name(a) and is_regular_file(a, ec) )
+            return a;
+    }
+
+    return boost::filesystem::path();
+}
+
+
+int collect_sources(const boost::filesystem::path& p,
+                    std::vector<boost::filesystem::path>& files)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    int status = EXIT_SUCCESS;
+
+    if ( exists(p) )    // does p actually exist?
+    {
+        if ( is_regular_file(p) )     // is p a regular file?
+        {
+            if ( is_archive(p) )
+                return collect_archive(p, files);
+
+            files.push_back(p);
+        }
+
+        else if ( is_directory(p) )   // is p a directory?
+        {
+            for ( auto it = directory_iterator(p);   // iterate through directory
+                  it != directory_iterator(); ++it )
+            {
+                if ( is_regular_file(*it) and not is_archive(*it) )   // is *it a regular file?
+                {
+                    files.push_back(*it);
+                }
+
+                else if ( is_regular_file(*it) or is_directory(*it) )   // an archive or a directory
+                {
+                    if (collect_sources(*it, files) != EXIT_SUCCESS)
+                        status = EXIT_FAILURE;
+                }
+
+                else    // *it is neither a regular file nor a directory!
+                {
+                    clog << *it << " exists, but is neither a regular file nor a directory\n";
+                    status = EXIT_FAILURE;
+                }
+            }
+        }
+
+        else    // p is neither a regular file nor a directory!
+        {
+            clog << p << " exists, but is neither a regular file nor a directory\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    else    // p does not exists!
+    {
+        clog << p << " does not exist\n";
+        return EXIT_FAILURE;
+    }
+
+    return status;
+}
+
+
+std::string source_stamp(const boost::filesystem::path& p)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    // Archive members change with their archive
+    const path archive = archive_of(p);
+    const path& f = archive.empty() ? p : archive;
+
+    boost::system::error_code ec;
+    const boost::uintmax_t size = file_size(f, ec);
+    if (ec)
+        return string();
+
+    const time_t time = last_write_time(f, ec);
+    if (ec)
+        return string();
+
+    ostringstream s;
+    s << absolute(p).generic_string() << '\n'
+      << size << ' ' << static_cast<long long>(time);
+    return s.str();
+}
+
+
+void unique_sources(std::vector<boost::filesystem::path>& files,
+                    const std::function<std::string (const boost::filesystem::path&)>& key)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    vector<path> sorted(files);
+    sort(sorted.begin(), sorted.end());
+
+    set<string> keys;
+    set<path> kept;
+    for (size_t i = 0; i < sorted.size(); ++i)
+        if ( keys.insert( key(sorted[i]) ).second )
+            kept.insert(sorted[i]);
+
+    size_t n = 0;
+    for (size_t i = 0; i < files.size(); ++i)
+        if ( kept.erase(files[i]) )     // once, should a file be listed twice
+            files[n++] = files[i];
+
+    files.resize(n);
+}
+
+
+#if defined(MPEG7_HAVE_LIBARCHIVE)
+
+struct archive_stream::impl
+{
+    struct archive* a;
+    boost::filesystem::path member;     // current member
+    bool data_read;                     // its contents have been read
+
+    impl() : a(0), data_read(false) {}
+
+    ~impl() { close(); }
+
+    bool open(const boost::filesystem::path& p)
+    {
+        close();
+
+        a = archive_read_new();
+        archive_read_support_filter_all(a);
+        archive_read_support_format_all(a);
+
+        if (archive_read_open_filename(a, p.string().c_str(), 1 << 16) != ARCHIVE_OK)
+        {
+            close();
+            return false;
+        }
+
+        member.clear();
+        return true;
+    }
+
+    void close()
+    {
+        if (a)
+            archive_read_free(a);
+        a = 0;
+    }
+};
+
+
+archive_stream::archive_stream(const boost::filesystem::path& archive)
+    : archive_(archive), d_(new impl)
+{
+    d_->open(archive);
+}
+
+
+archive_stream::~archive_stream()
+{
+}
+
+
+bool archive_stream::is_open() const
+{
+    return d_->a != 0;
+}
+
+
+bool archive_stream::next(boost::filesystem::path& member)
+{
+    if (not d_->a)
+        return false;
+
+    struct archive_entry* e;
+    int r;
+
+    while ( (r = archive_read_next_header(d_->a, &e)) == ARCHIVE_OK
+            or r == ARCHIVE_WARN )
+    {
+        if (archive_entry_filetype(e) != AE_IFREG)
+            continue;
+
+        d_->member = archive_ / archive_entry_pathname(e);
+        d_->data_read = false;
+        member = d_->member;
+        return true;
+    }
+
+    d_->member.clear();
+    return false;
+}
+
+
+bool archive_stream::read(std::vector<unsigned char>& bytes)
+{
+    if (not d_->a or d_->member.empty() or d_->data_read)
+        return false;
+
+    d_->data_read = true;
+    bytes.clear();
+
+    // Members whose size is unknown (streamed tar entries, for instance)
+    // are read in growing chunks
+    size_t chunk = 1 << 16;
+    for (;;)
+    {
+        const size_t at = bytes.size();
+        bytes.resize(at + chunk);
+
+        const la_ssize_t n = archive_read_data(d_->a, &bytes[at], chunk);
+        if (n < 0)
+        {
+            bytes.clear();
+            return false;
+        }
+
+        bytes.resize(at + static_cast<size_t>(n));
+        if (n == 0)
+            return true;
+
+        chunk = std::min<size_t>(chunk * 2, 1 << 22);
+    }
+}
+
+
+bool archive_stream::read(const boost::filesystem::path& member,
+                          std::vector<unsigned char>& bytes)
+{
+    if (d_->member == member and not d_->data_read)
+        return read(bytes);
+
+    boost::filesystem::path m;
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        while (next(m))
+            if (m == member)
+                return read(bytes);
+
+        // Not found after the current member: start over
+        if ( not d_->open(archive_) )
+            return false;
+    }
+
+    return false;
+}
+
+#else   // MPEG7_HAVE_LIBARCHIVE
+
+struct archive_stream::impl
+{
+};
+
+
+archive_stream::archive_stream(const boost::filesystem::path& archive)
+    : archive_(archive), d_(new impl)
+{
+}
+
+
+archive_stream::~archive_stream()
+{
+}
+
+
+bool archive_stream::is_open() const
+{
+    return false;
+}
+
+
+bool archive_stream::next(boost::filesystem::path&)
+{
+    return false;
+}
+
+
+bool archive_stream::read(std::vector<unsigned char>&)
+{
+    return false;
+}
+
+
+bool archive_stream::read(const boost::filesystem::path&, std::vector<unsigned char>&)
+{
+    return false;
+}
+
+#endif  // MPEG7_HAVE_LIBARCHIVE
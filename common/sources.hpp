@@ -0,0 +1,125 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+
+/**
+ * Input sources
+ *
+ * Source files are found in directory trees and, when the tools are built
+ * with libarchive (MPEG7_HAVE_LIBARCHIVE), inside archives: ZIP, RAR, 7z
+ * and tar files, compressed or not, such as the ones in datasets/. The
+ * member of an archive is named by the path of the archive followed by
+ * its path within the archive, e.g.
+ *
+ *      datasets/mpeg7shapeA-PNG.rar/apple-1.png
+ *
+ * so that the rest of the tools handle files and members alike. Members
+ * are never extracted to disk: the I/O stage streams them into memory,
+ * in archive order, ahead of the workers.
+ */
+
+/**
+ * Whether archives can be read.
+ */
+
+bool archives_supported();
+
+/**
+ * Whether p names an archive, by its extension. Always false if archives
+ * are not supported.
+ */
+
+bool is_archive(const boost::filesystem::path& p);
+
+/**
+ * The archive that member p belongs to, or an empty path if p is not an
+ * archive member: the closest ancestor of p named like an archive that is
+ * a regular file. Only ancestors so named are looked up.
+ */
+
+boost::filesystem::path archive_of(const boost::filesystem::path& p);
+
+/**
+ * Collect the regular files under p (or p itself) into 'files', walking
+ * directories recursively and listing the members of archives, in the
+ * order they are found.
+ */
+
+int collect_sources(const boost::filesystem::path& p,
+                    std::vector<boost::filesystem::path>& files);
+
+/**
+ * What identifies the contents of source p without reading it: its
+ * absolute path, and the size and modification time of the file, or of
+ * its archive for a member. Empty if the file cannot be looked up.
+ */
+
+std::string source_stamp(const boost::filesystem::path& p);
+
+/**
+ * Keep one file of 'files' per value of 'key', the first one in path
+ * order, so that the choice does not depend on the order in which the
+ * files were found. The order of 'files' is otherwise preserved.
+ */
+
+void unique_sources(std::vector<boost::filesystem::path>& files,
+                    const std::function<std::string (const boost::filesystem::path&)>& key);
+
+
+/**
+ * Sequential reader of the members of an archive.
+ */
+
+class archive_stream
+{
+public:
+
+    explicit archive_stream(const boost::filesystem::path& archive);
+
+    ~archive_stream();
+
+    bool is_open() const;
+
+    const boost::filesystem::path& archive() const { return archive_; }
+
+    /**
+     * Move on to the next regular file member, and get its name (archive
+     * path included). Returns false at the end of the archive or on
+     * error.
+     */
+
+    bool next(boost::filesystem::path& member);
+
+    /**
+     * Read the contents of the current member into 'bytes'.
+     */
+
+    bool read(std::vector<unsigned char>& bytes);
+
+    /**
+     * Read the contents of 'member' into 'bytes', moving forward from the
+     * current member, or starting over from the first one if 'member'
+     * was passed. Reading members in archive order costs a single pass.
+     */
+
+    bool read(const boost::filesystem::path& member, std::vector<unsigned char>& bytes);
+
+private:
+
+    struct impl;
+
+    boost::filesystem::path archive_;
+    std::unique_ptr<impl> d_;
+
+    archive_stream(const archive_stream&);              // non-copyable
+    archive_stream& operator=(const archive_stream&);
+};
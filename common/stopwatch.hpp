@@ -0,0 +1,25 @@
+#pragma once
+
+#include <chrono>
+
+
+/**
+ * Wall-clock stopwatch.
+ */
+
+class stopwatch
+{
+public:
+
+    stopwatch() : start_( std::chrono::steady_clock::now() ) {}
+
+    double seconds() const
+    {
+        return std::chrono::duration<double>( std::chrono::steady_clock::now()
+                                              - start_ ).count();
+    }
+
+private:
+
+    std::chrono::steady_clock::time_point start_;
+};
@@ -0,0 +1,600 @@
+#include <algorithm>
+#include <ciso646>
+
+#if defined(MPEG7_HAVE_LIBPNG)
+#include <png.h>
+#else
+#include <cstdlib>
+
+#include <boost/cstdint.hpp>
+#endif
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "strips.hpp"
+#include "warp.hpp"
+
+
+#if defined(MPEG7_HAVE_LIBPNG)
+
+namespace
+{
+
+    // libpng reports errors by a longjmp to the last setjmp; each function
+    // below makes its own, and has no object to destroy after it.
+
+    void append(png_structp png, png_bytep data, png_size_t size)
+    {
+        std::vector<uchar>& out = *static_cast<std::vector<uchar>*>( png_get_io_ptr(png) );
+        out.insert(out.end(), data, data + size);
+    }
+
+    void flush(png_structp)
+    {
+    }
+
+    bool begin(png_structp png, png_infop info, const cv::Size& size,
+               const int type, const int compression, std::vector<uchar>* out)
+    {
+        static const int colour[5] = {
+            0, PNG_COLOR_TYPE_GRAY, 0, PNG_COLOR_TYPE_RGB, PNG_COLOR_TYPE_RGB_ALPHA };
+
+        if ( setjmp(png_jmpbuf(png)) )
+            return false;
+
+        png_set_write_fn(png, out, append, flush);
+        png_set_compression_level(png, compression);
+
+        png_set_IHDR(png, info, size.width, size.height,
+                     CV_MAT_DEPTH(type) == CV_16U ? 16 : 8,
+                     colour[CV_MAT_CN(type)], PNG_INTERLACE_NONE,
+                     PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png, info);
+
+        // OpenCV keeps BGR(A) samples in host order
+        if (CV_MAT_CN(type) > 1)
+            png_set_bgr(png);
+
+        const unsigned short one = 1;
+        if ( CV_MAT_DEPTH(type) == CV_16U
+             and *reinterpret_cast<const unsigned char*>(&one) == 1 )
+            png_set_swap(png);
+
+        return true;
+    }
+
+    bool write_rows(png_structp png, const cv::Mat& strip)
+    {
+        if ( setjmp(png_jmpbuf(png)) )
+            return false;
+
+        for (int r = 0; r < strip.rows; ++r)
+            png_write_row( png, const_cast<png_bytep>(strip.ptr(r)) );
+
+        return true;
+    }
+
+    bool end(png_structp png, png_infop info)
+    {
+        if ( setjmp(png_jmpbuf(png)) )
+            return false;
+
+        png_write_end(png, info);
+        return true;
+    }
+
+}
+
+#else   // MPEG7_HAVE_LIBPNG
+
+namespace
+{
+
+    /**
+     * CRC-32 of the PNG chunks, by a table made once, before main().
+     */
+
+    struct crc_table
+    {
+        boost::uint32_t t[256];
+
+        crc_table()
+        {
+            for (boost::uint32_t n = 0; n < 256; ++n)
+            {
+                boost::uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+        }
+    };
+
+    const crc_table crcs;
+
+    boost::uint32_t chunk_crc(boost::uint32_t c, const uchar* p, const size_t n)
+    {
+        c = ~c;
+        for (size_t i = 0; i < n; ++i)
+            c = crcs.t[(c ^ p[i]) & 0xff] ^ (c >> 8);
+        return ~c;
+    }
+
+    void put32(std::vector<uchar>& out, const boost::uint32_t v)
+    {
+        const uchar b[4] = { uchar(v >> 24), uchar(v >> 16), uchar(v >> 8), uchar(v) };
+        out.insert(out.end(), b, b + 4);
+    }
+
+    /**
+     * Append to 'out' the PNG chunk of 'type' holding 'data'.
+     */
+
+    void put_chunk(std::vector<uchar>& out, const char* type,
+                   const uchar* data, const size_t n)
+    {
+        put32( out, boost::uint32_t(n) );
+        const size_t at = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data, data + n);
+        put32( out, chunk_crc(0, &out[at], n + 4) );
+    }
+
+    /**
+     * A zlib stream (RFC 1950, 1951) written as it is fed, into 'out': a
+     * deflate block of the fixed Huffman codes, whose matches are found in
+     * a 32 KiB window by hash chains, as zlib's own fast levels find them.
+     * It takes no more memory than the window, however long the stream;
+     * silhouettes, being runs of a few values, compress well enough
+     * without the dynamic codes of libpng.
+     */
+
+    class deflater
+    {
+    public:
+
+        deflater(std::vector<uchar>& out, const int compression)
+            : out_(out), buf_(2 * window), head_(1 << hash_bits), prev_(window),
+              start_(0), end_(0),
+              chain_(compression > 0 ? 1 << (compression - 1) : 0),
+              a_(1), b_(0), bits_(0), count_(0)
+        {
+            // Header: deflate, 32 KiB window; then a block of the fixed
+            // codes, not the last
+            out_.push_back(0x78);
+            out_.push_back(0x01);
+            put(0, 1);
+            put(1, 2);
+        }
+
+        void write(const uchar* p, size_t n)
+        {
+            checksum(p, n);
+
+            while (n > 0)
+            {
+                if ( end_ == buf_.size() )
+                    slide();
+
+                const size_t k = std::min(n, buf_.size() - end_);
+                std::copy(p, p + k, buf_.begin() + end_);
+                end_ += k, p += k, n -= k;
+
+                compress(false);
+            }
+        }
+
+        void finish()
+        {
+            compress(true);
+
+            // End of the block, and an empty last one
+            symbol(256);
+            put(1, 1);
+            put(1, 2);
+            symbol(256);
+
+            if (count_ > 0)
+                put(0, 8 - count_);
+
+            put32( out_, (b_ << 16) | a_ );
+        }
+
+    private:
+
+        enum { window = 1 << 15, min_match = 3, max_match = 258, hash_bits = 15 };
+
+        std::vector<uchar>& out_;
+        std::vector<uchar> buf_;        // the window, and what is to come
+        std::vector<size_t> head_,      // last position of each hash, + 1
+                            prev_;      // the one before, by position
+        size_t start_,                  // next byte to compress
+               end_;                    // end of the data in buf_
+        const int chain_;               // positions tried for a match
+        boost::uint32_t a_, b_;         // Adler-32
+        boost::uint32_t bits_;          // bits not yet out, and their count
+        int count_;
+
+        // Bits, least significant first
+        void put(const boost::uint32_t v, const int n)
+        {
+            bits_ |= v << count_;
+            count_ += n;
+            for (; count_ >= 8; count_ -= 8, bits_ >>= 8)
+                out_.push_back( uchar(bits_) );
+        }
+
+        // Huffman codes, most significant bit first
+        void code(const unsigned c, const int n)
+        {
+            unsigned r = 0;
+            for (int k = 0; k < n; ++k)
+                r |= (c >> k & 1) << (n - 1 - k);
+            put(r, n);
+        }
+
+        void symbol(const int s)
+        {
+            if (s < 144)
+                code(0x30 + s, 8);
+            else if (s < 256)
+                code(0x190 + s - 144, 9);
+            else if (s < 280)
+                code(s - 256, 7);
+            else
+                code(0xc0 + s - 280, 8);
+        }
+
+        void match(const int length, const int distance)
+        {
+            static const int lbase[29] = {
+                3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 },
+                             lextra[29] = {
+                0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 },
+                             dbase[30] = {
+                1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                8193, 12289, 16385, 24577 },
+                             dextra[30] = {
+                0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+            const int l = int( std::upper_bound(lbase, lbase + 29, length) - lbase ) - 1,
+                      d = int( std::upper_bound(dbase, dbase + 30, distance) - dbase ) - 1;
+
+            symbol(257 + l);
+            put(length - lbase[l], lextra[l]);
+            code(d, 5);
+            put(distance - dbase[d], dextra[d]);
+        }
+
+        size_t hash(const size_t at) const
+        {
+            return ( buf_[at] << 10 ^ buf_[at + 1] << 5 ^ buf_[at + 2] )
+                   & ((1 << hash_bits) - 1);
+        }
+
+        // Chain position 'at' in, returning the last one of its hash
+        size_t insert(const size_t at)
+        {
+            size_t& h = head_[ hash(at) ];
+            const size_t last = h;
+            prev_[at % window] = last;
+            h = at + 1;
+            return last;
+        }
+
+        // Compress what is in buf_, but for the last bytes of a possible
+        // match unless 'flush'
+        void compress(const bool flush)
+        {
+            while ( end_ - start_ >= (flush ? 1 : size_t(max_match)) )
+            {
+                const size_t avail = std::min<size_t>(end_ - start_, max_match);
+                size_t best = 0,
+                       distance = 0;
+
+                if (avail >= min_match)
+                {
+                    size_t next = insert(start_);
+                    for (int tries = chain_; next != 0 and tries > 0; --tries)
+                    {
+                        const size_t at = next - 1;
+                        if (start_ - at >= window)
+                            break;
+
+                        size_t l = 0;
+                        while (l < avail and buf_[at + l] == buf_[start_ + l])
+                            ++l;
+
+                        if (l > best)
+                        {
+                            best = l, distance = start_ - at;
+                            if (l == avail)
+                                break;
+                        }
+
+                        next = prev_[at % window];
+                    }
+                }
+
+                if (best >= min_match)
+                {
+                    match( int(best), int(distance) );
+                    for (size_t k = 1; k < best; ++k)
+                        if (end_ - (start_ + k) >= min_match)
+                            insert(start_ + k);
+                    start_ += best;
+                }
+
+                else
+                    symbol( buf_[start_++] );
+            }
+        }
+
+        // Drop the oldest half of buf_, which no match can reach any more
+        void slide()
+        {
+            std::copy(buf_.begin() + window, buf_.begin() + end_, buf_.begin());
+            start_ -= window, end_ -= window;
+
+            for (size_t i = 0; i < head_.size(); ++i)
+                head_[i] = head_[i] > window ? head_[i] - window : 0;
+            for (size_t i = 0; i < prev_.size(); ++i)
+                prev_[i] = prev_[i] > window ? prev_[i] - window : 0;
+        }
+
+        void checksum(const uchar* p, size_t n)
+        {
+            // 5552 bytes at most between reductions keep b_ in 32 bits
+            while (n > 0)
+            {
+                const size_t k = std::min<size_t>(n, 5552);
+                for (size_t i = 0; i < k; ++i)
+                    a_ += p[i], b_ += a_;
+                a_ %= 65521, b_ %= 65521;
+                p += k, n -= k;
+            }
+        }
+    };
+
+    /**
+     * PNG row 'raw' (samples in PNG order) filtered against 'above', with
+     * the filter that minimises the sum of the absolute values of its
+     * bytes, as libpng picks it; into 'row', the filter byte first.
+     */
+
+    void filter_row(const std::vector<uchar>& raw, const std::vector<uchar>& above,
+                    const size_t bpp, std::vector<uchar>& row,
+                    std::vector<uchar>& trial)
+    {
+        const size_t n = raw.size();
+        unsigned long least = ~0ul;
+
+        for (int f = 0; f < 5; ++f)
+        {
+            trial[0] = uchar(f);
+            unsigned long sum = 0;
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                const int x = raw[i],
+                          a = i >= bpp ? raw[i - bpp] : 0,
+                          b = above[i],
+                          c = i >= bpp ? above[i - bpp] : 0;
+
+                int pred = 0;
+                switch (f)
+                {
+                case 1: pred = a; break;
+                case 2: pred = b; break;
+                case 3: pred = (a + b) / 2; break;
+                case 4:
+                    {
+                        const int p = a + b - c,
+                                  pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                        pred = pa <= pb and pa <= pc ? a : pb <= pc ? b : c;
+                    }
+                    break;
+                }
+
+                const uchar v = uchar(x - pred);
+                trial[i + 1] = v;
+                sum += v < 128 ? v : 256 - v;
+            }
+
+            if (sum < least)
+                least = sum, row.swap(trial);
+        }
+    }
+
+    /**
+     * Row 'r' of 'strip' in PNG order: RGB(A) rather than BGR(A), and 16
+     * bits big-endian.
+     */
+
+    void png_row(const cv::Mat& strip, const int r, std::vector<uchar>& raw)
+    {
+        const int cn = strip.channels(),
+                  n = strip.cols * cn;
+
+        if (strip.depth() == CV_16U)
+        {
+            const ushort* p = strip.ptr<ushort>(r);
+            for (int i = 0; i < n; ++i)
+            {
+                const int c = i % cn,
+                          s = p[cn > 2 and c < 3 ? i - c + 2 - c : i];
+                raw[2 * i] = uchar(s >> 8);
+                raw[2 * i + 1] = uchar(s);
+            }
+        }
+
+        else
+        {
+            const uchar* p = strip.ptr<uchar>(r);
+            for (int i = 0; i < n; ++i)
+            {
+                const int c = i % cn;
+                raw[i] = p[cn > 2 and c < 3 ? i - c + 2 - c : i];
+            }
+        }
+    }
+
+}
+
+#endif  // MPEG7_HAVE_LIBPNG
+
+
+int strip_rows(const int width, const int type, const size_t budget)
+{
+    const size_t row = size_t(width) * CV_ELEM_SIZE(type);
+
+    return static_cast<int>( std::max<size_t>(1, row > 0 ? budget / row : 1) );
+}
+
+
+bool encode_png_strips(const cv::Size& size, const int type, const int rows,
+                       const int compression, const strip_filler& fill,
+                       std::vector<uchar>& out)
+{
+    using namespace cv;
+    using namespace std;
+
+    const int depth = CV_MAT_DEPTH(type),
+              channels = CV_MAT_CN(type);
+
+    if ( (depth != CV_8U and depth != CV_16U) or channels == 2 or channels > 4
+         or size.width <= 0 or size.height <= 0 )
+        return false;
+
+    out.clear();
+
+#if defined(MPEG7_HAVE_LIBPNG)
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0);
+    if (not png)
+        return false;
+
+    png_infop info = png_create_info_struct(png);
+    if (not info)
+    {
+        png_destroy_write_struct(&png, 0);
+        return false;
+    }
+
+    bool ok = begin(png, info, size, type, compression, &out);
+
+    try
+    {
+        Mat strip( min(rows, size.height), size.width, type );
+
+        for (int y = 0; ok and y < size.height; y += strip.rows)
+        {
+            if (size.height - y < strip.rows)
+                strip = strip.rowRange(0, size.height - y);
+
+            fill(y, strip);
+            ok = write_rows(png, strip);
+        }
+    }
+
+    catch (...)
+    {
+        png_destroy_write_struct(&png, &info);
+        throw;
+    }
+
+    ok = ok and end(png, info);
+    png_destroy_write_struct(&png, &info);
+
+    if (not ok)
+        out.clear();
+
+    return ok;
+
+#else   // MPEG7_HAVE_LIBPNG
+
+    const int depth_bits = depth == CV_16U ? 16 : 8;
+    const size_t bpp = channels * depth_bits / 8,
+                 width = size_t(size.width) * bpp;
+
+    static const uchar signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' },
+                       colour[5] = { 0, 0, 0, 2, 6 };
+
+    out.assign(signature, signature + 8);
+
+    vector<uchar> header;
+    put32( header, size.width );
+    put32( header, size.height );
+    header.push_back( uchar(depth_bits) );
+    header.push_back( colour[channels] );
+    header.push_back(0);    // deflate
+    header.push_back(0);    // adaptive filters
+    header.push_back(0);    // not interlaced
+    put_chunk(out, "IHDR", header.data(), header.size());
+
+    // The zlib stream, out in IDAT chunks of 64 KiB or so
+    vector<uchar> stream;
+    deflater z(stream, compression);
+
+    vector<uchar> raw(width), above(width, 0), row(width + 1), trial(width + 1);
+
+    Mat strip( min(rows, size.height), size.width, type );
+
+    for (int y = 0; y < size.height; y += strip.rows)
+    {
+        if (size.height - y < strip.rows)
+            strip = strip.rowRange(0, size.height - y);
+
+        fill(y, strip);
+
+        for (int r = 0; r < strip.rows; ++r)
+        {
+            png_row(strip, r, raw);
+            filter_row(raw, above, bpp, row, trial);
+            z.write(row.data(), row.size());
+            raw.swap(above);
+
+            if ( stream.size() >= 1 << 16 )
+            {
+                put_chunk(out, "IDAT", stream.data(), stream.size());
+                stream.clear();
+            }
+        }
+    }
+
+    z.finish();
+    put_chunk(out, "IDAT", stream.data(), stream.size());
+    put_chunk(out, "IEND", 0, 0);
+
+    return true;
+
+#endif  // MPEG7_HAVE_LIBPNG
+}
+
+
+void scale_strip(const cv::Mat& src, const cv::Size& size, const int y,
+                 cv::Mat& strip)
+{
+    using namespace cv;
+
+    // The inverse map of cv::resize, from the centres of the destination
+    // pixels to the source: x' = (x + 0.5) / sx - 0.5, and likewise for y,
+    // offset to the first row of the strip
+    const double ix = double(src.cols) / size.width,
+                 iy = double(src.rows) / size.height;
+
+    const affine_map m = {{ ix, 0, 0.5 * ix - 0.5, 0, iy, (y + 0.5) * iy - 0.5 }};
+
+    // The kernels do 8 and 16 bits; cv::warpAffine the other depths
+    if ( not warp_linear<scale_warp>(src, strip, m, replicate_border) )
+    {
+        Mat w(2, 3, CV_64F, const_cast<double*>(m.m));
+        warpAffine(src, strip, w, strip.size(), CV_INTER_LINEAR | CV_WARP_INVERSE_MAP,
+                   BORDER_REPLICATE);
+    }
+}
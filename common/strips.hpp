@@ -0,0 +1,58 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+
+/**
+ * Images made in strips
+ *
+ * An image too large to be held whole (a source scaled up by 16 takes 256
+ * times its memory) is made in strips of rows, top to bottom, and every
+ * strip is encoded as soon as it is filled, so that the memory a worker
+ * needs is bounded by the size of a strip, plus the encoded image, however
+ * large the image gets.
+ *
+ * PNG images are streamed row by row into libpng if the build provides it
+ * (MPEG7_HAVE_LIBPNG). Otherwise a built-in encoder filters the rows as
+ * libpng does and deflates them with the fixed Huffman codes in a 32 KiB
+ * window: the images are the same, the files larger (two to three times
+ * for silhouettes), and the memory as bounded.
+ */
+
+/**
+ * Fills 'strip' with the rows of the image from row 'y' on.
+ */
+
+typedef std::function<void (const int y, cv::Mat& strip)> strip_filler;
+
+/**
+ * Number of rows of the strips of an image 'width' pixels wide, of 'type',
+ * taking at most 'budget' bytes (at least one row).
+ */
+
+int strip_rows(const int width, const int type, const size_t budget);
+
+/**
+ * Encode into 'out', as PNG with 'compression' (0 to 9), the image of
+ * 'size' and 'type' (8 or 16 bits; 1, 3 or 4 channels) that 'fill' makes
+ * in strips of 'rows'. Returns false on failure. Without libpng,
+ * 'compression' bounds the search for matches (0: none).
+ */
+
+bool encode_png_strips(const cv::Size& size, const int type, const int rows,
+                       const int compression, const strip_filler& fill,
+                       std::vector<uchar>& out);
+
+/**
+ * Rows 'y' to 'y' + strip.rows - 1 of 'src' scaled to 'size' by bilinear
+ * interpolation, into 'strip'. Pixel centres and borders are those of
+ * cv::resize; the weights are quantised to 1/32 of a pixel, as in
+ * cv::warpAffine (whose arithmetic the scaling kernel of warp.hpp does),
+ * so values may differ from those of cv::resize by one level.
+ */
+
+void scale_strip(const cv::Mat& src, const cv::Size& size, const int y,
+                 cv::Mat& strip);
@@ -0,0 +1,209 @@
+#include <ciso646>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem/fstream.hpp>
+
+#include "trace.hpp"
+
+#if defined(_MSC_VER)
+#define MPEG7_THREAD_LOCAL __declspec(thread)
+#else
+#define MPEG7_THREAD_LOCAL __thread
+#endif
+
+
+bool trace_enabled = false;
+
+
+namespace
+{
+
+    struct trace_record
+    {
+        const char* name;
+        boost::uint64_t begin,
+                        end;
+    };
+
+    /**
+     * Events of one thread, written by that thread only.
+     */
+
+    struct trace_ring
+    {
+        std::string name;
+        std::vector<trace_record> records;  // up to trace_capacity
+        size_t count;                       // events recorded so far
+    };
+
+    // Every ring ever made, in order of creation; they live until exit
+    std::mutex rings_mutex;
+    std::vector< std::unique_ptr<trace_ring> > rings;
+
+    boost::filesystem::path trace_file;
+    boost::uint64_t origin;
+
+    MPEG7_THREAD_LOCAL trace_ring* local_ring = 0;
+
+    trace_ring& thread_ring()
+    {
+        if (not local_ring)
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex);
+
+            std::ostringstream name;
+            name << "thread " << rings.size();
+
+            rings.push_back( std::unique_ptr<trace_ring>(new trace_ring) );
+            local_ring = rings.back().get();
+            local_ring->name = name.str();
+            local_ring->count = 0;
+
+            // The whole ring at once, so that recording never allocates
+            local_ring->records.reserve(trace_capacity);
+        }
+
+        return *local_ring;
+    }
+
+    /**
+     * Write the timeline of every thread as Chrome trace JSON.
+     */
+
+    void save_trace()
+    {
+        using namespace std;
+
+        const double scale = 1 / trace_ticks_per_microsecond();
+
+        ostringstream out;
+        out << fixed << setprecision(3)
+            << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+               "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+               "\"args\":{\"name\":\"mpeg7ce1dataset\"}}";
+
+        size_t dropped = 0;
+
+        lock_guard<mutex> lock(rings_mutex);
+
+        for (size_t t = 0; t < rings.size(); ++t)
+        {
+            const trace_ring& r = *rings[t];
+            if (r.count == 0)
+                continue;
+
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                << t + 1 << ",\"args\":{\"name\":\"" << r.name << "\"}}";
+
+            // Oldest first
+            const size_t n = r.records.size(),
+                         first = r.count > n ? r.count % n : 0;
+            dropped += r.count - n;
+
+            for (size_t k = 0; k < n; ++k)
+            {
+                const trace_record& e = r.records[(first + k) % n];
+                out << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                    << t + 1 << ",\"ts\":" << scale * double(e.begin - origin)
+                    << ",\"dur\":" << scale * double(e.end - e.begin) << '}';
+            }
+        }
+
+        out << "\n]}\n";
+
+        // Written on its own, as the I/O stage is gone by now
+        const string text = out.str();
+        boost::filesystem::ofstream file(trace_file, ios_base::binary | ios_base::trunc);
+        file.write( text.data(), text.size() );
+        file.close();
+
+        if ( not file )
+            clog << trace_file << " could not be written\n";
+        else if (dropped > 0)
+            clog << dropped << " trace events were overwritten; " << trace_file
+                 << " holds the last " << trace_capacity << " of each thread\n";
+    }
+
+}
+
+
+void start_trace(const boost::filesystem::path& file)
+{
+    if (trace_enabled)
+        return;
+
+    trace_file = file;
+    origin = trace_clock();
+    trace_enabled = true;
+    thread_ring().name = "main";
+    std::atexit(save_trace);
+}
+
+
+void name_trace_thread(const char* name, const unsigned index)
+{
+    if (not tracing())
+        return;
+
+    std::ostringstream s;
+    s << name << ' ' << index;
+    thread_ring().name = s.str();
+}
+
+
+boost::uint64_t trace_clock()
+{
+#if defined(_WIN32)
+    // The steady clock of older runtimes ticks every few milliseconds
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart;
+#else
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>( steady_clock::now().time_since_epoch() ).count();
+#endif
+}
+
+
+double trace_ticks_per_microsecond()
+{
+#if defined(_WIN32)
+    LARGE_INTEGER f;
+    QueryPerformanceFrequency(&f);
+    return f.QuadPart / 1e6;
+#else
+    return 1e3;
+#endif
+}
+
+
+void trace_event(const char* name, const boost::uint64_t begin,
+                 const boost::uint64_t end)
+{
+    if (not tracing())
+        return;
+
+    trace_ring& r = thread_ring();
+
+    const trace_record e = { name, begin, end };
+
+    if (r.records.size() < trace_capacity)
+        r.records.push_back(e);
+    else
+        r.records[r.count % trace_capacity] = e;
+
+    ++r.count;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <boost/cstdint.hpp>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+
+/**
+ * Timeline of a run
+ *
+ * Totals cannot tell why concurrent workers stall: whether they all wait
+ * on the encoder, on the I/O stage or on the commits. With --trace <file>
+ * every tool records when each of its threads decodes, thresholds,
+ * traces, computes moments, serializes, warps, encodes, reads, writes and
+ * commits, and writes the timeline to <file> at exit as Chrome trace JSON
+ * (chrome://tracing or ui.perfetto.dev), one track per thread.
+ *
+ * Recording takes no lock, and allocates on the first event of a thread
+ * only: every thread appends complete events (name, begin, end) to a ring
+ * of its own, reserved whole then, the oldest being overwritten once it holds
+ * trace_capacity of them; the rings are only read at exit, when the
+ * threads are gone. A trace_scope costs two clock reads while tracing and
+ * the test of a flag otherwise, so the recorder may stay in production
+ * builds.
+ */
+
+/**
+ * Events kept per thread.
+ */
+
+const size_t trace_capacity = 1 << 18;
+
+/**
+ * Start recording, and have the timeline written to 'file' at exit. To be
+ * called before any thread is started.
+ */
+
+void start_trace(const boost::filesystem::path& file);
+
+extern bool trace_enabled;
+
+inline bool tracing() { return trace_enabled; }
+
+/**
+ * Name the track of the calling thread, e.g. "worker" 3 -> "worker 3".
+ */
+
+void name_trace_thread(const char* name, const unsigned index);
+
+/**
+ * Clock of the events, in ticks of an unspecified length.
+ */
+
+boost::uint64_t trace_clock();
+
+/**
+ * Ticks of trace_clock() in a microsecond, for timings finer than those
+ * of stopwatch.hpp.
+ */
+
+double trace_ticks_per_microsecond();
+
+/**
+ * Record on the calling thread's track that 'name', a string literal,
+ * ran from 'begin' to 'end' (trace_clock() ticks).
+ */
+
+void trace_event(const char* name, const boost::uint64_t begin,
+                 const boost::uint64_t end);
+
+/**
+ * The lifetime of a scope as an event:
+ *
+ *      {
+ *          trace_scope scope("encode");
+ *          imencode(...);
+ *      }
+ */
+
+class trace_scope
+{
+public:
+
+    explicit trace_scope(const char* name)
+        : name_( tracing() ? name : 0 ), begin_( name_ ? trace_clock() : 0 )
+    {
+    }
+
+    ~trace_scope()
+    {
+        if (name_)
+            trace_event(name_, begin_, trace_clock());
+    }
+
+private:
+
+    const char* name_;
+    boost::uint64_t begin_;
+
+    trace_scope(const trace_scope&);                // non-copyable
+    trace_scope& operator=(const trace_scope&);
+};
@@ -0,0 +1,225 @@
+#if defined(__linux__)
+
+#include <ciso646>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "uring.hpp"
+
+
+uring::uring()
+    : fd_(-1), sq_ring_(MAP_FAILED), cq_ring_(MAP_FAILED),
+      sq_ring_size_(0), cq_ring_size_(0), sqes_(0), sqes_size_(0),
+      sq_head_(0), sq_tail_(0), sq_array_(0), sq_mask_(0), sq_entries_(0),
+      queued_(0), cq_head_(0), cq_tail_(0), cq_mask_(0), cqes_(0)
+{
+}
+
+
+uring::~uring()
+{
+    close();
+}
+
+
+bool uring::open(const unsigned entries)
+{
+    struct io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+
+    fd_ = static_cast<int>( syscall(__NR_io_uring_setup, entries, &p) );
+    if (fd_ < 0)
+        return false;
+
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+        sq_ring_size_ = cq_ring_size_ = sq_ring_size_ > cq_ring_size_
+                                      ? sq_ring_size_ : cq_ring_size_;
+
+    sq_ring_ = mmap(0, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    if (single)
+        cq_ring_ = sq_ring_;
+    else
+    {
+        cq_ring_ = mmap(0, cq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+    }
+
+    sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(0, sqes_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_  = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_  = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    sq_mask_  = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_entries_ = p.sq_entries;
+
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_    = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+
+    return true;
+}
+
+
+void uring::close()
+{
+    if (sqes_)
+        munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED and cq_ring_ != sq_ring_)
+        munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED)
+        munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0)
+        ::close(fd_);
+
+    fd_ = -1;
+    sq_ring_ = cq_ring_ = MAP_FAILED;
+    sqes_ = 0;
+    queued_ = 0;
+}
+
+
+bool uring::prep(const unsigned char op, const int fd, const struct iovec* iov,
+                 const unsigned n, const unsigned long long offset,
+                 const unsigned flags, void* data)
+{
+    const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE),
+                   tail = *sq_tail_ + queued_;
+
+    if (tail - head >= sq_entries_)
+        return false;
+
+    const unsigned index = tail & sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<unsigned long long>(iov);
+    sqe->len = n;
+    sqe->fsync_flags = flags;       // shared with the flags of readv/writev
+    sqe->user_data = reinterpret_cast<unsigned long long>(data);
+
+    sq_array_[index] = index;
+    ++queued_;
+
+    return true;
+}
+
+
+bool uring::prep_readv(const int fd, const struct iovec* iov, const unsigned n,
+                       const unsigned long long offset, void* data)
+{
+    return prep(IORING_OP_READV, fd, iov, n, offset, 0, data);
+}
+
+
+bool uring::prep_writev(const int fd, const struct iovec* iov, const unsigned n,
+                        const unsigned long long offset, void* data)
+{
+    return prep(IORING_OP_WRITEV, fd, iov, n, offset, 0, data);
+}
+
+
+bool uring::prep_fdatasync(const int fd, void* data)
+{
+    return prep(IORING_OP_FSYNC, fd, 0, 0, 0, IORING_FSYNC_DATASYNC, data);
+}
+
+
+bool uring::submit(const unsigned wait)
+{
+    // Publish the queued entries to the kernel
+    __atomic_store_n(sq_tail_, *sq_tail_ + queued_, __ATOMIC_RELEASE);
+    queued_ = 0;
+
+    for (;;)
+    {
+        // Only what the kernel has not consumed yet: it moves the head past
+        // every entry it takes, and may take fewer than it is given
+        const unsigned left = *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+
+        const long r = syscall(__NR_io_uring_enter, fd_, left, wait,
+                               wait > 0 ? IORING_ENTER_GETEVENTS : 0, 0, 0);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        // Short of entries it can take for now, with no completion to wait
+        // for: the rest goes with the next call
+        if (static_cast<unsigned long>(r) >= left or r == 0)
+            return true;
+    }
+}
+
+
+bool uring::discard(void*& data)
+{
+    const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE),
+                   tail = *sq_tail_;
+
+    if (head == tail)
+        return false;
+
+    const unsigned index = sq_array_[(tail - 1) & sq_mask_];
+    data = reinterpret_cast<void*>( static_cast<size_t>(sqes_[index].user_data) );
+
+    __atomic_store_n(sq_tail_, tail - 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+
+bool uring::next_completion(int& result, void*& data)
+{
+    const unsigned head = *cq_head_,
+                   tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+    if (head == tail)
+        return false;
+
+    const struct io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+    result = cqe->res;
+    data = reinterpret_cast<void*>( static_cast<size_t>(cqe->user_data) );
+
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+#endif  // __linux__
@@ -0,0 +1,107 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <linux/io_uring.h>
+
+
+/**
+ * Minimal io_uring submission/completion ring
+ *
+ * A thin layer over the raw kernel interface (io_uring_setup/enter and the
+ * mmap-ed rings), enough for batches of vectored reads and writes; it
+ * spares the dependency on liburing. A ring must be used by one thread.
+ */
+
+class uring
+{
+public:
+
+    uring();
+    ~uring();
+
+    /**
+     * Set up a ring of 'entries' submission slots; false if the kernel
+     * does not support io_uring (or forbids it).
+     */
+
+    bool open(const unsigned entries);
+
+    bool is_open() const { return fd_ >= 0; }
+
+    unsigned entries() const { return sq_entries_; }
+
+    /**
+     * Queue a readv/writev of 'fd' at 'offset'; false if the submission
+     * ring is full. 'data' is returned with the completion.
+     */
+
+    bool prep_readv(const int fd, const struct iovec* iov, const unsigned n,
+                    const unsigned long long offset, void* data);
+
+    bool prep_writev(const int fd, const struct iovec* iov, const unsigned n,
+                     const unsigned long long offset, void* data);
+
+    /**
+     * Queue an fdatasync of 'fd'; false if the submission ring is full.
+     */
+
+    bool prep_fdatasync(const int fd, void* data);
+
+    /**
+     * Submit every queued request, and those an earlier call left to the
+     * kernel but it did not take, and wait until at least 'wait' requests
+     * have completed. Returns false on error.
+     */
+
+    bool submit(const unsigned wait);
+
+    /**
+     * Take back one request given to the kernel that it has not taken yet,
+     * if any: 'data' is that given to prep_*().
+     */
+
+    bool discard(void*& data);
+
+    /**
+     * Retrieve one completion, if any: the result of the operation (bytes
+     * transferred or -errno) and the data given to prep_*().
+     */
+
+    bool next_completion(int& result, void*& data);
+
+private:
+
+    uring(const uring&);                // non-copyable
+    uring& operator=(const uring&);
+
+    bool prep(const unsigned char op, const int fd, const struct iovec* iov,
+              const unsigned n, const unsigned long long offset,
+              const unsigned flags, void* data);
+
+    void close();
+
+    int fd_;
+
+    void*  sq_ring_;
+    void*  cq_ring_;
+    size_t sq_ring_size_,
+           cq_ring_size_;
+
+    struct io_uring_sqe* sqes_;
+    size_t sqes_size_;
+
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_array_;
+    unsigned  sq_mask_,
+              sq_entries_,
+              queued_;
+
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned  cq_mask_;
+    struct io_uring_cqe* cqes_;
+};
+
+#endif  // __linux__
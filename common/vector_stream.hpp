@@ -0,0 +1,61 @@
+#pragma once
+
+#include <ciso646>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+
+/**
+ * Output stream appending to a byte vector
+ *
+ * Used to serialize a whole document in memory before handing it to the
+ * I/O stage. The vector is not cleared, so its capacity can be recycled.
+ */
+
+class vector_buffer : public std::streambuf
+{
+public:
+
+    explicit vector_buffer(std::vector<unsigned char>& v)
+        : v_(v)
+    {
+    }
+
+protected:
+
+    int_type overflow(int_type c)
+    {
+        if (not traits_type::eq_int_type(c, traits_type::eof()))
+            v_.push_back( static_cast<unsigned char>(c) );
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n)
+    {
+        v_.insert(v_.end(), s, s + n);
+        return n;
+    }
+
+private:
+
+    vector_buffer& operator=(const vector_buffer&);
+
+    std::vector<unsigned char>& v_;
+};
+
+
+class vector_ostream : public std::ostream
+{
+public:
+
+    explicit vector_ostream(std::vector<unsigned char>& v)
+        : std::ostream(0), buffer_(v)
+    {
+        rdbuf(&buffer_);
+    }
+
+private:
+
+    vector_buffer buffer_;
+};
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <ciso646>
+#include <vector>
+
+#include "warp.hpp"
+
+
+namespace
+{
+
+    // Fractional bits of the source coordinates as stepped along a row,
+    // and as interpolated (32 sub-pixel positions); cv::warpAffine's
+    // AB_BITS and INTER_BITS
+    const int coord_bits = 10,
+              sub_bits = 5,
+              sub_size = 1 << sub_bits,
+              sub_mask = sub_size - 1;
+
+    // Weights are products of multiples of 1/32: 10 bits
+    const int weight_bits = 2 * sub_bits;
+
+    /**
+     * Bilinear weights of the 32 x 32 sub-pixel positions, top-left,
+     * top-right, bottom-left, bottom-right, in units of 1/1024; made once,
+     * before main().
+     */
+
+    struct weight_table
+    {
+        int w[sub_size * sub_size][4];
+
+        weight_table()
+        {
+            for (int fy = 0; fy < sub_size; ++fy)
+                for (int fx = 0; fx < sub_size; ++fx)
+                {
+                    int* const t = w[fy * sub_size + fx];
+                    t[0] = (sub_size - fx) * (sub_size - fy);
+                    t[1] = fx * (sub_size - fy);
+                    t[2] = (sub_size - fx) * fy;
+                    t[3] = fx * fy;
+                }
+        }
+    };
+
+    const weight_table weights;
+
+    inline int clamp_short(const int v)
+    {
+        return std::min(std::max(v, -32768), 32767);
+    }
+
+    inline int clamp(const int v, const int hi)
+    {
+        return std::min(std::max(v, 0), hi);
+    }
+
+    /**
+     * Pixel at (sx, sy), whose neighbours are not all inside the source.
+     */
+
+    template <typename T, int CN>
+    void edge_pixel(const cv::Mat& src, const int sx, const int sy,
+                    const int* w, const warp_border border, T* d)
+    {
+        const int sw = src.cols,
+                  sh = src.rows;
+
+        static const T zero[CN] = {};
+        const T* v[4];
+
+        if (border == replicate_border)
+        {
+            const int x0 = clamp(sx, sw - 1), x1 = clamp(sx + 1, sw - 1),
+                      y0 = clamp(sy, sh - 1), y1 = clamp(sy + 1, sh - 1);
+
+            v[0] = src.ptr<T>(y0) + x0 * CN;
+            v[1] = src.ptr<T>(y0) + x1 * CN;
+            v[2] = src.ptr<T>(y1) + x0 * CN;
+            v[3] = src.ptr<T>(y1) + x1 * CN;
+        }
+
+        else if (sx >= sw or sx + 1 < 0 or sy >= sh or sy + 1 < 0)
+        {
+            for (int k = 0; k < CN; ++k)
+                d[k] = 0;
+            return;
+        }
+
+        else
+        {
+            const bool x0 = sx >= 0, x1 = sx + 1 < sw,
+                       y0 = sy >= 0, y1 = sy + 1 < sh;
+
+            v[0] = x0 and y0 ? src.ptr<T>(sy) + sx * CN : zero;
+            v[1] = x1 and y0 ? src.ptr<T>(sy) + (sx + 1) * CN : zero;
+            v[2] = x0 and y1 ? src.ptr<T>(sy + 1) + sx * CN : zero;
+            v[3] = x1 and y1 ? src.ptr<T>(sy + 1) + (sx + 1) * CN : zero;
+        }
+
+        for (int k = 0; k < CN; ++k)
+            d[k] = static_cast<T>( ( v[0][k] * w[0] + v[1][k] * w[1]
+                                   + v[2][k] * w[2] + v[3][k] * w[3]
+                                   + (1 << (weight_bits - 1)) ) >> weight_bits );
+    }
+
+    /**
+     * The warp, for one pixel type and one class of map. The class and
+     * the channel count being constants, the coordinate arithmetic the
+     * class does not need and the channel loop vanish at compile time.
+     */
+
+    template <typename T, int CN, warp_class Class>
+    void warp_kernel(const cv::Mat& src, cv::Mat& dst, const affine_map& map,
+                     const warp_border border)
+    {
+        using namespace std;
+
+        const double* const m = map.m;
+        const double unit = 1 << coord_bits;
+        const int round = 1 << (coord_bits - sub_bits - 1),
+                  shift = coord_bits - sub_bits;
+
+        const int sw1 = src.cols - 1,
+                  sh1 = src.rows - 1;
+        const size_t step = src.step / sizeof(T);
+        const T* const base = src.ptr<T>(0);
+
+        // Steps of the source coordinates along a row
+        vector<int> adelta(dst.cols),
+                    bdelta(Class == rotate_warp ? dst.cols : 0);
+        for (int x = 0; x < dst.cols; ++x)
+        {
+            adelta[x] = cvRound(m[0] * x * unit);
+            if (Class == rotate_warp)
+                bdelta[x] = cvRound(m[3] * x * unit);
+        }
+
+        // Scalings: x' does not depend on y, and is stepped once for all
+        if (Class == scale_warp)
+        {
+            const int x0 = cvRound(m[2] * unit) + round;
+            for (int x = 0; x < dst.cols; ++x)
+                adelta[x] = (x0 + adelta[x]) >> shift;
+        }
+
+        const int* const a = adelta.data();
+        const int* const b = bdelta.data();
+
+        for (int y = 0; y < dst.rows; ++y)
+        {
+            T* const d = dst.ptr<T>(y);
+
+            const int x0 = cvRound((m[1] * y + m[2]) * unit) + round,
+                      y0 = cvRound((m[4] * y + m[5]) * unit) + round;
+
+            // Scalings and shears: y' is the same along the row
+            const int yr = y0 >> shift;
+
+            // Source coordinates of pixel x, in 1/32 pixel
+            auto source_x = [&](const int x)
+            {
+                return Class == scale_warp ? a[x] : (x0 + a[x]) >> shift;
+            };
+            auto source_y = [&](const int x)
+            {
+                return Class == rotate_warp ? (y0 + b[x]) >> shift : yr;
+            };
+            auto inside = [&](const int x)
+            {
+                return unsigned(clamp_short(source_x(x) >> sub_bits)) < unsigned(sw1)
+                   and unsigned(clamp_short(source_y(x) >> sub_bits)) < unsigned(sh1);
+            };
+            auto edge = [&](const int x)
+            {
+                const int X = source_x(x),
+                          Y = source_y(x);
+                edge_pixel<T, CN>(src, clamp_short(X >> sub_bits),
+                                  clamp_short(Y >> sub_bits),
+                                  weights.w[ (Y & sub_mask) * sub_size + (X & sub_mask) ],
+                                  border, d + x * CN);
+            };
+
+            // The source coordinates are monotonic along the row: the
+            // pixels whose neighbours are all inside the source make one
+            // run [xa, xb), between the edge pixels at either end
+            int xa = 0,
+                xb = dst.cols;
+            for (; xa < xb and not inside(xa); ++xa)
+                edge(xa);
+            for (; xb > xa and not inside(xb - 1); --xb)
+                edge(xb - 1);
+
+            // The run, without a test
+            const T* const row = base + (Class == rotate_warp ? 0 : (yr >> sub_bits) * step);
+            const int (* const wy)[4] = weights.w + (Class == rotate_warp ? 0 : (yr & sub_mask) * sub_size);
+
+            for (int x = xa; x < xb; ++x)
+            {
+                const int X = source_x(x),
+                          Y = source_y(x);
+
+                const T* const s0 = Class == rotate_warp
+                                  ? base + (Y >> sub_bits) * step + (X >> sub_bits) * CN
+                                  : row + (X >> sub_bits) * CN;
+                const T* const s1 = s0 + step;
+                const int* const w = Class == rotate_warp
+                                   ? weights.w[ (Y & sub_mask) * sub_size + (X & sub_mask) ]
+                                   : wy[X & sub_mask];
+
+                T* const p = d + x * CN;
+                for (int k = 0; k < CN; ++k)
+                    p[k] = static_cast<T>( ( s0[k] * w[0] + s0[k + CN] * w[1]
+                                           + s1[k] * w[2] + s1[k + CN] * w[3]
+                                           + (1 << (weight_bits - 1)) ) >> weight_bits );
+            }
+        }
+    }
+
+    template <typename T, warp_class Class>
+    void warp_pixels(const cv::Mat& src, cv::Mat& dst, const affine_map& map,
+                     const warp_border border)
+    {
+        switch ( src.channels() )
+        {
+        case 1:
+            warp_kernel<T, 1, Class>(src, dst, map, border);
+            break;
+        case 2:
+            warp_kernel<T, 2, Class>(src, dst, map, border);
+            break;
+        case 3:
+            warp_kernel<T, 3, Class>(src, dst, map, border);
+            break;
+        default:
+            warp_kernel<T, 4, Class>(src, dst, map, border);
+            break;
+        }
+    }
+
+    /**
+     * Whether 'map' is of class 'Class': it has none of the terms the
+     * kernels of the class leave out.
+     */
+
+    bool of_class(const affine_map& map, const warp_class Class)
+    {
+        return Class == rotate_warp
+            or ( map.m[3] == 0 and (Class == shear_warp or map.m[1] == 0) );
+    }
+
+}
+
+
+affine_map invert(const affine_map& forward)
+{
+    const double* const m = forward.m;
+
+    double d = m[0] * m[4] - m[1] * m[3];
+    d = d != 0 ? 1.0 / d : 0;
+
+    affine_map inverse;
+    double* const r = inverse.m;
+
+    r[0] = m[4] * d;
+    r[1] = -m[1] * d;
+    r[3] = -m[3] * d;
+    r[4] = m[0] * d;
+    r[2] = -r[0] * m[2] - r[1] * m[5];
+    r[5] = -r[3] * m[2] - r[4] * m[5];
+
+    return inverse;
+}
+
+
+affine_map compose(const affine_map& second, const affine_map& first)
+{
+    const double* const a = second.m;
+    const double* const b = first.m;
+
+    affine_map c;
+    double* const r = c.m;
+
+    r[0] = a[0] * b[0] + a[1] * b[3];
+    r[1] = a[0] * b[1] + a[1] * b[4];
+    r[2] = a[0] * b[2] + a[1] * b[5] + a[2];
+    r[3] = a[3] * b[0] + a[4] * b[3];
+    r[4] = a[3] * b[1] + a[4] * b[4];
+    r[5] = a[3] * b[2] + a[4] * b[5] + a[5];
+
+    return c;
+}
+
+
+affine_map to_map(const cv::Mat& m)
+{
+    affine_map a;
+    for (int k = 0; k < 6; ++k)
+        a.m[k] = m.at<double>(k / 3, k % 3);
+    return a;
+}
+
+
+template <warp_class Class>
+bool warp_linear(const cv::Mat& src, cv::Mat& dst, const affine_map& map,
+                 const warp_border border)
+{
+    if ( src.type() != dst.type() or src.channels() > 4 or src.empty()
+         or not of_class(map, Class) )
+        return false;
+
+    switch ( src.depth() )
+    {
+    case CV_8U:
+        warp_pixels<uchar, Class>(src, dst, map, border);
+        return true;
+
+    case CV_16U:
+        warp_pixels<ushort, Class>(src, dst, map, border);
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+template bool warp_linear<scale_warp>(const cv::Mat&, cv::Mat&, const affine_map&,
+                                      const warp_border);
+template bool warp_linear<shear_warp>(const cv::Mat&, cv::Mat&, const affine_map&,
+                                      const warp_border);
+template bool warp_linear<rotate_warp>(const cv::Mat&, cv::Mat&, const affine_map&,
+                                       const warp_border);
+
+
+bool warp_linear(const cv::Mat& src, cv::Mat& dst, const affine_map& map,
+                 const warp_border border)
+{
+    return of_class(map, scale_warp) ? warp_linear<scale_warp>(src, dst, map, border)
+         : of_class(map, shear_warp) ? warp_linear<shear_warp>(src, dst, map, border)
+         : warp_linear<rotate_warp>(src, dst, map, border);
+}
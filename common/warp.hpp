@@ -0,0 +1,99 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+
+/**
+ * Fixed-point affine warps
+ *
+ * The interpolated transforms of the datasets (the rotations of mpeg7A,
+ * the skews of mpeg7D, the scalings done in strips) all come down to
+ * bilinear warps by an affine map known in advance. warp_linear() does
+ * them with kernels compiled for each pixel type (8 or 16 bits, 1 to 4
+ * channels) and each class of map (warp_class):
+ *
+ *      scale   x' and y' each depend on one of x, y only: the source
+ *              columns and their weights are the same on every row, and
+ *              are looked up in a table made once per image;
+ *      shear   y' depends on y only (a shear along the rows, or a
+ *              scaling): the source row is the same along a row;
+ *      rotate  any other map, rotations and skews among them.
+ *
+ * The arithmetic is that of cv::warpAffine with CV_INTER_LINEAR: source
+ * coordinates in fixed point with 10 fractional bits, stepped by integer
+ * additions along each row and rounded to 5 bits, and weights from a
+ * table of the 32 x 32 sub-pixel positions; the weights of a position
+ * being products of multiples of 1/32, the result is exact in integers.
+ * It is that of cv::warpAffine for 8 bits; for 16 bits, where OpenCV sums
+ * in float, the two may differ by 1 where the float sum is rounded. Pixels
+ * whose neighbours fall outside the source take the border value for
+ * those neighbours; the source coordinates being monotonic along a row,
+ * such pixels are at either end of it, and the run between them is done
+ * without a test.
+ */
+
+/**
+ * An affine map,
+ *
+ *      x' = m[0] x + m[1] y + m[2],
+ *      y' = m[3] x + m[4] y + m[5];
+ *
+ * warp_linear() takes one from destination to source coordinates.
+ */
+
+struct affine_map
+{
+    double m[6];
+};
+
+/**
+ * Inverse of 'forward', computed as cv::warpAffine does for a map given
+ * from source to destination (without CV_WARP_INVERSE_MAP).
+ */
+
+affine_map invert(const affine_map& forward);
+
+/**
+ * The map doing 'first', then 'second'.
+ */
+
+affine_map compose(const affine_map& second, const affine_map& first);
+
+/**
+ * Map of a 2 x 3 CV_64F matrix, as used by cv::warpAffine.
+ */
+
+affine_map to_map(const cv::Mat& m);
+
+/**
+ * Borders: outside the source, pixels are 0 (constant_border, as
+ * BORDER_CONSTANT with the default value) or the nearest edge pixel
+ * (replicate_border, as BORDER_REPLICATE).
+ */
+
+enum warp_border { constant_border, replicate_border };
+
+/**
+ * Classes of maps, as above.
+ */
+
+enum warp_class { scale_warp, shear_warp, rotate_warp };
+
+/**
+ * Fill 'dst', allocated by the caller, with 'src' warped by 'map' (from
+ * destination to source), with the kernels of class 'Class'. Returns
+ * false, leaving 'dst' untouched, if 'src' and 'dst' are not of the same
+ * type, 8 or 16 bits with 1 to 4 channels, or if 'map' is not of the
+ * class. Instantiated for the three classes.
+ */
+
+template <warp_class Class>
+bool warp_linear(const cv::Mat& src, cv::Mat& dst, const affine_map& map,
+                 const warp_border border = constant_border);
+
+/**
+ * The same, with the class of 'map' found at run time.
+ */
+
+bool warp_linear(const cv::Mat& src, cv::Mat& dst, const affine_map& map,
+                 const warp_border border = constant_border);
@@ -2,15 +2,53 @@
 #include <ciso646>
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #define BOOST_FILESYSTEM_NO_DEPRECATED 1
 #include <boost/filesystem.hpp>
 
 #include <opencv2/highgui/highgui.hpp>
 
+#include "../common/options.hpp"
+#include "settings.hpp"
+
 
 int scan_file(const boost::filesystem::path& p, 
-              const boost::filesystem::path& q);
+              const boost::filesystem::path& q,
+              const rigid_settings& settings, const run_options& opts);
+
+
+/**
+ * Parse a comma separated list of positive scale factors.
+ */
+
+bool parse_scales(const std::string& list, std::vector<double>& scales)
+{
+    using namespace std;
+
+    vector<double> parsed;
+
+    for (size_t at = 0; at <= list.size(); )
+    {
+        size_t end = list.find(',', at);
+        if (end == string::npos)
+            end = list.size();
+
+        const string item = list.substr(at, end - at);
+        char* rest = 0;
+
+        const double s = strtod(item.c_str(), &rest);
+        if (*rest or rest == item.c_str() or not (s > 0))
+            return false;
+
+        parsed.push_back(s);
+        at = end + 1;
+    }
+
+    scales.swap(parsed);
+    return true;
+}
 
 
 int main(const int argc, const char* argv[])
@@ -18,16 +56,81 @@ int main(const int argc, const char* argv[])
     using namespace boost::filesystem;
     using namespace std;
 
-    if (argc < 3)
+    bool usage = false;
+    rigid_settings settings;
+    run_options opts;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--legacy-interpolation")
+            settings.legacy = true;
+
+        else if (opt == "--scales" and arg + 1 < argc)
+        {
+            if ( not parse_scales(argv[++arg], settings.scales) )
+                usage = true;
+        }
+
+        else if (opt == "--strip-memory" and arg + 1 < argc)
+        {
+            const int mib = atoi(argv[++arg]);
+            if (mib > 0)
+                settings.strip_budget = size_t(mib) << 20;
+            else
+                usage = true;
+        }
+
+        else if (opt == "--vector")
+            settings.vector.enabled = true;
+
+        else if (opt == "--compare" and arg + 1 < argc)
+            settings.vector.compare = argv[++arg];
+
+        else if (opt == "--levels" and arg + 1 < argc)
+        {
+            if ( not parse_levels(argv[++arg], settings.vector.contour.levels) )
+                usage = true;
+        }
+
+        else if ( not parse_run_option(argc, argv, arg, opts, usage) )
+            usage = true;
+    }
+
+    if ( not settings.vector.enabled and not settings.vector.compare.empty() )
+        usage = true;
+
+    if (usage or argc - arg < 2)
     {
-        cout << "Usage: mpeg7A <src path> <dst path>\n";
+        cout << "\n"
+                "Usage: mpeg7A [options] <src path> <dst path>\n\n"
+                "  Options\n"
+                "  -------\n"
+                "  --legacy-interpolation\n"
+                "                     Interpolate the x2 scaling and the 90 degree\n"
+                "                     rotation too, as in the published dataset.\n"
+                "  --scales <list>    Scale factors, e.g. 2,4,8,16 (default\n"
+                "                     2,0.3,0.25,0.2,0.1), for suffixes -2, -3...\n"
+                "  --strip-memory <n> Make PNG outputs larger than <n> MiB (default\n"
+                "                     64) in strips of rows of at most <n> MiB.\n"
+                "  --vector           Make the contour files of the variants only,\n"
+                "                     from the contour files of the sources under\n"
+                "                     <src path>, by mapping their paths.\n"
+                "  --compare <path>   With --vector, compare every contour file\n"
+                "                     made with the one traced from the raster\n"
+                "                     output, in <path>/scale or <path>/rotation.\n"
+                "  --levels <list>    With --vector, the path levels written (as\n"
+                "                     for mpeg7contour).\n"
+             << run_options_usage << "\n";
         return EXIT_FAILURE;
     }
 
     try
     {
-        const path p = argv[1];
-        const path q = argv[2];
+        const path p = argv[arg];
+        const path q = argv[arg + 1];
 
         if ( not exists(p) )    // does p exist?
         {
@@ -80,7 +183,7 @@ int main(const int argc, const char* argv[])
             return EXIT_FAILURE;
         }
 
-        if (scan_file(p, q) != EXIT_SUCCESS)
+        if (scan_file(p, q, settings, opts) != EXIT_SUCCESS)
             return EXIT_FAILURE;
     }
 
@@ -1,8 +1,10 @@
 ﻿
+#include <algorithm>
 #include <ciso646>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <sstream>
 
 #define BOOST_FILESYSTEM_NO_DEPRECATED 1
 #include <boost/filesystem.hpp>
@@ -10,6 +12,17 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include "../common/frame_cache.hpp"
+#include "../common/grid.hpp"
+#include "../common/io_stage.hpp"
+#include "../common/mapped_file.hpp"
+#include "../common/parallel.hpp"
+#include "../common/strips.hpp"
+#include "../common/trace.hpp"
+#include "../common/warp.hpp"
+#include "../mpeg7contour/vector.hpp"
+#include "settings.hpp"
+
 
 /**
  * For each case use the linear transformation:
@@ -22,7 +35,8 @@
  *      A = [  s   0 ],     b = [ 0 ],      ^w = s · w,     ...     (w: width)
  *          [  0   s ]          [ 0 ]       ^h = s · h;     ...     (h: height)
  *
- * where s in { 2, 0.3, 0.25, 0.2, 0.1 }.
+ * where s in { 2, 0.3, 0.25, 0.2, 0.1 } (or the factors set in the
+ * settings).
  *
  *
  * For a counter-clockwise rotation of 'angle':
@@ -33,9 +47,101 @@
  *      ^w = | c · w | + | s · h |,     ^h = | s · w | + | c · h |;
  *
  * where angle in { 9, 36, 45, 90, 150 }.
+ *
+ *
+ * The scaling by 2 and the rotation by 90 degrees map pixels onto pixels,
+ * and are done exactly, by pixel replication and by a transpose and flip,
+ * unless the settings ask for the interpolated images of the published
+ * dataset.
+ *
+ * The other rotations are interpolated by the fixed-point kernels of
+ * warp.hpp, whose rotation maps are made from constant tables; they are
+ * those of cv::warpAffine for 8 bits. With the settings asking for the
+ * published dataset, cv::warpAffine does them itself.
+ *
+ * PNG outputs scaled up beyond the strip budget of the settings are made
+ * and encoded in strips of rows (see strips.hpp), so that large factors do
+ * not take memory in proportion to their square.
  */
 
 
+namespace
+{
+
+    // The database includes 420 shapes; 70 basic shapes and 5 
+    // derived shapes from each basic shape by rotation (in 
+    // digital domain) with angles: 9, 36, 45 (composed of 9 
+    // and 36 degree rotations), 90 and 150 degrees.
+    const double angle[5] = { 9.0, 36.0, 45.0, 90.0, 150.0 },
+                 sina[5] = {
+                     0.15643446504023087, 0.58778525229247314,
+                     0.70710678118654746, 1.0, 0.5 };
+
+    /**
+     * Map of the pixel centres of an image of size 'size' to those of its
+     * scaling to 'dsize', by cv::resize or by replication alike:
+     * x' = (x + 0.5) ^w / w - 0.5, and likewise for y.
+     */
+
+    affine_map scale_map(const cv::Size& size, const cv::Size& dsize)
+    {
+        const double kx = double(dsize.width) / size.width,
+                     ky = double(dsize.height) / size.height;
+
+        const affine_map m = {{ kx, 0, 0.5 * kx - 0.5, 0, ky, 0.5 * ky - 0.5 }};
+        return m;
+    }
+
+    /**
+     * Map of rotate_quarter (grid.hpp) on an image of size 'size'.
+     */
+
+    affine_map quarter_map(const cv::Size& size, const int turns)
+    {
+        const double w1 = size.width - 1,
+                     h1 = size.height - 1;
+
+        const affine_map m[3] = {
+            {{  0, 1, 0, -1,  0, w1 }},
+            {{ -1, 0, w1, 0, -1, h1 }},
+            {{  0, -1, h1, 1, 0, 0 }} };
+
+        return m[turns - 1];
+    }
+
+}
+
+
+/**
+ * Size of an image of size 'size' rotated by an angle of sine 'sa' (and
+ * positive cosine), as the rotations of the dataset are made.
+ */
+
+cv::Size rotated_size(const cv::Size& size, const double sa)
+{
+    const double ca = std::sqrt(1 - sa * sa);
+    return cv::Size( int(size.width * ca + size.height * sa + 0.5),
+                     int(size.width * sa + size.height * ca + 0.5) );
+}
+
+
+/**
+ * Matrix of cv::rotate: the counter-clockwise rotation by 'angle' degrees
+ * about the centre of an image of size 'size', recentred on a canvas of
+ * size 'dsize'.
+ */
+
+cv::Mat rotation_matrix(const cv::Size& size, const cv::Size& dsize,
+                        const double angle)
+{
+    const cv::Point2d centre(0.5 * size.width, 0.5 * size.height);
+    cv::Mat r = cv::getRotationMatrix2D(centre, angle, 1.0);
+    r.at<double>(0,2) += 0.5 * (dsize.width - size.width);
+    r.at<double>(1,2) += 0.5 * (dsize.height - size.height);
+    return r;
+}
+
+
 /**
  * Rigid transformations
  */
@@ -57,156 +163,395 @@ namespace cv
     void rotate(const Mat& src, Mat& dst, const Size& dsize, 
                 const double angle, const int flags = CV_INTER_LINEAR)
     {
-        const Point2d centre(0.5 * src.cols, 0.5 * src.rows);
-        Mat r = getRotationMatrix2D(centre, angle, 1.0);
-        if (dsize.width != 0)
-            r.at<double>(0,2) += 0.5 * (dsize.width - src.cols);
-        else if (dst.cols != 0)
-            r.at<double>(0,2) += 0.5 * (dst.cols - src.cols);
-        if (dsize.height != 0)
-            r.at<double>(1,2) += 0.5 * (dsize.height - src.rows);
-        else if (dst.rows != 0)
-            r.at<double>(1,2) += 0.5 * (dst.rows - src.rows);
-        warpAffine(src, dst, r, dsize, flags);
+        const Size size( dsize.width != 0 ? dsize.width
+                         : dst.cols != 0 ? dst.cols : src.cols,
+                         dsize.height != 0 ? dsize.height
+                         : dst.rows != 0 ? dst.rows : src.rows );
+        warpAffine(src, dst, rotation_matrix(src.size(), size, angle), dsize, flags);
+    }
+
+}
+
+
+namespace
+{
+
+    // Cosines and sines of the angles, as cv::getRotationMatrix2D computes
+    // them; constants, folded into each instantiation of rotation_map
+    const double rotation[5][2] = {
+        { 0.9876883405951378, 0.15643446504023087 },
+        { 0.8090169943749475, 0.5877852522924731 },
+        { 0.7071067811865476, 0.7071067811865475 },
+        { 6.123233995736766e-17, 1.0 },
+        { -0.8660254037844387, 0.49999999999999994 } };
+
+    /**
+     * Map of rotation_matrix for angle[I], from source to destination.
+     */
+
+    template <int I>
+    affine_map rotation_map(const cv::Size& size, const cv::Size& dsize)
+    {
+        const double c = rotation[I][0],
+                     s = rotation[I][1],
+                     cx = 0.5 * size.width,
+                     cy = 0.5 * size.height;
+
+        const affine_map m = {{
+             c, s, (1 - c) * cx - s * cy + 0.5 * (dsize.width - size.width),
+            -s, c, s * cx + (1 - c) * cy + 0.5 * (dsize.height - size.height) }};
+        return m;
+    }
+
+    /**
+     * The composite rotation: by angle[0], then by angle[1].
+     */
+
+    template <>
+    affine_map rotation_map<2>(const cv::Size& size, const cv::Size& dsize)
+    {
+        const cv::Size aux = rotated_size(size, sina[0]);
+        return compose( rotation_map<1>(aux, dsize), rotation_map<0>(size, aux) );
     }
 
+    typedef affine_map (*rotation_fn)(const cv::Size&, const cv::Size&);
+
+    const rotation_fn rotation_maps[5] = {
+        rotation_map<0>, rotation_map<1>, rotation_map<2>,
+        rotation_map<3>, rotation_map<4> };
+
 }
 
 
 int rigid_image(const boost::filesystem::path& p, 
-                const boost::filesystem::path& q)
+                const boost::filesystem::path& q,
+                const rigid_settings& settings, frame_cache& frames,
+                io_stage& io)
 {
     using namespace boost::filesystem;
     using namespace cv;
     using namespace std;
 
-    int status = EXIT_SUCCESS;
+    // Note: p has been checked to be a regular file by scan_file; its
+    // contents come prefetched from the I/O stage unless its decoded image
+    // is in the frame cache, and the outputs are encoded in memory and
+    // written behind the worker's back.
+
+    auto report = [](const path& f)
+    {
+        lock_guard<mutex> lock(console_mutex());
+        cout << "  \"" << f << "\"\n";
+    };
+
+    // Get the base filename for output files.
+    const path scl_p = q / "scale", 
+               rot_p = q / "rotation";
+
+    const path xt = p.extension();
+    path fn = p.filename();
+    fn.replace_extension("");
+    const string sn = fn.string();
+    fn = sn.substr( 0, sn.find_last_of('-') );
+
+    path rot_f = fn;
+    rot_f += "-1";
+    rot_f.replace_extension(xt);
+
+    {
+        lock_guard<mutex> lock(console_mutex());
+        cout << "Processing \"" << p << "\"\n Geenerating:\n";
+    }
+
+    // The decoded image, mapped from the frame cache if it is there
+    Mat src;
+    mapped_file frame;
+    const bool cached = frames.find(p, frame, src);
+
+    // The untransformed versions are copies of the source
+    path scl_f = scl_p / rot_f;
+    rot_f = rot_p / rot_f;
+    const bool copies = not exists(scl_f) or not exists(rot_f);
+
+    // Load the image
+    vector<uchar> bytes;
+    if ( (copies or not cached) and not io.fetch(p, bytes) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << p << " could not be read\n";
+        return EXIT_FAILURE;
+    }
+
+    vector<uchar> buf;
 
-    if ( exists(p) )  // does p actually exist?
+    if ( not exists(scl_f) )
+        buf = bytes, io.write(scl_f, buf);
+    report(scl_f);
+
+    if ( not exists(rot_f) )
+        buf = bytes, io.write(rot_f, buf);
+    report(rot_f);
+
+    if (not cached)
     {
-        if ( is_regular_file(p) )   // is p a regular file? 
         {
-            // Get the base filename for output files.
-            const path scl_p = q / "scale", 
-                       rot_p = q / "rotation";
-
-            const path xt = p.extension();
-            path fn = p.filename();
-            fn.replace_extension("");
-            const string sn = fn.string();
-            fn = sn.substr( 0, sn.find_last_of('-') );
-
-            path rot_f = fn;
-            rot_f += "-1";
-            rot_f.replace_extension(xt);
-
-            cout << "Processing \"" << p << "\"\n Geenerating:\n";
-
-            path scl_f = scl_p / rot_f;
-            if ( not exists(scl_f) )
-                copy(p, scl_f); // create_hard_link
-            cout << "  \"" << scl_f << "\"\n";
-
-            rot_f = rot_p / rot_f;
-            if ( not exists(rot_f) )
-                copy(p, rot_f); // create_hard_link
-            cout << "  \"" << rot_f << "\"\n";
-
-            // Load the image
-            Mat src = imread( p.string(), CV_LOAD_IMAGE_ANYDEPTH );
-
-            // The database includes 420 shapes; 70 basic shapes and 5
-            // derived shapes from each basic shape by scaling digital
-            // images with factors 2, 0.3, 0.25, 0.2, and 0.1.
-            const double scale[5] = { 2.00, 0.30, 0.25, 0.20, 0.10 };
-
-            // The database includes 420 shapes; 70 basic shapes and 5 
-            // derived shapes from each basic shape by rotation (in 
-            // digital domain) with angles: 9, 36, 45 (composed of 9 
-            // and 36 degree rotations), 90 and 150 degrees.
-            const double angle[5] = { 9.0, 36.0, 45.0, 90.0, 150.0 },
-                         sina[5] = {
-                             0.15643446504023087, 0.58778525229247314,
-                             0.70710678118654746, 1.0, 0.5 };
-
-            // File name suffixes
-            const char* fs[5] = { "-2", "-3", "-4", "-5", "-6" };
-
-            // PNG saving options
-            vector<int> opt;
-            opt.push_back(CV_IMWRITE_PNG_COMPRESSION);
-            opt.push_back(9);
-
-            // Create transformed versions
-            for (int i = 0; i < 5; ++i)
-            {
-                // Set file name for scaled figure
-                rot_f = fn, rot_f += fs[i], rot_f.replace_extension(xt);
-                scl_f = scl_p / rot_f;
+            trace_scope scope("decode");
+            src = imdecode( Mat(bytes), CV_LOAD_IMAGE_ANYDEPTH );
+        }
 
-                if ( not exists(scl_f) )
-                {
-                    // Set the dst image the same type as src and scaled size
-                    Size scl_size( int(src.cols * scale[i] + 0.5),
-                                   int(src.rows * scale[i] + 0.5) );
+        if ( src.empty() )
+        {
+            lock_guard<mutex> lock(console_mutex());
+            clog << p << " could not be decoded\n";
+            return EXIT_FAILURE;
+        }
 
-                    Mat scl = Mat::zeros( scl_size, src.type() );
+        frames.store(p, src, buf, io);
+    }
 
-                    // Scale the image
-                    resize(src, scl, scl_size, scale[i], scale[i], 
-                           scale[i] > 1 ? CV_INTER_LINEAR : CV_INTER_AREA);
+    const vector<double>& scale = settings.scales;
+    const bool legacy = settings.legacy;
 
-                    // Save the image
-                    imwrite( scl_f.string(), scl, opt );
-                    cout << "  \"" << scl_f << "\"\n";
-                }
+    // PNG saving options
+    vector<int> opt;
+    opt.push_back(CV_IMWRITE_PNG_COMPRESSION);
+    opt.push_back(9);
 
-                // Set file name for rotated figure
-                rot_f = rot_p / rot_f;
+    // Create transformed versions
+    const size_t n = max<size_t>(5, scale.size());
+    for (size_t i = 0; i < n; ++i)
+    {
+        // File name suffix: -2, -3, ...
+        ostringstream fs;
+        fs << '-' << i + 2;
 
-                if ( not exists(rot_f) )
-                {
-                    // Set the dst image the same type as src and rotated size
-                    const double sa = sina[i], ca = sqrt(1 - sa * sa);
-                    Size rot_size( int(src.cols * ca + src.rows * sa + 0.5) ,
-                                   int(src.cols * sa + src.rows * ca + 0.5) );
+        // Set file name for scaled figure
+        rot_f = fn, rot_f += fs.str(), rot_f.replace_extension(xt);
+        scl_f = scl_p / rot_f;
 
-                    Mat rot = Mat::zeros( rot_size, src.type() );
+        if ( i < scale.size() and not exists(scl_f) )
+        {
+            // Set the dst image the same type as src and scaled size
+            Size scl_size( int(src.cols * scale[i] + 0.5),
+                           int(src.rows * scale[i] + 0.5) );
 
-                    // Rotate the image
-                    if (i != 2) // is it a single rotation?
-                        rotate(src, rot, rot_size, angle[i], CV_INTER_LINEAR);
+            int factor;
+            const bool exact = not legacy and is_integer_scale(scale[i], factor);
 
-                    else // it is a composite rotation!
-                    {
-                        const double sb = sina[0], cb = sqrt(1 - sb * sb);
-                        Size aux_size( int(src.cols * cb + src.rows * sb + 0.5) ,
-                                       int(src.cols * sb + src.rows * cb + 0.5) );
+            // Too large to be held whole: scale and encode in strips
+            const bool large = scale[i] > 1 and xt == ".png"
+                and double(scl_size.area()) * src.elemSize() > settings.strip_budget;
 
-                        Mat aux = Mat::zeros( aux_size, src.type() );
+            if (large)
+            {
+                const strip_filler fill = [&](const int y, Mat& strip)
+                {
+                    trace_scope scope("warp");
+                    if (exact)
+                        replicate_rows(src, factor, y, strip);
+                    else
+                        scale_strip(src, scl_size, y, strip);
+                };
+
+                const int rows = strip_rows(scl_size.width, src.type(),
+                                            settings.strip_budget);
+
+                trace_scope scope("encode");
+                if ( not encode_png_strips(scl_size, src.type(), rows, 9, fill, buf) )
+                {
+                    lock_guard<mutex> lock(console_mutex());
+                    clog << scl_f << " could not be encoded\n";
+                    return EXIT_FAILURE;
+                }
+            }
 
-                        rotate(src, aux, aux_size, angle[0], CV_INTER_LINEAR);
-                        rotate(aux, rot, rot_size, angle[1], CV_INTER_LINEAR);
-                    }
+            else
+            {
+                Mat scl = Mat::zeros( scl_size, src.type() );
 
-                    // Save the image
-                    imwrite( rot_f.string(), rot, opt );
-                    cout << "  \"" << rot_f << "\"\n";
+                // Scale the image
+                {
+                    trace_scope scope("warp");
+                    if (exact)
+                        replicate(src, scl, factor);
+                    else
+                        resize(src, scl, scl_size, scale[i], scale[i], 
+                               scale[i] > 1 ? CV_INTER_LINEAR : CV_INTER_AREA);
                 }
+
+                // Encode the image
+                trace_scope scope("encode");
+                imencode( xt.string(), scl, buf, opt );
             }
+
+            // Save the image
+            io.write( scl_f, buf );
+            report(scl_f);
         }
 
-        else    // p is not a regular file!
+        // Set file name for rotated figure
+        rot_f = rot_p / rot_f;
+
+        if ( i < 5 and not exists(rot_f) )
         {
-            clog << p << " exists, but is not a regular file\n";
-            status = EXIT_FAILURE;
+            // Set the dst image the same type as src and rotated size
+            const Size rot_size = rotated_size(src.size(), sina[i]);
+
+            Mat rot = Mat::zeros( rot_size, src.type() );
+
+            // Rotate 'from' onto 'to' by angle[k]: with the fixed-point
+            // kernels, or with cv::warpAffine as in the published dataset
+            // (and for the depths the kernels do not do)
+            auto turn = [&](const Mat& from, Mat& to, const int k)
+            {
+                if ( legacy or not warp_linear<rotate_warp>( from, to,
+                         invert( rotation_maps[k](from.size(), to.size()) ) ) )
+                    rotate(from, to, to.size(), angle[k], CV_INTER_LINEAR);
+            };
+
+            // Rotate the image
+            {
+                trace_scope scope("warp");
+
+                int turns;
+                if ( not legacy and i != 2 and is_quarter_turn(angle[i], turns) )
+                    rotate_quarter(src, rot, turns);
+
+                else if (i != 2) // is it a single rotation?
+                    turn(src, rot, int(i));
+
+                else // it is a composite rotation!
+                {
+                    const Size aux_size = rotated_size(src.size(), sina[0]);
+
+                    Mat aux = Mat::zeros( aux_size, src.type() );
+
+                    turn(src, aux, 0);
+                    turn(aux, rot, 1);
+                }
+            }
+
+            // Save the image
+            {
+                trace_scope scope("encode");
+                imencode( xt.string(), rot, buf, opt );
+            }
+            io.write( rot_f, buf );
+            report(rot_f);
         }
     }
 
-    else    // p does not exists!
+    return EXIT_SUCCESS;
+}
+
+
+int rigid_vector(const boost::filesystem::path& p, 
+                 const boost::filesystem::path& q,
+                 const rigid_settings& settings, vector_workspace& ws,
+                 io_stage& io, divergence_report& report)
+{
+    using namespace boost::filesystem;
+    using namespace cv;
+    using namespace std;
+
+    // Note: p is the contour file of a source image; the contour files of
+    // the variants are made from it, in the vector domain, as mpeg7contour
+    // would trace them from the images rigid_image makes.
+
+    // Get the base filename for output files.
+    const path scl_p = q / "scale", 
+               rot_p = q / "rotation";
+
+    path fn = p.filename();
+    fn.replace_extension("");
+    const string sn = fn.string();
+    fn = sn.substr( 0, sn.find_last_of('-') );
+
+    path rot_f = fn;
+    rot_f += "-1.ctx";
+
     {
-        clog << p << " does not exist\n";
+        lock_guard<mutex> lock(console_mutex());
+        cout << "Processing \"" << p << "\"\n Generating:\n";
+    }
+
+    if ( load_silhouette(p, ws, io) != EXIT_SUCCESS )
         return EXIT_FAILURE;
+
+    // The untransformed versions are copies of the source
+    vector<uchar> buf;
+
+    path scl_f = scl_p / rot_f;
+    if ( not exists(scl_f) )
+        buf = ws.bytes, io.write(scl_f, buf);
+
+    rot_f = rot_p / rot_f;
+    if ( not exists(rot_f) )
+        buf = ws.bytes, io.write(rot_f, buf);
+
+    // The contour files traced from the raster outputs, if compared
+    auto raster = [&](const char* dir, const path& f)
+    {
+        return settings.vector.compare.empty() ? path()
+             : settings.vector.compare / dir / f.filename();
+    };
+
+    const Size src( int(ws.base.width), int(ws.base.height) );
+    const vector<double>& scale = settings.scales;
+
+    int status = EXIT_SUCCESS;
+
+    // Create transformed versions
+    const size_t n = max<size_t>(5, scale.size());
+    for (size_t i = 0; i < n; ++i)
+    {
+        // File name suffix: -2, -3, ...
+        ostringstream fs;
+        fs << '-' << i + 2 << ".ctx";
+
+        // Set file name for scaled figure
+        rot_f = fn, rot_f += fs.str();
+        scl_f = scl_p / rot_f;
+
+        if ( i < scale.size() and not exists(scl_f) )
+        {
+            Size scl_size( int(src.width * scale[i] + 0.5),
+                           int(src.height * scale[i] + 0.5) );
+
+            ostringstream kind;
+            kind << "scale " << scale[i];
+
+            if ( vector_variant( scale_map(src, scl_size), scl_size, scl_f,
+                                 raster("scale", scl_f), kind.str(),
+                                 settings.vector, ws, io, report ) != EXIT_SUCCESS )
+                status = EXIT_FAILURE;
+        }
+
+        // Set file name for rotated figure
+        rot_f = rot_p / rot_f;
+
+        if ( i < 5 and not exists(rot_f) )
+        {
+            const Size rot_size = rotated_size(src, sina[i]);
+
+            // The map of the image rotation, composed for the composite
+            // rotation
+            affine_map m;
+
+            int turns;
+            if ( not settings.legacy and i != 2 and is_quarter_turn(angle[i], turns) )
+                m = quarter_map(src, turns);
+
+            else
+                m = rotation_maps[i](src, rot_size);
+
+            ostringstream kind;
+            kind << "rotation " << angle[i];
+
+            if ( vector_variant( m, rot_size, rot_f, raster("rotation", rot_f),
+                                 kind.str(), settings.vector, ws, io,
+                                 report ) != EXIT_SUCCESS )
+                status = EXIT_FAILURE;
+        }
     }
 
     return status;
@@ -1,68 +1,115 @@
-
+#include <algorithm>
 #include <ciso646>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
 #define BOOST_FILESYSTEM_NO_DEPRECATED 1
 #include <boost/filesystem.hpp>
 
+#include "../common/commit.hpp"
+#include "../common/frame_cache.hpp"
+#include "../common/io_stage.hpp"
+#include "../common/manifest.hpp"
+#include "../common/options.hpp"
+#include "../common/parallel.hpp"
+#include "../common/shard.hpp"
+#include "../common/sources.hpp"
+#include "settings.hpp"
+
 
 int rigid_image(const boost::filesystem::path& p, 
-                const boost::filesystem::path& q);
+                const boost::filesystem::path& q,
+                const rigid_settings& settings, frame_cache& frames,
+                io_stage& io);
+
+int rigid_vector(const boost::filesystem::path& p, 
+                 const boost::filesystem::path& q,
+                 const rigid_settings& settings, vector_workspace& ws,
+                 io_stage& io, divergence_report& report);
 
 
-int scan_file(const boost::filesystem::path& p, const boost::filesystem::path& q)
+int scan_file(const boost::filesystem::path& p, const boost::filesystem::path& q,
+              const rigid_settings& settings, const run_options& opts)
 {
     using namespace boost::filesystem;
     using namespace std;
 
-    int status = EXIT_SUCCESS;
+    vector<path> files;
 
-    if ( exists(p) )    // does p actually exist?
+    int status = collect_sources(p, files);
+
+    // Images staged by an interrupted run are incomplete. With several
+    // shards at work, they may as well be another shard's pending writes.
+    if (opts.shards == 1)
     {
-        if ( is_regular_file(p) )     // is p a regular file?
-        {
-            if ( rigid_image(p, q) != EXIT_SUCCESS )
-                status = EXIT_FAILURE;
-        }
-
-        else if ( is_directory(p) )   // is p a directory?
-        {
-            for ( auto it = directory_iterator(p);   // iterate through directory
-                  it != directory_iterator(); ++it )
-            {
-                if ( is_regular_file(*it) )   // is *it a regular file?   
-                {
-                    if ( rigid_image(*it, q) != EXIT_SUCCESS )
-                        status = EXIT_FAILURE;
-                }
-
-                else if ( is_directory(*it) )   // is *it a directory?
-                {
-                    if (scan_file(*it, q) != EXIT_SUCCESS)
-                        status = EXIT_FAILURE;
-                }
-
-                else    // *it is neither a regular file nor a directory!
-                {
-                    clog << *it << " exists, but is neither a regular file nor a directory\n";
-                    status = EXIT_FAILURE;
-                }
-            }
-        }
-
-        else    // p is neither a regular file nor a directory!
-        {
-            clog << p << " exists, but is neither a regular file nor a directory\n";
-            return EXIT_FAILURE;
-        }
+        remove_staged(q / "scale");
+        remove_staged(q / "rotation");
     }
 
-    else    // p does not exists!
+    // In the vector mode the sources are the contour files of the images
+    vector<path> pending;
+    for (size_t i = 0; i < files.size(); ++i)
+        if ( not settings.vector.enabled or files[i].extension() == ".ctx" )
+            pending.push_back(files[i]);
+
+    // Sources sharing a base name (the file name up to its last '-') map
+    // onto the same outputs; only the first one, in path order, is
+    // processed. Every shard makes the same choice before keeping its own
+    // share of the sources. The sources are processed in the order they
+    // were found, which is archive order for archive members.
+    unique_sources(pending, [](const path& f) -> string
     {
-        clog << p << " does not exist\n";
-        return EXIT_FAILURE;
-    }
+        const string sn = f.stem().string();
+        return sn.substr( 0, sn.find_last_of('-') );
+    });
+
+    select_shard(pending, p, opts.shard, opts.shards);
+
+    manifest m("mpeg7A", opts.shard, opts.shards, p);
+
+    io_stage io(opts.io, opts.io_threads, opts.lookahead, opts.durable);
+
+    // Images decoded by a previous run are mapped from the frame cache;
+    // only the other sources are read ahead. Contour files are not images.
+    frame_cache frames(settings.vector.enabled ? string() : opts.frames);
+    io.prefetch( frames.misses(pending) );
+
+    // One workspace per worker in the vector mode
+    vector< unique_ptr<vector_workspace> > ws;
+    if (settings.vector.enabled)
+        for (unsigned w = 0; w < max(opts.jobs, 1u); ++w)
+            ws.push_back( unique_ptr<vector_workspace>(new vector_workspace) );
+
+    divergence_report report;
+
+    auto task = [&](const path& f, const unsigned w)
+    {
+        const int s = settings.vector.enabled
+                    ? rigid_vector(f, q, settings, *ws[w], io, report)
+                    : rigid_image(f, q, settings, frames, io);
+        m.record(f, s == EXIT_SUCCESS ? manifest::done : manifest::failed);
+        return s;
+    };
+
+    if ( parallel_for_each(pending, opts.jobs, task) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( io.drain() != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( not report.empty() )
+        report.print(cout);
+
+    if ( frames.enabled() )
+        cout << frames.hits() << " images mapped from the frame cache, "
+             << frames.stores() << " added to it\n";
+
+    if ( not opts.manifest.empty()
+         and m.save(opts.manifest, status, opts.durable) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
 
     return status;
 }
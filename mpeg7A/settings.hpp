@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "../mpeg7contour/vector.hpp"
+
+
+/**
+ * What the rigid stage makes of an image
+ */
+
+struct rigid_settings
+{
+    bool legacy;                    // interpolate exact transforms too
+    std::vector<double> scales;     // scale factors, for suffixes -2, -3...
+    size_t strip_budget;            // bytes of an output made whole, beyond
+                                    // which it is made in strips (strips.hpp)
+    vector_settings vector;         // contour files only, in the vector
+                                    // domain (vector.hpp)
+
+    rigid_settings()
+        : legacy(false), strip_budget(64 << 20)
+    {
+        // The database includes 420 shapes; 70 basic shapes and 5
+        // derived shapes from each basic shape by scaling digital
+        // images with factors 2, 0.3, 0.25, 0.2, and 0.1.
+        const double mpeg7[5] = { 2.00, 0.30, 0.25, 0.20, 0.10 };
+        scales.assign(mpeg7, mpeg7 + 5);
+    }
+};
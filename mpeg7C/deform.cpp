@@ -0,0 +1,165 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "../common/io_stage.hpp"
+#include "../common/parallel.hpp"
+#include "../common/trace.hpp"
+#include "../mpeg7contour/cache.hpp"
+#include "fields.hpp"
+#include "settings.hpp"
+#include "workspace.hpp"
+
+
+boost::filesystem::path ctx_path(const boost::filesystem::path& p,
+                                 const boost::filesystem::path& q);
+
+int trace_image(const cv::Mat& src, const boost::filesystem::path& ctx_p,
+                const contour_settings& settings, result_cache& cache,
+                contour_workspace& ws, io_stage& io);
+
+
+int deform_image(const boost::filesystem::path& p,
+                 const boost::filesystem::path& q,
+                 const deform_settings& settings, field_cache& fields,
+                 result_cache& cache, deform_workspace& ws, io_stage& io)
+{
+    using namespace boost::filesystem;
+    using namespace cv;
+    using namespace std;
+
+    // Note: p has been checked to be a regular file by scan_file; its
+    // contents come prefetched from the I/O stage, and the outputs are
+    // encoded in memory and written behind the worker's back.
+
+    // Get the base filename for output files.
+    const path def_p = q / "nonrigid";
+
+    const path xt = p.extension();
+    path fn = p.filename();
+    fn.replace_extension("");
+    const string sn = fn.string();
+    fn = sn.substr( 0, sn.find_last_of('-') );
+
+    path def_f = fn;
+    def_f += "-1";
+    def_f.replace_extension(xt);
+    def_f = def_p / def_f;
+
+    {
+        lock_guard<mutex> lock(console_mutex());
+        cout << "Processing \"" << p << "\"\n Generating:\n";
+    }
+
+    // Load the image
+    if ( not io.fetch(p, ws.bytes) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << p << " could not be read\n";
+        return EXIT_FAILURE;
+    }
+
+    // The undeformed shape is a copy of the source
+    if ( not exists(def_f) )
+    {
+        ws.buf = ws.bytes;
+        io.write(def_f, ws.buf);
+
+        lock_guard<mutex> lock(console_mutex());
+        cout << "  \"" << def_f << "\"\n";
+    }
+
+    {
+        trace_scope scope("decode");
+        imdecode( Mat(ws.bytes), CV_LOAD_IMAGE_ANYDEPTH, &ws.src );
+    }
+
+    if ( ws.src.empty() )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << p << " could not be decoded\n";
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+
+    if ( settings.contours and not exists( ctx_path(def_f, def_p) ) )
+    {
+        ws.contour.reset();
+        if ( trace_image( ws.src, ctx_path(def_f, def_p), settings.contour,
+                          cache, ws.contour, io ) != EXIT_SUCCESS )
+            status = EXIT_FAILURE;
+    }
+
+    // What is pulled in from beyond the canvas is the background, the
+    // value of the top-left pixel
+    const Scalar background = mean( ws.src( Rect(0, 0, 1, 1) ) );
+
+    // PNG saving options
+    vector<int> opt;
+    opt.push_back(CV_IMWRITE_PNG_COMPRESSION);
+    opt.push_back(9);
+
+    // Create the variants, -2, -3... by field, then by amplitude
+    int suffix = 2;
+    for (unsigned i = 0; i < settings.fields; ++i)
+        for (size_t j = 0; j < settings.amplitudes.size(); ++j, ++suffix)
+        {
+            def_f = fn;
+            def_f += "-" + to_string( static_cast<long long>(suffix) );
+            def_f.replace_extension(xt);
+            def_f = def_p / def_f;
+
+            const path ctx_f = ctx_path(def_f, def_p);
+            const bool image = not exists(def_f),
+                       trace = settings.contours and not exists(ctx_f);
+
+            if (not image and not trace)
+                continue;
+
+            const shared_ptr<const displacement_field> field
+                = fields.get( ws.src.size(), i, settings.amplitudes[j] );
+
+            {
+                trace_scope scope("remap");
+                remap( ws.src, ws.variant, field->map1, field->map2,
+                       CV_INTER_LINEAR, BORDER_CONSTANT, background );
+            }
+
+            if (image)
+            {
+                // Save the image
+                {
+                    trace_scope scope("encode");
+                    imencode( xt.string(), ws.variant, ws.buf, opt );
+                }
+                io.write( def_f, ws.buf );
+
+                lock_guard<mutex> lock(console_mutex());
+                cout << "  \"" << def_f << "\" (field " << i << ", amplitude "
+                     << fixed << setprecision(3) << settings.amplitudes[j] << ")\n";
+            }
+
+            // Trace the variant while it is at hand
+            if (trace)
+            {
+                ws.contour.reset();
+                if ( trace_image( ws.variant, ctx_f, settings.contour, cache,
+                                  ws.contour, io ) != EXIT_SUCCESS )
+                    status = EXIT_FAILURE;
+            }
+        }
+
+    return status;
+}
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <ciso646>
+#include <string>
+#include <vector>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "../common/hash.hpp"
+#include "../common/trace.hpp"
+#include "fields.hpp"
+
+
+namespace
+{
+
+    /**
+     * Catmull-Rom weights of the control points i - 1 .. i + 2 at t in
+     * [0, 1] between points i and i + 1.
+     */
+
+    inline void spline_weights(const double t, double w[4])
+    {
+        const double t2 = t * t,
+                     t3 = t2 * t;
+
+        w[0] = (-t3 + 2 * t2 - t) / 2;
+        w[1] = (3 * t3 - 5 * t2 + 2) / 2;
+        w[2] = (-3 * t3 + 4 * t2 + t) / 2;
+        w[3] = (t3 - t2) / 2;
+    }
+
+    /**
+     * Cell and weights of the control points of 'n' pixels along an axis
+     * of 'grid' cells: the tap of pixel i is the first of its 4 control
+     * points, clamped to the grid at the ends.
+     */
+
+    void axis_weights(const int n, const unsigned grid, std::vector<int>& taps,
+                      std::vector<double>& weights)
+    {
+        taps.resize(n * 4);
+        weights.resize(n * 4);
+
+        for (int i = 0; i < n; ++i)
+        {
+            const double u = n > 1 ? double(i) * grid / (n - 1) : 0;
+            const int cell = std::min( static_cast<int>(u), static_cast<int>(grid) - 1 );
+
+            spline_weights( u - cell, &weights[i * 4] );
+            for (int k = 0; k < 4; ++k)
+                taps[i * 4 + k] = std::min( std::max(cell - 1 + k, 0),
+                                            static_cast<int>(grid) );
+        }
+    }
+
+}
+
+
+void displacement_maps(const cv::Size& size, const unsigned grid,
+                       const unsigned seed, const unsigned index,
+                       const double amplitude, cv::Mat& mapx, cv::Mat& mapy)
+{
+    using namespace std;
+
+    const int points = grid + 1;
+
+    // The control points of the field, the same for every canvas
+    hash128 h(seed);
+    h.update( "field " + to_string( static_cast<unsigned long long>(index) ) );
+    cv::RNG rng( stoull(h.hex().substr(0, 16), 0, 16) );
+
+    vector<double> control(points * points * 2);
+    for (size_t k = 0; k < control.size(); ++k)
+        control[k] = rng.uniform(-1.0, 1.0);
+
+    vector<int> xtaps, ytaps;
+    vector<double> xweights, yweights;
+    axis_weights(size.width, grid, xtaps, xweights);
+    axis_weights(size.height, grid, ytaps, yweights);
+
+    // Every row of control points interpolated along x, then each pixel
+    // along y from those
+    vector<double> rows(points * size.width * 2);
+    for (int r = 0; r < points; ++r)
+        for (int x = 0; x < size.width; ++x)
+            for (int c = 0; c < 2; ++c)
+            {
+                double s = 0;
+                for (int k = 0; k < 4; ++k)
+                    s += xweights[x * 4 + k] * control[ (r * points + xtaps[x * 4 + k]) * 2 + c ];
+                rows[ (r * size.width + x) * 2 + c ] = s;
+            }
+
+    const double ax = amplitude * size.width,
+                 ay = amplitude * size.height;
+
+    mapx.create(size, CV_32FC1);
+    mapy.create(size, CV_32FC1);
+
+    for (int y = 0; y < size.height; ++y)
+    {
+        float* const mx = mapx.ptr<float>(y);
+        float* const my = mapy.ptr<float>(y);
+        const int* const t = &ytaps[y * 4];
+        const double* const w = &yweights[y * 4];
+
+        for (int x = 0; x < size.width; ++x)
+        {
+            double dx = 0,
+                   dy = 0;
+            for (int k = 0; k < 4; ++k)
+            {
+                dx += w[k] * rows[ (t[k] * size.width + x) * 2 ];
+                dy += w[k] * rows[ (t[k] * size.width + x) * 2 + 1 ];
+            }
+
+            mx[x] = static_cast<float>(x + ax * dx);
+            my[x] = static_cast<float>(y + ay * dy);
+        }
+    }
+}
+
+
+bool field_cache::key::operator<(const key& k) const
+{
+    if (width != k.width)
+        return width < k.width;
+    if (height != k.height)
+        return height < k.height;
+    if (index != k.index)
+        return index < k.index;
+    return amplitude < k.amplitude;
+}
+
+
+field_cache::field_cache(const unsigned grid, const unsigned seed, const size_t budget)
+    : grid_( std::max(grid, 1u) ), seed_(seed), budget_(budget), bytes_(0),
+      clock_(0), hits_(0), made_(0)
+{
+}
+
+
+std::shared_ptr<const displacement_field> field_cache::get(const cv::Size& size,
+                                                          const unsigned index,
+                                                          const double amplitude)
+{
+    using namespace std;
+
+    const key k = { size.width, size.height, index, amplitude };
+
+    {
+        lock_guard<mutex> lock(mutex_);
+
+        const map<key, entry>::iterator e = entries_.find(k);
+        if ( e != entries_.end() )
+        {
+            e->second.used = ++clock_;
+            ++hits_;
+            return e->second.field;
+        }
+    }
+
+    // Made outside the lock, so that the workers needing other fields, or
+    // none, go on
+    shared_ptr<displacement_field> f = make_shared<displacement_field>();
+    {
+        trace_scope scope("field");
+
+        cv::Mat mapx, mapy;
+        displacement_maps(size, grid_, seed_, index, amplitude, mapx, mapy);
+        cv::convertMaps(mapx, mapy, f->map1, f->map2, CV_16SC2);
+    }
+    ++made_;
+
+    lock_guard<mutex> lock(mutex_);
+
+    const pair<map<key, entry>::iterator, bool> e
+        = entries_.insert( make_pair( k, entry() ) );
+
+    if (not e.second)
+    {
+        e.first->second.used = ++clock_;
+        return e.first->second.field;
+    }
+
+    e.first->second.field = f;
+    e.first->second.used = ++clock_;
+    bytes_ += f->bytes();
+
+    // The least recently used beyond the budget, never the one just made
+    while (bytes_ > budget_ and entries_.size() > 1)
+    {
+        map<key, entry>::iterator oldest = entries_.end();
+        for (map<key, entry>::iterator i = entries_.begin(); i != entries_.end(); ++i)
+            if ( i != e.first and (oldest == entries_.end() or i->second.used < oldest->second.used) )
+                oldest = i;
+
+        bytes_ -= oldest->second.field->bytes();
+        entries_.erase(oldest);
+    }
+
+    return f;
+}
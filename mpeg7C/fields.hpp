@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <opencv2/core/core.hpp>
+
+
+/**
+ * Smooth random displacement fields
+ *
+ * A field is drawn on a grid of (grid + 1) x (grid + 1) control points
+ * spread evenly over the unit square: each gets a displacement of
+ * uniform random components in [-1, 1]. Between them, the displacement is
+ * interpolated by Catmull-Rom splines, row then column, which makes it
+ * smooth and passes it through the control points. Field 'index' of
+ * 'seed' is the same deformation of the unit square whatever the image:
+ * on a canvas of w x h pixels, the pixel (x, y) of a variant is taken
+ * from the source at
+ *
+ *      x + amplitude w dx(x / (w - 1), y / (h - 1)),
+ *      y + amplitude h dy(x / (w - 1), y / (h - 1)).
+ *
+ * The map folds over itself where the displacement changes by a pixel or
+ * more from one pixel to the next, which takes an amplitude x grid of
+ * about 0.4; smaller products give smooth, one-to-one deformations.
+ */
+
+/**
+ * The maps of cv::remap making one variant, in fixed point (CV_16SC2 and
+ * CV_16UC1, see cv::convertMaps), the fastest form of them.
+ */
+
+struct displacement_field
+{
+    cv::Mat map1,
+            map2;
+
+    size_t bytes() const
+    {
+        return map1.total() * map1.elemSize() + map2.total() * map2.elemSize();
+    }
+};
+
+/**
+ * Make field 'index' of 'seed', on 'grid' cells a side, for a canvas of
+ * 'size' at 'amplitude', into the floating point maps 'mapx' and 'mapy'
+ * (CV_32FC1).
+ */
+
+void displacement_maps(const cv::Size& size, const unsigned grid,
+                       const unsigned seed, const unsigned index,
+                       const double amplitude, cv::Mat& mapx, cv::Mat& mapy);
+
+/**
+ * Fields shared by every worker
+ *
+ * Many sources have the same canvas, so each field is made once per
+ * canvas size and amplitude and kept for the images that follow, whatever
+ * the worker. A worker asking for a field that is not there makes it
+ * without holding the others back; if two make the same one at once, the
+ * first stored is kept. Beyond 'budget' bytes of fields, the least
+ * recently used ones are dropped; those being applied stay alive until
+ * their workers are done with them.
+ */
+
+class field_cache
+{
+public:
+
+    field_cache(const unsigned grid, const unsigned seed, const size_t budget);
+
+    /**
+     * Field 'index' for a canvas of 'size' at 'amplitude'.
+     */
+
+    std::shared_ptr<const displacement_field> get(const cv::Size& size,
+                                                  const unsigned index,
+                                                  const double amplitude);
+
+    size_t hits() const { return hits_; }
+
+    size_t made() const { return made_; }
+
+private:
+
+    field_cache(const field_cache&);                // non-copyable
+    field_cache& operator=(const field_cache&);
+
+    struct key
+    {
+        int width,
+            height;
+        unsigned index;
+        double amplitude;
+
+        bool operator<(const key& k) const;
+    };
+
+    struct entry
+    {
+        std::shared_ptr<const displacement_field> field;
+        size_t used;                // clock_ when last asked for
+    };
+
+    const unsigned grid_,
+                   seed_;
+    const size_t budget_;
+
+    std::mutex mutex_;
+    std::map<key, entry> entries_;
+    size_t bytes_,
+           clock_;
+
+    std::atomic<size_t> hits_,
+                        made_;
+};
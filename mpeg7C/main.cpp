@@ -0,0 +1,232 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include "../common/options.hpp"
+#include "settings.hpp"
+
+
+int scan_file(const boost::filesystem::path& p, 
+              const boost::filesystem::path& q,
+              const deform_settings& settings, const run_options& opts);
+
+
+/**
+ * Parse a comma separated list of shares of the canvas, in (0, 1).
+ */
+
+bool parse_amplitudes(const std::string& list, std::vector<double>& amplitudes)
+{
+    using namespace std;
+
+    vector<double> parsed;
+
+    for (size_t at = 0; at <= list.size(); )
+    {
+        size_t end = list.find(',', at);
+        if (end == string::npos)
+            end = list.size();
+
+        const string item = list.substr(at, end - at);
+        char* rest = 0;
+
+        const double c = strtod(item.c_str(), &rest);
+        if (*rest or rest == item.c_str() or not (c > 0 and c < 1))
+            return false;
+
+        parsed.push_back(c);
+        at = end + 1;
+    }
+
+    amplitudes.swap(parsed);
+    return true;
+}
+
+
+int main(const int argc, const char* argv[])
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    bool usage = false;
+    deform_settings settings;
+    run_options opts;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--fields" and arg + 1 < argc)
+        {
+            const int n = atoi(argv[++arg]);
+            if (n < 1)
+                usage = true;
+            settings.fields = static_cast<unsigned>(n);
+        }
+
+        else if (opt == "--amplitudes" and arg + 1 < argc)
+        {
+            if ( not parse_amplitudes(argv[++arg], settings.amplitudes) )
+                usage = true;
+        }
+
+        else if (opt == "--grid" and arg + 1 < argc)
+        {
+            const int n = atoi(argv[++arg]);
+            if (n < 1)
+                usage = true;
+            settings.grid = static_cast<unsigned>(n);
+        }
+
+        else if (opt == "--field-memory" and arg + 1 < argc)
+        {
+            const int mib = atoi(argv[++arg]);
+            if (mib < 0)
+                usage = true;
+            settings.field_budget = static_cast<size_t>(mib) << 20;
+        }
+
+        else if (opt == "--seed" and arg + 1 < argc)
+            settings.seed = static_cast<unsigned>( strtoul(argv[++arg], 0, 10) );
+
+        else if (opt == "--contours")
+            settings.contours = true;
+
+        else if (opt == "-i" or opt == "--invert")
+            settings.contour.invert = true;
+
+        else if (opt == "--cache" and arg + 1 < argc)
+            settings.contour.cache = argv[++arg];
+
+        else if (opt == "--levels" and arg + 1 < argc)
+        {
+            if ( not parse_levels(argv[++arg], settings.contour.levels) )
+                usage = true;
+        }
+
+        else if ( not parse_run_option(argc, argv, arg, opts, usage) )
+            usage = true;
+    }
+
+    if (usage or argc - arg < 2)
+    {
+        cout << "\n"
+                "Usage: mpeg7C [options] <src path> <dst path>\n\n"
+                "  Make non-rigid deformations of the shapes: every source is\n"
+                "  copied as -1, then warped by smooth random displacement\n"
+                "  fields, each at every amplitude, in variants -2, -3... The\n"
+                "  fields depend only on the seed and the size of the canvas,\n"
+                "  and are made once for all the images of a size.\n\n"
+                "  Options\n"
+                "  -------\n"
+                "  --fields <n>       Random fields (default 3).\n"
+                "  --amplitudes <l>   Largest displacements of the control points,\n"
+                "                     as shares of the canvas, e.g. 0.01,0.1\n"
+                "                     (default 0.02,0.05).\n"
+                "  --grid <n>         Cells of the control grid a side (default 4);\n"
+                "                     more make wavier fields. Keep amplitude x\n"
+                "                     grid below about 0.4, or the shapes fold.\n"
+                "  --seed <n>         Seed of the fields (default 0).\n"
+                "  --field-memory <n> Keep up to <n> MiB of fields for reuse\n"
+                "                     (default 256).\n"
+                "  --contours         Also write the contour file of every output,\n"
+                "                     traced from memory (see mpeg7contour).\n"
+                "  --invert | -i      Invert the images traced.\n"
+                "  --cache <dir>      Reuse the contour files of identical images,\n"
+                "                     kept in <dir> across runs.\n"
+                "  --levels <list>    Path levels of the contour files (see\n"
+                "                     mpeg7contour; default full).\n"
+             << run_options_usage << "\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        const path p = argv[arg];
+        const path q = argv[arg + 1];
+
+        if ( not exists(p) )    // does p exist?
+        {
+            cout << p << " does not exist.\n";
+            return EXIT_FAILURE;
+        }
+
+        while ( not exists(q) )
+        {
+            cout << q << " does not exist. Do you want to create it? (Y/N): ";
+
+            char c;
+            if (cin >> c)
+            {
+                if (c == 'y' or c == 'Y')
+                {
+                    create_directories(q);
+                    break;
+                }
+                else if (c == 'n' or c == 'N')
+                {
+                    break;
+                }
+            }
+
+            else
+            {
+                cin.clear(0);
+            }
+        }
+
+        if ( exists(q) )    // does q exist?
+        {
+            if ( is_directory(q) )  // is q a directory?
+            {
+                if ( not exists(q / "nonrigid") )
+                {
+                    create_directory(q / "nonrigid");
+                }
+            }
+        }
+
+        else    // q does not exist!
+        {
+            clog << q << " does not exist\n";
+            return EXIT_FAILURE;
+        }
+
+        if (scan_file(p, q, settings, opts) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    catch (const filesystem_error& x)
+    {
+        cerr << "Error: Unhandled filesystem error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const bad_alloc& x)
+    {
+        cerr << "Error: Unhandled memory error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const exception& x)
+    {
+        cerr << "Error: Unhandled standard exception\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (...)
+    {
+        cerr << "Error: Unhandled unknown exception\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "../mpeg7contour/settings.hpp"
+
+
+/**
+ * What the non-rigid stage makes of an image
+ */
+
+struct deform_settings
+{
+    unsigned fields;                // random fields, each one a variant
+                                    // per amplitude
+    std::vector<double> amplitudes; // largest displacements of the control
+                                    // points, as shares of the canvas
+    unsigned grid;                  // cells of the control grid a side
+                                    // (fields.hpp)
+    unsigned seed;                  // seed of the fields
+    size_t field_budget;            // bytes of fields kept for reuse
+    bool contours;                  // trace the outputs too
+    contour_settings contour;       // how (mpeg7contour)
+
+    deform_settings()
+        : fields(3), grid(4), seed(0), field_budget(256 << 20), contours(false)
+    {
+        const double shares[2] = { 0.02, 0.05 };
+        amplitudes.assign(shares, shares + 2);
+    }
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "../mpeg7contour/workspace.hpp"
+
+
+/**
+ * Per-worker buffers of the non-rigid stage
+ *
+ * Each source is decoded once into 'src'; every variant is remapped into
+ * 'variant', encoded from there and traced from there when contour files
+ * are wanted. The maps themselves are shared (see field_cache). All the
+ * buffers keep their capacity across images.
+ */
+
+struct deform_workspace
+{
+    std::vector<uchar> bytes;       // encoded source file
+    std::vector<uchar> buf;         // encoded output file
+
+    cv::Mat src,                    // decoded source image
+            variant;                // deformed source
+
+    contour_workspace contour;      // buffers of the contour stage
+};
@@ -3,6 +3,8 @@
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <sstream>
+#include <vector>
 
 #define BOOST_FILESYSTEM_NO_DEPRECATED 1
 #include <boost/filesystem.hpp>
@@ -10,6 +12,14 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include "../common/frame_cache.hpp"
+#include "../common/io_stage.hpp"
+#include "../common/mapped_file.hpp"
+#include "../common/parallel.hpp"
+#include "../common/trace.hpp"
+#include "../common/warp.hpp"
+#include "settings.hpp"
+
 
 /**
  * For direct skewing with offset 's':
@@ -31,9 +41,82 @@
  * With the linear transformation:
  *
  *      ^p = A2 · ( A1 · p + b ) + b.
+ *
+ *
+ * The skews are interpolated by the fixed-point kernels of warp.hpp, whose
+ * maps are made from the constant offsets; they are those of
+ * cv::warpAffine for 8 bits. With --legacy-interpolation, cv::warpAffine
+ * does them itself, as for the published dataset.
  */
 
 
+namespace
+{
+
+    // The database includes 420 shapes; 70 basic shapes and 5 
+    // derived shapes from each basic shape by skewing (in 
+    // digital domain) with offsets: 0.1, 0.2, 0.3, 0.5 and 0.7.
+    const double offset[5] = { 0.1, 0.2, 0.3, 0.5, 0.7 };
+
+    // File name suffixes
+    const char* fs[5] = { "-2", "-3", "-4", "-5", "-6" };
+
+    /**
+     * Size of an image of size 'size' skewed by 'offset' along both axes.
+     */
+
+    cv::Size skewed_size(const cv::Size& size, const double offset)
+    {
+        return cv::Size( int(size.width + size.height * offset + 0.5),
+                         int(size.height + size.width * offset + 0.5) );
+    }
+
+    /**
+     * Map of a vertical flip of an image of height 'h', as cv::flip makes
+     * it.
+     */
+
+    affine_map flip_map(const int h)
+    {
+        const affine_map m = {{ 1, 0, 0, 0, -1, h - 1.0 }};
+        return m;
+    }
+
+    /**
+     * Map of the skew by offset[I] along both axes, from source to
+     * destination; the offset is a constant, folded into each
+     * instantiation.
+     */
+
+    template <int I>
+    affine_map skew_map()
+    {
+        const affine_map m = {{ 1, offset[I], 0, offset[I], 1, 0 }};
+        return m;
+    }
+
+    typedef affine_map (*skew_fn)();
+
+    const skew_fn skew_maps[5] = {
+        skew_map<0>, skew_map<1>, skew_map<2>, skew_map<3>, skew_map<4> };
+
+}
+
+
+/**
+ * Matrix of the skews: x' = x + sx y, y' = sy x + y.
+ */
+
+cv::Mat skew_matrix(const double sx, const double sy)
+{
+    cv::Mat skw(2, 3, CV_64FC1);
+    skw.at<double>(0,0) = skw.at<double>(1,1) = 1;
+    skw.at<double>(0,1) = sx, skw.at<double>(1,0) = sy;
+    skw.at<double>(0,2) = skw.at<double>(1,2) = 0;
+    return skw;
+}
+
+
 /**
  * Affine transformations
  */
@@ -46,145 +129,265 @@ namespace cv
 #define CV_FLIP_BOTH       -1
 
     /**
-     * Skew an image
+     * Skew an image by offset[i]: with the fixed-point kernels, or with
+     * cv::warpAffine if 'legacy' (and for the depths the kernels do not
+     * do)
      */
 
-    void skew1(const Mat& src, Mat& dst, const Size& dsize,
-               const double sx, const double sy, int flags = CV_INTER_LINEAR)
+    void skew2(const Mat& src, Mat& dst, const Size& dsize, const int i,
+               const bool legacy)
     {
-        Mat skw(2, 3, CV_64FC1);
-        skw.at<double>(0,0) = skw.at<double>(1,1) = 1;
-        skw.at<double>(0,1) = sx, skw.at<double>(1,0) = sy;
-        skw.at<double>(0,2) = skw.at<double>(1,2) = 0;
-        Mat aux1, aux2;
-        flip(src, aux1, CV_FLIP_VERTICAL);
-        warpAffine(aux1, aux2, skw, dsize, flags);
-        flip(aux2, dst, CV_FLIP_VERTICAL);
+        dst.create(dsize, src.type());
+        if ( legacy or not warp_linear<rotate_warp>( src, dst, invert( skew_maps[i]() ) ) )
+            warpAffine(src, dst, skew_matrix(offset[i], offset[i]), dsize, CV_INTER_LINEAR);
     }
 
-    void skew2(const Mat& src, Mat& dst, const Size& dsize,
-               const double sx, const double sy, int flags = CV_INTER_LINEAR)
+    void skew1(const Mat& src, Mat& dst, const Size& dsize, const int i,
+               const bool legacy)
     {
-        Mat skw(2, 3, CV_64FC1);
-        skw.at<double>(0,0) = skw.at<double>(1,1) = 1;
-        skw.at<double>(0,1) = sx, skw.at<double>(1,0) = sy;
-        skw.at<double>(0,2) = skw.at<double>(1,2) = 0;
-        warpAffine(src, dst, skw, dsize, flags);
+        Mat aux1, aux2;
+        flip(src, aux1, CV_FLIP_VERTICAL);
+        skew2(aux1, aux2, dsize, i, legacy);
+        flip(aux2, dst, CV_FLIP_VERTICAL);
     }
 
 }
 
 
 int affine_image(const boost::filesystem::path& p, 
-                 const boost::filesystem::path& q)
+                 const boost::filesystem::path& q,
+                 const affine_settings& settings, frame_cache& frames,
+                 io_stage& io)
 {
     using namespace boost::filesystem;
     using namespace cv;
     using namespace std;
 
-    int status = EXIT_SUCCESS;
+    // Note: p has been checked to be a regular file by scan_file; its
+    // contents come prefetched from the I/O stage unless its decoded image
+    // is in the frame cache, and the outputs are encoded in memory and
+    // written behind the worker's back.
 
-    if ( exists(p) )  // does p actually exist?
+    auto report = [](const path& f)
     {
-        if ( is_regular_file(p) )   // is p a regular file? 
-        {
-            // Get the base filename for output files.
-            const path skv_p = q / "skew1", 
-                       skw_p = q / "skew2";
-
-            const path xt = p.extension();
-            path fn = p.filename();
-            fn.replace_extension("");
-            const string sn = fn.string();
-            fn = sn.substr( 0, sn.find_last_of('-') );
-
-            path skw_f = fn;
-            skw_f += "-1";
-            skw_f.replace_extension(xt);
-
-            cout << "Processing \"" << p << "\"\n Geenerating:\n";
-
-            path skv_f = skv_p / skw_f;
-            if ( not exists(skv_f) )
-                copy(p, skv_f); // create_hard_link
-            cout << "  \"" << skv_f << "\"\n";
-
-            skw_f = skw_p / skw_f;
-            if ( not exists(skw_f) )
-                copy(p, skw_f); // create_hard_link
-            cout << "  \"" << skw_f << "\"\n";
-
-            // Load the image
-            const Mat src = imread( p.string(), CV_LOAD_IMAGE_ANYDEPTH );
-
-            // The database includes 420 shapes; 70 basic shapes and 5 
-            // derived shapes from each basic shape by skewing (in 
-            // digital domain) with offsets: 0.1, 0.2, 0.3, 0.5 and 0.7.
-            const double offset[5] = { 0.1, 0.2, 0.3, 0.5, 0.7 };
-
-            // File name suffixes
-            const char* fs[5] = { "-2", "-3", "-4", "-5", "-6" };
-
-            // PNG saving options
-            vector<int> opt;
-            opt.push_back(CV_IMWRITE_PNG_COMPRESSION);
-            opt.push_back(9);
-
-            // Create transformed versions
-            for (int i = 0; i < 5; ++i)
-            {
-                // Set file name for (direct) skewed figure
-                skw_f = fn, skw_f += fs[i], skw_f.replace_extension(xt);
-                skv_f = skv_p / skw_f;
+        lock_guard<mutex> lock(console_mutex());
+        cout << "  \"" << f << "\"\n";
+    };
 
-                if (not exists(skv_f))
-                {
-                    // Set the dst image the same type as src and scaled size
-                    Size skv_size( int(src.cols + src.rows * offset[i] + 0.5),
-                                   int(src.rows + src.cols * offset[i] + 0.5) );
+    // Get the base filename for output files.
+    const path skv_p = q / "skew1", 
+               skw_p = q / "skew2";
 
-                    Mat skv = Mat::zeros( skv_size, src.type() );
+    const path xt = p.extension();
+    path fn = p.filename();
+    fn.replace_extension("");
+    const string sn = fn.string();
+    fn = sn.substr( 0, sn.find_last_of('-') );
 
-                    // Skew the image
-                    skew1(src, skv, skv_size, offset[i], offset[i], CV_INTER_LINEAR);
+    path skw_f = fn;
+    skw_f += "-1";
+    skw_f.replace_extension(xt);
 
-                    // Save the image
-                    imwrite( skv_f.string(), skv, opt );
-                    cout << "  \"" << skv_f << "\"\n";
-                }
+    {
+        lock_guard<mutex> lock(console_mutex());
+        cout << "Processing \"" << p << "\"\n Geenerating:\n";
+    }
 
-                // Set file name for (reverse) skewed figure
-                skw_f = skw_p / skw_f;
+    // The decoded image, mapped from the frame cache if it is there
+    Mat src;
+    mapped_file frame;
+    const bool cached = frames.find(p, frame, src);
 
-                if (not exists(skw_f))
-                {
-                    // Set the dst image the same type as src and scaled size
-                    Size skw_size( int(src.cols + src.rows * offset[i] + 0.5),
-                                   int(src.rows + src.cols * offset[i] + 0.5) );
+    // The untransformed versions are copies of the source
+    path skv_f = skv_p / skw_f;
+    skw_f = skw_p / skw_f;
+    const bool copies = not exists(skv_f) or not exists(skw_f);
 
-                    Mat skw = Mat::zeros( skw_size, src.type() );
+    // Load the image
+    vector<uchar> bytes;
+    if ( (copies or not cached) and not io.fetch(p, bytes) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << p << " could not be read\n";
+        return EXIT_FAILURE;
+    }
+
+    vector<uchar> buf;
 
-                    // Skew the image
-                    skew2(src, skw, skw_size, offset[i], offset[i], CV_INTER_LINEAR);
+    if ( not exists(skv_f) )
+        buf = bytes, io.write(skv_f, buf);
+    report(skv_f);
 
-                    // Save the image
-                    imwrite( skw_f.string(), skw, opt );
-                    cout << "  \"" << skw_f << "\"\n";
-                }
+    if ( not exists(skw_f) )
+        buf = bytes, io.write(skw_f, buf);
+    report(skw_f);
+
+    if (not cached)
+    {
+        {
+            trace_scope scope("decode");
+            src = imdecode( Mat(bytes), CV_LOAD_IMAGE_ANYDEPTH );
+        }
+
+        if ( src.empty() )
+        {
+            lock_guard<mutex> lock(console_mutex());
+            clog << p << " could not be decoded\n";
+            return EXIT_FAILURE;
+        }
+
+        frames.store(p, src, buf, io);
+    }
+
+    // PNG saving options
+    vector<int> opt;
+    opt.push_back(CV_IMWRITE_PNG_COMPRESSION);
+    opt.push_back(9);
+
+    // Create transformed versions
+    for (int i = 0; i < 5; ++i)
+    {
+        // Set file name for (direct) skewed figure
+        skw_f = fn, skw_f += fs[i], skw_f.replace_extension(xt);
+        skv_f = skv_p / skw_f;
+
+        if (not exists(skv_f))
+        {
+            // Set the dst image the same type as src and scaled size
+            const Size skv_size = skewed_size(src.size(), offset[i]);
+
+            Mat skv = Mat::zeros( skv_size, src.type() );
+
+            // Skew the image
+            {
+                trace_scope scope("warp");
+                skew1(src, skv, skv_size, i, settings.legacy);
             }
+
+            // Save the image
+            {
+                trace_scope scope("encode");
+                imencode( xt.string(), skv, buf, opt );
+            }
+            io.write( skv_f, buf );
+            report(skv_f);
         }
 
-        else    // p is not a regular file!
+        // Set file name for (reverse) skewed figure
+        skw_f = skw_p / skw_f;
+
+        if (not exists(skw_f))
         {
-            clog << p << " exists, but is not a regular file\n";
-            status = EXIT_FAILURE;
+            // Set the dst image the same type as src and scaled size
+            const Size skw_size = skewed_size(src.size(), offset[i]);
+
+            Mat skw = Mat::zeros( skw_size, src.type() );
+
+            // Skew the image
+            {
+                trace_scope scope("warp");
+                skew2(src, skw, skw_size, i, settings.legacy);
+            }
+
+            // Save the image
+            {
+                trace_scope scope("encode");
+                imencode( xt.string(), skw, buf, opt );
+            }
+            io.write( skw_f, buf );
+            report(skw_f);
         }
     }
 
-    else    // p does not exists!
+    return EXIT_SUCCESS;
+}
+
+
+int affine_vector(const boost::filesystem::path& p, 
+                  const boost::filesystem::path& q,
+                  const vector_settings& settings, vector_workspace& ws,
+                  io_stage& io, divergence_report& report)
+{
+    using namespace boost::filesystem;
+    using namespace cv;
+    using namespace std;
+
+    // Note: p is the contour file of a source image; the contour files of
+    // the variants are made from it, in the vector domain, as mpeg7contour
+    // would trace them from the images affine_image makes.
+
+    // Get the base filename for output files.
+    const path skv_p = q / "skew1", 
+               skw_p = q / "skew2";
+
+    path fn = p.filename();
+    fn.replace_extension("");
+    const string sn = fn.string();
+    fn = sn.substr( 0, sn.find_last_of('-') );
+
+    path skw_f = fn;
+    skw_f += "-1.ctx";
+
     {
-        clog << p << " does not exist\n";
+        lock_guard<mutex> lock(console_mutex());
+        cout << "Processing \"" << p << "\"\n Generating:\n";
+    }
+
+    if ( load_silhouette(p, ws, io) != EXIT_SUCCESS )
         return EXIT_FAILURE;
+
+    // The untransformed versions are copies of the source
+    vector<uchar> buf;
+
+    path skv_f = skv_p / skw_f;
+    if ( not exists(skv_f) )
+        buf = ws.bytes, io.write(skv_f, buf);
+
+    skw_f = skw_p / skw_f;
+    if ( not exists(skw_f) )
+        buf = ws.bytes, io.write(skw_f, buf);
+
+    // The contour files traced from the raster outputs, if compared
+    auto raster = [&](const char* dir, const path& f)
+    {
+        return settings.compare.empty() ? path()
+             : settings.compare / dir / f.filename();
+    };
+
+    const Size src( int(ws.base.width), int(ws.base.height) );
+
+    int status = EXIT_SUCCESS;
+
+    // Create transformed versions
+    for (int i = 0; i < 5; ++i)
+    {
+        const Size size = skewed_size(src, offset[i]);
+        const affine_map skew = skew_maps[i]();
+
+        ostringstream kind;
+        kind << offset[i];
+
+        // Set file name for (direct) skewed figure
+        skw_f = fn, skw_f += fs[i], skw_f += ".ctx";
+        skv_f = skv_p / skw_f;
+
+        // skew1 flips the source upside down, skews it, and flips the result
+        if ( not exists(skv_f)
+             and vector_variant( compose( flip_map(size.height),
+                                          compose( skew, flip_map(src.height) ) ),
+                                 size, skv_f, raster("skew1", skv_f),
+                                 "skew1 " + kind.str(), settings, ws, io,
+                                 report ) != EXIT_SUCCESS )
+            status = EXIT_FAILURE;
+
+        // Set file name for (reverse) skewed figure
+        skw_f = skw_p / skw_f;
+
+        if ( not exists(skw_f)
+             and vector_variant( skew, size, skw_f, raster("skew2", skw_f),
+                                 "skew2 " + kind.str(), settings, ws, io,
+                                 report ) != EXIT_SUCCESS )
+            status = EXIT_FAILURE;
     }
 
     return status;
@@ -2,15 +2,20 @@
 #include <ciso646>
 #include <cstdlib>
 #include <iostream>
+#include <string>
 
 #define BOOST_FILESYSTEM_NO_DEPRECATED 1
 #include <boost/filesystem.hpp>
 
 #include <opencv2/highgui/highgui.hpp>
 
+#include "../common/options.hpp"
+#include "settings.hpp"
+
 
 int scan_file(const boost::filesystem::path& p, 
-              const boost::filesystem::path& q);
+              const boost::filesystem::path& q,
+              const affine_settings& settings, const run_options& opts);
 
 
 int main(const int argc, const char* argv[])
@@ -18,16 +23,63 @@ int main(const int argc, const char* argv[])
     using namespace boost::filesystem;
     using namespace std;
 
-    if (argc < 3)
+    bool usage = false;
+    affine_settings settings;
+    run_options opts;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--legacy-interpolation")
+            settings.legacy = true;
+
+        else if (opt == "--vector")
+            settings.vector.enabled = true;
+
+        else if (opt == "--compare" and arg + 1 < argc)
+            settings.vector.compare = argv[++arg];
+
+        else if (opt == "--levels" and arg + 1 < argc)
+        {
+            if ( not parse_levels(argv[++arg], settings.vector.contour.levels) )
+                usage = true;
+        }
+
+        else if ( not parse_run_option(argc, argv, arg, opts, usage) )
+            usage = true;
+    }
+
+    if ( not settings.vector.enabled and not settings.vector.compare.empty() )
+        usage = true;
+
+    if (usage or argc - arg < 2)
     {
-        cout << "Usage: mpeg7A <src path> <dst path>\n";
+        cout << "\n"
+                "Usage: mpeg7D [options] <src path> <dst path>\n\n"
+                "  Options\n"
+                "  -------\n"
+                "  --legacy-interpolation\n"
+                "                     Skew with cv::warpAffine, as in the published\n"
+                "                     dataset, rather than the fixed-point kernels\n"
+                "                     (the same for 8-bit images).\n"
+                "  --vector           Make the contour files of the variants only,\n"
+                "                     from the contour files of the sources under\n"
+                "                     <src path>, by mapping their paths.\n"
+                "  --compare <path>   With --vector, compare every contour file\n"
+                "                     made with the one traced from the raster\n"
+                "                     output, in <path>/skew1 or <path>/skew2.\n"
+                "  --levels <list>    With --vector, the path levels written (as\n"
+                "                     for mpeg7contour).\n"
+             << run_options_usage << "\n";
         return EXIT_FAILURE;
     }
 
     try
     {
-        const path p = argv[1];
-        const path q = argv[2];
+        const path p = argv[arg];
+        const path q = argv[arg + 1];
 
         if ( not exists(p) )    // does p exist?
         {
@@ -80,7 +132,7 @@ int main(const int argc, const char* argv[])
             return EXIT_FAILURE;
         }
 
-        if (scan_file(p, q) != EXIT_SUCCESS)
+        if (scan_file(p, q, settings, opts) != EXIT_SUCCESS)
             return EXIT_FAILURE;
     }
 
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../mpeg7contour/vector.hpp"
+
+
+/**
+ * What the affine stage makes of an image
+ */
+
+struct affine_settings
+{
+    bool legacy;                    // skew with cv::warpAffine
+    vector_settings vector;         // contour files only, in the vector
+                                    // domain (vector.hpp)
+
+    affine_settings()
+        : legacy(false)
+    {
+    }
+};
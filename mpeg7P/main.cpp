@@ -0,0 +1,243 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include "../common/options.hpp"
+#include "settings.hpp"
+
+
+int scan_file(const boost::filesystem::path& p, 
+              const boost::filesystem::path& q,
+              const partial_settings& settings, const run_options& opts);
+
+
+/**
+ * Parse a comma separated list of shares of the shape, in (0, 1).
+ */
+
+bool parse_coverages(const std::string& list, std::vector<double>& coverages)
+{
+    using namespace std;
+
+    vector<double> parsed;
+
+    for (size_t at = 0; at <= list.size(); )
+    {
+        size_t end = list.find(',', at);
+        if (end == string::npos)
+            end = list.size();
+
+        const string item = list.substr(at, end - at);
+        char* rest = 0;
+
+        const double c = strtod(item.c_str(), &rest);
+        if (*rest or rest == item.c_str() or not (c > 0 and c < 1))
+            return false;
+
+        parsed.push_back(c);
+        at = end + 1;
+    }
+
+    coverages.swap(parsed);
+    return true;
+}
+
+
+/**
+ * Parse a comma separated list of mask kinds.
+ */
+
+bool parse_masks(const std::string& list, std::vector<mask_kind>& masks)
+{
+    using namespace std;
+
+    vector<mask_kind> parsed;
+
+    for (size_t at = 0; at <= list.size(); )
+    {
+        size_t end = list.find(',', at);
+        if (end == string::npos)
+            end = list.size();
+
+        const string item = list.substr(at, end - at);
+
+        if (item == "crop")
+            parsed.push_back(crop_mask);
+        else if (item == "rectangle")
+            parsed.push_back(rectangle_mask);
+        else if (item == "polygon")
+            parsed.push_back(polygon_mask);
+        else
+            return false;
+
+        at = end + 1;
+    }
+
+    masks.swap(parsed);
+    return true;
+}
+
+
+int main(const int argc, const char* argv[])
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    bool usage = false;
+    partial_settings settings;
+    run_options opts;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--masks" and arg + 1 < argc)
+        {
+            if ( not parse_masks(argv[++arg], settings.masks) )
+                usage = true;
+        }
+
+        else if (opt == "--coverages" and arg + 1 < argc)
+        {
+            if ( not parse_coverages(argv[++arg], settings.coverages) )
+                usage = true;
+        }
+
+        else if (opt == "--seed" and arg + 1 < argc)
+            settings.seed = static_cast<unsigned>( strtoul(argv[++arg], 0, 10) );
+
+        else if (opt == "--contours")
+            settings.contours = true;
+
+        else if (opt == "-i" or opt == "--invert")
+            settings.contour.invert = true;
+
+        else if (opt == "--cache" and arg + 1 < argc)
+            settings.contour.cache = argv[++arg];
+
+        else if (opt == "--levels" and arg + 1 < argc)
+        {
+            if ( not parse_levels(argv[++arg], settings.contour.levels) )
+                usage = true;
+        }
+
+        else if ( not parse_run_option(argc, argv, arg, opts, usage) )
+            usage = true;
+    }
+
+    if (usage or argc - arg < 2)
+    {
+        cout << "\n"
+                "Usage: mpeg7P [options] <src path> <dst path>\n\n"
+                "  Make partial shapes, as in Apple-Partial: every source is\n"
+                "  copied as -1, then part of its shape is hidden by masks of\n"
+                "  each kind, at each coverage, in variants -2, -3...\n\n"
+                "  Options\n"
+                "  -------\n"
+                "  --masks <list>     Kinds of mask, in order: crop (straight cut),\n"
+                "                     rectangle, polygon (convex), e.g. crop,polygon\n"
+                "                     (default all three).\n"
+                "  --coverages <list> Shares of the shape hidden by each mask, e.g.\n"
+                "                     0.05,0.4 (default 0.1,0.2,0.3).\n"
+                "  --seed <n>         Seed of the masks' placement (default 0).\n"
+                "  --contours         Also write the contour file of every output,\n"
+                "                     traced from memory (see mpeg7contour).\n"
+                "  --invert | -i      Invert the images traced.\n"
+                "  --cache <dir>      Reuse the contour files of identical images,\n"
+                "                     kept in <dir> across runs.\n"
+                "  --levels <list>    Path levels of the contour files (see\n"
+                "                     mpeg7contour; default full).\n"
+             << run_options_usage << "\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        const path p = argv[arg];
+        const path q = argv[arg + 1];
+
+        if ( not exists(p) )    // does p exist?
+        {
+            cout << p << " does not exist.\n";
+            return EXIT_FAILURE;
+        }
+
+        while ( not exists(q) )
+        {
+            cout << q << " does not exist. Do you want to create it? (Y/N): ";
+
+            char c;
+            if (cin >> c)
+            {
+                if (c == 'y' or c == 'Y')
+                {
+                    create_directories(q);
+                    break;
+                }
+                else if (c == 'n' or c == 'N')
+                {
+                    break;
+                }
+            }
+
+            else
+            {
+                cin.clear(0);
+            }
+        }
+
+        if ( exists(q) )    // does q exist?
+        {
+            if ( is_directory(q) )  // is q a directory?
+            {
+                if ( not exists(q / "partial") )
+                {
+                    create_directory(q / "partial");
+                }
+            }
+        }
+
+        else    // q does not exist!
+        {
+            clog << q << " does not exist\n";
+            return EXIT_FAILURE;
+        }
+
+        if (scan_file(p, q, settings, opts) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    catch (const filesystem_error& x)
+    {
+        cerr << "Error: Unhandled filesystem error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const bad_alloc& x)
+    {
+        cerr << "Error: Unhandled memory error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const exception& x)
+    {
+        cerr << "Error: Unhandled standard exception\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (...)
+    {
+        cerr << "Error: Unhandled unknown exception\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
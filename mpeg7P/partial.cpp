@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <ciso646>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "../common/hash.hpp"
+#include "../common/io_stage.hpp"
+#include "../common/masks.hpp"
+#include "../common/parallel.hpp"
+#include "../common/trace.hpp"
+#include "../mpeg7contour/cache.hpp"
+#include "settings.hpp"
+#include "workspace.hpp"
+
+
+boost::filesystem::path ctx_path(const boost::filesystem::path& p,
+                                 const boost::filesystem::path& q);
+
+int trace_image(const cv::Mat& src, const boost::filesystem::path& ctx_p,
+                const contour_settings& settings, result_cache& cache,
+                contour_workspace& ws, io_stage& io);
+
+
+namespace
+{
+
+    const double pi = 3.14159265358979323846;
+
+    const char* mask_names[3] = { "crop", "rectangle", "polygon" };
+
+    /**
+     * Make in 'm' the smallest mask of the family make(u), u >= 0, that
+     * hides at least 'goal' of the shape pixels, the masks growing with u.
+     * Returns the shape pixels it hides.
+     */
+
+    template <class Make>
+    size_t grow_mask(const Make& make, const foreground_map& shape,
+                     const size_t goal, span_mask& m)
+    {
+        double lo = 0,
+               hi = std::max(shape.rows(), shape.cols()) + 1.0;
+
+        make(lo, m);
+        if (shape.covered(m) >= goal)
+            return shape.covered(m);
+
+        // Past the image, every mask can only grow over nothing: give up
+        // the goal there rather than loop
+        for (make(hi, m); shape.covered(m) < goal and hi < 1e6; make(hi, m))
+            hi *= 2;
+
+        for (int i = 0; i < 40 and hi - lo > 1e-3; ++i)
+        {
+            const double mid = (lo + hi) / 2;
+            make(mid, m);
+            if (shape.covered(m) >= goal)
+                hi = mid;
+            else
+                lo = mid;
+        }
+
+        make(hi, m);
+        return shape.covered(m);
+    }
+
+    /**
+     * Place a mask of kind 'kind' over the shape of 'shape' at random,
+     * sized to hide the share 'coverage' of it. Returns the share hidden.
+     */
+
+    double place_mask(const mask_kind kind, const double coverage,
+                      const foreground_map& shape, cv::RNG& rng,
+                      std::vector<cv::Point2d>& vertices, span_mask& m)
+    {
+        using namespace std;
+
+        const int rows = shape.rows(),
+                  cols = shape.cols();
+        const cv::Rect box = shape.bounds();
+
+        const size_t goal = static_cast<size_t>(
+            ceil( min(max(coverage, 0.0), 1.0) * shape.total() ) );
+
+        size_t hidden = 0;
+
+        switch (kind)
+        {
+        case crop_mask:
+        {
+            // Cut along a random direction, from the far side of the shape
+            const double t = rng.uniform(0.0, 2 * pi),
+                         a = cos(t),
+                         b = sin(t);
+
+            const double far = max( a * box.x, a * (box.x + box.width) )
+                             + max( b * box.y, b * (box.y + box.height) ) + 1;
+
+            hidden = grow_mask( [&](const double u, span_mask& s)
+            {
+                half_plane_spans(rows, cols, a, b, far - u, s);
+            }, shape, goal, m );
+            break;
+        }
+
+        case rectangle_mask:
+        {
+            // A box of random proportions, centred within the shape's bounds
+            const double cx = box.x + rng.uniform(0.0, 1.0) * box.width,
+                         cy = box.y + rng.uniform(0.0, 1.0) * box.height,
+                         r = sqrt( exp( rng.uniform(log(0.5), log(2.0)) ) );
+
+            hidden = grow_mask( [&](const double u, span_mask& s)
+            {
+                const int x0 = static_cast<int>( floor(cx - u * r / 2) ),
+                          x1 = static_cast<int>( ceil(cx + u * r / 2) ),
+                          y0 = static_cast<int>( floor(cy - u / r / 2) ),
+                          y1 = static_cast<int>( ceil(cy + u / r / 2) );
+                rectangle_spans(rows, cols, cv::Rect(x0, y0, x1 - x0, y1 - y0), s);
+            }, shape, goal, m );
+            break;
+        }
+
+        default:
+        {
+            // 3 to 6 vertices on a random ellipse, about evenly spread so
+            // that the centre stays inside; scaling about the centre then
+            // only grows the polygon
+            const int k = rng.uniform(3, 7);
+            const double cx = box.x + rng.uniform(0.0, 1.0) * box.width,
+                         cy = box.y + rng.uniform(0.0, 1.0) * box.height,
+                         r = sqrt( exp( rng.uniform(log(0.5), log(2.0)) ) ),
+                         tilt = rng.uniform(0.0, pi),
+                         start = rng.uniform(0.0, 2 * pi);
+
+            vector<cv::Point2d> unit(k);
+            for (int i = 0; i < k; ++i)
+            {
+                const double t = start + 2 * pi * i / k
+                               + rng.uniform(-0.4, 0.4) * pi / k;
+                const double ex = r * cos(t) / 2,
+                             ey = sin(t) / r / 2;
+                unit[i] = cv::Point2d( ex * cos(tilt) - ey * sin(tilt),
+                                       ex * sin(tilt) + ey * cos(tilt) );
+            }
+
+            hidden = grow_mask( [&](const double u, span_mask& s)
+            {
+                vertices.resize(k);
+                for (int i = 0; i < k; ++i)
+                    vertices[i] = cv::Point2d(cx + u * unit[i].x, cy + u * unit[i].y);
+                polygon_spans(rows, cols, vertices, s);
+            }, shape, goal, m );
+            break;
+        }
+        }
+
+        return shape.total() > 0 ? double(hidden) / shape.total() : 0;
+    }
+
+    /**
+     * Random numbers for the masks of the source named 'name': the same
+     * for every run, shard and worker.
+     */
+
+    cv::RNG mask_rng(const std::string& name, const unsigned seed)
+    {
+        hash128 h(seed);
+        h.update(name);
+        return cv::RNG( std::stoull(h.hex().substr(0, 16), 0, 16) );
+    }
+
+}
+
+
+int partial_image(const boost::filesystem::path& p,
+                  const boost::filesystem::path& q,
+                  const partial_settings& settings, result_cache& cache,
+                  partial_workspace& ws, io_stage& io)
+{
+    using namespace boost::filesystem;
+    using namespace cv;
+    using namespace std;
+
+    // Note: p has been checked to be a regular file by scan_file; its
+    // contents come prefetched from the I/O stage, and the outputs are
+    // encoded in memory and written behind the worker's back.
+
+    // Get the base filename for output files.
+    const path prt_p = q / "partial";
+
+    const path xt = p.extension();
+    path fn = p.filename();
+    fn.replace_extension("");
+    const string sn = fn.string();
+    fn = sn.substr( 0, sn.find_last_of('-') );
+
+    path prt_f = fn;
+    prt_f += "-1";
+    prt_f.replace_extension(xt);
+    prt_f = prt_p / prt_f;
+
+    {
+        lock_guard<mutex> lock(console_mutex());
+        cout << "Processing \"" << p << "\"\n Generating:\n";
+    }
+
+    // Load the image
+    if ( not io.fetch(p, ws.bytes) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << p << " could not be read\n";
+        return EXIT_FAILURE;
+    }
+
+    // The whole shape is a copy of the source
+    if ( not exists(prt_f) )
+    {
+        ws.buf = ws.bytes;
+        io.write(prt_f, ws.buf);
+
+        lock_guard<mutex> lock(console_mutex());
+        cout << "  \"" << prt_f << "\"\n";
+    }
+
+    {
+        trace_scope scope("decode");
+        imdecode( Mat(ws.bytes), CV_LOAD_IMAGE_ANYDEPTH, &ws.src );
+    }
+
+    if ( ws.src.empty() )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << p << " could not be decoded\n";
+        return EXIT_FAILURE;
+    }
+
+    // The shape is whatever differs from the top-left corner
+    {
+        trace_scope scope("mask");
+        ws.shape.assign(ws.src);
+    }
+
+    if (ws.shape.total() == 0)
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << p << " has no shape to hide\n";
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+
+    if ( settings.contours and not exists( ctx_path(prt_f, prt_p) ) )
+    {
+        ws.contour.reset();
+        if ( trace_image( ws.src, ctx_path(prt_f, prt_p), settings.contour,
+                          cache, ws.contour, io ) != EXIT_SUCCESS )
+            status = EXIT_FAILURE;
+    }
+
+    // PNG saving options
+    vector<int> opt;
+    opt.push_back(CV_IMWRITE_PNG_COMPRESSION);
+    opt.push_back(9);
+
+    RNG rng = mask_rng(sn, settings.seed);
+
+    // Create the variants, -2, -3... by kind of mask, then by coverage. The
+    // masks are placed whether the outputs exist or not, so that the
+    // variants made do not depend on those made before.
+    int suffix = 2;
+    for (size_t i = 0; i < settings.masks.size(); ++i)
+        for (size_t j = 0; j < settings.coverages.size(); ++j, ++suffix)
+        {
+            double hidden;
+            {
+                trace_scope scope("mask");
+                hidden = place_mask( settings.masks[i], settings.coverages[j],
+                                     ws.shape, rng, ws.vertices, ws.mask );
+            }
+
+            prt_f = fn;
+            prt_f += "-" + to_string( static_cast<long long>(suffix) );
+            prt_f.replace_extension(xt);
+            prt_f = prt_p / prt_f;
+
+            const path ctx_f = ctx_path(prt_f, prt_p);
+            const bool image = not exists(prt_f),
+                       trace = settings.contours and not exists(ctx_f);
+
+            if (not image and not trace)
+                continue;
+
+            {
+                trace_scope scope("mask");
+                ws.src.copyTo(ws.variant);
+                fill_spans( ws.variant, ws.mask, ws.shape.background() );
+            }
+
+            if (image)
+            {
+                // Save the image
+                {
+                    trace_scope scope("encode");
+                    imencode( xt.string(), ws.variant, ws.buf, opt );
+                }
+                io.write( prt_f, ws.buf );
+
+                lock_guard<mutex> lock(console_mutex());
+                cout << "  \"" << prt_f << "\" (" << mask_names[settings.masks[i]]
+                     << ", " << fixed << setprecision(1) << 100 * hidden
+                     << "% hidden)\n";
+            }
+
+            // Trace the variant while it is at hand
+            if (trace)
+            {
+                ws.contour.reset();
+                if ( trace_image( ws.variant, ctx_f, settings.contour, cache,
+                                  ws.contour, io ) != EXIT_SUCCESS )
+                    status = EXIT_FAILURE;
+            }
+        }
+
+    return status;
+}
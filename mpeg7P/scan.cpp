@@ -0,0 +1,92 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/commit.hpp"
+#include "../common/io_stage.hpp"
+#include "../common/manifest.hpp"
+#include "../common/options.hpp"
+#include "../common/parallel.hpp"
+#include "../common/shard.hpp"
+#include "../common/sources.hpp"
+#include "../mpeg7contour/cache.hpp"
+#include "settings.hpp"
+#include "workspace.hpp"
+
+
+int partial_image(const boost::filesystem::path& p,
+                  const boost::filesystem::path& q,
+                  const partial_settings& settings, result_cache& cache,
+                  partial_workspace& ws, io_stage& io);
+
+
+int scan_file(const boost::filesystem::path& p, const boost::filesystem::path& q,
+              const partial_settings& settings, const run_options& opts)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    vector<path> files;
+
+    int status = collect_sources(p, files);
+
+    // Images staged by an interrupted run are incomplete. With several
+    // shards at work, they may as well be another shard's pending writes.
+    if (opts.shards == 1)
+        remove_staged(q / "partial");
+
+    // Sources sharing a base name (the file name up to its last '-') map
+    // onto the same outputs; only the first one, in path order, is
+    // processed. Every shard makes the same choice before keeping its own
+    // share of the sources. The sources are processed in the order they
+    // were found, which is archive order for archive members.
+    vector<path> pending(files);
+    unique_sources(pending, [](const path& f) -> string
+    {
+        const string sn = f.stem().string();
+        return sn.substr( 0, sn.find_last_of('-') );
+    });
+
+    select_shard(pending, p, opts.shard, opts.shards);
+
+    manifest m("mpeg7P", opts.shard, opts.shards, p);
+
+    io_stage io(opts.io, opts.io_threads, opts.lookahead, opts.durable);
+    io.prefetch(pending);
+
+    result_cache cache(settings.contour.cache, settings.contour);
+
+    // One workspace per worker, reused for every image the worker processes
+    vector< unique_ptr<partial_workspace> > ws;
+    for (unsigned w = 0; w < max(opts.jobs, 1u); ++w)
+        ws.push_back( unique_ptr<partial_workspace>(new partial_workspace) );
+
+    auto task = [&](const path& f, const unsigned w)
+    {
+        const int s = partial_image(f, q, settings, cache, *ws[w], io);
+        m.record(f, s == EXIT_SUCCESS ? manifest::done : manifest::failed);
+        return s;
+    };
+
+    if ( parallel_for_each(pending, opts.jobs, task) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( io.drain() != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( cache.enabled() )
+        cout << cache.hits() << " contour files reused from the cache, "
+             << cache.stores() << " added to it\n";
+
+    if ( not opts.manifest.empty()
+         and m.save(opts.manifest, status, opts.durable) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    return status;
+}
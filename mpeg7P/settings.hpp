@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "../mpeg7contour/settings.hpp"
+
+
+/**
+ * Masks hiding part of a shape:
+ *
+ *      crop        everything beyond a straight cut, as if the shape ran
+ *                  off the edge of the picture;
+ *      rectangle   an axis-aligned box over the shape;
+ *      polygon     a convex polygon over the shape.
+ */
+
+enum mask_kind { crop_mask, rectangle_mask, polygon_mask };
+
+/**
+ * What the partial stage makes of an image
+ */
+
+struct partial_settings
+{
+    std::vector<mask_kind> masks;   // kinds of mask, in output order
+    std::vector<double> coverages;  // shares of the shape hidden by each
+    unsigned seed;                  // seed of the masks' placement
+    bool contours;                  // trace the outputs too
+    contour_settings contour;       // how (mpeg7contour)
+
+    partial_settings()
+        : seed(0), contours(false)
+    {
+        masks.push_back(crop_mask);
+        masks.push_back(rectangle_mask);
+        masks.push_back(polygon_mask);
+
+        const double shares[3] = { 0.1, 0.2, 0.3 };
+        coverages.assign(shares, shares + 3);
+    }
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "../common/masks.hpp"
+#include "../mpeg7contour/workspace.hpp"
+
+
+/**
+ * Per-worker buffers of the partial stage
+ *
+ * Each source is decoded once into 'src'; every variant is made in
+ * 'variant', a copy of it with one mask filled in, encoded from there and
+ * traced from there when contour files are wanted, so that no variant is
+ * ever decoded again. All the buffers keep their capacity across images.
+ */
+
+struct partial_workspace
+{
+    std::vector<uchar> bytes;       // encoded source file
+    std::vector<uchar> buf;         // encoded output file
+
+    cv::Mat src,                    // decoded source image
+            variant;                // source with a mask filled in
+
+    foreground_map shape;           // shape pixels of 'src'
+    span_mask mask;                 // mask of the variant being made
+    std::vector<cv::Point2d> vertices;
+
+    contour_workspace contour;      // buffers of the contour stage
+};
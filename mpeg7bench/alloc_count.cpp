@@ -0,0 +1,46 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "bench.hpp"
+
+
+/**
+ * Replacement of the global allocation functions counting every call, so
+ * that benchmarks can report heap allocations per unit of work.
+ */
+
+static std::atomic<size_t> allocations(0);
+
+
+size_t heap_allocations()
+{
+    return allocations.load();
+}
+
+
+void* operator new(size_t n)
+{
+    ++allocations;
+    if (void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+
+void* operator new[](size_t n)
+{
+    return operator new(n);
+}
+
+
+void operator delete(void* p) throw()
+{
+    std::free(p);
+}
+
+
+void operator delete[](void* p) throw()
+{
+    std::free(p);
+}
@@ -0,0 +1,333 @@
+#include <ciso646>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "../common/silhouette.hpp"
+#include "../common/vector_stream.hpp"
+#include "../mpeg7contour/levels.hpp"
+#include "../mpeg7contour/workspace.hpp"
+#include "bench.hpp"
+
+
+int write_contour(std::ostream& out,
+                  const std::vector< std::vector< cv::Point > >& contours,
+                  const std::vector< cv::Vec4i >& hierarchy,
+                  const size_t width, const size_t height,
+                  const std::vector<path_level>& levels,
+                  const std::vector<contour_shape>* shapes,
+                  packed_rtree& index, path_scratch& scratch,
+                  std::vector<unsigned char>* sidecar);
+
+
+/**
+ * Contour stage allocation benchmark
+ *
+ * Runs the in-memory part of contour_image (decode, threshold, trace,
+ * moments and serialization) over a synthetic corpus of PNG silhouettes,
+ * once allocating fresh buffers for every image as the stage used to do,
+ * and once recycling per-worker workspaces. Disk I/O is left out so that
+ * only allocator behaviour and compute are measured.
+ */
+
+namespace
+{
+
+    /**
+     * Matrix allocator counting its calls, otherwise equivalent to the
+     * default OpenCV one.
+     */
+
+    class counting_mat_allocator : public cv::MatAllocator
+    {
+    public:
+
+        counting_mat_allocator() : count(0) {}
+
+        void allocate(int dims, const int* sizes, int type, int*& refcount,
+                      uchar*& datastart, uchar*& data, size_t* step)
+        {
+            size_t total = CV_ELEM_SIZE(type);
+            for (int i = dims - 1; i >= 0; --i)
+            {
+                step[i] = total;
+                total *= sizes[i];
+            }
+            total = (total + sizeof(int) - 1) & ~(sizeof(int) - 1);
+
+            datastart = data = static_cast<uchar*>( cv::fastMalloc(total + sizeof(int)) );
+            refcount = reinterpret_cast<int*>(data + total);
+            *refcount = 1;
+            ++count;
+        }
+
+        void deallocate(int* /*refcount*/, uchar* datastart, uchar* /*data*/)
+        {
+            cv::fastFree(datastart);
+        }
+
+        std::atomic<size_t> count;
+    };
+
+    /**
+     * Stream buffer that discards its content whenever it fills up, the
+     * in-memory stand-in for a file stream.
+     */
+
+    class sink_buffer : public std::streambuf
+    {
+    public:
+
+        sink_buffer(char* buffer, const size_t size)
+        {
+            setp(buffer, buffer + size);
+        }
+
+    protected:
+
+        int_type overflow(int_type c)
+        {
+            setp(pbase(), epptr());
+            if (not traits_type::eq_int_type(c, traits_type::eof()))
+            {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+    };
+
+    counting_mat_allocator mat_counter;
+
+    // The default CTX output: the full chain only
+    const std::vector<path_level> full_chain(1);
+
+    /**
+     * Process one image allocating everything afresh.
+     */
+
+    void fresh_image(const std::vector<uchar>& png)
+    {
+        using namespace cv;
+        using namespace std;
+
+        Mat src, dst;
+        src.allocator = dst.allocator = &mat_counter;
+
+        imdecode( Mat(png), CV_LOAD_IMAGE_ANYDEPTH, &src );
+        threshold( src, dst, 0, 255, CV_THRESH_BINARY|CV_THRESH_OTSU );
+
+        vector< vector<Point> > contours;
+        vector< Vec4i > hierarchy;
+        packed_rtree index;
+        path_scratch scratch;
+        findContours( dst, contours, hierarchy, CV_RETR_TREE,
+                      CV_CHAIN_APPROX_NONE );
+
+        // A file stream allocates its own buffer
+        vector<char> buffer(BUFSIZ);
+        sink_buffer sink(&buffer[0], buffer.size());
+        ostream out(&sink);
+        write_contour(out, contours, hierarchy, src.cols, src.rows,
+                      full_chain, 0, index, scratch, 0);
+    }
+
+    /**
+     * Process one image recycling the worker's workspace.
+     */
+
+    void workspace_image(const std::vector<uchar>& png, contour_workspace& ws)
+    {
+        using namespace cv;
+        using namespace std;
+
+        ws.reset();
+
+        imdecode( Mat(png), CV_LOAD_IMAGE_ANYDEPTH, &ws.src );
+        threshold( ws.src, ws.dst, 0, 255, CV_THRESH_BINARY|CV_THRESH_OTSU );
+        findContours( ws.dst, ws.contours, ws.hierarchy, CV_RETR_TREE,
+                      CV_CHAIN_APPROX_NONE );
+
+        ws.text.clear();
+        vector_ostream out(ws.text);
+        write_contour(out, ws.contours, ws.hierarchy, ws.src.cols, ws.src.rows,
+                      full_chain, 0, ws.index, ws.path, 0);
+    }
+
+    /**
+     * Draw a pseudo-random silhouette, of 128 to 767 pixels a side, with a
+     * few holes, and encode it as PNG.
+     */
+
+    std::vector<uchar> make_silhouette(unsigned& seed)
+    {
+        using namespace cv;
+        using namespace std;
+
+        struct lcg
+        {
+            static unsigned next(unsigned& s, const unsigned n)
+            {
+                s = s * 1664525u + 1013904223u;
+                return (s >> 8) % n;
+            }
+        };
+
+        const int w = 128 + lcg::next(seed, 640),
+                  h = 128 + lcg::next(seed, 640);
+
+        Mat img = Mat::zeros(h, w, CV_8UC1);
+
+        ellipse( img, Point(w / 2, h / 2), Size(w / 3, h / 3),
+                 lcg::next(seed, 180), 0, 360, Scalar::all(255), CV_FILLED );
+        rectangle( img, Point(w / 8, h / 8),
+                   Point(w / 8 + lcg::next(seed, w / 2) + 4,
+                         h / 8 + lcg::next(seed, h / 4) + 4),
+                   Scalar::all(255), CV_FILLED );
+
+        const unsigned holes = lcg::next(seed, 6);
+        for (unsigned k = 0; k < holes; ++k)
+            circle( img, Point(w / 3 + lcg::next(seed, w / 3),
+                               h / 3 + lcg::next(seed, h / 3)),
+                    2 + lcg::next(seed, min(w, h) / 16),
+                    Scalar::all(0), CV_FILLED );
+
+        vector<uchar> png;
+        imencode(".png", img, png);
+        return png;
+    }
+
+}
+
+
+int bench_arena(const int argc, const char* argv[])
+{
+    using namespace std;
+
+    size_t images = 4000,
+           corpus = 64;
+    vector<unsigned> threads = parse_list("1,8,32");
+
+    for (int arg = 0; arg < argc; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--images" and arg + 1 < argc)
+            images = static_cast<size_t>( atol(argv[++arg]) );
+        else if (opt == "--corpus" and arg + 1 < argc)
+            corpus = static_cast<size_t>( atol(argv[++arg]) );
+        else if (opt == "--threads" and arg + 1 < argc)
+            threads = parse_list(argv[++arg]);
+        else
+        {
+            cout << "Usage: mpeg7bench arena [--images <n>] [--corpus <n>]"
+                    " [--threads <n,...>]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (corpus == 0 or images == 0)
+        return EXIT_FAILURE;
+
+    // Build the corpus
+    vector< vector<uchar> > pngs;
+    unsigned seed = 20140707u;
+    for (size_t i = 0; i < corpus; ++i)
+        pngs.push_back( make_silhouette(seed) );
+
+    cout << "Contour stage, " << images << " images over a corpus of "
+         << corpus << " silhouettes\n"
+         << "(allocations: operator new + image buffers + arena blocks;"
+            " OpenCV-internal storage is not counted)\n\n"
+         << "  mode       threads   images/s   allocs/image   arena peak\n";
+
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        for (size_t t = 0; t < threads.size(); ++t)
+        {
+            const unsigned n = max(threads[t], 1u);
+            const size_t per_thread = (images + n - 1) / n,
+                         warm_up = min(corpus, per_thread);
+
+            vector< unique_ptr<contour_workspace> > ws;
+            for (unsigned w = 0; w < n; ++w)
+                ws.push_back( unique_ptr<contour_workspace>(new contour_workspace) );
+
+            atomic<unsigned> ready(0);
+            atomic<bool> go(false);
+
+            auto worker = [&](const unsigned w)
+            {
+                // Warm up: let the workspaces reach their steady state
+                for (size_t i = 0; i < warm_up; ++i)
+                {
+                    const vector<uchar>& png = pngs[(w + i) % pngs.size()];
+                    if (mode == 0)
+                        fresh_image(png);
+                    else
+                        workspace_image(png, *ws[w]);
+                }
+
+                ++ready;
+                while (not go)
+                    this_thread::yield();
+
+                for (size_t i = 0; i < per_thread; ++i)
+                {
+                    const vector<uchar>& png = pngs[(w + i) % pngs.size()];
+                    if (mode == 0)
+                        fresh_image(png);
+                    else
+                        workspace_image(png, *ws[w]);
+                }
+            };
+
+            vector<thread> pool;
+            for (unsigned w = 0; w < n; ++w)
+                pool.push_back( thread(worker, w) );
+
+            while (ready < n)
+                this_thread::yield();
+
+            size_t blocks = 0;
+            for (unsigned w = 0; w < n; ++w)
+                blocks += ws[w]->heap.heap_allocations();
+            const size_t news = heap_allocations(),
+                         mats = mat_counter.count;
+
+            stopwatch clock;
+            go = true;
+            for (unsigned w = 0; w < n; ++w)
+                pool[w].join();
+            const double elapsed = clock.seconds();
+
+            size_t allocs = (heap_allocations() - news) + (mat_counter.count - mats),
+                   peak = 0;
+            for (unsigned w = 0; w < n; ++w)
+            {
+                allocs += ws[w]->heap.heap_allocations();
+                peak = max(peak, ws[w]->heap.peak());
+            }
+            allocs -= blocks;
+
+            const double done = double(per_thread) * n;
+
+            cout << "  " << left << setw(10) << (mode == 0 ? "fresh" : "workspace")
+                 << right << setw(8) << n
+                 << fixed << setprecision(1) << setw(11) << done / elapsed
+                 << setprecision(2) << setw(15) << allocs / done
+                 << setw(10) << (peak >> 10) << " KiB\n";
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
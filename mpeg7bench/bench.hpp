@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../common/stopwatch.hpp"
+
+
+/**
+ * Benchmark helpers
+ */
+
+/**
+ * Number of calls to the global operator new made so far by the process.
+ */
+
+size_t heap_allocations();
+
+/**
+ * Parse a comma separated list of unsigned integers, e.g. "1,8,32".
+ */
+
+inline std::vector<unsigned> parse_list(const std::string& s)
+{
+    std::vector<unsigned> v;
+    size_t at = 0;
+    while (at < s.size())
+    {
+        size_t end = s.find(',', at);
+        if (end == std::string::npos)
+            end = s.size();
+        if (end > at)
+            v.push_back( static_cast<unsigned>( std::atoi( s.substr(at, end - at).c_str() ) ) );
+        at = end + 1;
+    }
+    return v;
+}
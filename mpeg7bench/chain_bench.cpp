@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <ciso646>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/chain_codec.hpp"
+#include "../common/ctx.hpp"
+#include "bench.hpp"
+
+
+namespace
+{
+
+    enum path_form { chain_form, packed_form, sidecar_form };
+
+    /**
+     * A CTX document with one contour per chain, its path written in form
+     * 'form', and its sidecar file if the form has one. Returns the size of
+     * the path attribute values and of the sidecar file.
+     */
+
+    size_t make_document(const std::vector<ctx_contour>& contours, const path_form form,
+                         std::string& document, std::vector<unsigned char>& sidecar)
+    {
+        using namespace std;
+
+        static const char* const attribute[3] = { "chain", "packed", "sidecar" };
+
+        chain_packer packer;
+        vector<unsigned char> bytes;
+        ostringstream out;
+        size_t values = 0;
+
+        sidecar.clear();
+        if (form == sidecar_form)
+            begin_sidecar(sidecar);
+
+        out << "<?xml version=\"1.0\" standalone=\"yes\"?>\n<ctx>\n";
+
+        for (size_t i = 0; i < contours.size(); ++i)
+        {
+            const ctx_contour& c = contours[i];
+
+            ostringstream value;
+            value << c.x << ' ' << c.y;
+
+            if (form == chain_form)
+                for (size_t k = 0; k < c.chain.size(); ++k)
+                    value << ' ' << int(c.chain[k]);
+            else
+                packer.pack(c.chain.data(), c.chain.size(), bytes);
+
+            if (form == packed_form)
+            {
+                string text;
+                encode_base64(bytes.data(), bytes.size(), text);
+                value << ' ' << text;
+            }
+            else if (form == sidecar_form)
+                append_sidecar(i + 1, c.chain.size(), bytes, sidecar);
+
+            values += value.str().size();
+
+            out << "\t<contour id=\"" << (i + 1) << "\">\n\t\t<path"
+                << (form != chain_form ? " level=\"packed\"" : "")
+                << " vertices=\"" << (c.chain.size() + 1) << "\" "
+                << attribute[form] << "=\"" << value.str()
+                << "\" />\n\t</contour>\n";
+        }
+
+        out << "</ctx>";
+        document = out.str();
+        return values + sidecar.size();
+    }
+
+    /**
+     * Best time of 'rounds' reads of every path of 'document', and of its
+     * 'sidecar' file if not empty, in seconds. Returns a negative time if
+     * the document does not read back.
+     */
+
+    double read_document(const std::string& document,
+                         const std::vector<unsigned char>& sidecar,
+                         const size_t codes, const unsigned rounds)
+    {
+        double best = 0;
+
+        for (unsigned r = 0; r < rounds; ++r)
+        {
+            ctx_reader reader(document.data(), document.size());
+            sidecar_reader chains(sidecar.data(), sidecar.size());
+            ctx_contour c;
+            size_t read = 0;
+
+            stopwatch clock;
+            while ( read_contour(reader, c, sidecar.empty() ? 0 : &chains) )
+                read += c.chain.size();
+            const double elapsed = clock.seconds();
+
+            if ( read != codes or not reader.error().empty()
+                 or (not sidecar.empty() and not chains.done()) )
+                return -1;
+
+            if (r == 0 or elapsed < best)
+                best = elapsed;
+        }
+
+        return best;
+    }
+
+}
+
+
+int bench_chains(const int argc, const char* argv[])
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    const char* const usage = "Usage: mpeg7bench chains <ctx dir> [--rounds <n>]\n";
+
+    string root;
+    unsigned rounds = 20;
+
+    for (int arg = 0; arg < argc; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--rounds" and arg + 1 < argc)
+            rounds = static_cast<unsigned>( max(atoi(argv[++arg]), 1) );
+        else if (root.empty() and opt[0] != '-')
+            root = opt;
+        else
+        {
+            cout << usage;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ( root.empty() )
+    {
+        cout << usage;
+        return EXIT_FAILURE;
+    }
+
+    // The full paths of every contour under 'root'
+    vector<ctx_contour> contours;
+    size_t codes = 0;
+
+    for (recursive_directory_iterator it(root), end; it != end; ++it)
+    {
+        if (it->path().extension() != ".ctx")
+            continue;
+
+        std::ifstream in(it->path().string().c_str(), ios::binary);
+        const string text( (istreambuf_iterator<char>(in)), istreambuf_iterator<char>() );
+
+        ctx_reader reader(text.data(), text.size());
+        ctx_contour c;
+        while ( read_contour(reader, c) )
+            if (c.has_chain and not c.chain.empty())
+            {
+                contours.push_back(c);
+                codes += c.chain.size();
+            }
+    }
+
+    if (codes == 0)
+    {
+        cerr << "Error: No chain codes under " << root << '\n';
+        return EXIT_FAILURE;
+    }
+
+    static const char* const names[3] = { "full", "packed", "sidecar" };
+
+    string documents[3];
+    vector<unsigned char> sidecars[3];
+    size_t sizes[3];
+    double times[3];
+
+    for (int k = 0; k < 3; ++k)
+    {
+        sizes[k] = make_document(contours, path_form(k), documents[k], sidecars[k]);
+        times[k] = read_document(documents[k], sidecars[k], codes, rounds);
+
+        if (times[k] < 0)
+        {
+            cerr << "Error: Paths do not read back\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    cout << "Full paths of " << contours.size() << " contours, " << codes
+         << " chain codes, best of " << rounds << " reads\n\n"
+         << "  level    path bytes   bits/code   ns/code   Mcodes/s\n";
+
+    for (int k = 0; k < 3; ++k)
+        cout << "  " << left << setw(8) << names[k]
+             << right << setw(11) << sizes[k]
+             << fixed << setprecision(2) << setw(12) << 8.0 * sizes[k] / codes
+             << setw(10) << 1e9 * times[k] / codes
+             << setw(11) << codes / times[k] / 1e6 << '\n';
+
+    cout << '\n';
+    for (int k = 1; k < 3; ++k)
+        cout << "  " << names[k] << " paths take " << setprecision(1)
+             << double(sizes[0]) / sizes[k] << "x less room and read "
+             << setprecision(2) << times[0] / times[k] << "x as fast\n";
+
+    cout << "  whole documents: " << setprecision(1)
+         << double(documents[0].size()) / documents[1].size() << "x packed, "
+         << double(documents[0].size()) / (documents[2].size() + sidecars[2].size())
+         << "x sidecar\n";
+
+    return EXIT_SUCCESS;
+}
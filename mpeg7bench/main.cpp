@@ -0,0 +1,63 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "bench.hpp"
+
+
+int bench_arena(const int argc, const char* argv[]);
+
+int bench_chains(const int argc, const char* argv[]);
+
+int bench_warp(const int argc, const char* argv[]);
+
+
+int main(const int argc, const char* argv[])
+{
+    using namespace std;
+
+    const string name = argc > 1 ? argv[1] : "";
+
+    try
+    {
+        if (name == "arena")
+            return bench_arena(argc - 2, argv + 2);
+
+        if (name == "chains")
+            return bench_chains(argc - 2, argv + 2);
+
+        if (name == "warp")
+            return bench_warp(argc - 2, argv + 2);
+    }
+
+    catch (const bad_alloc& x)
+    {
+        cerr << "Error: Unhandled memory error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const exception& x)
+    {
+        cerr << "Error: Unhandled standard exception\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (...)
+    {
+        cerr << "Error: Unhandled unknown exception\n";
+        return EXIT_FAILURE;
+    }
+
+    cout << "\n"
+            "Usage: mpeg7bench <benchmark> [options]\n\n"
+            "  Benchmarks\n"
+            "  ----------\n"
+            "  arena  Contour stage allocations and throughput, fresh\n"
+            "         buffers vs per-worker workspaces.\n"
+            "  chains Size and read speed of the chain codes of a CTX\n"
+            "         corpus, as text and packed.\n"
+            "  warp   Affine warps of the generators, cv::warpAffine vs\n"
+            "         the fixed-point kernels of common/warp.\n\n";
+    return EXIT_FAILURE;
+}
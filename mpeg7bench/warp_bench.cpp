@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <ciso646>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "../common/warp.hpp"
+#include "bench.hpp"
+
+
+/**
+ * Affine warp benchmark
+ *
+ * Times the warps of the generators, cv::warpAffine against warp_linear,
+ * over random images of 8 and 16 bits: the rotations of mpeg7A, the
+ * skews of mpeg7D along either axis and the 2x enlargement of the strip
+ * scaler. Random pixels make every difference between the two show.
+ */
+
+namespace
+{
+
+    struct workload
+    {
+        std::string name;
+        cv::Mat m;          // as given to cv::warpAffine
+        int flags,
+            border;
+    };
+
+    std::vector<workload> workloads(const cv::Size& size)
+    {
+        using namespace cv;
+        using namespace std;
+
+        vector<workload> w;
+
+        // mpeg7A: about the centre, as cv::rotate does it
+        const double angles[5] = { 9.0, 36.0, 45.0, 90.0, 150.0 };
+        for (int i = 0; i < 5; ++i)
+        {
+            const workload r = {
+                "rotate " + to_string( static_cast<long long>(angles[i]) ),
+                getRotationMatrix2D( Point2f(0.5f * size.width, 0.5f * size.height),
+                                     angles[i], 1.0 ),
+                CV_INTER_LINEAR, BORDER_CONSTANT };
+            w.push_back(r);
+        }
+
+        // mpeg7D: skew1 and skew2 along x, then along y
+        const double skews[2] = { 0.1, 0.7 };
+        for (int axis = 0; axis < 2; ++axis)
+            for (int i = 0; i < 2; ++i)
+            {
+                workload s;
+                s.name = string(axis == 0 ? "skew x " : "skew y ")
+                       + (i == 0 ? "0.1" : "0.7");
+                s.m = Mat::eye(2, 3, CV_64F);
+                s.m.at<double>(axis == 0 ? 0 : 1, axis == 0 ? 1 : 0) = skews[i];
+                s.flags = CV_INTER_LINEAR;
+                s.border = BORDER_CONSTANT;
+                w.push_back(s);
+            }
+
+        // Strips: the inverse map of a 2x cv::resize
+        workload s;
+        s.name = "scale 2";
+        s.m = Mat::zeros(2, 3, CV_64F);
+        s.m.at<double>(0, 0) = s.m.at<double>(1, 1) = 0.5;
+        s.m.at<double>(0, 2) = s.m.at<double>(1, 2) = -0.25;
+        s.flags = CV_INTER_LINEAR | CV_WARP_INVERSE_MAP;
+        s.border = BORDER_REPLICATE;
+        w.push_back(s);
+
+        return w;
+    }
+
+    const char* class_name(const affine_map& map)
+    {
+        return map.m[1] == 0 and map.m[3] == 0 ? "scale"
+             : map.m[3] == 0 ? "shear" : "rotate";
+    }
+
+    /**
+     * Largest difference between 'a' and 'b', and the number of values
+     * that differ.
+     */
+
+    template <typename T>
+    int compare(const cv::Mat& a, const cv::Mat& b, size_t& differ)
+    {
+        int worst = 0;
+        differ = 0;
+
+        for (int y = 0; y < a.rows; ++y)
+        {
+            const T* p = a.ptr<T>(y);
+            const T* q = b.ptr<T>(y);
+            for (int x = 0; x < a.cols * a.channels(); ++x)
+                if (p[x] != q[x])
+                {
+                    worst = std::max( worst, std::abs(int(p[x]) - int(q[x])) );
+                    ++differ;
+                }
+        }
+
+        return worst;
+    }
+
+}
+
+
+int bench_warp(const int argc, const char* argv[])
+{
+    using namespace cv;
+    using namespace std;
+
+    const char* const usage = "Usage: mpeg7bench warp [--size <n>] [--rounds <n>]\n";
+
+    int side = 512;
+    unsigned rounds = 20;
+
+    for (int arg = 0; arg < argc; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--size" and arg + 1 < argc)
+            side = max(atoi(argv[++arg]), 2);
+        else if (opt == "--rounds" and arg + 1 < argc)
+            rounds = static_cast<unsigned>( max(atoi(argv[++arg]), 1) );
+        else
+        {
+            cout << usage;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const Size size(side, side);
+    const vector<workload> w = workloads(size);
+    const int types[4] = { CV_8UC1, CV_8UC3, CV_16UC1, CV_16UC3 };
+    const char* type_names[4] = { "8UC1", "8UC3", "16UC1", "16UC3" };
+
+    RNG rng(0x6d706567);
+
+    cout << side << " x " << side << " random images, best of " << rounds
+         << " warps\n\n"
+         << "  workload    class   type   warpAffine ms   fixed ms   speedup   max diff   differ\n";
+
+    double opencv_total = 0,
+           fixed_total = 0;
+
+    for (int t = 0; t < 4; ++t)
+    {
+        Mat src(size, types[t]);
+        rng.fill( src, RNG::UNIFORM, Scalar::all(0),
+                  Scalar::all(CV_MAT_DEPTH(types[t]) == CV_8U ? 256 : 65536) );
+
+        for (size_t k = 0; k < w.size(); ++k)
+        {
+            const affine_map map = w[k].flags & CV_WARP_INVERSE_MAP
+                                 ? to_map(w[k].m) : invert( to_map(w[k].m) );
+            const warp_border border = w[k].border == BORDER_REPLICATE
+                                     ? replicate_border : constant_border;
+
+            Mat reference(size, types[t]),
+                dst(size, types[t]);
+
+            double opencv_time = 0,
+                   fixed_time = 0;
+
+            for (unsigned r = 0; r < rounds; ++r)
+            {
+                {
+                    stopwatch clock;
+                    warpAffine(src, reference, w[k].m, size, w[k].flags, w[k].border);
+                    const double elapsed = clock.seconds();
+                    if (r == 0 or elapsed < opencv_time)
+                        opencv_time = elapsed;
+                }
+
+                {
+                    stopwatch clock;
+                    warp_linear(src, dst, map, border);
+                    const double elapsed = clock.seconds();
+                    if (r == 0 or elapsed < fixed_time)
+                        fixed_time = elapsed;
+                }
+            }
+
+            size_t differ;
+            const int worst = CV_MAT_DEPTH(types[t]) == CV_8U
+                            ? compare<uchar>(reference, dst, differ)
+                            : compare<ushort>(reference, dst, differ);
+
+            opencv_total += opencv_time;
+            fixed_total += fixed_time;
+
+            cout << "  " << left << setw(12) << w[k].name << setw(8) << class_name(map)
+                 << setw(7) << type_names[t] << right << fixed << setprecision(3)
+                 << setw(14) << 1e3 * opencv_time << setw(11) << 1e3 * fixed_time
+                 << setprecision(2) << setw(10) << opencv_time / fixed_time
+                 << setw(11) << worst << setw(9) << differ << '\n';
+        }
+    }
+
+    cout << "\n  warp_linear takes " << fixed << setprecision(2)
+         << fixed_total / opencv_total << "x the time of cv::warpAffine overall\n";
+
+    return EXIT_SUCCESS;
+}
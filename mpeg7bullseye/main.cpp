@@ -0,0 +1,118 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/options.hpp"
+#include "settings.hpp"
+
+
+int scan_file(const boost::filesystem::path& p,
+              const boost::filesystem::path& q,
+              const bullseye_settings& settings, const run_options& opts);
+
+
+int main(const int argc, const char* argv[])
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    bool usage = false;
+    bullseye_settings settings;
+    run_options opts;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-' and argv[arg][1] != '\0'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--descriptor" and arg + 1 < argc)
+        {
+            if ( not parse_descriptor(argv[++arg], settings.descriptor) )
+                usage = true;
+        }
+
+        else if (opt == "--distance" and arg + 1 < argc)
+        {
+            if ( not parse_metric(argv[++arg], settings.metric) )
+                usage = true;
+        }
+
+        else if (opt == "--tile" and arg + 1 < argc)
+        {
+            const int t = atoi(argv[++arg]);
+            if (t < 1)
+                usage = true;
+            settings.tile = static_cast<size_t>(t);
+        }
+
+        else if ( not parse_run_option(argc, argv, arg, opts, usage) )
+            usage = true;
+    }
+
+    if (usage or argc - arg < 1 or argc - arg > 2)
+    {
+        cout << "\n"
+                "Usage: mpeg7bullseye [options] <src path> [<dst matrix>]\n\n"
+                "  Run the CE-Shape-1 Part B similarity retrieval test on the\n"
+                "  CTX files under <src path>: compare every shape with every\n"
+                "  other one, and count, for each shape, those of its class\n"
+                "  (the file name up to its last '-') among the twice as many\n"
+                "  closest. Optionally write the distance matrix as a tab\n"
+                "  separated table.\n\n"
+                "  Options\n"
+                "  -------\n"
+                "  --descriptor <d>   Shape descriptor: fourier (centroid distance\n"
+                "                     spectrum; default) or hu (Hu invariants).\n"
+                "  --distance <m>     Distance between descriptors: l1 (default),\n"
+                "                     l2 or chi2.\n"
+                "  --tile <n>         Shapes a side of the tiles of the matrix\n"
+                "                     handed out to the workers (default 64).\n"
+             << run_options_usage << "\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        const path p = argv[arg];
+        const path q = argc - arg == 2 ? path(argv[arg + 1]) : path();
+
+        if ( not exists(p) )    // does p exist?
+        {
+            cout << p << " does not exist.\n";
+            return EXIT_FAILURE;
+        }
+
+        if (scan_file(p, q, settings, opts) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    catch (const filesystem_error& x)
+    {
+        cerr << "Error: Unhandled filesystem error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const bad_alloc& x)
+    {
+        cerr << "Error: Unhandled memory error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const exception& x)
+    {
+        cerr << "Error: Unhandled standard exception\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (...)
+    {
+        cerr << "Error: Unhandled unknown exception\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
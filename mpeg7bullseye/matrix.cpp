@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <ciso646>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "../common/parallel.hpp"
+#include "../common/trace.hpp"
+#include "matrix.hpp"
+
+
+namespace
+{
+
+    // Terms of each metric, summed over the components, and what makes the
+    // distance of their sum
+
+    struct l1_distance
+    {
+        static float term(const float a, const float b) { return std::fabs(a - b); }
+        static float finish(const float s) { return s; }
+    };
+
+    struct l2_distance
+    {
+        static float term(const float a, const float b) { return (a - b) * (a - b); }
+        static float finish(const float s) { return std::sqrt(s); }
+    };
+
+    struct chi2_distance
+    {
+        // The epsilon keeps 0/0 at 0 without a branch
+        static float term(const float a, const float b)
+        {
+            return (a - b) * (a - b) / (std::fabs(a) + std::fabs(b) + 1e-30f);
+        }
+
+        static float finish(const float s) { return s / 2; }
+    };
+
+    /**
+     * Distances between the descriptors of rows [i0, i1) and columns
+     * [j0, j1) of 'table', into 'out', a row of 'stride' floats for each
+     * of rows.
+     */
+
+    template <class Metric>
+    void fill_tile(const descriptor_table& table, const size_t i0, const size_t i1,
+                   const size_t j0, const size_t j1, float* out, const size_t stride)
+    {
+        const size_t width = j1 - j0;
+
+        for (size_t i = i0; i < i1; ++i)
+        {
+            float* const d = out + (i - i0) * stride;
+            const float* const a = table.row(i);
+
+            std::fill(d, d + width, 0.0f);
+
+            for (size_t k = 0; k < table.size(); ++k)
+            {
+                const float ak = a[k];
+                const float* const b = table.component(k) + j0;
+
+                for (size_t j = 0; j < width; ++j)
+                    d[j] += Metric::term(ak, b[j]);
+            }
+
+            for (size_t j = 0; j < width; ++j)
+                d[j] = Metric::finish(d[j]);
+        }
+    }
+
+}
+
+
+descriptor_table::descriptor_table(const size_t count, const size_t size)
+    : count_(count), size_(size), rows_(count * size), components_(count * size)
+{
+}
+
+
+void descriptor_table::transpose()
+{
+    for (size_t i = 0; i < count_; ++i)
+        for (size_t k = 0; k < size_; ++k)
+            components_[k * count_ + i] = rows_[i * size_ + k];
+}
+
+
+bool parse_metric(const std::string& name, metric_kind& kind)
+{
+    if (name == "l1")
+        kind = l1_metric;
+    else if (name == "l2")
+        kind = l2_metric;
+    else if (name == "chi2")
+        kind = chi2_metric;
+    else
+        return false;
+
+    return true;
+}
+
+
+const char* metric_name(const metric_kind kind)
+{
+    switch (kind)
+    {
+    case l1_metric:
+        return "l1";
+    case l2_metric:
+        return "l2";
+    default:
+        return "chi2";
+    }
+}
+
+
+void distance_matrix(const descriptor_table& table, const metric_kind metric,
+                     const size_t tile, const unsigned jobs,
+                     std::vector<float>& matrix)
+{
+    using namespace std;
+
+    const size_t n = table.count(),
+                 t = max<size_t>(tile, 1),
+                 blocks = (n + t - 1) / t;
+
+    matrix.resize(n * n);
+
+    // The tiles of the upper triangle, diagonal ones included
+    vector< pair<size_t, size_t> > tiles;
+    for (size_t bi = 0; bi < blocks; ++bi)
+        for (size_t bj = bi; bj < blocks; ++bj)
+            tiles.push_back( make_pair(bi, bj) );
+
+    vector< vector<float> > scratch( max(jobs, 1u), vector<float>(t * t) );
+
+    parallel_for( tiles.size(), jobs, [&](const size_t k, const unsigned w) -> int
+    {
+        const size_t i0 = tiles[k].first * t,  i1 = min(n, i0 + t),
+                     j0 = tiles[k].second * t, j1 = min(n, j0 + t);
+        float* const out = &scratch[w][0];
+
+        trace_scope scope("tile");
+
+        switch (metric)
+        {
+        case l1_metric:
+            fill_tile<l1_distance>(table, i0, i1, j0, j1, out, t);
+            break;
+        case l2_metric:
+            fill_tile<l2_distance>(table, i0, i1, j0, j1, out, t);
+            break;
+        default:
+            fill_tile<chi2_distance>(table, i0, i1, j0, j1, out, t);
+            break;
+        }
+
+        // The tile, then its mirror below the diagonal, written row by row
+        for (size_t i = i0; i < i1; ++i)
+            memcpy( &matrix[i * n + j0], out + (i - i0) * t, (j1 - j0) * sizeof(float) );
+
+        if (i0 != j0)
+            for (size_t j = j0; j < j1; ++j)
+                for (size_t i = i0; i < i1; ++i)
+                    matrix[j * n + i] = out[(i - i0) * t + (j - j0)];
+
+        return EXIT_SUCCESS;
+    } );
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+/**
+ * All-pairs distance matrix of shape descriptors
+ *
+ * The descriptors of all the shapes are held in one contiguous table,
+ * also kept transposed, one row per component. The matrix is computed in
+ * square tiles of the upper triangle, handed out to the workers; its
+ * lower triangle is copied from the upper one. Within a tile, each shape
+ * of the rows is compared with all the shapes of the columns at once,
+ * one component at a time, so that the inner loop runs over contiguous
+ * floats of the transposed table whatever the size of the descriptors, in
+ * a loop the compiler vectorises.
+ */
+
+class descriptor_table
+{
+public:
+
+    /**
+     * Table of 'count' descriptors of 'size' values each, all zero.
+     */
+
+    descriptor_table(const size_t count, const size_t size);
+
+    size_t count() const { return count_; }
+
+    size_t size() const { return size_; }
+
+    float* row(const size_t i) { return &rows_[i * size_]; }
+
+    const float* row(const size_t i) const { return &rows_[i * size_]; }
+
+    /**
+     * Values of component k of every descriptor, from the last call to
+     * transpose().
+     */
+
+    const float* component(const size_t k) const { return &components_[k * count_]; }
+
+    /**
+     * Copy the rows into the components.
+     */
+
+    void transpose();
+
+private:
+
+    size_t count_,
+           size_;
+    std::vector<float> rows_,           // count x size
+                       components_;     // size x count
+};
+
+/**
+ * Distances between descriptors:
+ *
+ *      l1      sum of |a - b|;
+ *      l2      square root of the sum of (a - b)^2;
+ *      chi2    half the sum of (a - b)^2 / (|a| + |b|), for histograms
+ *              and other non-negative descriptors.
+ */
+
+enum metric_kind { l1_metric, l2_metric, chi2_metric };
+
+/**
+ * Parse a metric name. Returns false if there is no such metric.
+ */
+
+bool parse_metric(const std::string& name, metric_kind& kind);
+
+const char* metric_name(const metric_kind kind);
+
+/**
+ * Fill 'matrix' with the count x count distances between the descriptors
+ * of 'table', row by row, computing tiles of 'tile' x 'tile' pairs on
+ * 'jobs' workers.
+ */
+
+void distance_matrix(const descriptor_table& table, const metric_kind metric,
+                     const size_t tile, const unsigned jobs,
+                     std::vector<float>& matrix);
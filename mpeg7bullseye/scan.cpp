@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <ciso646>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/io_stage.hpp"
+#include "../common/manifest.hpp"
+#include "../common/options.hpp"
+#include "../common/parallel.hpp"
+#include "../common/shard.hpp"
+#include "../common/sources.hpp"
+#include "../common/stopwatch.hpp"
+#include "../common/trace.hpp"
+#include "settings.hpp"
+#include "shapes.hpp"
+
+
+int scan_file(const boost::filesystem::path& p, const boost::filesystem::path& q,
+              const bullseye_settings& settings, const run_options& opts)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    if (opts.shards > 1)
+    {
+        clog << "An all-pairs evaluation needs every shape: --shard is not supported\n";
+        return EXIT_FAILURE;
+    }
+
+    vector<path> files;
+
+    int status = collect_sources(p, files);
+
+    // Contour files only, in path order, which is that of the matrix
+    vector<path> pending;
+    for (size_t i = 0; i < files.size(); ++i)
+        if (files[i].extension() == ".ctx")
+            pending.push_back(files[i]);
+
+    sort(pending.begin(), pending.end());
+
+    const size_t n = pending.size();
+
+    if (n == 0)
+    {
+        clog << "No contour files in " << p << '\n';
+        return EXIT_FAILURE;
+    }
+
+    manifest m("mpeg7bullseye", opts.shard, opts.shards, p);
+
+    map<path, size_t> index;
+    for (size_t i = 0; i < n; ++i)
+        index[pending[i]] = i;
+
+    // Class of every shape, numbered in order of appearance
+    map<string, size_t> class_index;
+    vector<size_t> classes(n),
+                   sizes;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const string name = shape_class(pending[i]);
+        if ( class_index.find(name) == class_index.end() )
+        {
+            class_index[name] = sizes.size();
+            sizes.push_back(0);
+        }
+        classes[i] = class_index[name];
+        ++sizes[classes[i]];
+    }
+
+    io_stage io(opts.io, opts.io_threads, opts.lookahead, opts.durable);
+    io.prefetch(pending);
+
+    // One workspace per worker, one row of the table per file
+    vector< unique_ptr<shape_workspace> > ws;
+    for (unsigned w = 0; w < max(opts.jobs, 1u); ++w)
+        ws.push_back( unique_ptr<shape_workspace>(new shape_workspace) );
+
+    descriptor_table table( n, descriptor_size(settings.descriptor) );
+
+    auto task = [&](const path& f, const unsigned w)
+    {
+        const int s = describe_file(f, settings.descriptor, *ws[w], io,
+                                    table.row( index.find(f)->second ));
+        m.record(f, s == EXIT_SUCCESS ? manifest::done : manifest::failed);
+        return s;
+    };
+
+    if ( parallel_for_each(pending, opts.jobs, task) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if (status == EXIT_SUCCESS)
+    {
+        table.transpose();
+
+        vector<float> matrix;
+        stopwatch clock;
+        distance_matrix(table, settings.metric, settings.tile, opts.jobs, matrix);
+        const double seconds = clock.seconds();
+
+        const size_t hits = bullseye_hits(matrix, classes, sizes, opts.jobs);
+
+        size_t possible = 0;
+        for (size_t i = 0; i < n; ++i)
+            possible += sizes[classes[i]];
+
+        const double pairs = 0.5 * double(n) * double(n - 1);
+
+        cout << n << " shapes in " << sizes.size() << " classes, "
+             << descriptor_name(settings.descriptor) << " descriptors, "
+             << metric_name(settings.metric) << " distance\n"
+             << fixed << setprecision(2)
+             << "bull's-eye score: " << 100.0 * hits / possible << "% ("
+             << hits << " of " << possible << ")\n"
+             << "matrix: " << setprecision(0) << pairs << " pairs in "
+             << setprecision(3) << seconds << " s, " << setprecision(1)
+             << (seconds > 0 ? pairs / seconds / 1e6 : 0) << " Mpairs/s (tiles of "
+             << settings.tile << ", " << max(opts.jobs, 1u) << " jobs)\n";
+
+        // The matrix, as a table with a header row and column of names
+        if ( not q.empty() )
+        {
+            ostringstream out;
+            out.precision(9);
+
+            out << "source";
+            for (size_t j = 0; j < n; ++j)
+                out << '\t' << relative_key(pending[j], p);
+            out << '\n';
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                out << relative_key(pending[i], p);
+                for (size_t j = 0; j < n; ++j)
+                    out << '\t' << matrix[i * n + j];
+                out << '\n';
+            }
+
+            const string text = out.str();
+            vector<unsigned char> bytes(text.begin(), text.end());
+            io.write(q, bytes);
+        }
+    }
+
+    if ( io.drain() != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( not opts.manifest.empty()
+         and m.save(opts.manifest, status, opts.durable) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    return status;
+}
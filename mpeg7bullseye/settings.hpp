@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+#include "../common/descriptors.hpp"
+#include "matrix.hpp"
+
+
+/**
+ * How shapes are compared
+ */
+
+struct bullseye_settings
+{
+    descriptor_kind descriptor;         // descriptor of each shape
+    metric_kind     metric;             // distance between descriptors
+    size_t          tile;               // shapes a side of matrix tiles
+
+    bullseye_settings()
+        : descriptor(fourier_descriptor), metric(l1_metric), tile(64)
+    {
+    }
+};
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+
+#include "../common/chain_codec.hpp"
+#include "../common/io_stage.hpp"
+#include "../common/parallel.hpp"
+#include "../common/trace.hpp"
+#include "shapes.hpp"
+
+
+namespace
+{
+
+    // Steps of the 8-connected Freeman chain code (see contour.xsd)
+    const int step_x[8] = { 1, 1, 0, -1, -1, -1,  0,  1 },
+              step_y[8] = { 0, 1, 1,  1,  0, -1, -1, -1 };
+
+    /**
+     * Twice the area enclosed by the full path of c, in absolute value.
+     */
+
+    long long double_area(const ctx_contour& c)
+    {
+        long long x = c.x,
+                  y = c.y,
+                  s = 0;
+
+        for (size_t i = 0; i < c.chain.size(); ++i)
+        {
+            const long long qx = x + step_x[c.chain[i] & 7],
+                            qy = y + step_y[c.chain[i] & 7];
+            s += x * qy - qx * y;
+            x = qx;
+            y = qy;
+        }
+
+        s += x * c.y - c.x * y;
+        return s < 0 ? -s : s;
+    }
+
+}
+
+
+int read_shape(const boost::filesystem::path& f, shape_workspace& ws, io_stage& io)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    if ( not io.fetch(f, ws.bytes) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << f << " could not be read\n";
+        return EXIT_FAILURE;
+    }
+
+    // The packed level may be kept in a sidecar file
+    path chains_p = f;
+    chains_p.replace_extension(".chains");
+
+    boost::system::error_code ec;
+    const bool has_sidecar = exists(chains_p, ec);
+
+    ws.chains.clear();
+    if ( has_sidecar and not io.fetch(chains_p, ws.chains) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << chains_p << " could not be read\n";
+        return EXIT_FAILURE;
+    }
+
+    sidecar_reader sidecar(ws.chains.empty() ? 0 : &ws.chains[0], ws.chains.size());
+
+    const char* text = ws.bytes.empty() ? ""
+                     : reinterpret_cast<const char*>(&ws.bytes[0]);
+    ctx_reader reader(text, ws.bytes.size());
+
+    long long width, height;
+    if ( not read_canvas(reader, width, height) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << f << " is not a CTX document: " << reader.error() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    long long largest = -1;
+
+    while ( read_contour(reader, ws.contour, has_sidecar ? &sidecar : 0) )
+    {
+        if (ws.contour.parent != 0 or not ws.contour.has_chain)
+            continue;
+
+        const long long area = double_area(ws.contour);
+        if (area > largest)
+        {
+            largest = area;
+            swap(ws.largest, ws.contour);
+        }
+    }
+
+    if ( not reader.error().empty() )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << f << ": " << reader.error() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    if ( has_sidecar and not sidecar.done() )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << chains_p << " does not hold the packed paths of " << f << '\n';
+        return EXIT_FAILURE;
+    }
+
+    if (largest <= 0)
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << f << " has no outer contour\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+int describe_file(const boost::filesystem::path& f, const descriptor_kind kind,
+                  shape_workspace& ws, io_stage& io, float* values)
+{
+    using namespace std;
+
+    if ( read_shape(f, ws, io) != EXIT_SUCCESS )
+        return EXIT_FAILURE;
+
+    bool described;
+    {
+        trace_scope scope("describe");
+        described = describe(ws.largest, kind, values);
+    }
+
+    if (not described)
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << f << " has no outer contour to describe\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+std::string shape_class(const boost::filesystem::path& f)
+{
+    const std::string stem = f.stem().string();
+    const size_t dash = stem.rfind('-');
+    return dash == std::string::npos or dash == 0 ? stem : stem.substr(0, dash);
+}
+
+
+size_t bullseye_hits(const std::vector<float>& matrix, const std::vector<size_t>& classes,
+                     const std::vector<size_t>& sizes, const unsigned jobs)
+{
+    using namespace std;
+
+    const size_t n = classes.size();
+
+    vector< vector< pair<float, size_t> > > rows( max(jobs, 1u) );
+    vector<size_t> hits(n);
+
+    parallel_for( n, jobs, [&](const size_t q, const unsigned w) -> int
+    {
+        vector< pair<float, size_t> >& row = rows[w];
+
+        // Ties go to the lower index, so that scores are reproducible
+        row.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            row[i] = make_pair(matrix[q * n + i], i);
+
+        const size_t window = min(n, 2 * sizes[classes[q]]);
+        nth_element( row.begin(), row.begin() + (window - 1), row.end() );
+
+        size_t h = 0;
+        for (size_t i = 0; i < window; ++i)
+            h += classes[row[i].second] == classes[q];
+        hits[q] = h;
+
+        return EXIT_SUCCESS;
+    } );
+
+    size_t total = 0;
+    for (size_t q = 0; q < n; ++q)
+        total += hits[q];
+    return total;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+#include "../common/ctx.hpp"
+#include "../common/descriptors.hpp"
+
+class io_stage;
+
+
+/**
+ * Shapes of the CE-Shape-1 contour files
+ *
+ * The shape of a CTX file is the largest of its outer contours, and its
+ * class the name of the file up to its last '-', as in "apple-1.ctx".
+ */
+
+/**
+ * Buffers of one worker, reused for every file it reads.
+ */
+
+struct shape_workspace
+{
+    std::vector<unsigned char> bytes,   // contents of the CTX file
+                               chains;  // and of its sidecar file, if any
+    ctx_contour contour,                // contour being read
+                largest;                // largest outer one so far
+};
+
+/**
+ * Read the shape of the CTX file f into ws.largest.
+ */
+
+int read_shape(const boost::filesystem::path& f, shape_workspace& ws, io_stage& io);
+
+/**
+ * Describe the shape of the CTX file f into 'values', descriptor_size()
+ * floats.
+ */
+
+int describe_file(const boost::filesystem::path& f, const descriptor_kind kind,
+                  shape_workspace& ws, io_stage& io, float* values);
+
+/**
+ * Class of the shape of file f.
+ */
+
+std::string shape_class(const boost::filesystem::path& f);
+
+/**
+ * Bull's-eye test of the n x n distance 'matrix' of shapes of the given
+ * 'classes', of the given 'sizes': for every shape, the number of shapes
+ * of its class among the 2 m closest to it (itself included), m being the
+ * size of the class. Returns the sum over all the shapes.
+ */
+
+size_t bullseye_hits(const std::vector<float>& matrix, const std::vector<size_t>& classes,
+                     const std::vector<size_t>& sizes, const unsigned jobs);
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <ciso646>
+#include <cstdio>
+#include <sstream>
+
+#include "../common/hash.hpp"
+#include "../common/io_stage.hpp"
+#include "../common/sources.hpp"
+#include "cache.hpp"
+
+
+result_cache::result_cache(const boost::filesystem::path& dir,
+                           const contour_settings& settings)
+    : dir_(dir), sidecar_(settings.sidecar), hits_(0), stores_(0)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    // Everything, besides the pixels, that the contour file depends on.
+    // Bump the format tag whenever write_contour changes its output.
+    ostringstream s;
+    s << "ctx-2 otsu " << (settings.invert ? "invert" : "direct");
+    for (size_t i = 0; i < settings.levels.size(); ++i)
+        s << ' ' << settings.levels[i].name();
+    if (settings.sidecar)
+        s << " sidecar";
+    fingerprint_ = s.str();
+
+    if (not enabled())
+        return;
+
+    // Create the 256 buckets once, rather than checking for them on every
+    // store, and list the entries they hold
+    for (unsigned b = 0; b < 256; ++b)
+    {
+        char name[3];
+        sprintf(name, "%02x", b);
+
+        boost::system::error_code ec;
+        create_directories(dir_ / name, ec);
+
+        for ( directory_iterator it(dir_ / name, ec); not ec and it != directory_iterator();
+              it.increment(ec) )
+            if ( it->path().extension() == ".ctx" )
+                known_.insert( it->path().stem().string() );
+    }
+}
+
+
+std::string result_cache::key(const cv::Mat& img) const
+{
+    hash128 h;
+
+    h.update(fingerprint_);
+
+    const int header[3] = { img.rows, img.cols, img.type() };
+    h.update(header, sizeof header);
+
+    const size_t row = img.cols * img.elemSize();
+    for (int r = 0; r < img.rows; ++r)
+        h.update(img.ptr(r), row);
+
+    return h.hex();
+}
+
+
+std::vector<boost::filesystem::path>
+result_cache::misses(const std::vector<boost::filesystem::path>& files)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    if (not enabled())
+        return files;
+
+    vector<path> rest;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const string stamp = source_stamp(files[i]);
+        if ( stamp.empty() )
+        {
+            rest.push_back(files[i]);
+            continue;
+        }
+
+        hash128 h;
+        h.update("ctx-source " + fingerprint_ + '\n' + stamp);
+        const string k = h.hex();
+
+        sources_[ files[i].string() ] = k;
+        if ( known_.count(k) )
+            found_[ files[i].string() ] = k;
+        else
+            rest.push_back(files[i]);
+    }
+
+    return rest;
+}
+
+
+boost::filesystem::path result_cache::entry_of(const boost::filesystem::path& p) const
+{
+    const std::map<std::string, std::string>::const_iterator k = found_.find( p.string() );
+    return k == found_.end() ? boost::filesystem::path() : entry(k->second);
+}
+
+
+std::string result_cache::source_key(const boost::filesystem::path& p) const
+{
+    const std::map<std::string, std::string>::const_iterator k = sources_.find( p.string() );
+    return k == sources_.end() ? std::string() : k->second;
+}
+
+
+bool result_cache::find_source(const boost::filesystem::path& p, std::vector<uchar>& text,
+                               std::vector<uchar>& chains, io_stage& io)
+{
+    const boost::filesystem::path e = entry_of(p);
+    if ( e.empty() or not io.fetch(e, text) or not split(text, chains) )
+        return false;
+
+    ++hits_;
+    return true;
+}
+
+
+bool result_cache::find(const std::string& key, std::vector<uchar>& text,
+                        std::vector<uchar>& chains, io_stage& io)
+{
+    // Entries made since the cache was opened are not looked for
+    if ( not enabled() or not known_.count(key) or not io.fetch(entry(key), text)
+         or not split(text, chains) )
+        return false;
+
+    ++hits_;
+    return true;
+}
+
+
+void result_cache::store(const std::string& key, const std::string& source,
+                         const std::vector<uchar>& text, const std::vector<uchar>& chains,
+                         std::vector<uchar>& copy, io_stage& io)
+{
+    if (not enabled())
+        return;
+
+    queue(key, text, chains, copy, io);
+    if ( not source.empty() )
+        queue(source, text, chains, copy, io);
+}
+
+
+bool result_cache::split(std::vector<uchar>& text, std::vector<uchar>& chains) const
+{
+    if (not sidecar_)
+        return true;
+
+    // A CTX document holds no null character
+    const std::vector<uchar>::iterator end = std::find(text.begin(), text.end(), 0);
+    if ( end == text.end() )
+        return false;
+
+    chains.assign(end + 1, text.end());
+    text.erase(end, text.end());
+    return true;
+}
+
+
+void result_cache::queue(const std::string& key, const std::vector<uchar>& text,
+                         const std::vector<uchar>& chains, std::vector<uchar>& copy,
+                         io_stage& io)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if ( not stored_.insert(key).second )
+            return;
+    }
+
+    copy.assign(text.begin(), text.end());
+    if (sidecar_)
+    {
+        copy.push_back(0);
+        copy.insert(copy.end(), chains.begin(), chains.end());
+    }
+
+    io.store(entry(key), copy);
+    ++stores_;
+}
+
+
+boost::filesystem::path result_cache::entry(const std::string& key) const
+{
+    return dir_ / key.substr(0, 2) / (key + ".ctx");
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include "settings.hpp"
+
+class io_stage;
+
+
+/**
+ * Content-addressed cache of contour files
+ *
+ * A contour file only depends on the decoded pixels of its image and on
+ * the settings of the contour stage, so identical images (the -1
+ * originals copied into scale/, rotation/, skew1/ and skew2/, or the same
+ * image in two formats) share it. The cache keeps every contour file
+ * written under the hash of its pixels and settings:
+ *
+ *      <cache dir>/<2 hex digits>/<32 hex digits>.ctx
+ *
+ * and the contour stage copies it instead of thresholding and tracing the
+ * image again. With --sidecar, an entry holds the contour file, a null
+ * character, then its sidecar file. The contour file of a source image is also kept under the
+ * hash of its stamp (see source_stamp()) and the settings, so that a later
+ * run knows it before decoding the image: the I/O stage reads the entry
+ * ahead in place of the source, and the worker copies it, never waiting
+ * on the file system. An image made in memory, or a source changed since,
+ * is only known by its pixels; its entry, if any, is read on the spot.
+ * The entries present are listed once, as the cache is opened, so that
+ * looking up a missing one costs nothing.
+ *
+ * Entries are committed like any other output, under staging
+ * names of their own, so the cache can be shared by concurrent runs and
+ * shards, and kept across runs; an entry that cannot be written costs a
+ * later run the work again, and does not fail this one.
+ */
+
+class result_cache
+{
+public:
+
+    /**
+     * Cache in 'dir', for contour files made with 'settings'. An empty
+     * 'dir' disables the cache.
+     */
+
+    result_cache(const boost::filesystem::path& dir,
+                 const contour_settings& settings);
+
+    bool enabled() const { return not dir_.empty(); }
+
+    /**
+     * Key of the contour file of the decoded image 'img'.
+     */
+
+    std::string key(const cv::Mat& img) const;
+
+    /**
+     * Sort out the sources of 'files' whose contour file is in the cache
+     * under their stamp, and return the others, in order. The entries of
+     * the former are for the I/O stage to read ahead (see entry_of()).
+     */
+
+    std::vector<boost::filesystem::path> misses(const std::vector<boost::filesystem::path>& files);
+
+    /**
+     * Entry of source p if misses() found it, an empty path otherwise.
+     */
+
+    boost::filesystem::path entry_of(const boost::filesystem::path& p) const;
+
+    /**
+     * Key of the stamp of source p, as misses() made it, or an empty
+     * string.
+     */
+
+    std::string source_key(const boost::filesystem::path& p) const;
+
+    /**
+     * Get the contour file of source p that misses() found, through the
+     * I/O stage, into 'text', and its sidecar file, if the settings make
+     * one, into 'chains'. Returns false if there is none, or it cannot be
+     * read.
+     */
+
+    bool find_source(const boost::filesystem::path& p, std::vector<uchar>& text,
+                     std::vector<uchar>& chains, io_stage& io);
+
+    /**
+     * Get the cached contour file of 'key' into 'text', and its sidecar
+     * file into 'chains', through the I/O stage. Returns false if there is
+     * none.
+     */
+
+    bool find(const std::string& key, std::vector<uchar>& text,
+              std::vector<uchar>& chains, io_stage& io);
+
+    /**
+     * Queue a copy of 'text', the contour file of 'key', and of 'chains',
+     * its sidecar file if the settings make one, to be written to the
+     * cache, and another under 'source', the source key of the image if it
+     * has one, unless this run has already queued them (the images sharing
+     * it being traced at the same time). 'copy' is the buffer handed over
+     * to the I/O stage.
+     */
+
+    void store(const std::string& key, const std::string& source,
+               const std::vector<uchar>& text, const std::vector<uchar>& chains,
+               std::vector<uchar>& copy, io_stage& io);
+
+    size_t hits() const { return hits_; }
+
+    size_t stores() const { return stores_; }
+
+private:
+
+    boost::filesystem::path dir_;
+    std::string fingerprint_;       // settings the contour file depends on
+    bool sidecar_;                  // entries hold a sidecar file
+
+    std::atomic<size_t> hits_,
+                        stores_;
+
+    std::unordered_set<std::string> known_;         // entries listed
+    std::map<std::string, std::string> sources_,    // source keys, by path
+                                       found_;      // those listed
+
+    std::mutex m_;
+    std::set<std::string> stored_;  // keys queued by this run
+
+    void queue(const std::string& key, const std::vector<uchar>& text,
+               const std::vector<uchar>& chains, std::vector<uchar>& copy,
+               io_stage& io);
+
+    bool split(std::vector<uchar>& text, std::vector<uchar>& chains) const;
+
+    boost::filesystem::path entry(const std::string& key) const;
+};
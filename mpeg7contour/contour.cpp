@@ -13,35 +13,78 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
-
-int save_contour(const std::vector< std::vector< cv::Point > >& contours,
-                 const std::vector< cv::Vec4i >& hierarchy,
-                 const size_t width, const size_t height,
-                 const boost::filesystem::path& q)
+#include "../common/frame_cache.hpp"
+#include "../common/io_stage.hpp"
+#include "../common/mapped_file.hpp"
+#include "../common/parallel.hpp"
+#include "../common/rtree.hpp"
+#include "../common/silhouette.hpp"
+#include "../common/trace.hpp"
+#include "../common/vector_stream.hpp"
+#include "cache.hpp"
+#include "levels.hpp"
+#include "settings.hpp"
+#include "workspace.hpp"
+
+
+/**
+ * Serialize the contours of one image as a CTX document, with the given
+ * path levels and an index of their bounding boxes. The moments and
+ * perimeter of each contour are computed from its points, or taken from
+ * 'shapes' if given. If 'sidecar' is given, it is made the sidecar file of
+ * the document, holding the codes of the packed level. 'index' and
+ * 'scratch' are working storage reused across calls.
+ */
+
+int write_contour(std::ostream& out,
+                  const std::vector< std::vector< cv::Point > >& contours,
+                  const std::vector< cv::Vec4i >& hierarchy,
+                  const size_t width, const size_t height,
+                  const std::vector<path_level>& levels,
+                  const std::vector<contour_shape>* shapes,
+                  packed_rtree& index, path_scratch& scratch,
+                  std::vector<unsigned char>* sidecar)
 {
-    using namespace boost::filesystem;
     using namespace std;
     using namespace cv;
 
-    path part_p = q;
-
     int status = EXIT_SUCCESS;
 
-    part_p.replace_extension(".part");
-
-    boost::filesystem::ofstream out(part_p, ios_base::binary);
-
-    if (not out.is_open())
-        return EXIT_FAILURE;
-
-    std::cout << part_p << '\n';
-
     out << "<?xml version=\"1.0\" standalone=\"yes\"?>\n"
            "<ctx>\n";
 
     out << "\t<canvas width=\"" << width << "\" height=\"" << height
         << "\" />\n";
 
+    // R-tree of the bounding boxes, ahead of the contours, so that readers
+    // can find those of a region without going through them all
+    index.clear();
+    for (unsigned i = 0; i < contours.size(); ++i)
+    {
+        const Rect r = boundingRect(contours[i]);
+        index.add( bbox(r.x, r.y, r.width, r.height) );
+    }
+    index.build();
+
+    if (sidecar)
+        begin_sidecar(*sidecar);
+
+    if ( index.size() > 0 )
+    {
+        out << "\t<index fanout=\"" << packed_rtree::fanout << "\" order=\"";
+        for (size_t k = 0; k < index.order().size(); ++k)
+            out << (k > 0 ? " " : "") << (index.order()[k] + 1);
+
+        out << "\" nodes=\"";
+        for (size_t k = 0; k < index.nodes().size(); ++k)
+        {
+            const bbox& b = index.nodes()[k];
+            out << (k > 0 ? " " : "") << b.x << ' ' << b.y << ' '
+                << b.width << ' ' << b.height;
+        }
+        out << "\" />\n";
+    }
+
     out << "\t<silhouette contours=\"" << contours.size();
     if (contours.size() > 1)
     {
@@ -84,8 +127,19 @@ int save_contour(const std::vector< std::vector< cv::Point > >& contours,
 
         out << ">\n";
 
-        const double  p = arcLength(contours[i], true);
-        const Moments m = moments(contours[i]);
+        double  p;
+        Moments m;
+        if (shapes)
+        {
+            p = (*shapes)[i].perimeter;
+            m = (*shapes)[i].moments;
+        }
+        else
+        {
+            trace_scope scope("moments");
+            p = arcLength(contours[i], true);
+            m = moments(contours[i]);
+        }
         const double i00 = 1.0 / m.m00;
         Point2d c(m.m10 * i00, m.m01 * i00);
 
@@ -97,6 +151,11 @@ int save_contour(const std::vector< std::vector< cv::Point > >& contours,
             << "\" cx=\"" << c.x << "\" cy=\"" << c.y
             << "\" />\n";
 
+        const bbox& b = index.box(i);
+        out << "\t\t\t<bounds x=\"" << b.x << "\" y=\"" << b.y
+            << "\" width=\"" << b.width << "\" height=\"" << b.height
+            << "\" />\n";
+
         // Cartesian geometric spatial (raw product about the origin) moments.
 
         out << "\t\t\t<spatial-moments m00=\"" << m.m00
@@ -132,68 +191,12 @@ int save_contour(const std::vector< std::vector< cv::Point > >& contours,
             << "\" nu12=\"" << m.nu12
             << "\" nu03=\"" << m.nu03 << "\" />\n";
 
-        // 8-connected Freeman chain code.
-        //
-        // Direction-to-code convention is:
-        //
-        //      3  2  1     0 (+1,  0)      3 (-1, +1)      6 ( 0, -1)
-        //      4  x  0     1 (+1, +1)      4 (-1,  0)      7 (+1, -1)
-        //      5  6  7     2 ( 0, +1)      5 (-1, -1)
-        //
-        // In terms of (delta_x, delta_y) if next pixel compared to the
-        // current and converting (dy,dx) pairs to scalar indexes thinking
-        // to them as base-3 numbers according to:
-        //
-        //      i = 3 * (dy+1) + (dx+1) = 3dy + dx + 4
-        //
-        //      ---------------------------------------
-        //      | deltax | deltay | code |  (base-3)  |
-        //      |------------------------------------|
-        //      |    0   |   +1   |   2  |      7     | 
-        //      |    0   |   -1   |   6  |      1     | 
-        //      |   -1   |   +1   |   3  |      6     | 
-        //      |   -1   |   -1   |   5  |      0     | 
-        //      |   +1   |   +1   |   1  |      8     | 
-        //      |   +1   |   -1   |   7  |      2     | 
-        //      |   -1   |    0   |   4  |      3     |  
-        //      |   +1   |    0   |   0  |      5     | 
-        //      ---------------------------------------
-        //
-        static const int cc[3][3] = {
-            {  5,  6,  7 },
-            {  4, -1,  0 },
-            {  3,  2,  1 }
-        };
-
-        out << "\t\t\t<path vertices=\""
-            << contours[i].size()
-            << "\" chain=\"";
-
-        auto it = contours[i].begin(),
-             et = contours[i].end();
-
-        int x = it->x,
-            y = it->y;
-
-        out << x << ' ' << y;
-
-        while (++it != et)
-        {
-            const int dx = it->x - x,
-                      dy = it->y - y;
-
-            const int code = cc[dy+1][dx+1];
-
-            if (code < 0)
+        // Contour path, at every level asked for
+        for (size_t k = 0; k < levels.size(); ++k)
+            if (write_path(out, contours[i], levels[k], scratch, i + 1,
+                           sidecar) != EXIT_SUCCESS)
                 return EXIT_FAILURE;
 
-            out << ' ' << code;
-
-            x = it->x, y = it->y;
-        }
-        
-        out << "\" />\n";
-
         out << "\t\t</contour>\n";
     }
 
@@ -201,76 +204,215 @@ int save_contour(const std::vector< std::vector< cv::Point > >& contours,
 
     out << "</ctx>";
 
-    out.close();
+    return status;
+}
 
-    rename(part_p, q);
-    std::cout << q << '\n';
 
-    return status;
+/**
+ * Name of the sidecar file of the contour file q.
+ */
+
+boost::filesystem::path sidecar_path(const boost::filesystem::path& q)
+{
+    boost::filesystem::path chains_p = q;
+    chains_p.replace_extension(".chains");
+    return chains_p;
+}
+
+
+/**
+ * Queue the contour file 'text' to be written as q, and its sidecar
+ * 'chains' next to it if the settings make one.
+ */
+
+void write_files(const boost::filesystem::path& q, const contour_settings& settings,
+                 std::vector<uchar>& text, std::vector<uchar>& chains, io_stage& io)
+{
+    if (settings.sidecar)
+        io.write(sidecar_path(q), chains);
+
+    io.write(q, text);
 }
 
 
+int save_contour(const std::vector< std::vector< cv::Point > >& contours,
+                 const std::vector< cv::Vec4i >& hierarchy,
+                 const size_t width, const size_t height,
+                 const std::vector<contour_shape>* shapes,
+                 const contour_settings& settings,
+                 const boost::filesystem::path& q,
+                 result_cache& cache, const std::string& key,
+                 contour_workspace& ws, io_stage& io)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    // Serialize the whole document in the worker's memory, then let the
+    // I/O stage write and commit it.
+    ws.text.clear();
+    vector_ostream out(ws.text);
+
+    {
+        trace_scope scope("serialize");
+        if (write_contour(out, contours, hierarchy, width, height, settings.levels,
+                          shapes, ws.index, ws.path, settings.sidecar ? &ws.chains : 0)
+            != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    if ( not key.empty() )
+        cache.store(key, ws.source, ws.text, ws.chains, ws.copy, io);
+
+    write_files(q, settings, ws.text, ws.chains, io);
+
+    {
+        lock_guard<mutex> lock(console_mutex());
+        std::cout << q << '\n';
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * Name of the contour file made from p in q.
+ */
+
+boost::filesystem::path ctx_path(const boost::filesystem::path& p,
+                                 const boost::filesystem::path& q)
+{
+    boost::filesystem::path ctx_p = q / p.filename();
+    ctx_p.replace_extension(".ctx");
+    return ctx_p;
+}
+
+
+/**
+ * Threshold and trace the decoded image 'src', and save its contour file
+ * as 'ctx_p' (or copy the cached one). 'src' may be held by the caller,
+ * as the images made in memory by the generators, or be ws.src.
+ */
+
+int trace_image(const cv::Mat& src, const boost::filesystem::path& ctx_p,
+                const contour_settings& settings, result_cache& cache,
+                contour_workspace& ws, io_stage& io);
+
+
 int contour_image(const boost::filesystem::path& p, 
                   const boost::filesystem::path& q,
-                  const bool invert)
+                  const contour_settings& settings, result_cache& cache,
+                  frame_cache& frames, contour_workspace& ws, io_stage& io)
 {
     using namespace boost::filesystem;
     using namespace std;
     using namespace cv;
 
-    int status = EXIT_SUCCESS;
+    // Note: p has been checked to be a regular file, and the contour file
+    // to be missing, by scan_file; the worker never waits on the file
+    // system other than for the prefetched contents of p or of its cached
+    // contour file, or the mapped pages of its decoded image.
+
+    // Get the base filename for output files.
+    const path ctx_p = ctx_path(p, q);
 
-    if ( exists(p) )  // does p actually exist?
     {
-        if ( is_regular_file(p) )   // is p a regular file? 
-        {
-            Mat src, dst;
+        lock_guard<mutex> lock(console_mutex());
+        cout << "Processing \n" << p << "\nGenerating:\n";
+    }
 
-            // Get the base filename for output files.
-            path ctx_p = q / p.filename();
-            ctx_p.replace_extension(".ctx");
+    // Recycle the buffers used by the previous image
+    ws.reset();
 
-            // Create contour files
-            if ( not exists(ctx_p) )
-            {
-                cout << "Processing \n" << p << "\nGenerating:\n";
+    // Traced by an earlier run: its contour file has been read ahead in
+    // place of the image
+    if ( cache.find_source(p, ws.text, ws.chains, io) )
+    {
+        write_files(ctx_p, settings, ws.text, ws.chains, io);
 
-                // Load the image
-                src = imread( p.string(), CV_LOAD_IMAGE_ANYDEPTH );
+        lock_guard<mutex> lock(console_mutex());
+        cout << ctx_p << " (cached)\n";
+        return EXIT_SUCCESS;
+    }
 
-                // Threshold the image
-                threshold( src, dst, 0, 255, CV_THRESH_BINARY|CV_THRESH_OTSU );
-                if (invert)
-                    subtract( Scalar::all(255), dst, dst );
+    ws.source = cache.source_key(p);
 
-                // Extract the contours and store them all as a list
-                // (Use CV_RETR_EXTERNAL for outer contour only.)
-                vector< vector<Point> > contours;
-                vector< Vec4i > hierarchy;
-                findContours( dst, contours, hierarchy, CV_RETR_TREE,
-                              CV_CHAIN_APPROX_NONE );
+    // The decoded image, mapped from the frame cache if it is there
+    {
+        mapped_file frame;
+        Mat cached;
+        if ( frames.find(p, frame, cached) )
+            return trace_image(cached, ctx_p, settings, cache, ws, io);
+    }
 
-                // Save the contour
-                status = save_contour( contours, hierarchy, src.cols, src.rows,
-                                       ctx_p );
+    // Load the image (decoding into the worker's arena)
+    if ( not io.fetch(p, ws.bytes) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << p << " could not be read\n";
+        return EXIT_FAILURE;
+    }
+
+    {
+        trace_scope scope("decode");
+        imdecode( Mat(ws.bytes), CV_LOAD_IMAGE_ANYDEPTH, &ws.src );
+    }
+
+    if ( ws.src.empty() )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << p << " could not be decoded\n";
+        return EXIT_FAILURE;
+    }
+
+    // The encoded source is done with: its buffer carries the entry
+    frames.store(p, ws.src, ws.bytes, io);
+
+    return trace_image(ws.src, ctx_p, settings, cache, ws, io);
+}
 
-                if ( status != EXIT_SUCCESS )
-                    return EXIT_FAILURE;
-            }
-        }
 
-        else    // p is not a regular file!
+int trace_image(const cv::Mat& src, const boost::filesystem::path& ctx_p,
+                const contour_settings& settings, result_cache& cache,
+                contour_workspace& ws, io_stage& io)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+    using namespace cv;
+
+    // Identical pixels give identical contour files: reuse the cached one
+    // if any
+    string key;
+    if ( cache.enabled() )
+    {
+        key = cache.key(src);
+
+        if ( cache.find(key, ws.text, ws.chains, io) )
         {
-            clog << p << " exists, but is not a regular file\n";
-            status = EXIT_FAILURE;
+            write_files(ctx_p, settings, ws.text, ws.chains, io);
+
+            lock_guard<mutex> lock(console_mutex());
+            cout << ctx_p << " (cached)\n";
+            return EXIT_SUCCESS;
         }
     }
 
-    else    // p does not exists!
+    // Threshold the image
     {
-        clog << p << " does not exist\n";
-        return EXIT_FAILURE;
+        trace_scope scope("threshold");
+        threshold( src, ws.dst, 0, 255, CV_THRESH_BINARY|CV_THRESH_OTSU );
+        if (settings.invert)
+            subtract( Scalar::all(255), ws.dst, ws.dst );
     }
 
-    return status;
+    // Extract the contours and store them all as a list
+    // (Use CV_RETR_EXTERNAL for outer contour only.)
+    {
+        trace_scope scope("findContours");
+        findContours( ws.dst, ws.contours, ws.hierarchy, CV_RETR_TREE,
+                      CV_CHAIN_APPROX_NONE );
+    }
+
+    // Save the contour
+    return save_contour( ws.contours, ws.hierarchy, src.cols, src.rows, 0,
+                         settings, ctx_p, cache, key, ws, io );
 }
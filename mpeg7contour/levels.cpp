@@ -0,0 +1,379 @@
+#include <ciso646>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "levels.hpp"
+
+
+namespace
+{
+
+    // 8-connected Freeman chain code.
+    //
+    // Direction-to-code convention is:
+    //
+    //      3  2  1     0 (+1,  0)      3 (-1, +1)      6 ( 0, -1)
+    //      4  x  0     1 (+1, +1)      4 (-1,  0)      7 (+1, -1)
+    //      5  6  7     2 ( 0, +1)      5 (-1, -1)
+    //
+    // In terms of (delta_x, delta_y) if next pixel compared to the
+    // current and converting (dy,dx) pairs to scalar indexes thinking
+    // to them as base-3 numbers according to:
+    //
+    //      i = 3 * (dy+1) + (dx+1) = 3dy + dx + 4
+    //
+    //      ---------------------------------------
+    //      | deltax | deltay | code |  (base-3)  |
+    //      |------------------------------------|
+    //      |    0   |   +1   |   2  |      7     |
+    //      |    0   |   -1   |   6  |      1     |
+    //      |   -1   |   +1   |   3  |      6     |
+    //      |   -1   |   -1   |   5  |      0     |
+    //      |   +1   |   +1   |   1  |      8     |
+    //      |   +1   |   -1   |   7  |      2     |
+    //      |   -1   |    0   |   4  |      3     |
+    //      |   +1   |    0   |   0  |      5     |
+    //      ---------------------------------------
+    //
+    const int cc[3][3] = {
+        {  5,  6,  7 },
+        {  4, -1,  0 },
+        {  3,  2,  1 }
+    };
+
+    /**
+     * Chain code of the step from a to b, or -1 if b is not an 8-neighbour
+     * of a.
+     */
+
+    int chain_code(const cv::Point& a, const cv::Point& b)
+    {
+        const int dx = b.x - a.x,
+                  dy = b.y - a.y;
+
+        if (dx < -1 or dx > 1 or dy < -1 or dy > 1)
+            return -1;
+
+        return cc[dy+1][dx+1];
+    }
+
+    int write_chain(std::ostream& out, const std::vector<cv::Point>& contour)
+    {
+        out << " vertices=\"" << contour.size() << "\" chain=\"";
+
+        auto it = contour.begin(),
+             et = contour.end();
+
+        out << it->x << ' ' << it->y;
+
+        for (auto pt = it++; it != et; pt = it++)
+        {
+            const int code = chain_code(*pt, *it);
+
+            if (code < 0)
+                return EXIT_FAILURE;
+
+            out << ' ' << code;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    int write_runs(std::ostream& out, const std::vector<cv::Point>& contour)
+    {
+        // First pass: count the runs, so that 'vertices' comes first
+        size_t runs = 0;
+        int last = -1;
+        for (size_t i = 1; i < contour.size(); ++i)
+        {
+            const int code = chain_code(contour[i-1], contour[i]);
+
+            if (code < 0)
+                return EXIT_FAILURE;
+
+            if (code != last)
+                ++runs;
+            last = code;
+        }
+
+        out << " vertices=\"" << (runs + 1) << "\" runs=\""
+            << contour[0].x << ' ' << contour[0].y;
+
+        // Second pass: code and length of every run
+        size_t length = 0;
+        last = -1;
+        for (size_t i = 1; i < contour.size(); ++i)
+        {
+            const int code = chain_code(contour[i-1], contour[i]);
+
+            if (code != last and length > 0)
+            {
+                out << ' ' << last << ' ' << length;
+                length = 0;
+            }
+
+            last = code;
+            ++length;
+        }
+
+        if (length > 0)
+            out << ' ' << last << ' ' << length;
+
+        return EXIT_SUCCESS;
+    }
+
+    /**
+     * Chain codes of 'contour' into scratch.codes, packed into
+     * scratch.bytes.
+     */
+
+    int pack_path(const std::vector<cv::Point>& contour, path_scratch& scratch)
+    {
+        scratch.codes.clear();
+        for (size_t i = 1; i < contour.size(); ++i)
+        {
+            const int code = chain_code(contour[i-1], contour[i]);
+
+            if (code < 0)
+                return EXIT_FAILURE;
+
+            scratch.codes.push_back( static_cast<unsigned char>(code) );
+        }
+
+        scratch.packer.pack(scratch.codes.data(), scratch.codes.size(), scratch.bytes);
+
+        return EXIT_SUCCESS;
+    }
+
+    int write_packed(std::ostream& out, const std::vector<cv::Point>& contour,
+                     path_scratch& scratch)
+    {
+        if (pack_path(contour, scratch) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+
+        scratch.text.clear();
+        encode_base64(scratch.bytes.data(), scratch.bytes.size(), scratch.text);
+
+        out << " vertices=\"" << contour.size() << "\" packed=\""
+            << contour[0].x << ' ' << contour[0].y << ' ' << scratch.text;
+
+        return EXIT_SUCCESS;
+    }
+
+    int write_sidecar(std::ostream& out, const std::vector<cv::Point>& contour,
+                      const long long id, path_scratch& scratch,
+                      std::vector<unsigned char>& sidecar)
+    {
+        if (pack_path(contour, scratch) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+
+        append_sidecar(id, scratch.codes.size(), scratch.bytes, sidecar);
+
+        out << " vertices=\"" << contour.size() << "\" sidecar=\""
+            << contour[0].x << ' ' << contour[0].y;
+
+        return EXIT_SUCCESS;
+    }
+
+    void write_points(std::ostream& out, const std::vector<cv::Point>& points)
+    {
+        out << " vertices=\"" << points.size() << "\" points=\"";
+
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            if (i > 0)
+                out << ' ';
+            out << points[i].x << ' ' << points[i].y;
+        }
+    }
+
+    void write_resampled(std::ostream& out, const std::vector<cv::Point>& contour,
+                         const unsigned count)
+    {
+        using namespace std;
+
+        const size_t n = contour.size();
+
+        double length = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            const cv::Point d = contour[(i + 1) % n] - contour[i];
+            length += sqrt( double(d.x) * d.x + double(d.y) * d.y );
+        }
+
+        const ios::fmtflags flags = out.flags();
+        const streamsize precision = out.precision();
+
+        out << " vertices=\"" << count << "\" points=\""
+            << fixed << setprecision(2);
+
+        // Walk the closed path, emitting a point every length/count pixels
+        const double step = length / count;
+        unsigned k = 0;
+        double at = 0;
+
+        for (size_t i = 0; i < n and k < count; ++i)
+        {
+            const cv::Point a = contour[i],
+                            d = contour[(i + 1) % n] - a;
+            const double edge = sqrt( double(d.x) * d.x + double(d.y) * d.y );
+
+            for (; k < count and k * step <= at + edge; ++k)
+            {
+                const double t = edge > 0 ? (k * step - at) / edge : 0;
+                if (k > 0)
+                    out << ' ';
+                out << (a.x + t * d.x) << ' ' << (a.y + t * d.y);
+            }
+
+            at += edge;
+        }
+
+        // Rounding may leave the last points just past the end of the path
+        for (; k < count; ++k)
+        {
+            if (k > 0)
+                out << ' ';
+            out << double(contour[0].x) << ' ' << double(contour[0].y);
+        }
+
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+}
+
+
+std::string path_level::name() const
+{
+    std::ostringstream s;
+
+    switch (kind)
+    {
+    case full:
+        s << "full";
+        break;
+
+    case simple:
+        s << "simple";
+        break;
+
+    case packed:
+        s << "packed";
+        break;
+
+    case douglas_peucker:
+        s << "dp:" << tolerance;
+        break;
+
+    case resampled:
+        s << "n:" << count;
+        break;
+    }
+
+    return s.str();
+}
+
+
+bool parse_levels(const std::string& list, std::vector<path_level>& levels)
+{
+    using namespace std;
+
+    vector<path_level> parsed;
+
+    for (size_t at = 0; at <= list.size(); )
+    {
+        size_t end = list.find(',', at);
+        if (end == string::npos)
+            end = list.size();
+
+        const string item = list.substr(at, end - at);
+        path_level l;
+        char* rest = 0;
+
+        if (item == "full")
+            l.kind = path_level::full;
+
+        else if (item == "simple")
+            l.kind = path_level::simple;
+
+        else if (item == "packed")
+            l.kind = path_level::packed;
+
+        else if (item.compare(0, 3, "dp:") == 0)
+        {
+            l.kind = path_level::douglas_peucker;
+            l.tolerance = strtod(item.c_str() + 3, &rest);
+            if (*rest or rest == item.c_str() + 3 or not (l.tolerance > 0))
+                return false;
+        }
+
+        else if (item.compare(0, 2, "n:") == 0)
+        {
+            l.kind = path_level::resampled;
+            const long count = strtol(item.c_str() + 2, &rest, 10);
+            if (*rest or rest == item.c_str() + 2 or count < 3 or count > 1 << 20)
+                return false;
+            l.count = static_cast<unsigned>(count);
+        }
+
+        else
+            return false;
+
+        parsed.push_back(l);
+        at = end + 1;
+    }
+
+    levels.swap(parsed);
+    return true;
+}
+
+
+int write_path(std::ostream& out, const std::vector<cv::Point>& contour,
+               const path_level& level, path_scratch& scratch,
+               const long long id, std::vector<unsigned char>* sidecar)
+{
+    int status = EXIT_SUCCESS;
+
+    out << "\t\t\t<path";
+
+    if (level.kind != path_level::full)
+        out << " level=\"" << level.name() << '\"';
+
+    switch (level.kind)
+    {
+    case path_level::full:
+        status = write_chain(out, contour);
+        break;
+
+    case path_level::simple:
+        status = write_runs(out, contour);
+        break;
+
+    case path_level::packed:
+        status = sidecar ? write_sidecar(out, contour, id, scratch, *sidecar)
+                         : write_packed(out, contour, scratch);
+        break;
+
+    case path_level::douglas_peucker:
+        cv::approxPolyDP(contour, scratch.points, level.tolerance, true);
+        write_points(out, scratch.points);
+        break;
+
+    case path_level::resampled:
+        write_resampled(out, contour, level.count);
+        break;
+    }
+
+    if (status != EXIT_SUCCESS)
+        return status;
+
+    out << "\" />\n";
+
+    return EXIT_SUCCESS;
+}
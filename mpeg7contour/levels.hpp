@@ -0,0 +1,83 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "../common/chain_codec.hpp"
+
+
+/**
+ * Resolution levels of a contour path
+ *
+ * Besides the full 8-connected chain, a CTX contour may carry coarser
+ * versions of its path, each in its own <path> element, so that readers
+ * can load only the resolution they need:
+ *
+ *      full       every boundary pixel, as a Freeman chain code (chain);
+ *      simple     the same path as runs of equal chain codes (runs), as
+ *                 CV_CHAIN_APPROX_SIMPLE would keep it; lossless;
+ *      packed     the same path, its chain codes entropy coded (packed,
+ *                 see chain_codec.hpp) in about an eighth of the room of
+ *                 the full level, or kept as raw bytes in a sidecar file
+ *                 next to the document (sidecar), in about an eleventh;
+ *                 lossless;
+ *      dp:<t>     the polygon simplified by Douglas-Peucker with a
+ *                 tolerance of <t> pixels (points);
+ *      n:<k>      <k> points evenly spaced along the closed path (points).
+ *
+ * The levels of a document are given as a comma separated list, e.g.
+ * "full,dp:1,dp:4,n:64", and written in that order. The default is "full"
+ * alone, which is what the CTX format always held.
+ */
+
+struct path_level
+{
+    enum kind_type { full, simple, packed, douglas_peucker, resampled };
+
+    kind_type kind;
+    double    tolerance;    // douglas_peucker
+    unsigned  count;        // resampled
+
+    path_level() : kind(full), tolerance(0), count(0) {}
+
+    /**
+     * Name of the level, as in a level list and in the CTX 'level'
+     * attribute.
+     */
+
+    std::string name() const;
+};
+
+/**
+ * Parse a comma separated list of levels. Returns false, leaving 'levels'
+ * untouched, if any of them is malformed.
+ */
+
+bool parse_levels(const std::string& list, std::vector<path_level>& levels);
+
+/**
+ * Working storage of write_path(), kept by the caller to be reused.
+ */
+
+struct path_scratch
+{
+    std::vector<cv::Point>     points;  // simplified path
+    std::vector<unsigned char> codes,   // chain codes of the full path
+                               bytes;   // and their packed form
+    std::string                text;    // in base64
+    chain_packer               packer;
+};
+
+/**
+ * Write the <path> element of 'contour', of id 'id', at level 'level'. If
+ * 'sidecar' is given, the codes of a packed level are appended to it (see
+ * append_sidecar()) rather than written in the element. Returns
+ * EXIT_FAILURE if the contour is not 8-connected.
+ */
+
+int write_path(std::ostream& out, const std::vector<cv::Point>& contour,
+               const path_level& level, path_scratch& scratch,
+               const long long id, std::vector<unsigned char>* sidecar);
@@ -8,10 +8,13 @@
 
 #include <opencv2/highgui/highgui.hpp>
 
+#include "../common/options.hpp"
+#include "settings.hpp"
+
 
 int scan_file(const boost::filesystem::path& p, 
               const boost::filesystem::path& q,
-              const bool invert);
+              const contour_settings& settings, const run_options& opts);
 
 
 int main(const int argc, const char* argv[])
@@ -19,23 +22,72 @@ int main(const int argc, const char* argv[])
     using namespace boost::filesystem;
     using namespace std;
 
-    const bool invert = (argv[1] == std::string("-i") or
-                         argv[1] == std::string("--invert"));
+    bool usage = false;
+    contour_settings settings;
+    run_options opts;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "-i" or opt == "--invert")
+            settings.invert = true;
+
+        else if (opt == "--cache" and arg + 1 < argc)
+            settings.cache = argv[++arg];
+
+        else if (opt == "--levels" and arg + 1 < argc)
+        {
+            if ( not parse_levels(argv[++arg], settings.levels) )
+                usage = true;
+        }
+
+        else if (opt == "--sidecar")
+            settings.sidecar = true;
+
+        else if ( not parse_run_option(argc, argv, arg, opts, usage) )
+            usage = true;
+    }
+
+    // The sidecar file holds the packed level
+    if (settings.sidecar)
+    {
+        bool packed = false;
+        for (size_t k = 0; k < settings.levels.size(); ++k)
+            if (settings.levels[k].kind == path_level::packed)
+                packed = true;
+
+        if (not packed)
+            usage = true;
+    }
 
-    if ((!invert and argc != 3) or (invert and argc != 4))
+    if (usage or argc - arg != 2)
     {
         cout << "\n"
                 "Usage: mpeg7contour [options] <src path> <dst path>\n\n"
                 "  Options\n"
                 "  -------\n"
-                "  --invert | -i  Invert the source image.\n\n";
+                "  --invert | -i      Invert the source image.\n"
+                "  --cache <dir>      Reuse the contour files of identical images,\n"
+                "                     kept in <dir> across runs.\n"
+                "  --levels <list>    Path levels written for every contour, in\n"
+                "                     order: full (Freeman chain; default), simple\n"
+                "                     (runs of equal codes), packed (entropy coded\n"
+                "                     codes), dp:<t> (Douglas-Peucker\n"
+                "                     with tolerance <t>), n:<k> (<k> points evenly\n"
+                "                     spaced), e.g. full,dp:1,n:64.\n"
+                "  --sidecar          Keep the codes of the packed level in a\n"
+                "                     binary <name>.chains file next to each\n"
+                "                     contour file, rather than in base64.\n"
+             << run_options_usage << "\n";
         return EXIT_FAILURE;
     }
 
     try
     {
-        const path p = argv[invert ? 2 : 1];
-        const path q = argv[invert ? 3 : 2];
+        const path p = argv[arg];
+        const path q = argv[arg + 1];
 
         if ( not exists(p) )    // does p exist?
         {
@@ -80,7 +132,7 @@ int main(const int argc, const char* argv[])
             return EXIT_FAILURE;
         }
 
-        if (scan_file(p, q, invert) != EXIT_SUCCESS)
+        if (scan_file(p, q, settings, opts) != EXIT_SUCCESS)
             return EXIT_FAILURE;
     }
 
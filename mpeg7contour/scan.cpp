@@ -1,70 +1,127 @@
-
 #include <ciso646>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 #define BOOST_FILESYSTEM_NO_DEPRECATED 1
 #include <boost/filesystem.hpp>
 
+#include "../common/commit.hpp"
+#include "../common/frame_cache.hpp"
+#include "../common/io_stage.hpp"
+#include "../common/manifest.hpp"
+#include "../common/options.hpp"
+#include "../common/parallel.hpp"
+#include "../common/shard.hpp"
+#include "../common/sources.hpp"
+#include "cache.hpp"
+#include "settings.hpp"
+#include "workspace.hpp"
+
 
-int contour_image(const boost::filesystem::path& p, 
+int contour_image(const boost::filesystem::path& p,
                   const boost::filesystem::path& q,
-                  const bool invert);
+                  const contour_settings& settings, result_cache& cache,
+                  frame_cache& frames, contour_workspace& ws, io_stage& io);
+
+boost::filesystem::path ctx_path(const boost::filesystem::path& p,
+                                 const boost::filesystem::path& q);
 
 
 int scan_file(const boost::filesystem::path& p, const boost::filesystem::path& q,
-              const bool invert)
+              const contour_settings& settings, const run_options& opts)
 {
     using namespace boost::filesystem;
     using namespace std;
 
-    int status = EXIT_SUCCESS;
+    vector<path> files;
+
+    int status = collect_sources(p, files);
+
+    // Contour files staged by an interrupted run are incomplete. With
+    // several shards at work, they may as well be another shard's pending
+    // writes.
+    if (opts.shards == 1)
+        remove_staged(q);
 
-    if ( exists(p) )    // does p actually exist?
+    // Sources sharing a file name map onto the same contour file; only the
+    // first one, in path order, is processed. Every shard makes the same
+    // choice before keeping its own share of the sources. The sources are
+    // processed in the order they were found, which is archive order for
+    // archive members.
+    vector<path> pending(files);
+    unique_sources(pending, [&](const path& f) { return ctx_path(f, q).string(); });
+
+    select_shard(pending, p, opts.shard, opts.shards);
+
+    manifest m("mpeg7contour", opts.shard, opts.shards, p);
+
+    // Skip the images whose contour file already exists, so that neither
+    // the I/O stage nor the workers spend time on them
+    size_t n = 0;
+    for (size_t i = 0; i < pending.size(); ++i)
     {
-        if ( is_regular_file(p) )     // is p a regular file?
-        {
-            if ( contour_image(p, q, invert) != EXIT_SUCCESS )
-                status = EXIT_FAILURE;
-        }
-
-        else if ( is_directory(p) )   // is p a directory?
-        {
-            for ( auto it = directory_iterator(p);   // iterate through directory
-                  it != directory_iterator(); ++it )
-            {
-                if ( is_regular_file(*it) )   // is *it a regular file?   
-                {
-                    if ( contour_image(*it, q, invert) != EXIT_SUCCESS )
-                        status = EXIT_FAILURE;
-                }
-
-                else if ( is_directory(*it) )   // is *it a directory?
-                {
-                    if (scan_file(*it, q, invert) != EXIT_SUCCESS)
-                        status = EXIT_FAILURE;
-                }
-
-                else    // *it is neither a regular file nor a directory!
-                {
-                    clog << *it << " exists, but is neither a regular file nor a directory\n";
-                    status = EXIT_FAILURE;
-                }
-            }
-        }
-
-        else    // p is neither a regular file nor a directory!
-        {
-            clog << p << " exists, but is neither a regular file nor a directory\n";
-            return EXIT_FAILURE;
-        }
+        if ( exists( ctx_path(pending[i], q) ) )
+            m.record(pending[i], manifest::skipped);
+        else
+            pending[n++] = pending[i];
     }
+    pending.resize(n);
+
+    io_stage io(opts.io, opts.io_threads, opts.lookahead, opts.durable);
+
+    // Images traced by a previous run have their contour file read ahead
+    // from the result cache instead; of the others, those decoded by a
+    // previous run, of this tool or of a generator, are mapped from the
+    // frame cache; only the remaining sources are read ahead, all in the
+    // order the workers take them
+    result_cache cache(settings.cache, settings);
+    frame_cache frames(opts.frames);
 
-    else    // p does not exists!
+    const vector<path> untraced = cache.misses(pending),
+                       undecoded = frames.misses(untraced);
+
+    vector<path> reads;
+    for (size_t i = 0, k = 0; i < pending.size(); ++i)
     {
-        clog << p << " does not exist\n";
-        return EXIT_FAILURE;
+        const path e = cache.entry_of(pending[i]);
+        if ( not e.empty() )
+            reads.push_back(e);
+        else if ( k < undecoded.size() and undecoded[k] == pending[i] )
+            reads.push_back( undecoded[k++] );
     }
+    io.prefetch(reads);
+
+    // One workspace per worker, reused for every image the worker processes
+    vector< unique_ptr<contour_workspace> > ws;
+    for (unsigned w = 0; w < max(opts.jobs, 1u); ++w)
+        ws.push_back( unique_ptr<contour_workspace>(new contour_workspace) );
+
+    auto task = [&](const path& f, const unsigned w)
+    {
+        const int s = contour_image(f, q, settings, cache, frames, *ws[w], io);
+        m.record(f, s == EXIT_SUCCESS ? manifest::done : manifest::failed);
+        return s;
+    };
+
+    if ( parallel_for_each(pending, opts.jobs, task) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( io.drain() != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( cache.enabled() )
+        cout << cache.hits() << " contour files reused from the cache, "
+             << cache.stores() << " added to it\n";
+
+    if ( frames.enabled() )
+        cout << frames.hits() << " images mapped from the frame cache, "
+             << frames.stores() << " added to it\n";
+
+    if ( not opts.manifest.empty()
+         and m.save(opts.manifest, status, opts.durable) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
 
     return status;
 }
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "levels.hpp"
+
+
+/**
+ * What the contour stage makes of an image
+ */
+
+struct contour_settings
+{
+    bool invert;                        // invert the source image
+    std::vector<path_level> levels;     // <path> levels written (levels.hpp)
+    bool sidecar;                       // packed level in a sidecar file
+                                        // (chain_codec.hpp)
+    std::string cache;                  // result cache directory (cache.hpp),
+                                        // if any
+
+    contour_settings()
+        : invert(false), levels(1), sidecar(false)
+    {
+    }
+};
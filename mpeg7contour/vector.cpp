@@ -0,0 +1,121 @@
+#include <ciso646>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/io_stage.hpp"
+#include "../common/parallel.hpp"
+#include "../common/trace.hpp"
+#include "cache.hpp"
+#include "vector.hpp"
+
+
+int save_contour(const std::vector< std::vector< cv::Point > >& contours,
+                 const std::vector< cv::Vec4i >& hierarchy,
+                 const size_t width, const size_t height,
+                 const std::vector<contour_shape>* shapes,
+                 const contour_settings& settings,
+                 const boost::filesystem::path& q,
+                 result_cache& cache, const std::string& key,
+                 contour_workspace& ws, io_stage& io);
+
+
+int load_silhouette(const boost::filesystem::path& p, vector_workspace& ws,
+                    io_stage& io)
+{
+    using namespace std;
+
+    if ( not io.fetch(p, ws.bytes) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << p << " could not be read\n";
+        return EXIT_FAILURE;
+    }
+
+    string error;
+    const char* text = ws.bytes.empty() ? ""
+                     : reinterpret_cast<const char*>(&ws.bytes[0]);
+
+    if ( not read_silhouette(text, ws.bytes.size(), ws.base, error) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << p << " is not a CTX document: " << error << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+int vector_variant(const affine_map& forward, const cv::Size& size,
+                   const boost::filesystem::path& ctx_p,
+                   const boost::filesystem::path& raster_p,
+                   const std::string& kind, const vector_settings& settings,
+                   vector_workspace& ws, io_stage& io, divergence_report& report)
+{
+    using namespace boost::filesystem;
+    using namespace cv;
+    using namespace std;
+
+    if (size.width <= 0 or size.height <= 0)
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << ctx_p << " would have an empty canvas\n";
+        return EXIT_FAILURE;
+    }
+
+    contour_workspace& cw = ws.contour;
+    cw.reset();
+
+    // Digitize the mapped paths into chains, keeping the moments of the
+    // mapped polygons
+    {
+        trace_scope scope("map");
+        map_silhouette(ws.base, forward, size, cw.contours, cw.hierarchy,
+                       ws.shapes, ws.fill);
+    }
+
+    // Compare before the paths are handed over
+    if ( not raster_p.empty() )
+        make_silhouette(cw.contours, cw.hierarchy, size.width, size.height, ws.made);
+
+    result_cache none(path(), settings.contour);
+    if ( save_contour( cw.contours, cw.hierarchy, size.width, size.height,
+                       &ws.shapes, settings.contour, ctx_p, none, string(), cw,
+                       io ) != EXIT_SUCCESS )
+        return EXIT_FAILURE;
+
+    if ( raster_p.empty() )
+        return EXIT_SUCCESS;
+
+    string error;
+    if ( not io.fetch(raster_p, ws.bytes)
+         or not read_silhouette( ws.bytes.empty() ? ""
+                                 : reinterpret_cast<const char*>(&ws.bytes[0]),
+                                 ws.bytes.size(), ws.traced, error ) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << raster_p << " could not be read for comparison"
+             << (error.empty() ? "" : ": ") << error << '\n';
+        return EXIT_SUCCESS;
+    }
+
+    divergence d;
+    {
+        trace_scope scope("compare");
+        d = compare_silhouettes(ws.made, ws.traced, ws.fill);
+    }
+    report.add(kind, d);
+
+    lock_guard<mutex> lock(console_mutex());
+    cout << "  vs " << raster_p << ": overlap " << fixed << setprecision(4)
+         << d.overlap << ", area " << showpos << setprecision(2) << 100 * d.area
+         << noshowpos << "%\n";
+    cout.unsetf(ios::floatfield);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include "../common/silhouette.hpp"
+#include "settings.hpp"
+#include "workspace.hpp"
+
+class io_stage;
+
+
+/**
+ * Contour files of transformed shapes, made in the vector domain
+ *
+ * The contour files of the variants made by mpeg7A and mpeg7D are had by
+ * warping, encoding and writing every variant, then reading, decoding,
+ * thresholding and tracing it again. With --vector those tools read the
+ * contour files of the base shapes instead, map their paths by the very
+ * transforms of the images, and digitize the mapped paths straight into
+ * chain codes (see silhouette.hpp), into the same tree of contour files;
+ * no image is drawn, traced, encoded, decoded or written. The moments
+ * written are those of the mapped polygons, computed from their vertices.
+ *
+ * The raster and vector outputs differ where interpolation and the
+ * threshold do not round as digitization of the edges does, and in their
+ * moments, those of the raster output being of its traced chain. With
+ * --compare <path>, every contour file made is compared with the one of
+ * the same name traced from the raster output, and the divergence is
+ * reported by kind of transform.
+ */
+
+struct vector_settings
+{
+    bool enabled;                       // make contour files only, from
+                                        // the contour files of the sources
+    boost::filesystem::path compare;    // contour files traced from the
+                                        // raster outputs, if any
+    contour_settings contour;           // levels of the paths written
+
+    vector_settings() : enabled(false) {}
+};
+
+/**
+ * Per-worker buffers of the vector mode.
+ */
+
+struct vector_workspace
+{
+    std::vector<uchar> bytes;       // contents of a contour file
+    silhouette base,                // silhouette of the source
+               made,                // of the variant being made
+               traced;              // of its raster counterpart
+    fill_scratch fill;              // working storage of map_silhouette()
+    std::vector<contour_shape> shapes;  // moments of the mapped paths
+    contour_workspace contour;      // buffers of the contour stage
+};
+
+/**
+ * Read the silhouette of the contour file 'p' into ws.base.
+ */
+
+int load_silhouette(const boost::filesystem::path& p, vector_workspace& ws,
+                    io_stage& io);
+
+/**
+ * Map ws.base by 'forward' onto a canvas of 'size', trace it and save its
+ * contour file as 'ctx_p'. If 'raster_p' is not empty, compare the result
+ * with that contour file, adding the divergence to 'report' under 'kind'.
+ */
+
+int vector_variant(const affine_map& forward, const cv::Size& size,
+                   const boost::filesystem::path& ctx_p,
+                   const boost::filesystem::path& raster_p,
+                   const std::string& kind, const vector_settings& settings,
+                   vector_workspace& ws, io_stage& io, divergence_report& report);
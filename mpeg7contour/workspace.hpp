@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "../common/arena.hpp"
+#include "../common/mat_arena.hpp"
+#include "../common/rtree.hpp"
+
+#include "levels.hpp"
+
+
+/**
+ * Per-worker buffers of the contour stage
+ *
+ * Every worker owns one workspace and reuses it for all the images it
+ * processes. The decoded source and the thresholded image are taken from
+ * the worker's arena; the encoded file, the contour lists, their index,
+ * the simplified and packed paths and the output files are vectors
+ * that keep their capacity across images. Nothing is returned to the heap
+ * between images: reset() only rewinds.
+ */
+
+struct contour_workspace
+{
+    arena               heap;       // storage for 'src' and 'dst'
+    mat_arena_allocator mat_heap;
+
+    cv::Mat src,                    // decoded source image
+            dst;                    // binary image traced by findContours
+
+    std::vector<uchar> bytes;       // encoded source file
+
+    std::vector< std::vector<cv::Point> > contours;
+    std::vector< cv::Vec4i > hierarchy;
+
+    packed_rtree index;             // index of the contours' bounds
+    path_scratch path;              // working storage of write_path()
+
+    std::vector<uchar> text;        // serialized CTX document
+    std::vector<uchar> chains;      // its sidecar file, if any
+    std::vector<uchar> copy;        // copy of it, for the result cache
+    std::string source;             // result cache key of the source file
+
+    size_t images;                  // images processed so far
+
+    contour_workspace()
+        : heap(4 << 20), mat_heap(heap), images(0)
+    {
+        src.allocator = dst.allocator = &mat_heap;
+    }
+
+    /**
+     * Make the workspace ready for the next image.
+     *
+     * The contour list is deliberately not cleared: findContours resizes
+     * it, and keeping the inner vectors alive preserves their capacity.
+     */
+
+    void reset()
+    {
+        src.release();
+        dst.release();
+        heap.reset();
+        bytes.clear();
+        hierarchy.clear();
+        source.clear();
+        ++images;
+    }
+
+private:
+
+    contour_workspace(const contour_workspace&);    // non-copyable
+    contour_workspace& operator=(const contour_workspace&);
+};
@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cctype>
+#include <ciso646>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "../common/ctx.hpp"
+#include "../common/trace.hpp"
+#include "compare.hpp"
+
+
+namespace
+{
+
+    /**
+     * Units in the last place between a and b: the doubles between them,
+     * counting one of the two.
+     */
+
+    unsigned long long ulp_distance(const double a, const double b)
+    {
+        if (a == b)
+            return 0;
+        if (a != a or b != b)
+            return ~0ull;
+
+        // The bits of the doubles as integers of the same order, the sign
+        // bit in the middle of the range
+        const unsigned long long sign = 1ull << 63;
+        unsigned long long ia, ib;
+        std::memcpy( &ia, &a, sizeof a );
+        std::memcpy( &ib, &b, sizeof b );
+        ia = ia & sign ? sign - (ia & ~sign) : sign + ia;
+        ib = ib & sign ? sign - (ib & ~sign) : sign + ib;
+
+        return ia > ib ? ia - ib : ib - ia;
+    }
+
+    /**
+     * Whether [begin, end) is written with a fraction or an exponent.
+     */
+
+    inline bool is_real(const char* begin, const char* end)
+    {
+        return std::find(begin, end, '.') != end or std::find(begin, end, 'e') != end
+            or std::find(begin, end, 'E') != end;
+    }
+
+    /**
+     * Parse the whole of [begin, end) as a number into 'value', using
+     * 'buffer'.
+     */
+
+    bool parse_number(const char* begin, const char* end, std::string& buffer,
+                      double& value)
+    {
+        buffer.assign(begin, end);
+        char* rest = 0;
+        value = std::strtod(buffer.c_str(), &rest);
+        return not buffer.empty() and *rest == '\0';
+    }
+
+    /**
+     * Convert 'img' to the 8-bit grey levels the contour stage thresholds.
+     */
+
+    void to_grey(const cv::Mat& img, cv::Mat& grey, cv::Mat& scratch)
+    {
+        const cv::Mat* from = &img;
+
+        if (img.depth() != CV_8U)
+        {
+            img.convertTo(scratch, CV_8U, img.depth() == CV_16U ? 1 / 257.0 : 1);
+            from = &scratch;
+        }
+
+        if (from->channels() == 3)
+            cv::cvtColor(*from, grey, CV_BGR2GRAY);
+        else if (from->channels() == 4)
+            cv::cvtColor(*from, grey, CV_BGRA2GRAY);
+        else
+            from->copyTo(grey);
+    }
+
+}
+
+
+bool is_image_file(const std::string& extension)
+{
+    std::string x(extension);
+    for (size_t i = 0; i < x.size(); ++i)
+        x[i] = static_cast<char>( std::tolower( static_cast<unsigned char>(x[i]) ) );
+
+    return x == ".png" or x == ".bmp" or x == ".pgm" or x == ".ppm"
+        or x == ".pbm" or x == ".tif" or x == ".tiff" or x == ".jpg"
+        or x == ".jpeg";
+}
+
+
+diff_result compare_ctx(const diff_settings& settings, diff_workspace& ws,
+                        std::string& reason)
+{
+    using namespace std;
+
+    if (ws.a == ws.b)
+        return identical_files;
+
+    trace_scope scope("compare ctx");
+
+    ctx_reader ra( ws.a.empty() ? "" : reinterpret_cast<const char*>(&ws.a[0]), ws.a.size() ),
+               rb( ws.b.empty() ? "" : reinterpret_cast<const char*>(&ws.b[0]), ws.b.size() );
+
+    size_t numbers = 0;                 // equal within the tolerance only
+    unsigned long long worst_ulps = 0;
+    double worst_relative = 0;
+
+    ostringstream out;
+
+    for (;;)
+    {
+        const ctx_reader::event ea = ra.next(),
+                                eb = rb.next();
+
+        if (ea == ctx_reader::failed or eb == ctx_reader::failed)
+        {
+            const ctx_reader& r = ea == ctx_reader::failed ? ra : rb;
+            out << (&r == &ra ? "first" : "second") << " file malformed at line "
+                << r.line() << ": " << r.error();
+            reason = out.str();
+            return different_files;
+        }
+
+        if ( ea != eb or (ea != ctx_reader::done and ra.name() != rb.name()) )
+        {
+            out << "line " << ra.line() << ": "
+                << (ea == ctx_reader::done ? "end" : ra.name()) << " vs "
+                << (eb == ctx_reader::done ? "end" : rb.name());
+            reason = out.str();
+            return different_files;
+        }
+
+        if (ea == ctx_reader::done)
+            break;
+
+        if (ea != ctx_reader::start)
+            continue;
+
+        if ( ra.attributes() != rb.attributes() )
+        {
+            out << "line " << ra.line() << ": <" << ra.name() << "> with "
+                << ra.attributes() << " vs " << rb.attributes() << " attributes";
+            reason = out.str();
+            return different_files;
+        }
+
+        // The codes of the paths are never numbers
+        const bool codes = ra.name() == "path";
+
+        for (size_t i = 0; i < ra.attributes(); ++i)
+        {
+            const char *name, *name_end, *value, *value_end;
+            ra.attribute(i, name, name_end, value, value_end);
+
+            const string key(name, name_end);
+            const char *other, *other_end;
+
+            if ( not rb.attribute(key.c_str(), other, other_end) )
+            {
+                out << "line " << ra.line() << ": <" << ra.name() << "> " << key
+                    << " missing from the second file";
+                reason = out.str();
+                return different_files;
+            }
+
+            if ( value_end - value == other_end - other
+                 and equal(value, value_end, other) )
+                continue;
+
+            double x, y;
+            if ( not codes
+                 and ( is_real(value, value_end) or is_real(other, other_end) )
+                 and parse_number(value, value_end, ws.value_a, x)
+                 and parse_number(other, other_end, ws.value_b, y) )
+            {
+                const unsigned long long ulps = ulp_distance(x, y);
+                const double relative = fabs(x - y) / max( max( fabs(x), fabs(y) ), 1.0 );
+
+                if (ulps <= settings.ulps or relative <= settings.relative)
+                {
+                    ++numbers;
+                    worst_ulps = max(worst_ulps, ulps);
+                    worst_relative = max(worst_relative, relative);
+                    continue;
+                }
+
+                out << "line " << ra.line() << ": <" << ra.name() << "> " << key
+                    << "=\"" << ws.value_a << "\" vs \"" << ws.value_b << "\", "
+                    << ulps << " ulps, relative " << relative;
+            }
+            else
+            {
+                const size_t shown = 40;
+                out << "line " << ra.line() << ": <" << ra.name() << "> " << key
+                    << "=\"" << string( value, min(value_end, value + shown) )
+                    << (value_end - value > ptrdiff_t(shown) ? "..." : "")
+                    << "\" vs \"" << string( other, min(other_end, other + shown) )
+                    << (other_end - other > ptrdiff_t(shown) ? "..." : "") << '"';
+            }
+
+            reason = out.str();
+            return different_files;
+        }
+    }
+
+    if (numbers == 0)
+        reason = "same elements and attributes, laid out differently";
+    else
+    {
+        out << numbers << " numbers within tolerance, up to " << worst_ulps
+            << " ulps, relative " << worst_relative;
+        reason = out.str();
+    }
+
+    return equivalent_files;
+}
+
+
+diff_result compare_images(const diff_settings& settings, diff_workspace& ws,
+                           std::string& reason)
+{
+    using namespace cv;
+    using namespace std;
+
+    if (ws.a == ws.b)
+        return identical_files;
+
+    {
+        trace_scope scope("decode");
+        imdecode( Mat(ws.a), CV_LOAD_IMAGE_UNCHANGED, &ws.image_a );
+        imdecode( Mat(ws.b), CV_LOAD_IMAGE_UNCHANGED, &ws.image_b );
+    }
+
+    if ( ws.image_a.empty() or ws.image_b.empty() )
+    {
+        reason = ws.image_a.empty() ? "first file could not be decoded"
+                                    : "second file could not be decoded";
+        return different_files;
+    }
+
+    ostringstream out;
+
+    if ( ws.image_a.size() != ws.image_b.size() or ws.image_a.type() != ws.image_b.type() )
+    {
+        out << ws.image_a.cols << 'x' << ws.image_a.rows << " type " << ws.image_a.type()
+            << " vs " << ws.image_b.cols << 'x' << ws.image_b.rows << " type "
+            << ws.image_b.type();
+        reason = out.str();
+        return different_files;
+    }
+
+    trace_scope scope("compare image");
+
+    absdiff(ws.image_a, ws.image_b, ws.scratch);
+    const Mat values = ws.scratch.reshape(1);
+    const int differing = countNonZero(values);
+
+    if (differing == 0)
+    {
+        reason = "same pixels, encoded differently";
+        return equivalent_files;
+    }
+
+    double largest;
+    minMaxLoc(values, 0, &largest);
+
+    out << differing << " pixel values differ, by up to " << largest;
+
+    if (settings.iou < 0)
+    {
+        reason = out.str();
+        return different_files;
+    }
+
+    // The shapes, thresholded as the contour stage does
+    to_grey(ws.image_a, ws.mask_a, ws.scratch);
+    threshold( ws.mask_a, ws.mask_a, 0, 255, CV_THRESH_BINARY|CV_THRESH_OTSU );
+    to_grey(ws.image_b, ws.mask_b, ws.scratch);
+    threshold( ws.mask_b, ws.mask_b, 0, 255, CV_THRESH_BINARY|CV_THRESH_OTSU );
+
+    bitwise_and(ws.mask_a, ws.mask_b, ws.scratch);
+    const int both = countNonZero(ws.scratch);
+    bitwise_or(ws.mask_a, ws.mask_b, ws.scratch);
+    const int either = countNonZero(ws.scratch);
+
+    const double iou = either > 0 ? double(both) / either : 1;
+    out << ", shapes overlap " << iou;
+    reason = out.str();
+
+    return iou >= settings.iou ? equivalent_files : different_files;
+}
+
+
+diff_result compare_bytes(diff_workspace& ws, std::string& reason)
+{
+    if (ws.a == ws.b)
+        return identical_files;
+
+    const size_t n = std::min( ws.a.size(), ws.b.size() );
+    size_t at = std::mismatch( ws.a.begin(), ws.a.begin() + n, ws.b.begin() ).first
+              - ws.a.begin();
+
+    std::ostringstream out;
+    out << "bytes differ from offset " << at << " (sizes " << ws.a.size()
+        << " and " << ws.b.size() << ')';
+    reason = out.str();
+
+    return different_files;
+}
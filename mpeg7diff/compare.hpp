@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+
+/**
+ * Comparison of two versions of an output file
+ *
+ * Two files are identical if their bytes are. Otherwise they may still be
+ * equivalent:
+ *
+ *      images      if they decode to the same pixels, as when only the
+ *                  encoder changed; or, given a least overlap, if the
+ *                  shapes of the two, thresholded as the contour stage
+ *                  does, overlap that much (pixels in both over pixels in
+ *                  either);
+ *      CTX files   if they hold the same elements with the same
+ *                  attributes, in the same order, the numbers written
+ *                  with a fraction or an exponent (the moments, and the
+ *                  like) within a tolerance; anything else, the codes of
+ *                  the paths included, must match exactly.
+ *
+ * Any other file must be identical.
+ */
+
+struct diff_settings
+{
+    double iou;                     // least overlap of differing images,
+                                    // or negative for the same pixels
+    unsigned long long ulps;        // numbers this many units in the last
+                                    // place apart are equal,
+    double relative;                // or this far apart (relative; absolute
+                                    // below 1)
+    bool verbose;                   // tell why equivalent files are
+
+    diff_settings() : iou(-1), ulps(0), relative(0), verbose(false) {}
+};
+
+enum diff_result { identical_files, equivalent_files, different_files };
+
+/**
+ * Per-worker buffers of the comparisons.
+ */
+
+struct diff_workspace
+{
+    std::vector<uchar> a,           // contents of the two files
+                       b;
+    cv::Mat image_a,                // their decoded images
+            image_b,
+            mask_a,                 // and shapes
+            mask_b,
+            scratch;
+    std::string value_a,            // numbers being parsed
+                value_b;
+};
+
+/**
+ * Whether files of 'extension' (".png"...) are images, compared decoded.
+ */
+
+bool is_image_file(const std::string& extension);
+
+/**
+ * Compare ws.a and ws.b, the contents of two CTX files. If they are not
+ * identical, 'reason' tells where they first differ and how much.
+ */
+
+diff_result compare_ctx(const diff_settings& settings, diff_workspace& ws,
+                        std::string& reason);
+
+/**
+ * Compare ws.a and ws.b, the contents of two image files.
+ */
+
+diff_result compare_images(const diff_settings& settings, diff_workspace& ws,
+                           std::string& reason);
+
+/**
+ * Compare ws.a and ws.b, the contents of any other two files.
+ */
+
+diff_result compare_bytes(diff_workspace& ws, std::string& reason);
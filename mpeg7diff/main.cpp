@@ -0,0 +1,135 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/options.hpp"
+#include "compare.hpp"
+
+
+int diff_trees(const boost::filesystem::path& a, const boost::filesystem::path& b,
+               const diff_settings& settings, const run_options& opts);
+
+
+int main(const int argc, const char* argv[])
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    bool usage = false;
+    diff_settings settings;
+    run_options opts;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--iou" and arg + 1 < argc)
+        {
+            char* rest = 0;
+            settings.iou = strtod(argv[++arg], &rest);
+            if (*rest or not (settings.iou >= 0 and settings.iou <= 1))
+                usage = true;
+        }
+
+        else if (opt == "--ulps" and arg + 1 < argc)
+        {
+            char* rest = 0;
+            settings.ulps = strtoul(argv[++arg], &rest, 10);
+            if (*rest)
+                usage = true;
+        }
+
+        else if (opt == "--relative" and arg + 1 < argc)
+        {
+            char* rest = 0;
+            settings.relative = strtod(argv[++arg], &rest);
+            if (*rest or not (settings.relative >= 0))
+                usage = true;
+        }
+
+        else if (opt == "-v" or opt == "--verbose")
+            settings.verbose = true;
+
+        else if ( not parse_run_option(argc, argv, arg, opts, usage) )
+            usage = true;
+    }
+
+    if (usage or argc - arg < 2)
+    {
+        cout << "\n"
+                "Usage: mpeg7diff [options] <tree a> <tree b>\n\n"
+                "  Check that two output trees hold the same results, e.g. those\n"
+                "  of two versions of the tools. Files are paired by their path\n"
+                "  relative to the trees; the images are compared decoded, and the\n"
+                "  contour files element by element, so that files written\n"
+                "  differently but meaning the same count as equivalent. Exits\n"
+                "  with failure if any file differs or is in one tree only.\n\n"
+                "  Options\n"
+                "  -------\n"
+                "  --iou <t>          Images whose pixels differ are equivalent if\n"
+                "                     their shapes, thresholded as by mpeg7contour,\n"
+                "                     overlap by at least <t> in [0, 1] (pixels in\n"
+                "                     both over pixels in either; default: the\n"
+                "                     pixels must be the same).\n"
+                "  --ulps <n>         Numbers of the contour files written with a\n"
+                "                     fraction or an exponent are equal up to <n>\n"
+                "                     units in the last place (default 0).\n"
+                "  --relative <t>     ...or up to a relative difference of <t>\n"
+                "                     (absolute below 1; default 0).\n"
+                "  --verbose | -v     Also tell why equivalent files are.\n"
+             << run_options_usage << "\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        const path a = argv[arg];
+        const path b = argv[arg + 1];
+
+        if ( not exists(a) )
+        {
+            cout << a << " does not exist.\n";
+            return EXIT_FAILURE;
+        }
+
+        if ( not exists(b) )
+        {
+            cout << b << " does not exist.\n";
+            return EXIT_FAILURE;
+        }
+
+        if (diff_trees(a, b, settings, opts) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    catch (const filesystem_error& x)
+    {
+        cerr << "Error: Unhandled filesystem error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const bad_alloc& x)
+    {
+        cerr << "Error: Unhandled memory error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const exception& x)
+    {
+        cerr << "Error: Unhandled standard exception\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (...)
+    {
+        cerr << "Error: Unhandled unknown exception\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <ciso646>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/io_stage.hpp"
+#include "../common/manifest.hpp"
+#include "../common/options.hpp"
+#include "../common/parallel.hpp"
+#include "../common/shard.hpp"
+#include "../common/sources.hpp"
+#include "../common/stopwatch.hpp"
+#include "../common/trace.hpp"
+#include "compare.hpp"
+
+
+namespace
+{
+
+    /**
+     * The files under 'root' of this shard, by path relative to it.
+     */
+
+    int collect_tree(const boost::filesystem::path& root, const run_options& opts,
+                     std::map<std::string, boost::filesystem::path>& files)
+    {
+        using namespace boost::filesystem;
+        using namespace std;
+
+        vector<path> found;
+        const int status = collect_sources(root, found);
+        select_shard(found, root, opts.shard, opts.shards);
+
+        for (size_t i = 0; i < found.size(); ++i)
+            files[ relative_key(found[i], root) ] = found[i];
+
+        return status;
+    }
+
+}
+
+
+int diff_trees(const boost::filesystem::path& a, const boost::filesystem::path& b,
+               const diff_settings& settings, const run_options& opts)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    manifest m("mpeg7diff", opts.shard, opts.shards, a);
+    io_stage io(opts.io, opts.io_threads, opts.lookahead, opts.durable);
+
+    map<string, path> in_a, in_b;
+    int status = EXIT_SUCCESS;
+    if ( collect_tree(a, opts, in_a) != EXIT_SUCCESS
+         or collect_tree(b, opts, in_b) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    // The pairs of files of the same relative path, in path order; the
+    // others are missing from one tree or the other
+    vector<string> keys;
+    vector<path> pairs;
+    size_t missing = 0;
+
+    for (map<string, path>::const_iterator i = in_a.begin(); i != in_a.end(); ++i)
+    {
+        const map<string, path>::const_iterator j = in_b.find(i->first);
+        if ( j == in_b.end() )
+        {
+            clog << "Only in " << a << ": " << i->first << '\n';
+            m.record(i->second, manifest::failed);
+            ++missing;
+            continue;
+        }
+
+        keys.push_back(i->first);
+        pairs.push_back(i->second);
+        pairs.push_back(j->second);
+    }
+
+    for (map<string, path>::const_iterator j = in_b.begin(); j != in_b.end(); ++j)
+        if ( in_a.find(j->first) == in_a.end() )
+        {
+            clog << "Only in " << b << ": " << j->first << '\n';
+            ++missing;
+        }
+
+    // Both files of every pair read ahead, one after the other
+    io.prefetch(pairs);
+
+    const size_t n = keys.size();
+
+    vector< unique_ptr<diff_workspace> > ws;
+    for (unsigned w = 0; w < max(opts.jobs, 1u); ++w)
+        ws.push_back( unique_ptr<diff_workspace>(new diff_workspace) );
+
+    vector<diff_result> results(n, different_files);
+    vector<unsigned long long> bytes(n, 0);
+
+    stopwatch clock;
+
+    if ( parallel_for( n, opts.jobs, [&](const size_t i, const unsigned w) -> int
+    {
+        diff_workspace& dw = *ws[w];
+        const path& pa = pairs[i * 2];
+        const path& pb = pairs[i * 2 + 1];
+
+        const bool read_a = io.fetch(pa, dw.a),
+                   read_b = io.fetch(pb, dw.b);
+
+        if (not read_a or not read_b)
+        {
+            lock_guard<mutex> lock(console_mutex());
+            clog << (read_a ? pb : pa) << " could not be read\n";
+            m.record(pa, manifest::failed);
+            return EXIT_FAILURE;
+        }
+
+        bytes[i] = dw.a.size() + dw.b.size();
+
+        const string xt = pa.extension().string();
+        string reason;
+
+        if (xt == ".ctx")
+            results[i] = compare_ctx(settings, dw, reason);
+        else if ( is_image_file(xt) )
+            results[i] = compare_images(settings, dw, reason);
+        else
+            results[i] = compare_bytes(dw, reason);
+
+        if (results[i] == different_files)
+        {
+            lock_guard<mutex> lock(console_mutex());
+            clog << "Files differ: " << keys[i] << "\n  " << reason << '\n';
+        }
+
+        else if (results[i] == equivalent_files and settings.verbose)
+        {
+            lock_guard<mutex> lock(console_mutex());
+            cout << "Equivalent: " << keys[i] << "\n  " << reason << '\n';
+        }
+
+        m.record( pa, results[i] == different_files ? manifest::failed : manifest::done );
+        return EXIT_SUCCESS;
+    } ) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    const double seconds = clock.seconds();
+
+    size_t counts[3] = { 0, 0, 0 };
+    unsigned long long total = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        ++counts[ results[i] ];
+        total += bytes[i];
+    }
+
+    cout << n << " pairs compared: " << counts[identical_files] << " identical, "
+         << counts[equivalent_files] << " equivalent, " << counts[different_files]
+         << " different; " << missing << " files in one tree only\n"
+         << fixed << setprecision(3) << "  " << seconds << " s, "
+         << setprecision(1) << (seconds > 0 ? n / seconds : 0) << " pairs/s, "
+         << (seconds > 0 ? total / seconds / (1 << 20) : 0) << " MiB/s, "
+         << max(opts.jobs, 1u) << " jobs\n";
+
+    if (counts[different_files] > 0 or missing > 0)
+        status = EXIT_FAILURE;
+
+    if ( io.drain() != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( not opts.manifest.empty()
+         and m.save(opts.manifest, status, opts.durable) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    return status;
+}
@@ -0,0 +1,155 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/options.hpp"
+#include "settings.hpp"
+
+
+int build_index(const boost::filesystem::path& p, const boost::filesystem::path& q,
+                const index_settings& settings, const run_options& opts);
+
+int query_index(const boost::filesystem::path& q, const boost::filesystem::path& p,
+                const index_settings& settings, const run_options& opts);
+
+
+int main(const int argc, const char* argv[])
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    bool usage = false;
+    index_settings settings;
+    run_options opts;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-' and argv[arg][1] != '\0'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--query")
+            settings.query = true;
+
+        else if (opt == "--descriptor" and arg + 1 < argc)
+        {
+            if ( not parse_descriptor(argv[++arg], settings.descriptor) )
+                usage = true;
+        }
+
+        else if (opt == "--distance" and arg + 1 < argc)
+        {
+            // Only true metrics prune the tree
+            if ( not parse_metric(argv[++arg], settings.metric)
+                 or settings.metric == chi2_metric )
+                usage = true;
+        }
+
+        else if (opt == "--leaf" and arg + 1 < argc)
+        {
+            const int n = atoi(argv[++arg]);
+            if (n < 1)
+                usage = true;
+            settings.leaf = static_cast<size_t>(n);
+        }
+
+        else if (opt == "--k" and arg + 1 < argc)
+        {
+            const int n = atoi(argv[++arg]);
+            if (n < 1)
+                usage = true;
+            settings.k = static_cast<size_t>(n);
+        }
+
+        else if (opt == "--budget" and arg + 1 < argc)
+        {
+            const int n = atoi(argv[++arg]);
+            if (n < 1)
+                usage = true;
+            settings.budget = static_cast<size_t>(n);
+        }
+
+        else if ( not parse_run_option(argc, argv, arg, opts, usage) )
+            usage = true;
+    }
+
+    const int operands = argc - arg;
+    if (settings.query ? operands < 1 or operands > 2 : operands != 2)
+        usage = true;
+
+    if (usage)
+    {
+        cout << "\n"
+                "Usage: mpeg7index [options] <src path> <index file>\n"
+                "       mpeg7index --query [options] <index file> [<src path>]\n\n"
+                "  Index the shapes of the CTX files under <src path> for nearest\n"
+                "  neighbour queries, in a vantage-point tree over their\n"
+                "  descriptors written to <index file>, which is used in place.\n\n"
+                "  With --query, search the index for the shapes nearest to those\n"
+                "  of the CTX files under <src path>, or to every shape it holds,\n"
+                "  and compare with an exhaustive search: latency percentiles of\n"
+                "  both, recall of the index, and the CE-Shape-1 bull's-eye\n"
+                "  score of each (shapes of the class of the query among the\n"
+                "  neighbours; the class is the file name up to its last '-').\n\n"
+                "  Options\n"
+                "  -------\n"
+                "  --descriptor <d>   Shape descriptor: fourier (centroid distance\n"
+                "                     spectrum; default) or hu (Hu invariants).\n"
+                "  --distance <m>     Distance between descriptors: l1 (default)\n"
+                "                     or l2.\n"
+                "  --leaf <n>         Subtrees of at most <n> shapes are scanned\n"
+                "                     rather than split (default 8).\n"
+                "  --k <n>            Neighbours of each query (default twice the\n"
+                "                     size of its class, as in the bull's-eye test).\n"
+                "  --budget <n>       Stop each query after <n> distances, for an\n"
+                "                     approximate search (default exact).\n"
+             << run_options_usage << "\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        const path first = argv[arg];
+        const path second = operands == 2 ? path(argv[arg + 1]) : path();
+
+        if ( not exists(first) )    // does it exist?
+        {
+            cout << first << " does not exist.\n";
+            return EXIT_FAILURE;
+        }
+
+        const int status = settings.query ? query_index(first, second, settings, opts)
+                                          : build_index(first, second, settings, opts);
+        if (status != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    catch (const filesystem_error& x)
+    {
+        cerr << "Error: Unhandled filesystem error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const bad_alloc& x)
+    {
+        cerr << "Error: Unhandled memory error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const exception& x)
+    {
+        cerr << "Error: Unhandled standard exception\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (...)
+    {
+        cerr << "Error: Unhandled unknown exception\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
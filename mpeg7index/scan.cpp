@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <ciso646>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/io_stage.hpp"
+#include "../common/manifest.hpp"
+#include "../common/mapped_file.hpp"
+#include "../common/options.hpp"
+#include "../common/parallel.hpp"
+#include "../common/shard.hpp"
+#include "../common/sources.hpp"
+#include "../common/stopwatch.hpp"
+#include "../common/trace.hpp"
+#include "../mpeg7bullseye/shapes.hpp"
+#include "settings.hpp"
+#include "vptree.hpp"
+
+
+namespace
+{
+
+    /**
+     * Describe the shape of every CTX file under p, in path order, into
+     * 'files' and the rows of 'values'.
+     */
+
+    int describe_sources(const boost::filesystem::path& p, const descriptor_kind kind,
+                         const run_options& opts, io_stage& io, manifest& m,
+                         std::vector<boost::filesystem::path>& files,
+                         std::vector<float>& values)
+    {
+        using namespace boost::filesystem;
+        using namespace std;
+
+        vector<path> found;
+        int status = collect_sources(p, found);
+
+        files.clear();
+        for (size_t i = 0; i < found.size(); ++i)
+            if (found[i].extension() == ".ctx")
+                files.push_back(found[i]);
+
+        sort(files.begin(), files.end());
+
+        if ( files.empty() )
+        {
+            clog << "No contour files in " << p << '\n';
+            return EXIT_FAILURE;
+        }
+
+        const size_t size = descriptor_size(kind);
+        values.assign(files.size() * size, 0);
+
+        io.prefetch(files);
+
+        vector< unique_ptr<shape_workspace> > ws;
+        for (unsigned w = 0; w < max(opts.jobs, 1u); ++w)
+            ws.push_back( unique_ptr<shape_workspace>(new shape_workspace) );
+
+        if ( parallel_for( files.size(), opts.jobs, [&](const size_t i, const unsigned w) -> int
+        {
+            const int s = describe_file(files[i], kind, *ws[w], io, &values[i * size]);
+            m.record(files[i], s == EXIT_SUCCESS ? manifest::done : manifest::failed);
+            return s;
+        } ) != EXIT_SUCCESS )
+            status = EXIT_FAILURE;
+
+        return status;
+    }
+
+    /**
+     * Value at fraction f of the sorted 'values', by the nearest rank.
+     */
+
+    double percentile(const std::vector<double>& values, const double f)
+    {
+        if ( values.empty() )
+            return 0;
+
+        const size_t rank = static_cast<size_t>( f * values.size() + 0.5 );
+        return values[ std::min( rank > 0 ? rank - 1 : 0, values.size() - 1 ) ];
+    }
+
+    /**
+     * Shapes of class c among 'found'.
+     */
+
+    size_t class_hits(const vp_index& index, const std::vector<vp_neighbour>& found,
+                      const size_t c)
+    {
+        size_t h = 0;
+        for (size_t i = 0; i < found.size(); ++i)
+            h += index.class_of( found[i].second ) == c;
+        return h;
+    }
+
+    /**
+     * Per-worker buffers of the queries.
+     */
+
+    struct query_workspace
+    {
+        vp_search search;
+        std::vector<vp_neighbour> approximate,
+                                  exact;
+        std::vector<boost::uint32_t> a,
+                                     b;
+    };
+
+}
+
+
+int build_index(const boost::filesystem::path& p, const boost::filesystem::path& q,
+                const index_settings& settings, const run_options& opts)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    if (opts.shards > 1)
+    {
+        clog << "An index holds every shape: --shard is not supported\n";
+        return EXIT_FAILURE;
+    }
+
+    manifest m("mpeg7index", opts.shard, opts.shards, p);
+    io_stage io(opts.io, opts.io_threads, opts.lookahead, opts.durable);
+
+    vector<path> files;
+    vector<float> values;
+    int status = describe_sources(p, settings.descriptor, opts, io, m, files, values);
+
+    if (status == EXIT_SUCCESS)
+    {
+        const size_t n = files.size();
+
+        // Names and classes, numbered in order of appearance
+        vector<string> names(n),
+                       class_names;
+        vector<boost::uint32_t> classes(n);
+        map<string, boost::uint32_t> class_index;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            names[i] = relative_key(files[i], p);
+
+            const string c = shape_class(files[i]);
+            if ( class_index.find(c) == class_index.end() )
+            {
+                class_index[c] = static_cast<boost::uint32_t>( class_names.size() );
+                class_names.push_back(c);
+            }
+            classes[i] = class_index[c];
+        }
+
+        vector<unsigned char> bytes;
+        stopwatch clock;
+        {
+            trace_scope scope("build");
+            build_vptree( values, n, descriptor_size(settings.descriptor),
+                          settings.descriptor, settings.metric, settings.leaf,
+                          names, classes, class_names, bytes );
+        }
+        const double seconds = clock.seconds();
+
+        cout << n << " shapes in " << class_names.size() << " classes, "
+             << descriptor_name(settings.descriptor) << " descriptors, "
+             << metric_name(settings.metric) << " distance\n"
+             << "tree built in " << fixed << setprecision(3) << seconds
+             << " s, leaves of " << settings.leaf << ", " << bytes.size()
+             << " bytes\n";
+
+        io.write(q, bytes);
+    }
+
+    if ( io.drain() != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( not opts.manifest.empty()
+         and m.save(opts.manifest, status, opts.durable) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    return status;
+}
+
+
+int query_index(const boost::filesystem::path& q, const boost::filesystem::path& p,
+                const index_settings& settings, const run_options& opts)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    mapped_file file;
+    vp_index index;
+    string error;
+
+    if ( not file.open(q) )
+    {
+        clog << q << " could not be mapped\n";
+        return EXIT_FAILURE;
+    }
+
+    if ( not index.attach(file.data(), file.size(), error) )
+    {
+        clog << q << ": " << error << '\n';
+        return EXIT_FAILURE;
+    }
+
+    manifest m("mpeg7index", opts.shard, opts.shards, p.empty() ? q : p);
+    io_stage io(opts.io, opts.io_threads, opts.lookahead, opts.durable);
+
+    // The queries: the shapes of p, or those of the index
+    vector<path> files;
+    vector<float> values;
+    vector<size_t> classes;
+    const size_t none = size_t(-1),
+                 size = index.size();
+
+    int status = EXIT_SUCCESS;
+
+    if ( not p.empty() )
+    {
+        status = describe_sources(p, index.descriptor(), opts, io, m, files, values);
+
+        map<string, size_t> class_index;
+        for (size_t c = 0; c < index.classes(); ++c)
+            class_index[ index.class_name(c) ] = c;
+
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            const map<string, size_t>::const_iterator c = class_index.find( shape_class(files[i]) );
+            classes.push_back( c == class_index.end() ? none : c->second );
+        }
+    }
+    else
+        for (size_t i = 0; i < index.count(); ++i)
+            classes.push_back( index.class_of(i) );
+
+    const size_t n = classes.size();
+
+    if (status == EXIT_SUCCESS and settings.k == 0)
+        for (size_t i = 0; i < n; ++i)
+            if (classes[i] == none)
+            {
+                clog << files[i] << " is of no class of the index: give --k\n";
+                status = EXIT_FAILURE;
+                break;
+            }
+
+    if (status == EXIT_SUCCESS)
+    {
+        const double tick = 1 / trace_ticks_per_microsecond();
+
+        vector< unique_ptr<query_workspace> > ws;
+        for (unsigned w = 0; w < max(opts.jobs, 1u); ++w)
+            ws.push_back( unique_ptr<query_workspace>(new query_workspace) );
+
+        vector<double> tree_us(n),
+                       scan_us(n),
+                       recall(n);
+        vector<size_t> evaluations(n),
+                       tree_hits(n),
+                       scan_hits(n),
+                       possible(n);
+
+        stopwatch clock;
+
+        parallel_for( n, opts.jobs, [&](const size_t i, const unsigned w) -> int
+        {
+            query_workspace& qw = *ws[w];
+            const float* const query = p.empty() ? index.point(i) : &values[i * size];
+            const size_t k = settings.k != 0 ? settings.k
+                                             : 2 * index.class_size( classes[i] );
+
+            boost::uint64_t t0 = trace_clock();
+            index.nearest(query, k, settings.budget, qw.search, qw.approximate);
+            boost::uint64_t t1 = trace_clock();
+            trace_event("nearest", t0, t1);
+            tree_us[i] = (t1 - t0) * tick;
+            evaluations[i] = qw.search.evaluations;
+
+            t0 = trace_clock();
+            index.scan(query, k, qw.search, qw.exact);
+            t1 = trace_clock();
+            trace_event("scan", t0, t1);
+            scan_us[i] = (t1 - t0) * tick;
+
+            // Shapes of the exhaustive answer the index found too
+            qw.a.clear();
+            qw.b.clear();
+            for (size_t j = 0; j < qw.approximate.size(); ++j)
+                qw.a.push_back( qw.approximate[j].second );
+            for (size_t j = 0; j < qw.exact.size(); ++j)
+                qw.b.push_back( qw.exact[j].second );
+            sort( qw.a.begin(), qw.a.end() );
+            sort( qw.b.begin(), qw.b.end() );
+
+            size_t common = 0;
+            for (size_t x = 0, y = 0; x < qw.a.size() and y < qw.b.size(); )
+                if (qw.a[x] < qw.b[y])
+                    ++x;
+                else if (qw.b[y] < qw.a[x])
+                    ++y;
+                else
+                    ++common, ++x, ++y;
+
+            recall[i] = qw.exact.empty() ? 1 : double(common) / qw.exact.size();
+
+            if (classes[i] != none)
+            {
+                tree_hits[i] = class_hits(index, qw.approximate, classes[i]);
+                scan_hits[i] = class_hits(index, qw.exact, classes[i]);
+                possible[i] = index.class_size( classes[i] );
+            }
+
+            return EXIT_SUCCESS;
+        } );
+
+        const double seconds = clock.seconds();
+
+        double mean_recall = 0,
+               mean_evaluations = 0;
+        size_t tree_total = 0,
+               scan_total = 0,
+               possible_total = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            mean_recall += recall[i] / n;
+            mean_evaluations += double(evaluations[i]) / n;
+            tree_total += tree_hits[i];
+            scan_total += scan_hits[i];
+            possible_total += possible[i];
+        }
+
+        const double worst_recall = n > 0 ? *min_element( recall.begin(), recall.end() ) : 1;
+
+        sort( tree_us.begin(), tree_us.end() );
+        sort( scan_us.begin(), scan_us.end() );
+
+        cout << n << " queries on " << index.count() << " shapes in "
+             << index.classes() << " classes, "
+             << descriptor_name( index.descriptor() ) << " descriptors, "
+             << metric_name( index.metric() ) << " distance, ";
+        if (settings.k != 0)
+            cout << settings.k << " neighbours";
+        else
+            cout << "twice the class";
+        if (settings.budget != 0)
+            cout << ", budget of " << settings.budget << " distances";
+        cout << '\n' << fixed << setprecision(1)
+             << "  latency (us)      p50      p90      p99      max\n"
+             << "  index    " << setw(11) << percentile(tree_us, 0.5)
+             << setw(9) << percentile(tree_us, 0.9)
+             << setw(9) << percentile(tree_us, 0.99)
+             << setw(9) << percentile(tree_us, 1) << '\n'
+             << "  scan     " << setw(11) << percentile(scan_us, 0.5)
+             << setw(9) << percentile(scan_us, 0.9)
+             << setw(9) << percentile(scan_us, 0.99)
+             << setw(9) << percentile(scan_us, 1) << '\n'
+             << "  distances per query: " << mean_evaluations << " of "
+             << index.count() << " ("
+             << (index.count() > 0 ? 100 * mean_evaluations / index.count() : 0)
+             << "%)\n"
+             << setprecision(4)
+             << "  recall: mean " << mean_recall << ", worst " << worst_recall << '\n';
+
+        if (possible_total > 0)
+            cout << setprecision(2)
+                 << "  bull's-eye score: index " << 100.0 * tree_total / possible_total
+                 << "%, exhaustive " << 100.0 * scan_total / possible_total << "%\n";
+
+        cout << setprecision(3) << "  " << seconds << " s, " << max(opts.jobs, 1u)
+             << " jobs\n";
+    }
+
+    if ( io.drain() != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( not opts.manifest.empty()
+         and m.save(opts.manifest, status, opts.durable) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    return status;
+}
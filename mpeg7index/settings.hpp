@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+#include "../common/descriptors.hpp"
+#include "../mpeg7bullseye/matrix.hpp"
+
+
+/**
+ * How the index is built and queried
+ */
+
+struct index_settings
+{
+    bool            query;              // query an index, not build one
+    descriptor_kind descriptor;         // descriptor of each shape
+    metric_kind     metric;             // distance between descriptors
+    size_t          leaf;               // largest subtree scanned whole
+    size_t          k;                  // neighbours of each query; 0 for
+                                        // twice the size of its class
+    size_t          budget;             // distances computed by a query at
+                                        // most; 0 for an exact search
+
+    index_settings()
+        : query(false), descriptor(fourier_descriptor), metric(l1_metric),
+          leaf(8), k(0), budget(0)
+    {
+    }
+};
@@ -0,0 +1,452 @@
+#include <algorithm>
+#include <ciso646>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+
+#include "vptree.hpp"
+
+
+namespace
+{
+
+    const char magic[8] = { 'M', 'P', 'E', 'G', '7', 'V', 'P', '1' };
+    const boost::uint32_t byte_order = 0x01020304;
+
+    // Vantage point candidates tried for each node, and shapes their
+    // spread is measured on
+    const size_t candidates = 5,
+                 spread_sample = 64;
+
+    // Rounding of the float distances must not prune a subtree holding a
+    // shape at the distance of the k-th: prune only beyond this factor
+    const float prune_slack = 1 + 1e-5f;
+
+    float l1_distance(const float* a, const float* b, const size_t n)
+    {
+        float s = 0;
+        for (size_t k = 0; k < n; ++k)
+            s += std::fabs(a[k] - b[k]);
+        return s;
+    }
+
+    float l2_distance(const float* a, const float* b, const size_t n)
+    {
+        float s = 0;
+        for (size_t k = 0; k < n; ++k)
+            s += (a[k] - b[k]) * (a[k] - b[k]);
+        return std::sqrt(s);
+    }
+
+    typedef float (*distance_function)(const float*, const float*, const size_t);
+
+    inline distance_function distance_of(const metric_kind metric)
+    {
+        return metric == l2_metric ? l2_distance : l1_distance;
+    }
+
+    /**
+     * Builder of the tree, over the shapes numbered by 'order'.
+     */
+
+    struct builder
+    {
+        const std::vector<float>& points;
+        const size_t size,
+                     leaf;
+        const distance_function distance;
+
+        std::vector<boost::uint32_t> order;     // shape at each position
+        std::vector<vp_node> nodes;             // node at each position
+        std::vector< std::pair<float, boost::uint32_t> > scratch;
+        std::vector<float> sample;
+        std::mt19937 random;                    // the same tree every time
+
+        builder(const std::vector<float>& points, const size_t count,
+                const size_t size, const size_t leaf, const distance_function distance)
+            : points(points), size(size), leaf( std::max<size_t>(leaf, 1) ),
+              distance(distance), order(count), nodes(count), scratch(count)
+        {
+            for (size_t i = 0; i < count; ++i)
+                order[i] = static_cast<boost::uint32_t>(i);
+
+            const vp_node none = { 0, 0 };
+            std::fill(nodes.begin(), nodes.end(), none);
+        }
+
+        const float* point(const size_t position) const
+        {
+            return &points[ order[position] * size ];
+        }
+
+        /**
+         * Move to 'begin' the candidate of [begin, end) whose distances to
+         * a sample of the others spread the most about their median, as
+         * it splits them the most cleanly.
+         */
+
+        void choose_vantage(const size_t begin, const size_t end)
+        {
+            using namespace std;
+
+            const size_t n = end - begin;
+
+            size_t best = begin;
+            float best_spread = -1;
+
+            for (size_t c = 0; c < min(candidates, n); ++c)
+            {
+                const size_t v = begin + random() % n;
+
+                sample.clear();
+                for (size_t s = 0; s < min(spread_sample, n); ++s)
+                    sample.push_back( distance( point(v), point( begin + random() % n ), size ) );
+
+                nth_element( sample.begin(), sample.begin() + sample.size() / 2, sample.end() );
+                const float median = sample[ sample.size() / 2 ];
+
+                float spread = 0;
+                for (size_t s = 0; s < sample.size(); ++s)
+                    spread += fabs(sample[s] - median);
+
+                if (spread > best_spread)
+                {
+                    best = v;
+                    best_spread = spread;
+                }
+            }
+
+            swap(order[begin], order[best]);
+        }
+
+        void build(const size_t begin, const size_t end)
+        {
+            using namespace std;
+
+            if (end - begin <= leaf)
+                return;
+
+            choose_vantage(begin, end);
+
+            // The others by distance to it, split at their median
+            const size_t rest = end - begin - 1,
+                         inside = rest / 2;
+
+            for (size_t i = 0; i < rest; ++i)
+                scratch[i] = make_pair( distance( point(begin), point(begin + 1 + i), size ),
+                                        order[begin + 1 + i] );
+
+            nth_element( scratch.begin(), scratch.begin() + inside,
+                         scratch.begin() + rest );
+
+            for (size_t i = 0; i < rest; ++i)
+                order[begin + 1 + i] = scratch[i].second;
+
+            nodes[begin].radius = scratch[inside].first;
+            nodes[begin].inside = static_cast<boost::uint32_t>(inside);
+
+            build(begin + 1, begin + 1 + inside);
+            build(begin + 1 + inside, end);
+        }
+    };
+
+    /**
+     * Append 'count' items at 'from' to 'bytes', from a multiple of 8
+     * bytes; returns the offset where they start.
+     */
+
+    template <class T>
+    boost::uint64_t append(std::vector<unsigned char>& bytes, const T* from,
+                           const size_t count)
+    {
+        bytes.resize( (bytes.size() + 7) / 8 * 8 );
+        const size_t at = bytes.size();
+
+        bytes.resize( at + count * sizeof(T) );
+        if (count > 0)
+            std::memcpy( &bytes[at], from, count * sizeof(T) );
+
+        return at;
+    }
+
+    /**
+     * Offer the shape at 'position', at 'd' from the query, to the k
+     * nearest of 'heap'.
+     */
+
+    inline void offer(std::vector<vp_neighbour>& heap, const size_t k, const float d,
+                      const boost::uint32_t position)
+    {
+        const vp_neighbour n(d, position);
+
+        if (heap.size() < k)
+        {
+            heap.push_back(n);
+            std::push_heap( heap.begin(), heap.end() );
+        }
+        else if ( n < heap.front() )
+        {
+            std::pop_heap( heap.begin(), heap.end() );
+            heap.back() = n;
+            std::push_heap( heap.begin(), heap.end() );
+        }
+    }
+
+}
+
+
+void build_vptree(std::vector<float>& points, const size_t count, const size_t size,
+                  const descriptor_kind descriptor, const metric_kind metric,
+                  const size_t leaf, std::vector<std::string>& names,
+                  std::vector<boost::uint32_t>& classes,
+                  const std::vector<std::string>& class_names,
+                  std::vector<unsigned char>& bytes)
+{
+    using namespace std;
+
+    builder b( points, count, size, leaf, distance_of(metric) );
+    b.build(0, count);
+
+    // Everything in the order of the tree
+    vector<float> ordered(count * size);
+    vector<string> ordered_names(count);
+    vector<boost::uint32_t> ordered_classes(count),
+                            sizes( class_names.size() );
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        copy( b.point(i), b.point(i) + size, &ordered[i * size] );
+        ordered_names[i].swap( names[ b.order[i] ] );
+        ordered_classes[i] = classes[ b.order[i] ];
+        ++sizes[ ordered_classes[i] ];
+    }
+
+    points.swap(ordered);
+    names.swap(ordered_names);
+    classes.swap(ordered_classes);
+
+    // The strings, names of the shapes then of the classes
+    vector<boost::uint32_t> offsets(1, 0);
+    string chars;
+    for (size_t i = 0; i < count + class_names.size(); ++i)
+    {
+        chars += i < count ? names[i] : class_names[i - count];
+        offsets.push_back( static_cast<boost::uint32_t>( chars.size() ) );
+    }
+
+    vp_header h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, magic, sizeof h.magic);
+    h.order = byte_order;
+    h.descriptor = descriptor;
+    h.metric = metric;
+    h.count = static_cast<boost::uint32_t>(count);
+    h.size = static_cast<boost::uint32_t>(size);
+    h.leaf = static_cast<boost::uint32_t>(b.leaf);
+    h.classes = static_cast<boost::uint32_t>( class_names.size() );
+
+    bytes.assign( sizeof h, 0 );
+    h.points = append( bytes, points.empty() ? 0 : &points[0], points.size() );
+    h.nodes = append( bytes, b.nodes.empty() ? 0 : &b.nodes[0], b.nodes.size() );
+    h.class_of = append( bytes, classes.empty() ? 0 : &classes[0], classes.size() );
+    h.sizes = append( bytes, sizes.empty() ? 0 : &sizes[0], sizes.size() );
+    h.strings = append( bytes, &offsets[0], offsets.size() );
+    append( bytes, chars.data(), chars.size() );
+    h.end = bytes.size();
+
+    memcpy(&bytes[0], &h, sizeof h);
+}
+
+
+vp_index::vp_index()
+    : header_(0), points_(0), nodes_(0), class_of_(0), sizes_(0), offsets_(0),
+      chars_(0)
+{
+}
+
+
+bool vp_index::attach(const unsigned char* data, const size_t size, std::string& error)
+{
+    using namespace std;
+
+    header_ = 0;
+
+    if (size < sizeof(vp_header) or memcmp(data, magic, sizeof magic) != 0)
+    {
+        error = "not an index file";
+        return false;
+    }
+
+    const vp_header* const h = reinterpret_cast<const vp_header*>(data);
+
+    if (h->order != byte_order)
+    {
+        error = "index file of another byte order";
+        return false;
+    }
+
+    descriptor_kind kind = descriptor_kind(h->descriptor);
+    if ( (kind != hu_descriptor and kind != fourier_descriptor)
+         or h->size != descriptor_size(kind)
+         or (h->metric != l1_metric and h->metric != l2_metric) )
+    {
+        error = "unknown descriptor or metric";
+        return false;
+    }
+
+    // Every section within the file, in order, the characters last
+    const boost::uint64_t n = h->count,
+                          strings = n + h->classes + 1,
+                          chars = (h->strings + strings * sizeof(boost::uint32_t) + 7) / 8 * 8;
+    const boost::uint64_t sections[6][2] =
+    {
+        { h->points,   n * h->size * sizeof(float) },
+        { h->nodes,    n * sizeof(vp_node) },
+        { h->class_of, n * sizeof(boost::uint32_t) },
+        { h->sizes,    h->classes * sizeof(boost::uint32_t) },
+        { h->strings,  strings * sizeof(boost::uint32_t) },
+        { chars,       0 }
+    };
+
+    boost::uint64_t at = sizeof(vp_header);
+    for (int s = 0; s < 6; ++s)
+    {
+        if (sections[s][0] < at or sections[s][0] % 8 != 0)
+        {
+            error = "truncated or malformed index file";
+            return false;
+        }
+        at = sections[s][0] + sections[s][1];
+    }
+
+    if (h->end != size or chars > size)
+    {
+        error = "truncated or malformed index file";
+        return false;
+    }
+
+    const boost::uint32_t* const offsets = reinterpret_cast<const boost::uint32_t*>(data + h->strings);
+    const boost::uint32_t* const class_of = reinterpret_cast<const boost::uint32_t*>(data + h->class_of);
+
+    if (chars + offsets[strings - 1] > size)
+    {
+        error = "truncated or malformed index file";
+        return false;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+        if (class_of[i] >= h->classes)
+        {
+            error = "malformed index file: unknown class";
+            return false;
+        }
+
+    header_ = h;
+    points_ = reinterpret_cast<const float*>(data + h->points);
+    nodes_ = reinterpret_cast<const vp_node*>(data + h->nodes);
+    class_of_ = class_of;
+    sizes_ = reinterpret_cast<const boost::uint32_t*>(data + h->sizes);
+    offsets_ = offsets;
+    chars_ = reinterpret_cast<const char*>(data + chars);
+
+    return true;
+}
+
+
+void vp_index::nearest(const float* query, const size_t k, const size_t budget,
+                       vp_search& s, std::vector<vp_neighbour>& found) const
+{
+    using namespace std;
+
+    const distance_function distance = distance_of( metric() );
+    const size_t n = count(),
+                 dims = size(),
+                 leaf = header_->leaf,
+                 want = min(k, n);
+
+    s.heap.clear();
+    s.stack.clear();
+    s.evaluations = 0;
+
+    if (want > 0)
+    {
+        const vp_search::pending root = { 0, static_cast<boost::uint32_t>(n), 0 };
+        s.stack.push_back(root);
+    }
+
+    while ( not s.stack.empty() )
+    {
+        const vp_search::pending p = s.stack.back();
+        s.stack.pop_back();
+
+        const float tau = s.heap.size() < want ? numeric_limits<float>::max()
+                                               : s.heap.front().first;
+        if (p.bound > tau * prune_slack)
+            continue;
+
+        if (budget != 0 and s.evaluations >= budget)
+            break;
+
+        if (p.end - p.begin <= leaf)
+        {
+            for (boost::uint32_t i = p.begin; i < p.end; ++i)
+                offer( s.heap, want, distance(query, point(i), dims), i );
+            s.evaluations += p.end - p.begin;
+            continue;
+        }
+
+        const float d = distance(query, point(p.begin), dims);
+        offer(s.heap, want, d, p.begin);
+        ++s.evaluations;
+
+        const vp_node& node = nodes_[p.begin];
+        const boost::uint32_t split = p.begin + 1
+                                    + min<boost::uint32_t>(node.inside, p.end - p.begin - 1);
+
+        vp_search::pending inner = { p.begin + 1, split, max(p.bound, d - node.radius) },
+                           outer = { split, p.end, max(p.bound, node.radius - d) };
+
+        // The subtree the query falls in is searched first, so popped last
+        if (d < node.radius)
+            swap(inner, outer);
+
+        if (inner.begin < inner.end)
+            s.stack.push_back(inner);
+        if (outer.begin < outer.end)
+            s.stack.push_back(outer);
+    }
+
+    sort_heap( s.heap.begin(), s.heap.end() );
+    found.assign( s.heap.begin(), s.heap.end() );
+}
+
+
+void vp_index::scan(const float* query, const size_t k, vp_search& s,
+                    std::vector<vp_neighbour>& found) const
+{
+    const distance_function distance = distance_of( metric() );
+    const size_t n = count(),
+                 dims = size(),
+                 want = std::min(k, n);
+
+    s.heap.clear();
+    for (size_t i = 0; i < n; ++i)
+        offer( s.heap, want, distance(query, point(i), dims),
+               static_cast<boost::uint32_t>(i) );
+    s.evaluations = n;
+
+    std::sort_heap( s.heap.begin(), s.heap.end() );
+    found.assign( s.heap.begin(), s.heap.end() );
+}
+
+
+std::string vp_index::text(const size_t i) const
+{
+    // Offsets past the last one were not checked by attach()
+    const boost::uint32_t last = offsets_[ header_->count + header_->classes ],
+                          begin = std::min(offsets_[i], last),
+                          end = std::min(offsets_[i + 1], last);
+
+    return begin < end ? std::string(chars_ + begin, chars_ + end) : std::string();
+}
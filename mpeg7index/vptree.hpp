@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "../common/descriptors.hpp"
+#include "../mpeg7bullseye/matrix.hpp"
+
+
+/**
+ * Vantage-point tree over shape descriptors, stored to be used in place
+ *
+ * Each node of the tree is a shape, its vantage point, and splits the
+ * shapes below it at the median of their distances to it: those within
+ * the radius go to the inner subtree, the others to the outer one. A
+ * query at distance d of a vantage point, whose k nearest shapes so far
+ * are within tau, need not visit the inner subtree if d - radius > tau,
+ * nor the outer one if radius - d > tau, by the triangle inequality; so
+ * the metric must be a true one (l1 or l2, not chi2).
+ *
+ * The shapes are stored in the order of a preorder walk of the tree, so
+ * that every subtree is a contiguous range: a node at position i with
+ * n shapes below it, itself included, has its inner subtree of 'inside'
+ * shapes at i + 1 and its outer one right after. Subtrees of at most
+ * 'leaf' shapes are not split but scanned. The file is then made of
+ * arrays with no pointer to fix up, which a query tool maps and searches
+ * without reading it:
+ *
+ *      header      vp_header, the offsets of the sections below
+ *      points      count x size floats, the descriptors
+ *      nodes       count vp_node
+ *      classes     count class numbers
+ *      sizes       the number of shapes of each class
+ *      strings     count + classes + 1 offsets into the characters
+ *                  that follow, of the relative path of every shape,
+ *                  then of the name of every class
+ *
+ * every section starting on a multiple of 8 bytes. The file is in the
+ * byte order of the machine that wrote it, and rejected by a machine of
+ * the other order.
+ */
+
+struct vp_header
+{
+    char magic[8];                  // "MPEG7VP1"
+    boost::uint32_t order,          // 0x01020304 as written
+                    descriptor,     // descriptor_kind
+                    metric,         // metric_kind
+                    count,          // shapes
+                    size,           // values of each descriptor
+                    leaf,           // largest subtree not split
+                    classes,        // number of classes
+                    reserved;
+    boost::uint64_t points,         // offsets of the sections, from the
+                    nodes,          // start of the file
+                    class_of,
+                    sizes,
+                    strings,
+                    end;            // size of the file
+};
+
+struct vp_node
+{
+    float radius;                   // the shapes of the inner subtree are
+                                    // within it, those of the outer one not
+    boost::uint32_t inside;         // shapes of the inner subtree
+};
+
+/**
+ * Build the tree of the 'count' descriptors of 'size' values in
+ * 'points', which are reordered, and serialize it with the relative path
+ * 'names' and class 'classes' of each shape into 'bytes'. Classes are
+ * numbered from 0 in order of 'class_names'.
+ */
+
+void build_vptree(std::vector<float>& points, const size_t count, const size_t size,
+                  const descriptor_kind descriptor, const metric_kind metric,
+                  const size_t leaf, std::vector<std::string>& names,
+                  std::vector<boost::uint32_t>& classes,
+                  const std::vector<std::string>& class_names,
+                  std::vector<unsigned char>& bytes);
+
+/**
+ * A neighbour found by a query: its distance and its position in the
+ * index.
+ */
+
+typedef std::pair<float, boost::uint32_t> vp_neighbour;
+
+/**
+ * Working storage of a query, one per thread, reused across queries.
+ */
+
+struct vp_search
+{
+    struct pending
+    {
+        boost::uint32_t begin,      // subtree of shapes [begin, end)
+                        end;
+        float bound;                // no shape of it is nearer
+    };
+
+    std::vector<pending> stack;
+    std::vector<vp_neighbour> heap; // the k nearest so far, farthest first
+    size_t evaluations;             // distances computed by the last query
+
+    vp_search() : evaluations(0) {}
+};
+
+/**
+ * An index file in memory, typically mapped (see mapped_file.hpp).
+ */
+
+class vp_index
+{
+public:
+
+    vp_index();
+
+    /**
+     * Use the index file in [data, data + size), which must outlive the
+     * index. Returns false, with the reason in 'error', if it is not a
+     * well-formed index file.
+     */
+
+    bool attach(const unsigned char* data, const size_t size, std::string& error);
+
+    size_t count() const { return header_->count; }
+
+    size_t size() const { return header_->size; }
+
+    size_t classes() const { return header_->classes; }
+
+    descriptor_kind descriptor() const { return descriptor_kind(header_->descriptor); }
+
+    metric_kind metric() const { return metric_kind(header_->metric); }
+
+    const float* point(const size_t i) const { return points_ + i * header_->size; }
+
+    size_t class_of(const size_t i) const { return class_of_[i]; }
+
+    size_t class_size(const size_t c) const { return sizes_[c]; }
+
+    std::string name(const size_t i) const { return text(i); }
+
+    std::string class_name(const size_t c) const { return text(header_->count + c); }
+
+    /**
+     * The k shapes nearest to 'query' (ties going to the lower position),
+     * nearest first, into 'found'. If 'budget' is not 0, the search stops
+     * after computing that many distances, and the result is approximate.
+     */
+
+    void nearest(const float* query, const size_t k, const size_t budget,
+                 vp_search& s, std::vector<vp_neighbour>& found) const;
+
+    /**
+     * The same by comparing 'query' with every shape.
+     */
+
+    void scan(const float* query, const size_t k, vp_search& s,
+              std::vector<vp_neighbour>& found) const;
+
+private:
+
+    std::string text(const size_t i) const;
+
+    const vp_header* header_;
+    const float* points_;
+    const vp_node* nodes_;
+    const boost::uint32_t* class_of_;
+    const boost::uint32_t* sizes_;
+    const boost::uint32_t* offsets_;
+    const char* chars_;
+};
@@ -0,0 +1,142 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/options.hpp"
+#include "matcher.hpp"
+
+
+int match_shapes(const boost::filesystem::path& p, const boost::filesystem::path& q,
+                 const match_settings& settings, const run_options& opts);
+
+
+int main(const int argc, const char* argv[])
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    bool usage = false;
+    match_settings settings;
+    run_options opts;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-' and argv[arg][1] != '\0'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--points" and arg + 1 < argc)
+        {
+            const int k = atoi(argv[++arg]);
+            if (k < 3)
+                usage = true;
+            settings.points = static_cast<size_t>(k);
+        }
+
+        else if (opt == "--bins" and arg + 2 < argc)
+        {
+            const int r = atoi(argv[++arg]),
+                      a = atoi(argv[++arg]);
+            if (r < 1 or a < 2 or a % 2 != 0 or r * a > 256)
+                usage = true;
+            settings.radial = static_cast<size_t>(r);
+            settings.angular = static_cast<size_t>(a);
+        }
+
+        else if (opt == "--starts" and arg + 1 < argc)
+        {
+            const int k = atoi(argv[++arg]);
+            if (k < 1)
+                usage = true;
+            settings.starts = static_cast<size_t>(k);
+        }
+
+        else if (opt == "--skip" and arg + 1 < argc)
+        {
+            char* rest = 0;
+            settings.skip = strtod(argv[++arg], &rest);
+            if (*rest or not (settings.skip >= 0))
+                usage = true;
+        }
+
+        else if (opt == "--inner")
+            settings.inner = true;
+
+        else if (opt == "--mirror")
+            settings.mirror = true;
+
+        else if ( not parse_run_option(argc, argv, arg, opts, usage) )
+            usage = true;
+    }
+
+    if (usage or argc - arg < 1 or argc - arg > 2)
+    {
+        cout << "\n"
+                "Usage: mpeg7match [options] <src path> [<dst matrix>]\n\n"
+                "  Match every shape of the CTX files under <src path> with every\n"
+                "  other one by shape contexts, aligning their contours point by\n"
+                "  point, and tell how fast, with the bull's-eye score of the\n"
+                "  matches: for each shape, those of its class (the file name up\n"
+                "  to its last '-') among the twice as many closest. Optionally\n"
+                "  write the distance matrix as a tab separated table.\n\n"
+                "  Options\n"
+                "  -------\n"
+                "  --points <n>       Points sampled along each contour (default\n"
+                "                     100).\n"
+                "  --bins <r> <a>     Bins of distance and of angle, an even number,\n"
+                "                     of the histograms (default 5 12).\n"
+                "  --inner            Bin the inner distance, along paths within the\n"
+                "                     shape, rather than the straight one.\n"
+                "  --mirror           Also match the mirror image of every shape.\n"
+                "  --starts <n>       Starting points of the alignments tried\n"
+                "                     (default 8).\n"
+                "  --skip <c>         Cost of leaving a point unmatched (default\n"
+                "                     0.25).\n"
+             << run_options_usage << "\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        const path p = argv[arg];
+        const path q = argc - arg == 2 ? path(argv[arg + 1]) : path();
+
+        if ( not exists(p) )    // does p exist?
+        {
+            cout << p << " does not exist.\n";
+            return EXIT_FAILURE;
+        }
+
+        if (match_shapes(p, q, settings, opts) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    catch (const filesystem_error& x)
+    {
+        cerr << "Error: Unhandled filesystem error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const bad_alloc& x)
+    {
+        cerr << "Error: Unhandled memory error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const exception& x)
+    {
+        cerr << "Error: Unhandled standard exception\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (...)
+    {
+        cerr << "Error: Unhandled unknown exception\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
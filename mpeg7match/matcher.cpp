@@ -0,0 +1,482 @@
+#include <algorithm>
+#include <ciso646>
+#include <cstring>
+#define _USE_MATH_DEFINES 1
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "matcher.hpp"
+
+
+namespace
+{
+
+    // Steps of the 8-connected Freeman chain code (see contour.xsd)
+    const int step_x[8] = { 1, 1, 0, -1, -1, -1,  0,  1 },
+              step_y[8] = { 0, 1, 1,  1,  0, -1, -1, -1 };
+
+    // Distances binned, relative to the mean one: the bins are evenly
+    // spaced in log distance between these, the closer and farther points
+    // going to the first and last bins
+    const double nearest_edge = 0.125,
+                 farthest_edge = 2;
+
+    inline double distance(const double dx, const double dy)
+    {
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+    /**
+     * Sample n points evenly spaced along the closed full path of c into
+     * x and y. Returns false if the path has no length.
+     */
+
+    bool sample_path(const ctx_contour& c, const size_t n,
+                     std::vector<float>& x, std::vector<float>& y)
+    {
+        const size_t codes = c.chain.size();
+
+        // End of the path, which closes back on its start point
+        int ex = c.x,
+            ey = c.y;
+        for (size_t i = 0; i < codes; ++i)
+        {
+            ex += step_x[c.chain[i] & 7];
+            ey += step_y[c.chain[i] & 7];
+        }
+
+        double length = distance(c.x - ex, c.y - ey);
+        for (size_t i = 0; i < codes; ++i)
+            length += c.chain[i] & 1 ? M_SQRT2 : 1;
+
+        if (length == 0)
+            return false;
+
+        x.resize(n);
+        y.resize(n);
+
+        const double step = length / n;
+        size_t k = 0;
+        double at = 0;
+        int px = c.x,
+            py = c.y;
+
+        for (size_t i = 0; i <= codes and k < n; ++i)
+        {
+            const int dx = i < codes ? step_x[c.chain[i] & 7] : c.x - ex,
+                      dy = i < codes ? step_y[c.chain[i] & 7] : c.y - ey;
+            const double edge = distance(dx, dy);
+
+            for (; k < n and k * step <= at + edge; ++k)
+            {
+                const double t = edge > 0 ? (k * step - at) / edge : 0;
+                x[k] = static_cast<float>(px + t * dx);
+                y[k] = static_cast<float>(py + t * dy);
+            }
+
+            px += dx;
+            py += dy;
+            at += edge;
+        }
+
+        // Rounding may leave the last samples just past the end of the path
+        for (; k < n; ++k)
+        {
+            x[k] = static_cast<float>(c.x);
+            y[k] = static_cast<float>(c.y);
+        }
+
+        return true;
+    }
+
+    /**
+     * Whether the segment from point i to point j lies within the polygon
+     * of the n points: it crosses none of its edges, and its midpoint is
+     * inside.
+     */
+
+    bool within(const float* x, const float* y, const size_t n,
+                const size_t i, const size_t j)
+    {
+        const double ax = x[i], ay = y[i],
+                     bx = x[j], by = y[j];
+
+        for (size_t e = 0; e < n; ++e)
+        {
+            const size_t f = e + 1 < n ? e + 1 : 0;
+            if (e == i or e == j or f == i or f == j)
+                continue;
+
+            const double cx = x[e], cy = y[e],
+                         dx = x[f], dy = y[f];
+
+            // Proper crossings only: touching the boundary is within
+            const double o1 = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax),
+                         o2 = (bx - ax) * (dy - ay) - (by - ay) * (dx - ax),
+                         o3 = (dx - cx) * (ay - cy) - (dy - cy) * (ax - cx),
+                         o4 = (dx - cx) * (by - cy) - (dy - cy) * (bx - cx);
+
+            if ( ((o1 > 0 and o2 < 0) or (o1 < 0 and o2 > 0))
+                 and ((o3 > 0 and o4 < 0) or (o3 < 0 and o4 > 0)) )
+                return false;
+        }
+
+        // Even-odd rule
+        const double mx = 0.5 * (ax + bx),
+                     my = 0.5 * (ay + by);
+        bool inside = false;
+
+        for (size_t e = 0, f = n - 1; e < n; f = e++)
+            if ( (y[e] > my) != (y[f] > my)
+                 and mx < x[e] + (my - y[e]) * (x[f] - x[e]) / (y[f] - y[e]) )
+                inside = not inside;
+
+        return inside;
+    }
+
+    /**
+     * Inner distances between the points of scratch, and the point each
+     * shortest path goes to first.
+     */
+
+    void inner_distances(context_scratch& scratch, const size_t n)
+    {
+        const float* x = &scratch.x[0];
+        const float* y = &scratch.y[0];
+        float* reach = &scratch.reach[0];
+        int* hop = &scratch.hop[0];
+
+        const float far = std::numeric_limits<float>::infinity();
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            reach[i * n + i] = 0;
+            hop[i * n + i] = static_cast<int>(i);
+
+            for (size_t j = i + 1; j < n; ++j)
+            {
+                const bool adjacent = j == i + 1 or (i == 0 and j == n - 1);
+                const float d = adjacent or within(x, y, n, i, j)
+                              ? static_cast<float>( distance(x[j] - x[i], y[j] - y[i]) )
+                              : far;
+
+                reach[i * n + j] = reach[j * n + i] = d;
+                hop[i * n + j] = static_cast<int>(j);
+                hop[j * n + i] = static_cast<int>(i);
+            }
+        }
+
+        // Floyd-Warshall, over rows of contiguous floats
+        for (size_t k = 0; k < n; ++k)
+        {
+            const float* through = &reach[k * n];
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                const float to = reach[i * n + k];
+                if (to == far)
+                    continue;
+
+                float* row = &reach[i * n];
+                int* first = &hop[i * n];
+                const int leg = first[k];
+
+                for (size_t j = 0; j < n; ++j)
+                {
+                    const float d = to + through[j];
+                    const bool shorter = d < row[j];
+                    row[j] = shorter ? d : row[j];
+                    first[j] = shorter ? leg : first[j];
+                }
+            }
+        }
+
+        // Rounding may split a thin part of the polygon: such points are
+        // reached in a straight line
+        for (size_t i = 0; i < n; ++i)
+            for (size_t j = 0; j < n; ++j)
+                if (reach[i * n + j] == far)
+                {
+                    reach[i * n + j] = static_cast<float>( distance(x[j] - x[i], y[j] - y[i]) );
+                    hop[i * n + j] = static_cast<int>(j);
+                }
+    }
+
+    /**
+     * Histograms of the points of scratch into 'values', bin-major.
+     */
+
+    bool describe_points(context_scratch& scratch, const match_settings& settings,
+                         float* values)
+    {
+        using namespace std;
+
+        const size_t n = settings.points,
+                     radial = settings.radial,
+                     angular = settings.angular,
+                     half = angular / 2;
+
+        // Counterclockwise, as a mirror image is once reversed
+        double area = 0;
+        for (size_t i = 0, j = n - 1; i < n; j = i++)
+            area += double(scratch.x[j]) * scratch.y[i] - double(scratch.x[i]) * scratch.y[j];
+
+        if (area < 0)
+        {
+            reverse( scratch.x.begin(), scratch.x.end() );
+            reverse( scratch.y.begin(), scratch.y.end() );
+        }
+
+        const float* x = &scratch.x[0];
+        const float* y = &scratch.y[0];
+
+        scratch.reach.resize(n * n);
+        scratch.hop.resize(n * n);
+        scratch.du.resize(n);
+        scratch.dv.resize(n);
+        scratch.bins.resize(n);
+
+        if (settings.inner)
+            inner_distances(scratch, n);
+        else
+            for (size_t i = 0; i < n; ++i)
+                for (size_t j = 0; j < n; ++j)
+                    scratch.reach[i * n + j] = static_cast<float>( distance(x[j] - x[i], y[j] - y[i]) );
+
+        double mean = 0;
+        for (size_t i = 0; i < n * n; ++i)
+            mean += scratch.reach[i];
+        mean /= double(n) * double(n - 1);
+
+        if (not (mean > 0))
+            return false;
+
+        // Edges between the bins of distance, and directions of those
+        // between the sectors of the upper half plane
+        float edges[256],
+              cosines[128],
+              sines[128];
+
+        for (size_t k = 1; k < radial; ++k)
+            edges[k - 1] = static_cast<float>( mean * nearest_edge
+                             * pow(farthest_edge / nearest_edge, double(k) / radial) );
+
+        for (size_t k = 1; k < half; ++k)
+        {
+            cosines[k - 1] = static_cast<float>( cos(2 * M_PI * k / angular) );
+            sines[k - 1] = static_cast<float>( sin(2 * M_PI * k / angular) );
+        }
+
+        memset( values, 0, n * radial * angular * sizeof(float) );
+
+        const float weight = 1.0f / (n - 1);
+        float* du = &scratch.du[0];
+        float* dv = &scratch.dv[0];
+        int* bins = &scratch.bins[0];
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            // Tangent at point i
+            const size_t before = i > 0 ? i - 1 : n - 1,
+                         after = i + 1 < n ? i + 1 : 0;
+            float tx = x[after] - x[before],
+                  ty = y[after] - y[before];
+            const float norm = static_cast<float>( distance(tx, ty) );
+            if (norm > 0)
+                tx /= norm, ty /= norm;
+            else
+                tx = 1, ty = 0;
+
+            // Where the others lie, in the frame of the tangent: straight
+            // or along the first leg of their path
+            const float xi = x[i],
+                        yi = y[i];
+            if (settings.inner)
+            {
+                const int* first = &scratch.hop[i * n];
+                for (size_t j = 0; j < n; ++j)
+                {
+                    const float dx = x[first[j]] - xi,
+                                dy = y[first[j]] - yi;
+                    du[j] = dx * tx + dy * ty;
+                    dv[j] = dy * tx - dx * ty;
+                }
+            }
+            else
+                for (size_t j = 0; j < n; ++j)
+                {
+                    const float dx = x[j] - xi,
+                                dy = y[j] - yi;
+                    du[j] = dx * tx + dy * ty;
+                    dv[j] = dy * tx - dx * ty;
+                }
+
+            // The lower half plane is the upper one turned half a turn
+            for (size_t j = 0; j < n; ++j)
+            {
+                const int lower = (dv[j] < 0) | ((dv[j] == 0) & (du[j] < 0));
+                const float s = 1.0f - 2.0f * lower;
+                du[j] *= s;
+                dv[j] *= s;
+                bins[j] = lower * static_cast<int>(half);
+            }
+
+            for (size_t k = 0; k + 1 < half; ++k)
+            {
+                const float c = cosines[k],
+                            s = sines[k];
+                for (size_t j = 0; j < n; ++j)
+                    bins[j] += c * dv[j] - s * du[j] >= 0;
+            }
+
+            const float* reach = &scratch.reach[i * n];
+            for (size_t k = 0; k + 1 < radial; ++k)
+            {
+                const float edge = edges[k];
+                const int a = static_cast<int>(angular);
+                for (size_t j = 0; j < n; ++j)
+                    bins[j] += a * (reach[j] >= edge);
+            }
+
+            bins[i] = -1;
+
+            for (size_t j = 0; j < n; ++j)
+                if (bins[j] >= 0)
+                    values[bins[j] * n + i] += weight;
+        }
+
+        return true;
+    }
+
+    /**
+     * Least cost of aligning the points of a with those of b, over the
+     * starting points tried.
+     */
+
+    float align(const float* a, const float* b, const match_settings& settings,
+                match_scratch& scratch)
+    {
+        using namespace std;
+
+        const size_t n = settings.points,
+                     width = 2 * n,
+                     bins = settings.radial * settings.angular;
+        const float skip = static_cast<float>(settings.skip);
+
+        scratch.cost.resize(n * width);
+        scratch.previous.resize(n + 1);
+        scratch.current.resize(n + 1);
+        scratch.across.resize(n + 1);
+
+        // Chi-square cost of point i of a against every point of b. A bin
+        // empty in a adds half that of b, and the bins of b add up to 1:
+        // only the few bins a point of a fills are summed
+        for (size_t i = 0; i < n; ++i)
+        {
+            float* row = &scratch.cost[i * width];
+            fill(row, row + n, 0.5f);
+
+            for (size_t k = 0; k < bins; ++k)
+            {
+                const float ak = a[k * n + i];
+                if (ak == 0)
+                    continue;
+
+                const float* bk = &b[k * n];
+
+                for (size_t j = 0; j < n; ++j)
+                {
+                    const float d = ak - bk[j];
+                    row[j] += 0.5f * (d * d / (ak + bk[j]) - bk[j]);
+                }
+            }
+
+            // Repeated, so that every starting point reads straight on
+            copy(row, row + n, row + n);
+        }
+
+        float best = numeric_limits<float>::infinity();
+        const size_t starts = max<size_t>( min(settings.starts, n), 1 );
+
+        for (size_t t = 0; t < starts; ++t)
+        {
+            const size_t start = t * n / starts;
+            float* previous = &scratch.previous[0];
+            float* current = &scratch.current[0];
+            float* across = &scratch.across[0];
+
+            for (size_t j = 0; j <= n; ++j)
+                previous[j] = j * skip;
+
+            for (size_t i = 1; i <= n; ++i)
+            {
+                const float* row = &scratch.cost[(i - 1) * width + start];
+
+                // Matching i with j, or leaving i unmatched, then leaving
+                // j unmatched along the row
+                for (size_t j = 1; j <= n; ++j)
+                    across[j] = min(previous[j - 1] + row[j - 1], previous[j] + skip);
+
+                current[0] = i * skip;
+                for (size_t j = 1; j <= n; ++j)
+                    current[j] = min(across[j], current[j - 1] + skip);
+
+                swap(previous, current);
+            }
+
+            best = min(best, previous[n]);
+        }
+
+        return best / n;
+    }
+
+}
+
+
+size_t context_size(const match_settings& settings)
+{
+    return settings.points * settings.radial * settings.angular * (settings.mirror ? 2 : 1);
+}
+
+
+bool describe_contexts(const ctx_contour& c, const match_settings& settings,
+                       context_scratch& scratch, float* values)
+{
+    if ( settings.points < 3 or not sample_path(c, settings.points, scratch.x, scratch.y) )
+        return false;
+
+    if ( not describe_points(scratch, settings, values) )
+        return false;
+
+    if (settings.mirror)
+    {
+        if ( not sample_path(c, settings.points, scratch.x, scratch.y) )
+            return false;
+
+        for (size_t i = 0; i < settings.points; ++i)
+            scratch.x[i] = -scratch.x[i];
+
+        const size_t size = settings.points * settings.radial * settings.angular;
+        if ( not describe_points(scratch, settings, values + size) )
+            return false;
+    }
+
+    return true;
+}
+
+
+float match_contexts(const float* a, const float* b, const match_settings& settings,
+                     match_scratch& scratch)
+{
+    float d = align(a, b, settings, scratch);
+
+    // The first shape against the mirror image of the second
+    if (settings.mirror)
+    {
+        const size_t size = settings.points * settings.radial * settings.angular;
+        d = std::min( d, align(a, b + size, settings, scratch) );
+    }
+
+    return d;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "../common/ctx.hpp"
+
+
+/**
+ * Shape context matching
+ *
+ * A shape is its contour resampled to N points evenly spaced along the
+ * path, each point described by a histogram of where the others lie from
+ * it, in log-polar bins [Belongie et al. 2002]: bins of distance, scaled
+ * by the mean distance between the points so that the size of the shape
+ * drops out, and bins of angle, taken from the tangent at the point so
+ * that its orientation drops out too. The distance is either the straight
+ * one, or the inner distance, the length of the shortest path between
+ * the points within the shape, which articulation does not change
+ * [Ling & Jacobs 2007]; its angle is then that of the first leg of the
+ * path.
+ *
+ * Two shapes match by aligning their points in order around the
+ * contours, with dynamic programming over the cost of matching point i of
+ * one with point j of the other, the chi-square distance between their
+ * histograms, points left unmatched costing a penalty each. Alignments
+ * starting at several points of the second contour are tried, and the
+ * distance is the least of their costs, over N.
+ *
+ * Histograms are binned without a logarithm or an arctangent: the bin of
+ * a distance is the number of bin edges it reaches, and that of an angle
+ * the number of sector edges the direction is past, found with cross
+ * products, so that binning all the points from one is a few compares and
+ * adds over contiguous floats, in loops the compiler vectorises. They are
+ * kept bin-major, N values per bin, so that the cost of a point of one
+ * shape against all the points of the other is a vectorised loop too.
+ */
+
+struct match_settings
+{
+    size_t points,          // points sampled along a contour
+           radial,          // bins of distance
+           angular,         // bins of angle, even
+           starts;          // starting points of the alignments tried
+    double skip;            // cost of leaving a point unmatched
+    bool   inner,           // inner distance rather than the straight one
+           mirror;          // also match the mirror image of the shapes
+
+    match_settings()
+        : points(100), radial(5), angular(12), starts(8), skip(0.25),
+          inner(false), mirror(false)
+    {
+    }
+};
+
+/**
+ * Buffers of one worker, reused for every shape it describes.
+ */
+
+struct context_scratch
+{
+    std::vector<float> x, y,            // sampled points
+                       du, dv,          // others, in the frame of a point
+                       reach;           // N x N distances between them
+    std::vector<int> hop,               // N x N first legs of the paths
+                     bins;              // bin of every other point
+};
+
+/**
+ * Buffers of one worker, reused for every pair it matches.
+ */
+
+struct match_scratch
+{
+    std::vector<float> cost,            // N x 2N, columns repeated
+                       previous,        // rows of the alignment
+                       current,
+                       across;          // best of the moves into a row
+};
+
+/**
+ * Number of floats of the descriptor of a shape: N points of
+ * radial x angular bins, twice with mirror images.
+ */
+
+size_t context_size(const match_settings& settings);
+
+/**
+ * Describe the full path of contour c into 'values', context_size()
+ * floats. Returns false if the path is too short to sample.
+ */
+
+bool describe_contexts(const ctx_contour& c, const match_settings& settings,
+                       context_scratch& scratch, float* values);
+
+/**
+ * Distance between the shapes described by a and b.
+ */
+
+float match_contexts(const float* a, const float* b, const match_settings& settings,
+                     match_scratch& scratch);
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <ciso646>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/io_stage.hpp"
+#include "../common/manifest.hpp"
+#include "../common/options.hpp"
+#include "../common/parallel.hpp"
+#include "../common/shard.hpp"
+#include "../common/sources.hpp"
+#include "../common/stopwatch.hpp"
+#include "../common/trace.hpp"
+#include "../mpeg7bullseye/shapes.hpp"
+#include "matcher.hpp"
+
+
+int match_shapes(const boost::filesystem::path& p, const boost::filesystem::path& q,
+                 const match_settings& settings, const run_options& opts)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    if (opts.shards > 1)
+    {
+        clog << "An all-pairs evaluation needs every shape: --shard is not supported\n";
+        return EXIT_FAILURE;
+    }
+
+    vector<path> files;
+
+    int status = collect_sources(p, files);
+
+    // Contour files only, in path order, which is that of the matrix
+    vector<path> pending;
+    for (size_t i = 0; i < files.size(); ++i)
+        if (files[i].extension() == ".ctx")
+            pending.push_back(files[i]);
+
+    sort(pending.begin(), pending.end());
+
+    const size_t n = pending.size();
+
+    if (n == 0)
+    {
+        clog << "No contour files in " << p << '\n';
+        return EXIT_FAILURE;
+    }
+
+    manifest m("mpeg7match", opts.shard, opts.shards, p);
+
+    // Class of every shape, numbered in order of appearance
+    map<string, size_t> class_index;
+    vector<size_t> classes(n),
+                   sizes;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const string name = shape_class(pending[i]);
+        if ( class_index.find(name) == class_index.end() )
+        {
+            class_index[name] = sizes.size();
+            sizes.push_back(0);
+        }
+        classes[i] = class_index[name];
+        ++sizes[classes[i]];
+    }
+
+    io_stage io(opts.io, opts.io_threads, opts.lookahead, opts.durable);
+    io.prefetch(pending);
+
+    // One workspace and scratch of each kind per worker, one descriptor
+    // per file
+    const unsigned workers = max(opts.jobs, 1u);
+    vector< unique_ptr<shape_workspace> > ws;
+    vector< unique_ptr<context_scratch> > contexts;
+    vector< unique_ptr<match_scratch> > scratch;
+    for (unsigned w = 0; w < workers; ++w)
+    {
+        ws.push_back( unique_ptr<shape_workspace>(new shape_workspace) );
+        contexts.push_back( unique_ptr<context_scratch>(new context_scratch) );
+        scratch.push_back( unique_ptr<match_scratch>(new match_scratch) );
+    }
+
+    const size_t size = context_size(settings);
+    vector<float> table(n * size);
+
+    stopwatch describing;
+
+    if ( parallel_for( n, opts.jobs, [&](const size_t i, const unsigned w) -> int
+    {
+        const path& f = pending[i];
+
+        int s = read_shape(f, *ws[w], io);
+        if (s == EXIT_SUCCESS)
+        {
+            trace_scope scope("describe");
+            if ( not describe_contexts(ws[w]->largest, settings, *contexts[w], &table[i * size]) )
+            {
+                lock_guard<mutex> lock(console_mutex());
+                clog << f << " has no outer contour to describe\n";
+                s = EXIT_FAILURE;
+            }
+        }
+
+        m.record(f, s == EXIT_SUCCESS ? manifest::done : manifest::failed);
+        return s;
+    } ) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    const double described = describing.seconds();
+
+    if (status == EXIT_SUCCESS)
+    {
+        // The upper triangle a row at a time, the longest rows first; each
+        // pair is written to both halves of the matrix
+        vector<float> matrix(n * n, 0.0f);
+        stopwatch clock;
+
+        parallel_for( n, opts.jobs, [&](const size_t i, const unsigned w) -> int
+        {
+            trace_scope scope("match");
+            match_scratch& ms = *scratch[w];
+            const float* a = &table[i * size];
+
+            for (size_t j = i + 1; j < n; ++j)
+                matrix[i * n + j] = matrix[j * n + i]
+                                  = match_contexts(a, &table[j * size], settings, ms);
+
+            return EXIT_SUCCESS;
+        } );
+
+        const double seconds = clock.seconds();
+
+        const size_t hits = bullseye_hits(matrix, classes, sizes, opts.jobs);
+
+        size_t possible = 0;
+        for (size_t i = 0; i < n; ++i)
+            possible += sizes[classes[i]];
+
+        const double pairs = 0.5 * double(n) * double(n - 1);
+
+        cout << n << " shapes in " << sizes.size() << " classes, "
+             << settings.points << " points, " << settings.radial << " x "
+             << settings.angular << " bins, "
+             << (settings.inner ? "inner" : "straight") << " distance"
+             << (settings.mirror ? ", mirror images" : "") << '\n'
+             << fixed << setprecision(2)
+             << "bull's-eye score: " << 100.0 * hits / possible << "% ("
+             << hits << " of " << possible << ")\n"
+             << "descriptors: " << setprecision(3) << described << " s, "
+             << setprecision(1) << (described > 0 ? n / described : 0) << " shapes/s\n"
+             << "matching: " << setprecision(0) << pairs << " pairs in "
+             << setprecision(3) << seconds << " s, " << setprecision(1)
+             << (seconds > 0 ? pairs / seconds : 0) << " matches/s ("
+             << settings.starts << " starts, " << workers << " jobs)\n";
+
+        // The matrix, as a table with a header row and column of names
+        if ( not q.empty() )
+        {
+            ostringstream out;
+            out.precision(9);
+
+            out << "source";
+            for (size_t j = 0; j < n; ++j)
+                out << '\t' << relative_key(pending[j], p);
+            out << '\n';
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                out << relative_key(pending[i], p);
+                for (size_t j = 0; j < n; ++j)
+                    out << '\t' << matrix[i * n + j];
+                out << '\n';
+            }
+
+            const string text = out.str();
+            vector<unsigned char> bytes(text.begin(), text.end());
+            io.write(q, bytes);
+        }
+    }
+
+    if ( io.drain() != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( not opts.manifest.empty()
+         and m.save(opts.manifest, status, opts.durable) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    return status;
+}
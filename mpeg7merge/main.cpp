@@ -0,0 +1,81 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/manifest.hpp"
+
+
+int main(const int argc, const char* argv[])
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    bool durable = true,
+         usage = false;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-' and argv[arg][1] != '\0'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--no-sync")
+            durable = false;
+        else
+            usage = true;
+    }
+
+    if (usage or argc - arg < 2)
+    {
+        cout << "\n"
+                "Usage: mpeg7merge [options] <dst manifest> <shard manifest>...\n\n"
+                "  Merge the manifests written by the shards of a run (--shard,\n"
+                "  --manifest) into <dst manifest>, checking that every shard\n"
+                "  is present and succeeded. Use - as <dst manifest> to only\n"
+                "  check them and print their statistics.\n\n"
+                "  Options\n"
+                "  -------\n"
+                "  --no-sync          Do not sync <dst manifest> to the storage\n"
+                "                     device.\n\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        const string out = argv[arg];
+
+        vector<path> inputs;
+        for (int i = arg + 1; i < argc; ++i)
+            inputs.push_back( argv[i] );
+
+        return merge_manifests(inputs, out == "-" ? path() : path(out), durable);
+    }
+
+    catch (const filesystem_error& x)
+    {
+        cerr << "Error: Unhandled filesystem error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const bad_alloc& x)
+    {
+        cerr << "Error: Unhandled memory error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const exception& x)
+    {
+        cerr << "Error: Unhandled standard exception\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (...)
+    {
+        cerr << "Error: Unhandled unknown exception\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,100 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/options.hpp"
+
+
+int scan_file(const boost::filesystem::path& p, 
+              const boost::filesystem::path& q,
+              const double tolerance, const run_options& opts);
+
+
+int main(const int argc, const char* argv[])
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    bool usage = false;
+    double tolerance = -1;
+    run_options opts;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-' and argv[arg][1] != '\0'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--check" and arg + 1 < argc)
+        {
+            char* rest = 0;
+            tolerance = strtod(argv[++arg], &rest);
+            if (*rest or not (tolerance >= 0))
+                usage = true;
+        }
+
+        else if ( not parse_run_option(argc, argv, arg, opts, usage) )
+            usage = true;
+    }
+
+    if (usage or argc - arg != 2)
+    {
+        cout << "\n"
+                "Usage: mpeg7moments [options] <src path> <dst table>\n\n"
+                "  Recompute the moments of every contour of the CTX files under\n"
+                "  <src path> from their chain codes, exactly, without the\n"
+                "  images, into a tab separated table (- for the standard\n"
+                "  output).\n\n"
+                "  Options\n"
+                "  -------\n"
+                "  --check <t>        Compare the moments stored in the files with\n"
+                "                     the recomputed ones, failing if any deviates\n"
+                "                     by more than <t> (relative; absolute below 1).\n"
+             << run_options_usage << "\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        const path p = argv[arg];
+        const string out = argv[arg + 1];
+
+        if ( not exists(p) )    // does p exist?
+        {
+            cout << p << " does not exist.\n";
+            return EXIT_FAILURE;
+        }
+
+        if (scan_file(p, out == "-" ? path() : path(out), tolerance, opts) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    catch (const filesystem_error& x)
+    {
+        cerr << "Error: Unhandled filesystem error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const bad_alloc& x)
+    {
+        cerr << "Error: Unhandled memory error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const exception& x)
+    {
+        cerr << "Error: Unhandled standard exception\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (...)
+    {
+        cerr << "Error: Unhandled unknown exception\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <ciso646>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/chain_codec.hpp"
+#include "../common/chain_moments.hpp"
+#include "../common/ctx.hpp"
+#include "../common/io_stage.hpp"
+#include "../common/parallel.hpp"
+#include "../common/trace.hpp"
+#include "moments.hpp"
+
+
+namespace
+{
+
+    /**
+     * Relative difference between a stored and a recomputed value, taking
+     * values below one as absolute.
+     */
+
+    double deviation(const double stored, const double exact)
+    {
+        return std::fabs(stored - exact) / std::max(1.0, std::fabs(exact));
+    }
+
+}
+
+
+int moments_file(const boost::filesystem::path& f, const std::string& name,
+                 const double tolerance, moments_workspace& ws, io_stage& io,
+                 moments_result& r)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    r = moments_result();
+
+    if ( not io.fetch(f, ws.bytes) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << f << " could not be read\n";
+        return EXIT_FAILURE;
+    }
+
+    // The packed level may be kept in a sidecar file
+    path chains_p = f;
+    chains_p.replace_extension(".chains");
+
+    boost::system::error_code ec;
+    const bool has_sidecar = exists(chains_p, ec);
+
+    ws.chains.clear();
+    if ( has_sidecar and not io.fetch(chains_p, ws.chains) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << chains_p << " could not be read\n";
+        return EXIT_FAILURE;
+    }
+
+    sidecar_reader sidecar(ws.chains.empty() ? 0 : &ws.chains[0], ws.chains.size());
+
+    const char* text = ws.bytes.empty() ? ""
+                     : reinterpret_cast<const char*>(&ws.bytes[0]);
+    ctx_reader reader(text, ws.bytes.size());
+
+    long long width, height;
+    if ( not read_canvas(reader, width, height) )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << f << " is not a CTX document: " << reader.error() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    ostringstream rows;
+    rows.precision(17);
+
+    ctx_contour& c = ws.contour;
+    cv::Moments m;
+
+    while ( read_contour(reader, c, has_sidecar ? &sidecar : 0) )
+    {
+        if (not c.has_chain)
+        {
+            lock_guard<mutex> lock(console_mutex());
+            clog << f << ": contour " << c.id << " has no full path\n";
+            return EXIT_FAILURE;
+        }
+
+        bool in_range;
+        {
+            trace_scope scope("moments");
+            in_range = chain_moments(c.x, c.y, c.chain.empty() ? 0 : &c.chain[0],
+                                     c.chain.size(), m);
+        }
+
+        if (not in_range)
+        {
+            lock_guard<mutex> lock(console_mutex());
+            clog << f << ": contour " << c.id << " is out of range\n";
+            return EXIT_FAILURE;
+        }
+
+        ++r.contours;
+
+        rows << name << '\t' << c.id
+             << '\t' << m.m00 << '\t' << m.m10 << '\t' << m.m01
+             << '\t' << m.m20 << '\t' << m.m11 << '\t' << m.m02
+             << '\t' << m.m30 << '\t' << m.m21 << '\t' << m.m12 << '\t' << m.m03
+             << '\t' << m.mu20 << '\t' << m.mu11 << '\t' << m.mu02
+             << '\t' << m.mu30 << '\t' << m.mu21 << '\t' << m.mu12 << '\t' << m.mu03
+             << '\t' << m.nu20 << '\t' << m.nu11 << '\t' << m.nu02
+             << '\t' << m.nu30 << '\t' << m.nu21 << '\t' << m.nu12 << '\t' << m.nu03
+             << '\n';
+
+        // Compare with the stored moments
+        if (tolerance >= 0 and c.has_spatial)
+        {
+            const double exact[10] = { m.m00, m.m10, m.m01, m.m20, m.m11,
+                                       m.m02, m.m30, m.m21, m.m12, m.m03 };
+
+            double worst = 0;
+            for (int k = 0; k < 10; ++k)
+                worst = max( worst, deviation(c.spatial[k], exact[k]) );
+
+            r.worst = max(r.worst, worst);
+
+            if (worst > tolerance)
+            {
+                ++r.mismatches;
+
+                lock_guard<mutex> lock(console_mutex());
+                clog << f << ": contour " << c.id
+                     << " stored moments deviate by " << worst << '\n';
+            }
+        }
+    }
+
+    if ( not reader.error().empty() )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << f << ": " << reader.error() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    if ( has_sidecar and not sidecar.done() )
+    {
+        lock_guard<mutex> lock(console_mutex());
+        clog << chains_p << " does not hold the packed paths of " << f << '\n';
+        return EXIT_FAILURE;
+    }
+
+    r.rows = rows.str();
+    return EXIT_SUCCESS;
+}
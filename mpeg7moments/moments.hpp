@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifndef BOOST_FILESYSTEM_NO_DEPRECATED
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#endif
+#include <boost/filesystem.hpp>
+
+#include "../common/ctx.hpp"
+
+class io_stage;
+
+
+/**
+ * Buffers of one worker, reused for every file it reads.
+ */
+
+struct moments_workspace
+{
+    std::vector<unsigned char> bytes,   // contents of the CTX file
+                               chains;  // and of its sidecar file, if any
+    ctx_contour contour;                // contour being read
+};
+
+/**
+ * What came out of one CTX file.
+ */
+
+struct moments_result
+{
+    std::string rows;       // table rows, one per contour
+    size_t contours,        // contours read
+           mismatches;      // contours whose stored moments deviate
+    double worst;           // largest deviation of the stored moments
+
+    moments_result() : contours(0), mismatches(0), worst(0) {}
+};
+
+/**
+ * Recompute the moments of every contour of the CTX file f, from its full
+ * path, into table rows starting with 'name'. With a 'tolerance' >= 0,
+ * compare the stored spatial moments with the recomputed ones, counting
+ * the contours that deviate more (relative difference, absolute below 1).
+ */
+
+int moments_file(const boost::filesystem::path& f, const std::string& name,
+                 const double tolerance, moments_workspace& ws, io_stage& io,
+                 moments_result& r);
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/io_stage.hpp"
+#include "../common/manifest.hpp"
+#include "../common/options.hpp"
+#include "../common/parallel.hpp"
+#include "../common/shard.hpp"
+#include "../common/sources.hpp"
+#include "moments.hpp"
+
+
+int scan_file(const boost::filesystem::path& p, const boost::filesystem::path& q,
+              const double tolerance, const run_options& opts)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    vector<path> files;
+
+    int status = collect_sources(p, files);
+
+    // Contour files only, in path order so that the table does not depend
+    // on the order in which they were found
+    vector<path> pending;
+    for (size_t i = 0; i < files.size(); ++i)
+        if (files[i].extension() == ".ctx")
+            pending.push_back(files[i]);
+
+    sort(pending.begin(), pending.end());
+
+    select_shard(pending, p, opts.shard, opts.shards);
+
+    manifest m("mpeg7moments", opts.shard, opts.shards, p);
+
+    map<path, size_t> index;
+    for (size_t i = 0; i < pending.size(); ++i)
+        index[pending[i]] = i;
+
+    io_stage io(opts.io, opts.io_threads, opts.lookahead, opts.durable);
+    io.prefetch(pending);
+
+    // One workspace per worker, one result per file
+    vector< unique_ptr<moments_workspace> > ws;
+    for (unsigned w = 0; w < max(opts.jobs, 1u); ++w)
+        ws.push_back( unique_ptr<moments_workspace>(new moments_workspace) );
+
+    vector<moments_result> results(pending.size());
+
+    auto task = [&](const path& f, const unsigned w)
+    {
+        const int s = moments_file(f, relative_key(f, p), tolerance, *ws[w], io,
+                                   results[ index.find(f)->second ]);
+        m.record(f, s == EXIT_SUCCESS ? manifest::done : manifest::failed);
+        return s;
+    };
+
+    if ( parallel_for_each(pending, opts.jobs, task) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    // The table, in path order
+    vector<unsigned char> table;
+    const string header =
+        "source\tcontour"
+        "\tm00\tm10\tm01\tm20\tm11\tm02\tm30\tm21\tm12\tm03"
+        "\tmu20\tmu11\tmu02\tmu30\tmu21\tmu12\tmu03"
+        "\tnu20\tnu11\tnu02\tnu30\tnu21\tnu12\tnu03\n";
+    table.assign(header.begin(), header.end());
+
+    size_t contours = 0,
+           mismatches = 0;
+    double worst = 0;
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        table.insert(table.end(), results[i].rows.begin(), results[i].rows.end());
+        contours += results[i].contours;
+        mismatches += results[i].mismatches;
+        worst = max(worst, results[i].worst);
+
+        // Let go of the rows as they are copied
+        string().swap(results[i].rows);
+    }
+
+    if ( q.empty() )
+        cout.write( reinterpret_cast<const char*>(&table[0]), table.size() );
+    else
+        io.write(q, table);
+
+    if ( io.drain() != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    clog << pending.size() << " contour files, " << contours << " contours\n";
+
+    if (tolerance >= 0)
+    {
+        clog << mismatches << " contours with stored moments deviating by more than "
+             << tolerance << " (largest deviation " << worst << ")\n";
+
+        if (mismatches > 0)
+            status = EXIT_FAILURE;
+    }
+
+    if ( not opts.manifest.empty()
+         and m.save(opts.manifest, status, opts.durable) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    return status;
+}
@@ -0,0 +1,105 @@
+#include <ciso646>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/options.hpp"
+#include "validate.hpp"
+
+
+int scan_file(const boost::filesystem::path& p, const validate_settings& settings,
+              const run_options& opts);
+
+
+int main(const int argc, const char* argv[])
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    bool usage = false;
+    validate_settings settings;
+    run_options opts;
+
+    int arg = 1;
+    for (; arg < argc and argv[arg][0] == '-' and argv[arg][1] != '\0'; ++arg)
+    {
+        const string opt = argv[arg];
+
+        if (opt == "--strict")
+            settings.strict = true;
+
+        else if (opt == "--problems" and arg + 1 < argc)
+        {
+            const int n = atoi(argv[++arg]);
+            if (n < 0)
+                usage = true;
+            settings.shown = static_cast<size_t>(n);
+        }
+
+        else if ( not parse_run_option(argc, argv, arg, opts, usage) )
+            usage = true;
+    }
+
+    if (usage or argc - arg != 1)
+    {
+        cout << "\n"
+                "Usage: mpeg7validate [options] <src path>\n\n"
+                "  Check that the CTX files under <src path> conform to\n"
+                "  datasets/contour.xsd: their structure and attribute types, the\n"
+                "  hierarchy of their contours and the outer contour list, the\n"
+                "  vertices of their paths, and their index. Exits with failure\n"
+                "  if any file is not valid.\n\n"
+                "  Options\n"
+                "  -------\n"
+                "  --strict           Do not tolerate the departures from the schema\n"
+                "                     of the files the tools write: decimals written\n"
+                "                     with an exponent or as nan or inf, and the\n"
+                "                     empty silhouettes of blank images.\n"
+                "  --problems <n>     Problems told per file (default 10).\n"
+             << run_options_usage << "\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        const path p = argv[arg];
+
+        if ( not exists(p) )    // does p exist?
+        {
+            cout << p << " does not exist.\n";
+            return EXIT_FAILURE;
+        }
+
+        if (scan_file(p, settings, opts) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    catch (const filesystem_error& x)
+    {
+        cerr << "Error: Unhandled filesystem error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const bad_alloc& x)
+    {
+        cerr << "Error: Unhandled memory error\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (const exception& x)
+    {
+        cerr << "Error: Unhandled standard exception\n" << x.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    catch (...)
+    {
+        cerr << "Error: Unhandled unknown exception\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
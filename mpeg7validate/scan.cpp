@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <ciso646>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED 1
+#include <boost/filesystem.hpp>
+
+#include "../common/io_stage.hpp"
+#include "../common/manifest.hpp"
+#include "../common/options.hpp"
+#include "../common/parallel.hpp"
+#include "../common/shard.hpp"
+#include "../common/sources.hpp"
+#include "../common/stopwatch.hpp"
+#include "validate.hpp"
+
+
+int scan_file(const boost::filesystem::path& p, const validate_settings& settings,
+              const run_options& opts)
+{
+    using namespace boost::filesystem;
+    using namespace std;
+
+    vector<path> files;
+
+    int status = collect_sources(p, files);
+
+    // Contour files only, in path order
+    vector<path> pending;
+    for (size_t i = 0; i < files.size(); ++i)
+        if (files[i].extension() == ".ctx")
+            pending.push_back(files[i]);
+
+    sort(pending.begin(), pending.end());
+
+    select_shard(pending, p, opts.shard, opts.shards);
+
+    manifest m("mpeg7validate", opts.shard, opts.shards, p);
+
+    io_stage io(opts.io, opts.io_threads, opts.lookahead, opts.durable);
+    io.prefetch(pending);
+
+    // One workspace per worker, one result per file
+    vector< unique_ptr<validate_workspace> > ws;
+    for (unsigned w = 0; w < max(opts.jobs, 1u); ++w)
+        ws.push_back( unique_ptr<validate_workspace>(new validate_workspace) );
+
+    vector<validate_result> results( pending.size() );
+    vector<unsigned char> valid( pending.size(), 0 );
+    vector<unsigned long long> bytes( pending.size(), 0 );
+
+    stopwatch clock;
+
+    if ( parallel_for( pending.size(), opts.jobs, [&](const size_t i, const unsigned w) -> int
+    {
+        validate_workspace& vw = *ws[w];
+        const path& f = pending[i];
+
+        if ( not io.fetch(f, vw.bytes) )
+        {
+            lock_guard<mutex> lock(console_mutex());
+            clog << f << " could not be read\n";
+            m.record(f, manifest::failed);
+            return EXIT_FAILURE;
+        }
+
+        bytes[i] = vw.bytes.size();
+
+        const char* text = vw.bytes.empty() ? ""
+                         : reinterpret_cast<const char*>(&vw.bytes[0]);
+        valid[i] = validate_ctx(text, vw.bytes.size(), settings, vw, results[i]);
+
+        if (not valid[i])
+        {
+            const validate_result& r = results[i];
+
+            lock_guard<mutex> lock(console_mutex());
+            clog << f << " is not valid (" << r.errors << " problems):\n";
+            for (size_t k = 0; k < r.problems.size(); ++k)
+                clog << "  " << r.problems[k] << '\n';
+            if (r.errors > r.problems.size())
+                clog << "  ...\n";
+        }
+
+        m.record(f, valid[i] ? manifest::done : manifest::failed);
+        return EXIT_SUCCESS;
+    } ) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    const double seconds = clock.seconds();
+
+    size_t invalid = 0,
+           contours = 0,
+           tolerated = 0,
+           departing = 0;
+    unsigned long long total = 0;
+
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        invalid += not valid[i];
+        contours += results[i].contours;
+        tolerated += results[i].tolerated;
+        departing += results[i].tolerated > 0;
+        total += bytes[i];
+    }
+
+    cout << pending.size() << " contour files, " << contours << " contours: "
+         << pending.size() - invalid << " valid, " << invalid << " not valid\n";
+
+    if (tolerated > 0)
+        cout << "  " << tolerated << " departures from the schema tolerated in "
+             << departing << " files (see --strict)\n";
+
+    cout << fixed << setprecision(3) << "  " << seconds << " s, "
+         << setprecision(1) << (seconds > 0 ? pending.size() / seconds : 0)
+         << " files/s, " << (seconds > 0 ? total / seconds / (1 << 20) : 0)
+         << " MiB/s, " << max(opts.jobs, 1u) << " jobs\n";
+
+    if (invalid > 0)
+        status = EXIT_FAILURE;
+
+    if ( io.drain() != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    if ( not opts.manifest.empty()
+         and m.save(opts.manifest, status, opts.durable) != EXIT_SUCCESS )
+        status = EXIT_FAILURE;
+
+    return status;
+}
@@ -0,0 +1,1238 @@
+#include <algorithm>
+#include <cctype>
+#include <ciso646>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "../common/chain_codec.hpp"
+#include "../common/trace.hpp"
+#include "validate.hpp"
+
+
+namespace
+{
+
+    enum value_type { decimal_value, natural_value, positive_value, text_value };
+
+    /**
+     * An attribute of an element: its name, the type of its value, and
+     * whether it is required. Lists of them end with a null name.
+     */
+
+    struct attribute_rule
+    {
+        const char* name;
+        value_type  type;
+        bool        required;
+    };
+
+    /**
+     * An element of a sequence: its name, how many times it may come in a
+     * row (max 0 for unbounded), its attributes and the sequence of its
+     * children (null for none). Lists of them end with a null name.
+     */
+
+    struct element_rule
+    {
+        const char*           name;
+        int                   min,
+                              max;
+        const attribute_rule* attributes;
+        const element_rule*   children;
+    };
+
+    // The schema, datasets/contour.xsd
+
+    const attribute_rule no_attributes[] = {
+        { 0, text_value, false } };
+
+    const attribute_rule canvas_attributes[] = {
+        { "width", positive_value, true },
+        { "height", positive_value, true },
+        { 0, text_value, false } };
+
+    const attribute_rule index_attributes[] = {
+        { "fanout", positive_value, true },
+        { "order", text_value, true },
+        { "nodes", text_value, true },
+        { 0, text_value, false } };
+
+    const attribute_rule silhouette_attributes[] = {
+        { "contours", natural_value, false },
+        { "outer-contour-list", text_value, false },
+        { 0, text_value, false } };
+
+    const attribute_rule contour_attributes[] = {
+        { "id", positive_value, true },
+        { "next-sibling", positive_value, false },
+        { "previous-sibling", positive_value, false },
+        { "first-child", positive_value, false },
+        { "parent", positive_value, false },
+        { 0, text_value, false } };
+
+    const attribute_rule shape_attributes[] = {
+        { "area", decimal_value, false },
+        { "perimeter", decimal_value, false },
+        { "compactness", decimal_value, false },
+        { "cx", decimal_value, false },
+        { "cy", decimal_value, false },
+        { 0, text_value, false } };
+
+    const attribute_rule bounds_attributes[] = {
+        { "x", natural_value, true },
+        { "y", natural_value, true },
+        { "width", positive_value, true },
+        { "height", positive_value, true },
+        { 0, text_value, false } };
+
+    const attribute_rule spatial_attributes[] = {
+        { "m00", decimal_value, false }, { "m10", decimal_value, false },
+        { "m01", decimal_value, false }, { "m20", decimal_value, false },
+        { "m11", decimal_value, false }, { "m02", decimal_value, false },
+        { "m30", decimal_value, false }, { "m21", decimal_value, false },
+        { "m12", decimal_value, false }, { "m03", decimal_value, false },
+        { 0, text_value, false } };
+
+    const attribute_rule central_attributes[] = {
+        { "mu20", decimal_value, false }, { "mu11", decimal_value, false },
+        { "mu02", decimal_value, false }, { "mu30", decimal_value, false },
+        { "mu21", decimal_value, false }, { "mu12", decimal_value, false },
+        { "mu03", decimal_value, false },
+        { 0, text_value, false } };
+
+    const attribute_rule normal_attributes[] = {
+        { "nu20", decimal_value, false }, { "nu11", decimal_value, false },
+        { "nu02", decimal_value, false }, { "nu30", decimal_value, false },
+        { "nu21", decimal_value, false }, { "nu12", decimal_value, false },
+        { "nu03", decimal_value, false },
+        { 0, text_value, false } };
+
+    const attribute_rule path_attributes[] = {
+        { "level", text_value, false },
+        { "vertices", positive_value, true },
+        { "chain", text_value, false },
+        { "runs", text_value, false },
+        { "packed", text_value, false },
+        { "sidecar", text_value, false },
+        { "points", text_value, false },
+        { 0, text_value, false } };
+
+    const element_rule contour_children[] = {
+        { "shape", 1, 1, shape_attributes, 0 },
+        { "bounds", 0, 1, bounds_attributes, 0 },
+        { "spatial-moments", 1, 1, spatial_attributes, 0 },
+        { "central-moments", 1, 1, central_attributes, 0 },
+        { "normal-moments", 1, 1, normal_attributes, 0 },
+        { "path", 1, 0, path_attributes, 0 },
+        { 0, 0, 0, 0, 0 } };
+
+    // At least one contour, says the schema; blank images have none, which
+    // is checked, and tolerated, with the count of the silhouette
+    const element_rule silhouette_children[] = {
+        { "contour", 0, 0, contour_attributes, contour_children },
+        { 0, 0, 0, 0, 0 } };
+
+    const element_rule ctx_children[] = {
+        { "canvas", 1, 1, canvas_attributes, 0 },
+        { "index", 0, 1, index_attributes, 0 },
+        { "silhouette", 1, 1, silhouette_attributes, silhouette_children },
+        { 0, 0, 0, 0, 0 } };
+
+    const element_rule document_children[] = {
+        { "ctx", 1, 1, no_attributes, ctx_children },
+        { 0, 0, 0, 0, 0 } };
+
+    const element_rule document = { "", 1, 1, no_attributes, document_children };
+
+    // Steps of the chain codes
+    const int step_x[8] = { 1, 1, 0, -1, -1, -1, 0, 1 },
+              step_y[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+    // Paths longer than this are not believed
+    const long long most_vertices = 1ll << 26;
+
+    /**
+     * Where the problems of a document go.
+     */
+
+    class report
+    {
+    public:
+
+        report(const ctx_reader& reader, const validate_settings& settings,
+               validate_result& r)
+            : reader_(reader), settings_(settings), r_(r)
+        {
+        }
+
+        /**
+         * A problem at the current tag, or, if not 'here', of the document
+         * as a whole.
+         */
+
+        void error(const std::string& message, const bool here = true)
+        {
+            if (r_.problems.size() < settings_.shown)
+            {
+                if (here)
+                {
+                    std::ostringstream s;
+                    s << "line " << reader_.line() << ": " << message;
+                    r_.problems.push_back( s.str() );
+                }
+                else
+                    r_.problems.push_back(message);
+            }
+
+            ++r_.errors;
+        }
+
+        /**
+         * A departure from the schema found in the files the tools write.
+         */
+
+        void tolerate(const std::string& message, const bool here = true)
+        {
+            if (settings_.strict)
+                error(message, here);
+            else
+                ++r_.tolerated;
+        }
+
+        /**
+         * The syntax error the reader failed on, which tells its line.
+         */
+
+        void malformed()
+        {
+            if (r_.problems.size() < settings_.shown)
+                r_.problems.push_back( reader_.error() );
+            ++r_.errors;
+        }
+
+    private:
+
+        const ctx_reader& reader_;
+        const validate_settings& settings_;
+        validate_result& r_;
+    };
+
+    inline std::string number(const long long n)
+    {
+        return std::to_string(n);
+    }
+
+    /**
+     * Value [begin, end) as told in a message, cut short if long.
+     */
+
+    std::string quoted(const char* begin, const char* end)
+    {
+        const ptrdiff_t shown = 24;
+        return '"' + std::string( begin, end - begin > shown ? begin + shown : end )
+             + (end - begin > shown ? "...\"" : "\"");
+    }
+
+    inline bool is_digit(const char c)
+    {
+        return c >= '0' and c <= '9';
+    }
+
+    inline bool is_space(const char c)
+    {
+        return c == ' ' or c == '\t' or c == '\n' or c == '\r';
+    }
+
+    inline void skip_spaces(const char*& at, const char* end)
+    {
+        while (at != end and is_space(*at))
+            ++at;
+    }
+
+    /**
+     * Parse a non-negative integer of up to 18 digits at 'at', moving it
+     * past the digits.
+     */
+
+    inline bool parse_natural(const char*& at, const char* end, long long& value)
+    {
+        const char* first = at;
+
+        value = 0;
+        for (; at != end and is_digit(*at); ++at)
+        {
+            if (at - first == 18)
+                return false;
+            value = value * 10 + (*at - '0');
+        }
+
+        return at != first;
+    }
+
+    /**
+     * Whether [begin, end) is a non-negative integer, into 'value'.
+     */
+
+    inline bool natural_value_of(const char* begin, const char* end, long long& value)
+    {
+        return parse_natural(begin, end, value) and begin == end;
+    }
+
+    /**
+     * Parse a space separated list of non-negative integers into 'values'.
+     */
+
+    bool parse_naturals(const char* at, const char* end, std::vector<long long>& values)
+    {
+        values.clear();
+
+        for (;;)
+        {
+            skip_spaces(at, end);
+            if (at == end)
+                return true;
+
+            long long value;
+            if ( not parse_natural(at, end, value) or (at != end and not is_space(*at)) )
+                return false;
+            values.push_back(value);
+        }
+    }
+
+    /**
+     * Whether [begin, end) is 'word', whatever the case.
+     */
+
+    bool same_word(const char* begin, const char* end, const char* word)
+    {
+        for (; begin != end and *word; ++begin, ++word)
+            if ( std::tolower( static_cast<unsigned char>(*begin) ) != *word )
+                return false;
+        return begin == end and *word == '\0';
+    }
+
+    enum decimal_form { decimal_number, double_number, not_a_number };
+
+    /**
+     * Whether [begin, end) is an xs:decimal, or a double written with an
+     * exponent or as nan or inf, as iostreams write them, or neither.
+     */
+
+    decimal_form decimal_form_of(const char* begin, const char* end)
+    {
+        const char* at = begin;
+        if (at != end and (*at == '+' or *at == '-'))
+            ++at;
+
+        if ( same_word(at, end, "nan") or same_word(at, end, "inf")
+             or same_word(at, end, "infinity") )
+            return double_number;
+
+        size_t digits = 0;
+        for (; at != end and is_digit(*at); ++at)
+            ++digits;
+        if (at != end and *at == '.')
+            for (++at; at != end and is_digit(*at); ++at)
+                ++digits;
+
+        if (digits == 0)
+            return not_a_number;
+        if (at == end)
+            return decimal_number;
+        if (*at != 'e' and *at != 'E')
+            return not_a_number;
+
+        if (++at != end and (*at == '+' or *at == '-'))
+            ++at;
+        if (at == end or not is_digit(*at))
+            return not_a_number;
+        while (at != end and is_digit(*at))
+            ++at;
+
+        return at == end ? double_number : not_a_number;
+    }
+
+    /**
+     * Check the attributes of the current start tag against 'rules'.
+     */
+
+    void check_attributes(const ctx_reader& reader, const attribute_rule* rules,
+                          report& out)
+    {
+        using namespace std;
+
+        for (size_t i = 0; i < reader.attributes(); ++i)
+        {
+            const char *name, *name_end, *value, *value_end;
+            reader.attribute(i, name, name_end, value, value_end);
+
+            const attribute_rule* rule = rules;
+            for (; rule->name; ++rule)
+                if ( size_t(name_end - name) == strlen(rule->name)
+                     and equal(name, name_end, rule->name) )
+                    break;
+
+            if (rule->name == 0)
+            {
+                out.error( "<" + reader.name() + "> has no attribute "
+                           + string(name, name_end) );
+                continue;
+            }
+
+            for (size_t j = 0; j < i; ++j)
+            {
+                const char *other, *other_end, *v, *v_end;
+                reader.attribute(j, other, other_end, v, v_end);
+                if ( other_end - other == name_end - name and equal(name, name_end, other) )
+                    out.error( "<" + reader.name() + "> has two " + rule->name
+                               + " attributes" );
+            }
+
+            long long n;
+
+            switch (rule->type)
+            {
+            case decimal_value:
+                switch ( decimal_form_of(value, value_end) )
+                {
+                case not_a_number:
+                    out.error( string(rule->name) + '=' + quoted(value, value_end)
+                               + " is not a decimal" );
+                    break;
+
+                case double_number:
+                    out.tolerate( string(rule->name) + '=' + quoted(value, value_end)
+                                  + " is not written as a decimal" );
+                    break;
+
+                default:
+                    break;
+                }
+                break;
+
+            case natural_value:
+                if ( not natural_value_of(value, value_end, n) )
+                    out.error( string(rule->name) + '=' + quoted(value, value_end)
+                               + " is not a non-negative integer" );
+                break;
+
+            case positive_value:
+                if ( not natural_value_of(value, value_end, n) or n == 0 )
+                    out.error( string(rule->name) + '=' + quoted(value, value_end)
+                               + " is not a positive integer" );
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        for (const attribute_rule* rule = rules; rule->name; ++rule)
+        {
+            const char *value, *value_end;
+            if ( rule->required and not reader.attribute(rule->name, value, value_end) )
+                out.error( "<" + reader.name() + "> without " + rule->name );
+        }
+    }
+
+    /**
+     * An open element: its rule (null for one out of the schema), and where
+     * its children stand in the sequence of its rule.
+     */
+
+    struct frame
+    {
+        const element_rule* rule;
+        const element_rule* child;
+        int                 count;      // children of that kind in a row
+
+        explicit frame(const element_rule* rule)
+            : rule(rule), child(rule ? rule->children : 0), count(0)
+        {
+        }
+    };
+
+    /**
+     * The rule of child 'name' of 'f', moving its sequence on to it, or
+     * null (the problem told) if it may not come there.
+     */
+
+    const element_rule* enter(frame& f, const std::string& name, report& out)
+    {
+        if (f.rule == 0)
+            return 0;
+
+        const std::string parent = f.rule->name[0] ? "<" + std::string(f.rule->name) + ">"
+                                                  : "the document";
+
+        if (f.child == 0)
+        {
+            out.error( "<" + name + "> inside " + parent );
+            return 0;
+        }
+
+        const element_rule* k = f.child;
+        while (k->name and name != k->name)
+            ++k;
+
+        if (k->name == 0)
+        {
+            bool known = false;
+            for (const element_rule* c = f.rule->children; c->name; ++c)
+                known = known or name == c->name;
+
+            out.error( "<" + name + ( known ? "> out of place in " : "> unexpected in " )
+                       + parent );
+            return 0;
+        }
+
+        if (k == f.child)
+        {
+            if (k->max != 0 and f.count >= k->max)
+            {
+                out.error( "more than one <" + name + "> in " + parent );
+                return 0;
+            }
+
+            ++f.count;
+            return k;
+        }
+
+        for (const element_rule* s = f.child; s != k; ++s)
+            if ( (s == f.child ? f.count : 0) < s->min )
+                out.error( "<" + std::string(s->name) + "> missing before <" + name + ">" );
+
+        f.child = k;
+        f.count = 1;
+        return k;
+    }
+
+    /**
+     * Check that the children of 'f' are complete, at its end tag.
+     */
+
+    void leave(const frame& f, report& out)
+    {
+        if (f.child == 0)
+            return;
+
+        for (const element_rule* s = f.child; s->name; ++s)
+            if ( (s == f.child ? f.count : 0) < s->min )
+                out.error( "<" + std::string(s->name) + "> missing"
+                           + ( f.rule->name[0] ? " in <" + std::string(f.rule->name) + ">"
+                                               : "" ) );
+    }
+
+    enum path_kind { full_path, simple_path, packed_path, points_path, bad_path };
+
+    /**
+     * Kind of the path of level [begin, end), and the points of an n:<k>
+     * level (0 otherwise).
+     */
+
+    path_kind level_of(const char* begin, const char* end, long long& points)
+    {
+        points = 0;
+
+        if ( same_word(begin, end, "full") )
+            return full_path;
+        if ( same_word(begin, end, "simple") )
+            return simple_path;
+        if ( same_word(begin, end, "packed") )
+            return packed_path;
+
+        if (end - begin > 3 and std::equal(begin, begin + 3, "dp:"))
+        {
+            // [0-9]+(\.[0-9]+)?([eE][-+]?[0-9]+)?
+            const char* at = begin + 3;
+            long long n;
+            if ( not parse_natural(at, end, n) )
+                return bad_path;
+            if (at != end and *at == '.' and not parse_natural(++at, end, n))
+                return bad_path;
+            if (at != end and (*at == 'e' or *at == 'E'))
+            {
+                if (++at != end and (*at == '-' or *at == '+'))
+                    ++at;
+                if ( not parse_natural(at, end, n) )
+                    return bad_path;
+            }
+            return at == end ? points_path : bad_path;
+        }
+
+        if (end - begin > 2 and std::equal(begin, begin + 2, "n:") and begin[2] != '0'
+            and natural_value_of(begin + 2, end, points))
+            return points_path;
+
+        return bad_path;
+    }
+
+    const char* kind_name(const path_kind kind)
+    {
+        return kind == full_path ? "full" : kind == simple_path ? "simple"
+             : kind == packed_path ? "packed" : "dp or n";
+    }
+
+    /**
+     * Parse "x y" followed by chain codes into 'codes'; 'runs' tells
+     * whether the codes come as (code, length) pairs, counted in 'pairs'.
+     */
+
+    bool parse_codes(const char* at, const char* end, const bool runs,
+                     long long& x, long long& y, std::vector<unsigned char>& codes,
+                     size_t& pairs)
+    {
+        codes.clear();
+        pairs = 0;
+
+        skip_spaces(at, end);
+        if ( not parse_natural(at, end, x) )
+            return false;
+        skip_spaces(at, end);
+        if ( not parse_natural(at, end, y) )
+            return false;
+
+        for (;;)
+        {
+            if (at != end and not is_space(*at))
+                return false;
+
+            skip_spaces(at, end);
+            if (at == end)
+                return true;
+
+            long long code, length = 1;
+            if ( not parse_natural(at, end, code) or code > 7 )
+                return false;
+
+            if (runs)
+            {
+                skip_spaces(at, end);
+                if ( not parse_natural(at, end, length) or length == 0
+                     or length + static_cast<long long>( codes.size() ) > most_vertices )
+                    return false;
+                ++pairs;
+            }
+
+            codes.insert( codes.end(), static_cast<size_t>(length),
+                          static_cast<unsigned char>(code) );
+        }
+    }
+
+    /**
+     * Parse "x y" followed by the base64 form of 'n' packed chain codes
+     * into 'codes', using 'bytes'.
+     */
+
+    bool parse_packed(const char* at, const char* end, const size_t n,
+                      long long& x, long long& y, std::vector<unsigned char>& bytes,
+                      std::vector<unsigned char>& codes)
+    {
+        skip_spaces(at, end);
+        if ( not parse_natural(at, end, x) )
+            return false;
+        skip_spaces(at, end);
+        if ( not parse_natural(at, end, y) )
+            return false;
+        skip_spaces(at, end);
+
+        if ( not decode_base64(at, end, bytes) )
+            return false;
+
+        codes.resize(n);
+        return unpack_chain( bytes.empty() ? 0 : &bytes[0], bytes.size(), n,
+                             codes.empty() ? 0 : &codes[0] );
+    }
+
+    /**
+     * Count the decimals of a points list, telling whether all are
+     * decimals.
+     */
+
+    bool count_points(const char* at, const char* end, size_t& numbers)
+    {
+        numbers = 0;
+
+        for (;;)
+        {
+            skip_spaces(at, end);
+            if (at == end)
+                return true;
+
+            const char* first = at;
+            while (at != end and not is_space(*at))
+                ++at;
+
+            if (decimal_form_of(first, at) != decimal_number)
+                return false;
+            ++numbers;
+        }
+    }
+
+    /**
+     * What is known of the contour being read.
+     */
+
+    struct contour_state
+    {
+        bool      lossless;     // a lossless path was read into ws.chain
+        long long x,            // where it starts
+                  y;
+
+        contour_state() : lossless(false), x(0), y(0) {}
+    };
+
+    /**
+     * Check the current <path>.
+     */
+
+    void check_path(const ctx_reader& reader, validate_workspace& ws,
+                    contour_state& cs, report& out)
+    {
+        static const char* const data[4] = { "chain", "runs", "packed", "points" };
+
+        const char *first, *last;
+
+        path_kind kind = full_path;
+        long long points = 0;
+
+        if ( reader.attribute("level", first, last) )
+        {
+            kind = level_of(first, last, points);
+            if (kind == bad_path)
+            {
+                out.error( "level=" + quoted(first, last) + " is not a level" );
+                return;
+            }
+        }
+
+        for (int k = 0; k < 4; ++k)
+            if ( k != kind and reader.attribute(data[k], first, last) )
+                out.error( std::string(data[k]) + " in a path of level "
+                           + kind_name(kind) );
+
+        // The codes of a packed path may be in the sidecar file, which is
+        // not checked: only where the path starts is known
+        if ( reader.attribute("sidecar", first, last) )
+        {
+            long long x, y;
+            size_t pairs;
+
+            if ( not parse_codes(first, last, false, x, y, ws.codes, pairs)
+                 or not ws.codes.empty() )
+                out.error("malformed sidecar start");
+
+            if (kind != packed_path)
+                out.error( std::string("sidecar in a path of level ") + kind_name(kind) );
+            else if ( reader.attribute(data[kind], first, last) )
+                out.error("packed path with both packed and sidecar");
+            return;
+        }
+
+        if ( not reader.attribute(data[kind], first, last) )
+        {
+            out.error( std::string("path without ") + data[kind] );
+            return;
+        }
+
+        long long vertices;
+        if ( not reader.attribute("vertices", vertices) or vertices <= 0 )
+            return;                             // told with the attributes
+
+        if (vertices > most_vertices)
+        {
+            out.error( "vertices=\"" + number(vertices) + "\" is too many" );
+            return;
+        }
+
+        long long x = 0, y = 0;
+        size_t pairs = 0;
+
+        switch (kind)
+        {
+        case full_path:
+            if ( not parse_codes(first, last, false, x, y, ws.codes, pairs) )
+            {
+                out.error("malformed chain");
+                return;
+            }
+            if ( vertices != static_cast<long long>( ws.codes.size() ) + 1 )
+            {
+                out.error( "vertices=\"" + number(vertices) + "\", but the chain has "
+                           + number( ws.codes.size() ) + " codes" );
+                return;
+            }
+            break;
+
+        case simple_path:
+            if ( not parse_codes(first, last, true, x, y, ws.codes, pairs) )
+            {
+                out.error("malformed runs");
+                return;
+            }
+            if ( vertices != static_cast<long long>(pairs) + 1 )
+            {
+                out.error( "vertices=\"" + number(vertices) + "\", but there are "
+                           + number(pairs) + " runs" );
+                return;
+            }
+            break;
+
+        case packed_path:
+            if ( not parse_packed(first, last, static_cast<size_t>(vertices - 1), x, y,
+                                  ws.packed, ws.codes) )
+            {
+                out.error( "packed codes are not those of vertices=\"" + number(vertices)
+                           + "\"" );
+                return;
+            }
+            break;
+
+        default:
+            {
+                size_t numbers;
+                if ( not count_points(first, last, numbers) or numbers % 2 != 0 )
+                    out.error("malformed points");
+                else if ( vertices != static_cast<long long>(numbers / 2) )
+                    out.error( "vertices=\"" + number(vertices) + "\", but there are "
+                               + number(numbers / 2) + " points" );
+                else if (points != 0 and vertices != points)
+                    out.error( "vertices=\"" + number(vertices) + "\" in a path of level n:"
+                               + number(points) );
+            }
+            return;
+        }
+
+        // Every lossless level holds the same path as the first one
+        if (not cs.lossless)
+        {
+            ws.chain.swap(ws.codes);
+            cs.x = x;
+            cs.y = y;
+            cs.lossless = true;
+        }
+        else if (x != cs.x or y != cs.y or ws.codes != ws.chain)
+            out.error( std::string("path of level ") + kind_name(kind)
+                       + " is not the same as the one before" );
+    }
+
+    /**
+     * Check the path of the contour just read against its bounds and the
+     * canvas.
+     */
+
+    void check_contour(const validate_workspace& ws, const contour_state& cs,
+                       const long long width, const long long height, report& out)
+    {
+        if (not cs.lossless)
+            return;
+
+        long long x = cs.x, y = cs.y,
+                  left = x, right = x, top = y, bottom = y;
+
+        for (size_t i = 0; i < ws.chain.size(); ++i)
+        {
+            x += step_x[ ws.chain[i] ];
+            y += step_y[ ws.chain[i] ];
+            left = std::min(left, x);
+            right = std::max(right, x);
+            top = std::min(top, y);
+            bottom = std::max(bottom, y);
+        }
+
+        const std::string id = "contour " + number( ws.links.size() );
+
+        if (x < cs.x - 1 or x > cs.x + 1 or y < cs.y - 1 or y > cs.y + 1)
+            out.error(id + ": path does not close");
+
+        if ( left < 0 or top < 0 or (width > 0 and right >= width)
+             or (height > 0 and bottom >= height) )
+            out.error(id + ": path leaves the canvas");
+
+        const bbox& b = ws.bounds.back();
+        if ( b.width > 0 and not ( b == bbox( static_cast<int>(left), static_cast<int>(top),
+                                             static_cast<int>(right - left + 1),
+                                             static_cast<int>(bottom - top + 1) ) ) )
+            out.error( id + ": bounds are not those of the path, " + number(left) + ' '
+                       + number(top) + ' ' + number(right - left + 1) + ' '
+                       + number(bottom - top + 1) );
+    }
+
+    /**
+     * Check the hierarchy of the contours and the outer contour list.
+     */
+
+    void check_hierarchy(validate_workspace& ws, const bool has_outer, report& out)
+    {
+        using namespace std;
+
+        const long long n = static_cast<long long>( ws.links.size() );
+
+        // References to existing contours, mirrored between siblings
+        for (long long i = 1; i <= n; ++i)
+        {
+            contour_links& c = ws.links[i - 1];
+            long long* const refs[4] = { &c.next, &c.previous, &c.child, &c.parent };
+            static const char* const names[4] = { "next-sibling", "previous-sibling",
+                                                  "first-child", "parent" };
+
+            for (int k = 0; k < 4; ++k)
+                if (*refs[k] > n or *refs[k] == i)
+                {
+                    out.error( "contour " + number(i) + ": " + names[k] + ' '
+                               + number(*refs[k]) + ( *refs[k] == i ? " is itself"
+                                                                    : " does not exist" ),
+                               false );
+                    *refs[k] = 0;
+                }
+        }
+
+        for (long long i = 1; i <= n; ++i)
+        {
+            const contour_links& c = ws.links[i - 1];
+
+            if (c.next != 0 and ws.links[c.next - 1].previous != i)
+                out.error( "contour " + number(i) + ": next-sibling " + number(c.next)
+                           + " does not have it as previous-sibling", false );
+
+            if (c.previous != 0 and ws.links[c.previous - 1].next != i)
+                out.error( "contour " + number(i) + ": previous-sibling "
+                           + number(c.previous) + " does not have it as next-sibling",
+                           false );
+        }
+
+        // Walk the siblings from the first outer contour down, once each
+        ws.seen.assign(static_cast<size_t>(n), 0);
+        ws.heads.clear();
+
+        for (long long i = 1; i <= n; ++i)
+            if (ws.links[i - 1].parent == 0 and ws.links[i - 1].previous == 0)
+            {
+                if ( ws.heads.empty() )
+                {
+                    ws.heads.push_back(i);
+                    ws.heads.push_back(0);
+                }
+                else
+                    out.error( "contour " + number(i) + ": another outer contour "
+                               "without previous-sibling", false );
+            }
+
+        if (n > 0 and ws.heads.empty())
+            out.error("no outer contour without previous-sibling", false);
+
+        for (size_t h = 0; h < ws.heads.size(); h += 2)
+        {
+            const long long parent = ws.heads[h + 1];
+
+            for (long long i = ws.heads[h]; i != 0; i = ws.links[i - 1].next)
+            {
+                const contour_links& c = ws.links[i - 1];
+
+                if (ws.seen[i - 1])
+                {
+                    out.error( "contour " + number(i) + " is reached twice", false );
+                    break;
+                }
+                ws.seen[i - 1] = 1;
+
+                if (c.parent != parent)
+                    out.error( "contour " + number(i) + ": parent " + number(c.parent)
+                               + ", but among the " + ( parent == 0 ? string("outer contours")
+                               : "children of " + number(parent) ), false );
+
+                if (c.child != 0)
+                {
+                    if (ws.links[c.child - 1].previous != 0)
+                        out.error( "contour " + number(i) + ": first-child "
+                                   + number(c.child) + " has a previous-sibling", false );
+
+                    ws.heads.push_back(c.child);
+                    ws.heads.push_back(i);
+                }
+            }
+        }
+
+        for (long long i = 1; i <= n; ++i)
+            if (not ws.seen[i - 1])
+                out.error( "contour " + number(i) + " is not reached from the outer contours",
+                           false );
+
+        // The outer contour list names those without a parent, once each
+        size_t outer = 0;
+        for (long long i = 1; i <= n; ++i)
+            outer += ws.links[i - 1].parent == 0;
+
+        if (not has_outer)
+        {
+            if (n > 1)
+                out.error("silhouette of several contours without outer-contour-list", false);
+            return;
+        }
+
+        ws.seen.assign(static_cast<size_t>(n), 0);
+        size_t listed = 0;
+
+        for (size_t k = 0; k < ws.outer.size(); ++k)
+        {
+            const long long i = ws.outer[k];
+
+            if (i < 1 or i > n)
+                out.error( "outer-contour-list: contour " + number(i) + " does not exist",
+                           false );
+            else if (ws.seen[i - 1])
+                out.error( "outer-contour-list: contour " + number(i) + " is listed twice",
+                           false );
+            else if (ws.links[i - 1].parent != 0)
+                out.error( "outer-contour-list: contour " + number(i) + " has a parent",
+                           false );
+            else
+            {
+                ws.seen[i - 1] = 1;
+                ++listed;
+            }
+        }
+
+        if (listed < outer)
+            out.error( "outer-contour-list misses " + number(outer - listed) + " of the "
+                       + number(outer) + " outer contours", false );
+    }
+
+    /**
+     * Check the index read into ws against the contours.
+     */
+
+    void check_index(validate_workspace& ws, report& out)
+    {
+        const size_t n = ws.links.size();
+
+        if (ws.order.size() != n)
+        {
+            out.error( "index of " + number( ws.order.size() ) + " contours, not "
+                       + number(n), false );
+            return;
+        }
+
+        ws.entries.resize(n);
+        for (size_t k = 0; k < n; ++k)
+        {
+            if (ws.order[k] < 1 or ws.order[k] > static_cast<long long>(n))
+            {
+                out.error( "index of contour " + number( ws.order[k] )
+                           + ", which does not exist", false );
+                return;
+            }
+            ws.entries[k] = static_cast<size_t>(ws.order[k] - 1);
+        }
+
+        if ( not ws.index.assign(ws.nodes, ws.entries) )
+        {
+            out.error("index is not a packed R-tree of its leaves", false);
+            return;
+        }
+
+        for (size_t k = 0; k < n; ++k)
+        {
+            const bbox& b = ws.bounds[ ws.entries[k] ];
+            if ( b.width > 0 and not (ws.nodes[k] == b) )
+                out.error( "index leaf of contour " + number( ws.order[k] )
+                           + " is not its bounds", false );
+        }
+    }
+
+}
+
+
+bool validate_ctx(const char* data, const size_t size,
+                  const validate_settings& settings, validate_workspace& ws,
+                  validate_result& r)
+{
+    using namespace std;
+
+    trace_scope scope("validate");
+
+    r.contours = 0;
+    r.errors = 0;
+    r.tolerated = 0;
+    r.problems.clear();
+
+    ctx_reader reader(data, size);
+    report out(reader, settings, r);
+
+    ws.links.clear();
+    ws.bounds.clear();
+    ws.outer.clear();
+    ws.order.clear();
+    ws.nodes.clear();
+
+    vector<frame> frames;
+    frames.reserve(8);
+    frames.push_back( frame(&document) );
+
+    long long width = 0,
+              height = 0,
+              contours = -1;
+    bool has_silhouette = false,
+         has_index = false,
+         has_outer = false;
+    contour_state cs;
+
+    for (;;)
+    {
+        const ctx_reader::event e = reader.next();
+
+        if (e == ctx_reader::failed)
+        {
+            out.malformed();
+            return false;
+        }
+
+        if (e == ctx_reader::done)
+            break;
+
+        const size_t depth = frames.size();
+
+        if (e == ctx_reader::end)
+        {
+            if (reader.name() != ws.open[depth - 2])
+                out.error( "</" + reader.name() + "> closes <" + ws.open[depth - 2] + ">" );
+
+            const frame& f = frames.back();
+            if (f.rule != 0)
+            {
+                leave(f, out);
+                if (reader.name() == "contour")
+                    check_contour(ws, cs, width, height, out);
+            }
+
+            frames.pop_back();
+            continue;
+        }
+
+        const element_rule* rule = enter(frames.back(), reader.name(), out);
+        frames.push_back( frame(rule) );
+
+        if (ws.open.size() < depth)
+            ws.open.push_back( reader.name() );
+        else
+            ws.open[depth - 1] = reader.name();
+
+        if (rule == 0)
+            continue;
+
+        check_attributes(reader, rule->attributes, out);
+
+        const string& name = reader.name();
+        const char *first, *last;
+
+        if (name == "contour")
+        {
+            contour_links c = { 0, 0, 0, 0 };
+            long long id = 0;
+
+            reader.attribute("id", id);
+            reader.attribute("next-sibling", c.next);
+            reader.attribute("previous-sibling", c.previous);
+            reader.attribute("first-child", c.child);
+            reader.attribute("parent", c.parent);
+
+            ws.links.push_back(c);
+            ws.bounds.push_back( bbox() );
+            cs = contour_state();
+            ++r.contours;
+
+            if ( id != static_cast<long long>( ws.links.size() ) )
+                out.error( "contour " + number(id) + " where contour "
+                           + number( ws.links.size() ) + " is expected" );
+        }
+
+        else if (name == "path")
+            check_path(reader, ws, cs, out);
+
+        else if (name == "bounds")
+        {
+            long long x, y, w, h;
+            if ( reader.attribute("x", x) and reader.attribute("y", y)
+                 and reader.attribute("width", w) and reader.attribute("height", h)
+                 and x >= 0 and y >= 0 and w > 0 and h > 0 )
+            {
+                ws.bounds.back() = bbox( static_cast<int>(x), static_cast<int>(y),
+                                         static_cast<int>(w), static_cast<int>(h) );
+
+                if ( (width > 0 and x + w > width) or (height > 0 and y + h > height) )
+                    out.error("bounds leave the canvas");
+            }
+        }
+
+        else if (name == "canvas")
+        {
+            reader.attribute("width", width);
+            reader.attribute("height", height);
+        }
+
+        else if (name == "index")
+        {
+            long long fanout;
+            if ( reader.attribute("fanout", fanout)
+                 and fanout != static_cast<long long>(packed_rtree::fanout) )
+                out.error( "index fanout is not " + number(packed_rtree::fanout) );
+
+            else if ( reader.attribute("order", first, last)
+                      and not parse_naturals(first, last, ws.order) )
+                out.error("malformed index order");
+
+            else if ( reader.attribute("nodes", first, last)
+                      and ( not parse_naturals(first, last, ws.numbers)
+                            or ws.numbers.size() % 4 != 0 ) )
+                out.error("malformed index nodes");
+
+            else
+            {
+                ws.nodes.resize(ws.numbers.size() / 4);
+                for (size_t k = 0; k < ws.nodes.size(); ++k)
+                    ws.nodes[k] = bbox( static_cast<int>(ws.numbers[4*k]),
+                                        static_cast<int>(ws.numbers[4*k+1]),
+                                        static_cast<int>(ws.numbers[4*k+2]),
+                                        static_cast<int>(ws.numbers[4*k+3]) );
+                has_index = true;
+            }
+        }
+
+        else if (name == "silhouette")
+        {
+            has_silhouette = true;
+
+            if ( not reader.attribute("contours", contours) )
+                contours = -1;
+
+            if ( reader.attribute("outer-contour-list", first, last) )
+            {
+                has_outer = true;
+                if ( not parse_naturals(first, last, ws.outer) )
+                    out.error("malformed outer-contour-list");
+                else if ( ws.outer.empty() )
+                    out.error("empty outer-contour-list");
+            }
+        }
+    }
+
+    leave(frames.back(), out);
+
+    // The document as a whole
+    const long long n = static_cast<long long>( ws.links.size() );
+
+    if (contours >= 0 and contours != n)
+        out.error( "silhouette of " + number(contours) + " contours holds "
+                   + number(n), false );
+
+    if (has_silhouette and n == 0)
+        out.tolerate("silhouette without contours", false);
+
+    check_hierarchy(ws, has_outer, out);
+
+    if (has_index)
+        check_index(ws, out);
+
+    return r.errors == 0;
+}
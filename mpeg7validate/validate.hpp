@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "../common/ctx.hpp"
+#include "../common/rtree.hpp"
+
+
+/**
+ * Validation of CTX documents
+ *
+ * Checks a document against datasets/contour.xsd in a single pass of
+ * ctx_reader over its text, keeping a few numbers per contour and nothing
+ * of the rest:
+ *
+ *      structure   the elements, in the order and numbers the schema
+ *                  gives them, their end tags matching;
+ *      attributes  the required ones present, no others, each of its
+ *                  type: integers, decimals, path levels, and the lists of
+ *                  numbers of the paths and of the index;
+ *      hierarchy   ids numbered 1, 2... in document order, as the index
+ *                  refers to them; next-sibling and previous-sibling
+ *                  mirroring each other; every contour reached once from
+ *                  the outer ones, through first-child and next-sibling,
+ *                  with the parent it gives; outer-contour-list naming the
+ *                  contours without a parent (left out for a lone
+ *                  contour); 'contours' counting them all;
+ *      paths       'vertices' matching the chain codes (plus one) of the
+ *                  chain, runs and packed paths, or the points of the
+ *                  others; the lossless levels holding the same closed
+ *                  path, within the bounds given and the canvas;
+ *      index       a packed R-tree of every contour, its leaves their
+ *                  bounds.
+ *
+ * The ids are numbers and no namespace is used, as in every file the
+ * tools write, rather than the names and the qualified form the schema
+ * would want. Two more departures from the letter of the schema are
+ * tolerated, and counted, unless strict: decimals written with an
+ * exponent or as nan or inf, as the moments of tiny contours are, and the
+ * empty silhouette (contours="0") of blank images.
+ */
+
+struct validate_settings
+{
+    bool   strict;          // tolerate no departure from the schema
+    size_t shown;           // problems told per document
+
+    validate_settings() : strict(false), shown(10) {}
+};
+
+/**
+ * What came out of one document.
+ */
+
+struct validate_result
+{
+    size_t contours,                    // contours read
+           errors,                      // problems found
+           tolerated;                   // departures tolerated
+    std::vector<std::string> problems;  // the first ones, by line
+
+    validate_result() : contours(0), errors(0), tolerated(0) {}
+};
+
+/**
+ * Hierarchy of one contour: the ids it refers to, 0 for none.
+ */
+
+struct contour_links
+{
+    long long next,
+              previous,
+              child,
+              parent;
+};
+
+/**
+ * Buffers of one worker, reused for every document it checks.
+ */
+
+struct validate_workspace
+{
+    std::vector<unsigned char> bytes;   // contents of the document
+    std::vector<std::string> open;      // names of the open elements
+    std::vector<contour_links> links;   // per contour
+    std::vector<bbox> bounds;           // per contour, empty if none
+    std::vector<long long> outer,       // outer-contour-list
+                           order,       // index leaves
+                           numbers;
+    std::vector<bbox> nodes;            // index boxes
+    std::vector<size_t> entries;
+    packed_rtree index;
+    std::vector<unsigned char> chain,   // full path of the contour
+                               codes,   // that of another lossless level
+                               packed;
+    std::vector<unsigned char> seen;    // contours reached
+    std::vector<long long> heads;       // sibling lists to walk
+};
+
+/**
+ * Check the CTX document in [data, data + size). Returns whether it is
+ * valid; 'r' tells why not.
+ */
+
+bool validate_ctx(const char* data, const size_t size,
+                  const validate_settings& settings, validate_workspace& ws,
+                  validate_result& r);